@@ -37,15 +37,21 @@
 
 #include "tstream.h"
 #include "tenv.h"
+#include <atomic>
 #include <deque>
+#include <functional>
 #include <numeric>
 #include <sstream>
+#include <unordered_map>
 #ifdef _WIN32
 #include <crtdbg.h>
 #endif
 
 // Qt includes
 #include <QThreadStorage>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
 
 //------------------------------------------------------------------------------
 
@@ -64,7 +70,15 @@ class ImageInfo;
 
 // std::ofstream os("C:\\cache.txt");
 
-TUINT32 HistoryCount = 0;
+// Access stamps of the cache items
+std::atomic<TUINT32> HistoryCount(0);
+
+// Bytes taken by the uncompressed items
+std::atomic<TINT64> UncompressedSize(0);
+
+// Weight of the rebuild cost of items which are not reloadable, relative to
+// reloadable ones - the eviction priority is divided by it
+const double RebuildCostWeight = 4.0;
 //------------------------------------------------------------------------------
 
 class TheCodec final : public TRasterCodecLz4 {
@@ -95,14 +109,23 @@ public:
       : m_cantCompress(false)
       , m_builder(0)
       , m_imageInfo(0)
-      , m_modified(false) {}
+      , m_historyCount(0)
+      , m_modified(false)
+      , m_reloadable(false)
+      , m_memSize(0)
+      , m_lruPrev(0)
+      , m_lruNext(0) {}
 
   CacheItem(ImageBuilder *builder, ImageInfo *imageInfo)
       : m_cantCompress(false)
       , m_builder(builder)
       , m_imageInfo(imageInfo)
       , m_historyCount(0)
-      , m_modified(false) {}
+      , m_modified(false)
+      , m_reloadable(false)
+      , m_memSize(0)
+      , m_lruPrev(0)
+      , m_lruNext(0) {}
 
   virtual ~CacheItem() {}
 
@@ -117,6 +140,12 @@ public:
   std::string m_id;
   TUINT32 m_historyCount;
   bool m_modified;
+  bool m_reloadable;  // the owner can rebuild the image if it goes missing
+
+  // Size accounted in UncompressedSize, and links in the access list of the
+  // cache shard - for uncompressed items
+  TUINT32 m_memSize;
+  CacheItem *m_lruPrev, *m_lruNext;
 };
 
 #ifdef _WIN32
@@ -634,6 +663,8 @@ TImageP UncompressedOnDiskCacheItem::getImage() const {
       ras = (TRasterP)(TRasterGR8P(rii->m_size));
     else if (m_pixelsize == 2)
       ras = (TRasterP)(TRasterGR16P(rii->m_size));
+    else if (m_pixelsize == 16)
+      ras = (TRasterP)(TRasterFP(rii->m_size));
     else
       assert(false);
     ras->lock();
@@ -684,7 +715,66 @@ std::string TImageCache::getUniqueId(void) {
 
 class TImageCache::Imp {
 public:
-  Imp() : m_rootDir() {
+  typedef std::unordered_map<std::string, CacheItemP> Items;
+  typedef std::unordered_map<std::string, std::string> DuplicatedItems;
+
+  //! The cache content is striped in shards by id hash, each one guarded by
+  //! its own mutex - so that threads accessing different ids rarely contend.
+  //! Operations spanning multiple shards lock them in increasing index order.
+  struct Shard {
+    Items m_uncompressedItems;
+    Items m_compressedItems;
+    DuplicatedItems m_duplicatedItems;  // for duplicated items (when id1!=id2
+                                        // but image1==image2) in the map: key
+                                        // is dup id, value is main id
+
+    // Uncompressed items by last access, from the least recent one
+    CacheItem *m_lruFirst, *m_lruLast;
+
+    TThread::Mutex m_mutex;
+
+    Shard() : m_lruFirst(0), m_lruLast(0) {}
+
+    void link(CacheItem *item);
+    void unlink(CacheItem *item);
+
+    void addUncompressed(const std::string &id, const CacheItemP &item);
+    void eraseUncompressed(Items::iterator it);
+  };
+
+  //! Locks all the shards, for operations on the whole cache
+  class ShardsLocker {
+    Imp *m_imp;
+
+  public:
+    ShardsLocker(Imp *imp) : m_imp(imp) {
+      for (int i = 0; i < shardsCount; ++i) m_imp->m_shards[i].m_mutex.lock();
+    }
+    ~ShardsLocker() {
+      for (int i = shardsCount - 1; i >= 0; --i)
+        m_imp->m_shards[i].m_mutex.unlock();
+    }
+  };
+
+  static const int shardsCount = 16;
+
+  //! The background thread compressing the cache
+  class Maintainer final : public QThread {
+    Imp *m_imp;
+
+  public:
+    Maintainer(Imp *imp) : m_imp(imp) {}
+    void run() override { m_imp->maintain(); }
+  };
+
+public:
+  Imp()
+      : m_rootDir()
+      , m_duplicatesCount(0)
+      , m_highWatermark(0)
+      , m_lowWatermark(0)
+      , m_maintenancePending(false)
+      , m_exiting(false) {
     // ATTENZIONE: e' molto piu' veloce se si usa memoria fisica
     // invece che virtuale: la virtuale e' tanta, non c'e' quindi bisogno
     // di comprimere le immagini, che grandi come sono vengono swappate su disco
@@ -695,6 +785,15 @@ public:
   }
 
   ~Imp() {
+    if (m_maintainer) {
+      {
+        QMutexLocker locker(&m_maintenanceMutex);
+        m_exiting = true;
+        m_maintenanceCondition.wakeOne();
+      }
+      m_maintainer->wait();
+    }
+
     if (m_rootDir != TFilePath()) TSystem::rmDirTree(m_rootDir);
   }
 
@@ -706,9 +805,27 @@ public:
       return TSystem::memoryShortage();
   }
 
+  bool needsCompression() {
+    TINT64 highWatermark = m_highWatermark;
+    return (highWatermark > 0 && UncompressedSize > highWatermark) ||
+           notEnoughMemory();
+  }
+
+  bool isCompressedEnough() {
+    TINT64 lowWatermark = m_lowWatermark;
+    return (lowWatermark <= 0 || UncompressedSize <= lowWatermark) &&
+           !notEnoughMemory();
+  }
+
+  Shard &getShard(const std::string &id) {
+    return m_shards[std::hash<std::string>()(id) % shardsCount];
+  }
+
+  void requestCompression();
+  void maintain();
   void doCompress();
   void doCompress(std::string id);
-  UCHAR *compressAndMalloc(TUINT32 requestedSize);  // compress in the cache
+  UCHAR *compressAndMalloc(TUINT64 requestedSize);  // compress in the cache
                                                     // till it can nallocate the
                                                     // requested memory
   void outputMap(UINT chunkRequested, std::string filename);
@@ -724,24 +841,59 @@ public:
   bool m_isEnabled;
 #endif
 
-  std::map<std::string, CacheItemP> m_uncompressedItems;
-  std::map<TUINT32, std::string> m_itemHistory;
-  std::map<std::string, CacheItemP> m_compressedItems;
+  Shard m_shards[shardsCount];
+
   std::map<void *, std::string>
-      m_itemsByImagePointer;  // items ordered by ImageP.getPointer()
-  std::map<std::string, std::string> m_duplicatedItems;  // for duplicated items
-                                                         // (when id1!=id2 but
-                                                         // image1==image2) in
-                                                         // the map: key is dup
-                                                         // id, value is main id
+      m_itemsByImagePointer;       // items ordered by ImageP.getPointer()
+  TThread::Mutex m_pointersMutex;  // guards m_itemsByImagePointer - it may be
+                                   // locked with shards locked, never before
+
+  // Duplicated items in all the shards - while there are none, operations
+  // on a single id need not look into the other shards. It is increased
+  // with m_pointersMutex locked, so that holding it the count cannot rise.
+  std::atomic<int> m_duplicatesCount;
+
   // memoria fisica totale della macchina che non puo' essere utilizzata;
   TINT64 m_reservedMemory;
-  TThread::Mutex m_mutex;
 
-  static int m_fileid;
+  // Uncompressed items are compressed in background above the high
+  // watermark, down to the low one (in bytes, zero if disabled)
+  std::atomic<TINT64> m_highWatermark, m_lowWatermark;
+
+  std::unique_ptr<Maintainer> m_maintainer;
+  QMutex m_maintenanceMutex;
+  QWaitCondition m_maintenanceCondition;
+  bool m_maintenancePending, m_exiting;
+
+  TThread::Mutex m_codecMutex;  // TheCodec is not reentrant - it is locked
+                                // after any shard
+
+  TImageCache::Statistics m_stats;
+  QMutex m_statsMutex;
+
+  static std::atomic<int> m_fileid;
+
+  void count(TINT64 TImageCache::Statistics::*counter) {
+    QMutexLocker locker(&m_statsMutex);
+    ++(m_stats.*counter);
+  }
+
+private:
+  void setPointer(const TImageP &img, const std::string &id);
+  bool claimPointer(const TImageP &img, const std::string &id,
+                    std::string &ownerId);
+  void removePointer(const TImageP &img);
+
+  void doRemove(Shard &shard, const std::string &id);
+  void doRemap(const std::string &dstId, const std::string &srcId,
+               bool remapDuplicates);
+
+  void evict(const std::function<bool()> &done, bool onDisk);
+  void compressItem(Shard &shard, CacheItem *item, bool onDisk);
+  void moveCompressedToDisk(const std::function<bool()> &done);
 };
 
-int TImageCache::Imp::m_fileid;
+std::atomic<int> TImageCache::Imp::m_fileid(0);
 
 //------------------------------------------------------------------------------
 namespace {
@@ -778,276 +930,390 @@ inline TINT32 hasExternalReferences(const TImageP &img) {
 
   return std::max(refCount, img->getRefCount()) > 1;
 }
+
+// Returns whether the uncompressed item can be compressed
+inline bool isCompressible(CacheItem *item) {
+  UncompressedOnMemoryCacheItem *uitem =
+      dynamic_cast<UncompressedOnMemoryCacheItem *>(item);
+  return !(item->m_cantCompress ||
+           (uitem &&
+            (!uitem->m_image || hasExternalReferences(uitem->m_image))));
+}
 }
 //------------------------------------------------------------------------------
 
-void TImageCache::Imp::doCompress() {
-  // se la memoria usata per mantenere le immagini decompresse e' superiore
-  // a un dato valore, comprimo alcune immagini non compresse non checked-out
-  // in modo da liberare memoria
+void TImageCache::Imp::Shard::link(CacheItem *item) {
+  item->m_historyCount = HistoryCount++;
+
+  item->m_lruPrev = m_lruLast;
+  item->m_lruNext = 0;
+
+  if (m_lruLast)
+    m_lruLast->m_lruNext = item;
+  else
+    m_lruFirst = item;
+
+  m_lruLast = item;
+}
 
-  // per il momento scorre tutte le immagini alla ricerca di immagini
-  // non compresse non checked-out
+//------------------------------------------------------------------------------
+
+void TImageCache::Imp::Shard::unlink(CacheItem *item) {
+  if (item->m_lruPrev)
+    item->m_lruPrev->m_lruNext = item->m_lruNext;
+  else
+    m_lruFirst = item->m_lruNext;
+
+  if (item->m_lruNext)
+    item->m_lruNext->m_lruPrev = item->m_lruPrev;
+  else
+    m_lruLast = item->m_lruPrev;
+
+  item->m_lruPrev = item->m_lruNext = 0;
+}
+
+//------------------------------------------------------------------------------
+
+void TImageCache::Imp::Shard::addUncompressed(const std::string &id,
+                                              const CacheItemP &item) {
+  Items::iterator it = m_uncompressedItems.find(id);
+  if (it != m_uncompressedItems.end()) eraseUncompressed(it);
+
+  item->m_id              = id;
+  item->m_memSize         = item->getSize();
+  m_uncompressedItems[id] = item;
+  link(item.getPointer());
+
+  UncompressedSize += item->m_memSize;
+}
 
-  TThread::MutexLocker sl(&m_mutex);
+//------------------------------------------------------------------------------
 
-  std::map<TUINT32, std::string>::iterator itu = m_itemHistory.begin();
+void TImageCache::Imp::Shard::eraseUncompressed(Items::iterator it) {
+  UncompressedSize -= it->second->m_memSize;
 
-  for (; itu != m_itemHistory.end() && notEnoughMemory();) {
-    std::map<std::string, CacheItemP>::iterator it =
-        m_uncompressedItems.find(itu->second);
-    assert(it != m_uncompressedItems.end());
-    CacheItemP item = it->second;
+  unlink(it->second.getPointer());
+  m_uncompressedItems.erase(it);
+}
 
-    UncompressedOnMemoryCacheItemP uitem = item;
-    if (item->m_cantCompress ||
-        (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image)))) {
-      ++itu;
+//------------------------------------------------------------------------------
+
+void TImageCache::Imp::setPointer(const TImageP &img, const std::string &id) {
+  TThread::MutexLocker sl(&m_pointersMutex);
+  m_itemsByImagePointer[getPointer(img)] = id;
+}
+
+//------------------------------------------------------------------------------
+
+//! Associates the image to the specified id, unless it is already associated
+//! to another one - which is returned in \b ownerId.
+bool TImageCache::Imp::claimPointer(const TImageP &img, const std::string &id,
+                                    std::string &ownerId) {
+  TThread::MutexLocker sl(&m_pointersMutex);
+
+  std::pair<std::map<void *, std::string>::iterator, bool> result =
+      m_itemsByImagePointer.insert(std::make_pair(getPointer(img), id));
+  if (!result.second) ownerId = result.first->second;
+
+  return result.second;
+}
+
+//------------------------------------------------------------------------------
+
+void TImageCache::Imp::removePointer(const TImageP &img) {
+  TThread::MutexLocker sl(&m_pointersMutex);
+  m_itemsByImagePointer.erase(getPointer(img));
+}
+
+//------------------------------------------------------------------------------
+
+//! Releases uncompressed items in order of eviction priority, until \b done
+//! returns true. Reloadable items are dropped, the others compressed - or
+//! stored uncompressed on disk, if \b onDisk is true.
+/*!
+  The priority weighs an item's size by the accesses to the cache since its
+  last one, divided by its rebuild cost - so large, stale items go first, and
+  reloadable ones before those only the cache can give back.
+*/
+void TImageCache::Imp::evict(const std::function<bool()> &done, bool onDisk) {
+  struct Victim {
+    double m_priority;
+    int m_shard;
+    std::string m_id;
+    CacheItemP m_item;
+    TUINT32 m_historyCount;
+
+    bool operator<(const Victim &other) const {
+      return m_priority > other.m_priority;
+    }
+  };
+
+  std::vector<Victim> victims;
+  TUINT32 now = HistoryCount;
+
+  for (int i = 0; i < shardsCount; ++i) {
+    Shard &shard = m_shards[i];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    for (CacheItem *item = shard.m_lruFirst; item; item = item->m_lruNext) {
+      if (!isCompressible(item)) continue;
+
+      double cost = (item->m_reloadable && m_duplicatesCount == 0)
+                        ? 1.0
+                        : RebuildCostWeight;
+
+      Victim victim;
+      victim.m_priority =
+          (now - item->m_historyCount + 1.0) * item->m_memSize / cost;
+      victim.m_shard        = i;
+      victim.m_id           = item->m_id;
+      victim.m_item         = item;
+      victim.m_historyCount = item->m_historyCount;
+      victims.push_back(victim);
+    }
+  }
+
+  std::sort(victims.begin(), victims.end());
+
+  for (const Victim &victim : victims) {
+    if (done()) return;
+
+    Shard &shard = m_shards[victim.m_shard];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    // Skip items removed or accessed in the meantime
+    Items::iterator it = shard.m_uncompressedItems.find(victim.m_id);
+    if (it == shard.m_uncompressedItems.end() || it->second != victim.m_item ||
+        victim.m_item->m_historyCount != victim.m_historyCount ||
+        !isCompressible(victim.m_item.getPointer()))
       continue;
+
+    // Duplicated ids may refer to the item - it is not dropped then
+    if (victim.m_item->m_reloadable) {
+      TThread::MutexLocker pl(&m_pointersMutex);
+      if (m_duplicatesCount == 0) {
+        removePointer(victim.m_item->getImage());
+        shard.eraseUncompressed(it);
+        shard.m_compressedItems.erase(victim.m_id);
+
+        count(&TImageCache::Statistics::m_drops);
+        continue;
+      }
     }
-    std::string id = it->first;
 
-#ifdef _WIN32
-    assert(itu->first == it->second->m_historyCount);
-    itu = m_itemHistory.erase(itu);
-    m_itemsByImagePointer.erase(getPointer(item->getImage()));
-    m_uncompressedItems.erase(it);
-#else
-    std::map<TUINT32, std::string>::iterator itu2 = itu;
-    itu++;
-    m_itemHistory.erase(itu2);
-    m_itemsByImagePointer.erase(item->getImage().getPointer());
-    m_uncompressedItems.erase(it);
-#endif
+    compressItem(shard, victim.m_item.getPointer(), onDisk);
+  }
+}
+
+//------------------------------------------------------------------------------
 
-    if (m_compressedItems.find(id) == m_compressedItems.end()) {
-      assert(uitem);
-      item->m_cantCompress = true;
-      CacheItemP newItem   = new CompressedOnMemoryCacheItem(
-          item->getImage());  // WARNING the codec buffer  allocation can CHANGE
-                              // the cache.
-      item->m_cantCompress = false;
-      if (newItem->getSize() ==
+//! Replaces the uncompressed item with a compressed one - or with an
+//! uncompressed one on disk. Must be invoked with the item's shard locked.
+void TImageCache::Imp::compressItem(Shard &shard, CacheItem *item,
+                                    bool onDisk) {
+  CacheItemP itemP(item);  // keeps it alive once out of the shard
+  std::string id = item->m_id;
+
+  removePointer(item->getImage());
+  shard.eraseUncompressed(shard.m_uncompressedItems.find(id));
+
+  if (shard.m_compressedItems.find(id) != shard.m_compressedItems.end())
+    return;
+
+  TThread::MutexLocker sl(&m_codecMutex);
+
+  CacheItemP newItem;
+  if (!onDisk) {
+    item->m_cantCompress = true;
+    newItem              = new CompressedOnMemoryCacheItem(
+        item->getImage());  // WARNING the codec buffer  allocation can CHANGE
+                            // the cache.
+    item->m_cantCompress = false;
+  }
+
+  if (!newItem ||
+      newItem->getSize() ==
           0)  /// non c'era memoria sufficiente per il buffer compresso....
-      {
+  {
+    assert(m_rootDir != TFilePath());
+    TFilePath fp =
+        m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
+    newItem = new UncompressedOnDiskCacheItem(fp, item->getImage());
+
+    count(&TImageCache::Statistics::m_spills);
+  } else
+    count(&TImageCache::Statistics::m_compressions);
+
+  newItem->m_reloadable       = item->m_reloadable;
+  shard.m_compressedItems[id] = newItem;
+}
+
+//------------------------------------------------------------------------------
+
+//! Moves compressed items from memory to disk, until \b done returns true.
+void TImageCache::Imp::moveCompressedToDisk(
+    const std::function<bool()> &done) {
+  for (int i = 0; i < shardsCount; ++i) {
+    Shard &shard = m_shards[i];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    // Storing items on disk may reenter the cache - so, collect them first
+    std::vector<std::string> ids;
+
+    Items::iterator itc = shard.m_compressedItems.begin();
+    for (; itc != shard.m_compressedItems.end(); ++itc)
+      if (CompressedOnMemoryCacheItemP(itc->second))
+        ids.push_back(itc->first);
+
+    for (const std::string &id : ids) {
+      if (done()) return;
+
+      itc = shard.m_compressedItems.find(id);
+      if (itc == shard.m_compressedItems.end()) continue;
+
+      CacheItemP item = itc->second;
+      if (item->m_cantCompress) continue;
+
+      CompressedOnMemoryCacheItemP citem = item;
+      if (citem) {
         assert(m_rootDir != TFilePath());
         TFilePath fp =
             m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-        newItem = new UncompressedOnDiskCacheItem(fp, item->getImage());
+
+        CacheItemP newItem = new CompressedOnDiskCacheItem(
+            fp, citem->m_compressedRas, citem->m_builder->clone(),
+            citem->m_imageInfo->clone());
+
+        newItem->m_reloadable       = citem->m_reloadable;
+        shard.m_compressedItems[id] = newItem;
+
+        count(&TImageCache::Statistics::m_spills);
       }
-      m_compressedItems[id] = newItem;
-      item                  = CacheItemP();
-      uitem                 = UncompressedOnMemoryCacheItemP();
-      // doCompress();//restart, since interators can have been changed (see
-      // comment above)
-      // return;
-      itu = m_itemHistory.begin();
     }
   }
+}
 
-  // se il quantitativo di memoria utilizzata e' superiore a un dato valore,
-  // sposto
-  // su disco alcune immagini compresse in modo da liberare memoria
+//------------------------------------------------------------------------------
 
-  if (itu != m_itemHistory.end())  // memory is enough!
+//! Has the cache compressed if it takes too much memory. Compression runs in
+//! the background thread, so that the threads accessing the cache do not
+//! wait for it.
+void TImageCache::Imp::requestCompression() {
+  if (TBigMemoryManager::instance()->isActive()) {
+    // Raster allocations may compress the cache themselves, reentering it -
+    // compression runs inline then, under the same locks
+    doCompress();
     return;
+  }
 
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for (; itc != m_compressedItems.end() && notEnoughMemory(); ++itc) {
-    CacheItemP item = itc->second;
-    if (item->m_cantCompress) continue;
+  if (!needsCompression()) return;
 
-    CompressedOnMemoryCacheItemP citem = itc->second;
-    if (citem) {
-      assert(m_rootDir != TFilePath());
-      TFilePath fp =
-          m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
+  QMutexLocker locker(&m_maintenanceMutex);
 
-      CacheItemP newItem = new CompressedOnDiskCacheItem(
-          fp, citem->m_compressedRas, citem->m_builder->clone(),
-          citem->m_imageInfo->clone());
+  m_maintenancePending = true;
 
-      itc->second                   = 0;
-      m_compressedItems[itc->first] = newItem;
-    }
-  }
+  if (!m_maintainer) {
+    m_maintainer.reset(new Maintainer(this));
+    m_maintainer->start(QThread::LowPriority);
+  } else
+    m_maintenanceCondition.wakeOne();
 }
 
 //------------------------------------------------------------------------------
 
-void TImageCache::Imp::doCompress(std::string id) {
-  TThread::MutexLocker sl(&m_mutex);
+//! The background thread's body. Compresses the cache below the low
+//! watermark and out of memory shortages, each time it is requested to.
+void TImageCache::Imp::maintain() {
+  QMutexLocker locker(&m_maintenanceMutex);
 
-  // search id in m_uncompressedItems
-  std::map<std::string, CacheItemP>::iterator it = m_uncompressedItems.find(id);
-  if (it == m_uncompressedItems.end()) return;  // id not found: return
+  while (!m_exiting) {
+    if (!m_maintenancePending) {
+      m_maintenanceCondition.wait(&m_maintenanceMutex);
+      continue;
+    }
 
-  // is item suitable for compression ?
-  CacheItemP item                      = it->second;
-  UncompressedOnMemoryCacheItemP uitem = item;
-  if (item->m_cantCompress ||
-      (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image))))
-    return;
+    m_maintenancePending = false;
+    locker.unlock();
 
-  // search id in m_itemHistory
-  std::map<TUINT32, std::string>::iterator itu = m_itemHistory.begin();
-  while (itu != m_itemHistory.end() && itu->second != id) ++itu;
-  if (itu == m_itemHistory.end()) return;  // id not found: return
+    evict([this]() { return isCompressedEnough(); }, false);
 
-// delete itu from m_itemHistory
-#ifdef _WIN32
-  assert(itu->first == it->second->m_historyCount);
-  itu = m_itemHistory.erase(itu);
-  m_itemsByImagePointer.erase(getPointer(item->getImage()));
-#else
-  std::map<TUINT32, std::string>::iterator itu2 = itu;
-  itu++;
-  m_itemHistory.erase(itu2);
-  m_itemsByImagePointer.erase(item->getImage().getPointer());
-#endif
+    if (notEnoughMemory())
+      moveCompressedToDisk([this]() { return !notEnoughMemory(); });
 
-  // delete item from m_uncompressedItems
-  m_uncompressedItems.erase(it);
+    count(&TImageCache::Statistics::m_backgroundPasses);
 
-  // check if item has been already compressed. this should never happen
-  if (m_compressedItems.find(id) != m_compressedItems.end()) return;
-
-  assert(uitem);
-  item->m_cantCompress = true;  // ??
-  CacheItemP newItem   = new CompressedOnMemoryCacheItem(
-      item->getImage());  // WARNING the codec buffer  allocation can CHANGE the
-                          // cache.
-  item->m_cantCompress = false;  // ??
-  if (newItem->getSize() ==
-      0)  /// non c'era memoria sufficiente per il buffer compresso....
-  {
-    assert(m_rootDir != TFilePath());
-    TFilePath fp =
-        m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-    newItem = new UncompressedOnDiskCacheItem(fp, item->getImage());
+    locker.relock();
   }
-  m_compressedItems[id] = newItem;
-  item                  = CacheItemP();
-  uitem                 = UncompressedOnMemoryCacheItemP();
 }
 
-/*
+//------------------------------------------------------------------------------
+
+void TImageCache::Imp::doCompress() {
+  // se la memoria usata per mantenere le immagini decompresse e' superiore
+  // a un dato valore, comprimo alcune immagini non compresse non checked-out
+  // in modo da liberare memoria
+
+  if (!notEnoughMemory()) return;
+
+  ShardsLocker locker(this);
+
+  count(&TImageCache::Statistics::m_inlinePasses);
+
+  evict([this]() { return !notEnoughMemory(); }, false);
+
   // se il quantitativo di memoria utilizzata e' superiore a un dato valore,
-  sposto
+  // sposto
   // su disco alcune immagini compresse in modo da liberare memoria
 
-  if (itu != m_itemHistory.end()) //memory is enough!
+  if (!notEnoughMemory())  // memory is enough!
     return;
 
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for ( ; itc != m_compressedItems.end() && notEnoughMemory(); ++itc)
-        {
-          CacheItemP item = itc->second;
-          if (item->m_cantCompress)
-                  continue;
-
-          CompressedOnMemoryCacheItemP citem = itc->second;
-          if (citem)
-                {
-                  assert(m_rootDir!=TFilePath());
-                  TFilePath fp = m_rootDir +
-  TFilePath(toString(TImageCache::Imp::m_fileid++));
-
-                  CacheItemP newItem = new CompressedOnDiskCacheItem(fp,
-  citem->m_compressedRas,
-                                                                                                                                                                                                                           citem->m_builder->clone(), citem->m_imageInfo->clone());
-
-                  itc->second = 0;
-                  m_compressedItems[itc->first] = newItem;
-                }
-        }
-  */
+  moveCompressedToDisk([this]() { return !notEnoughMemory(); });
+}
 
 //------------------------------------------------------------------------------
 
-UCHAR *TImageCache::Imp::compressAndMalloc(TUINT32 size) {
-  UCHAR *buf = 0;
+void TImageCache::Imp::doCompress(std::string id) {
+  // Compression may reenter the cache - so, lock it whole
+  ShardsLocker locker(this);
 
-  TThread::MutexLocker sl(&m_mutex);
+  Shard &shard = getShard(id);
 
-  TheCodec::instance()->reset();
+  // search id in m_uncompressedItems
+  Items::iterator it = shard.m_uncompressedItems.find(id);
+  if (it == shard.m_uncompressedItems.end()) return;  // id not found: return
 
-  // if (size!=0)
-  //  size = size>>10;
+  // is item suitable for compression ?
+  if (!isCompressible(it->second.getPointer())) return;
 
-  // assert(size==0 || TBigMemoryManager::instance()->isActive());
+  compressItem(shard, it->second.getPointer(), false);
+}
 
-  std::map<TUINT32, std::string>::iterator itu = m_itemHistory.begin();
-  while (
-      (buf = TBigMemoryManager::instance()->getBuffer(size)) == 0 &&
-      itu !=
-          m_itemHistory
-              .end())  //>TBigMemoryManager::instance()->getAvailableMemoryinKb()))
-  {
-    std::map<std::string, CacheItemP>::iterator it =
-        m_uncompressedItems.find(itu->second);
-    assert(it != m_uncompressedItems.end());
-    CacheItemP item = it->second;
-
-    UncompressedOnMemoryCacheItemP uitem = item;
-    if (item->m_cantCompress ||
-        (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image)))) {
-      ++itu;
-      continue;
-    }
+//------------------------------------------------------------------------------
 
-    if (m_compressedItems.find(it->first) == m_compressedItems.end()) {
-      assert(uitem);
-      CacheItemP newItem;
-      // newItem = new CompressedOnMemoryCacheItem(item->getImage());
-      // if (newItem->getSize()==0)
-      //  {
-      assert(m_rootDir != TFilePath());
-      TFilePath fp =
-          m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-      newItem = new UncompressedOnDiskCacheItem(fp, item->getImage());
-      //  }
-
-      m_compressedItems[it->first] = newItem;
-    }
+UCHAR *TImageCache::Imp::compressAndMalloc(TUINT64 size) {
+  UCHAR *buf = 0;
 
-#ifdef _WIN32
-    assert(itu->first == it->second->m_historyCount);
-    itu = m_itemHistory.erase(itu);
-    m_itemsByImagePointer.erase(getPointer(item->getImage()));
-    m_uncompressedItems.erase(it);
-#else
-    std::map<TUINT32, std::string>::iterator itu2 = itu;
-    itu++;
-    m_itemHistory.erase(itu2);
-    m_itemsByImagePointer.erase(item->getImage().getPointer());
-    m_uncompressedItems.erase(it);
-#endif
+  ShardsLocker locker(this);
+
+  {
+    TThread::MutexLocker sl(&m_codecMutex);
+    TheCodec::instance()->reset();
   }
 
-  if (buf != 0) return buf;
+  // if (size!=0)
+  //  size = size>>10;
 
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for (; itc != m_compressedItems.end() &&
-         (buf = TBigMemoryManager::instance()->getBuffer(size)) == 0;
-       ++itc) {
-    CacheItemP item = itc->second;
-    if (item->m_cantCompress) continue;
+  // assert(size==0 || TBigMemoryManager::instance()->isActive());
 
-    CompressedOnMemoryCacheItemP citem = itc->second;
-    if (citem) {
-      assert(m_rootDir != TFilePath());
-      TFilePath fp =
-          m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
+  auto allocated = [&buf, size]() {
+    return (buf = TBigMemoryManager::instance()->getBuffer(size)) != 0;
+  };
 
-      CacheItemP newItem = new CompressedOnDiskCacheItem(
-          fp, citem->m_compressedRas, citem->m_builder->clone(),
-          citem->m_imageInfo->clone());
+  evict(allocated, true);
+  if (buf != 0 || allocated()) return buf;
 
-      itc->second                   = 0;
-      m_compressedItems[itc->first] = newItem;
-    }
-  }
+  moveCompressedToDisk(allocated);
 
   return buf;
 }
@@ -1144,7 +1410,7 @@ return m_imp->m_rootDir;
 */
 //------------------------------------------------------------------------------
 
-UCHAR *TImageCache::compressAndMalloc(TUINT32 requestedSize) {
+UCHAR *TImageCache::compressAndMalloc(TUINT64 requestedSize) {
   return m_imp->compressAndMalloc(requestedSize);
 }
 
@@ -1160,101 +1426,78 @@ void TImageCache::add(const std::string &id, const TImageP &img,
 
 void TImageCache::Imp::add(const std::string &id, const TImageP &img,
                            bool overwrite) {
-  TThread::MutexLocker sl(&m_mutex);
-
-#ifdef LEVO
-  std::map<std::string, CacheItemP>::iterator it1 = m_uncompressedItems.begin();
-
-  for (; it1 != m_uncompressedItems.end(); ++it1) {
-    UncompressedOnMemoryCacheItemP item =
-        (UncompressedOnMemoryCacheItemP)it1->second;
-    // m_memUsage -= item->getSize();
-    assert(item);
-    TImageP refImg = item->getImage();
-    if (refImg.getPointer() == img.getPointer() && it1->first != id)
-      assert(!"opps gia' esiste in cache!");
-  }
-#endif
+  Shard &shard = getShard(id);
 
-  std::map<std::string, CacheItemP>::iterator itUncompr =
-      m_uncompressedItems.find(id);
-  std::map<std::string, CacheItemP>::iterator itCompr =
-      m_compressedItems.find(id);
+  {
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    Items::iterator itUncompr = shard.m_uncompressedItems.find(id);
+    Items::iterator itCompr   = shard.m_compressedItems.find(id);
 
 #ifdef _DEBUGTOONZ
-  TRasterImageP rimg = (TRasterImageP)img;
-  TToonzImageP timg  = (TToonzImageP)img;
+    TRasterImageP rimg = (TRasterImageP)img;
+    TToonzImageP timg  = (TToonzImageP)img;
 #endif
 
-  if (itUncompr != m_uncompressedItems.end() ||
-      itCompr !=
-          m_compressedItems.end())  // already present in cache with same id...
-  {
-    if (overwrite) {
+    if (itUncompr != shard.m_uncompressedItems.end() ||
+        itCompr != shard.m_compressedItems
+                       .end())  // already present in cache with same id...
+    {
+      if (!overwrite) return;
+
 #ifdef _DEBUGTOONZ
       if (rimg)
         rimg->getRaster()->m_cashed = true;
       else if (timg)
         timg->getRaster()->m_cashed = true;
 #endif
-      std::map<std::string, CacheItemP>::iterator it;
-
-      if (itUncompr != m_uncompressedItems.end()) {
-        assert(m_itemHistory.find(itUncompr->second->m_historyCount) !=
-               m_itemHistory.end());
-        m_itemHistory.erase(itUncompr->second->m_historyCount);
-        m_itemsByImagePointer.erase(getPointer(itUncompr->second->getImage()));
-        m_uncompressedItems.erase(itUncompr);
+
+      if (itUncompr != shard.m_uncompressedItems.end()) {
+        removePointer(itUncompr->second->getImage());
+        shard.eraseUncompressed(itUncompr);
       }
-      if (itCompr != m_compressedItems.end()) m_compressedItems.erase(id);
-    } else
-      return;
-  } else {
-    std::map<std::string, std::string>::iterator dt =
-        m_duplicatedItems.find(id);
-    if ((dt != m_duplicatedItems.end()) && !overwrite) return;
-
-    std::map<void *, std::string>::iterator it;
-    if ((it = m_itemsByImagePointer.find(getPointer(img))) !=
-        m_itemsByImagePointer
-            .end())  // already present in cache with another id...
-    {
-      m_duplicatedItems[id] = it->second;
-      return;
-    }
+      if (itCompr != shard.m_compressedItems.end())
+        shard.m_compressedItems.erase(id);
 
-    if (dt != m_duplicatedItems.end()) m_duplicatedItems.erase(dt);
-  }
+      setPointer(img, id);
+    } else {
+      DuplicatedItems::iterator dt = shard.m_duplicatedItems.find(id);
+      if ((dt != shard.m_duplicatedItems.end()) && !overwrite) return;
+
+      std::string mainId;
+      TThread::MutexLocker pl(&m_pointersMutex);
+      if (!claimPointer(img, id,
+                        mainId))  // already present in cache with another id...
+      {
+        if (dt == shard.m_duplicatedItems.end()) ++m_duplicatesCount;
+        shard.m_duplicatedItems[id] = mainId;
+        return;
+      }
 
-  CacheItemP item;
+      if (dt != shard.m_duplicatedItems.end()) {
+        shard.m_duplicatedItems.erase(dt);
+        --m_duplicatesCount;
+      }
+    }
 
 #ifdef _DEBUGTOONZ
-  if (rimg)
-    rimg->getRaster()->m_cashed = true;
-  else if (timg)
-    timg->getRaster()->m_cashed = true;
+    if (rimg)
+      rimg->getRaster()->m_cashed = true;
+    else if (timg)
+      timg->getRaster()->m_cashed = true;
 #endif
 
-  item = new UncompressedOnMemoryCacheItem(img);
+    CacheItemP item = new UncompressedOnMemoryCacheItem(img);
 #ifdef TNZCORE_LIGHT
-  item->m_cantCompress = false;
+    item->m_cantCompress = false;
 #else
-  item->m_cantCompress = (TVectorImageP(img) ? true : false);
+    item->m_cantCompress = (TVectorImageP(img) ? true : false);
 #endif
-  item->m_id                             = id;
-  m_uncompressedItems[id]                = item;
-  m_itemsByImagePointer[getPointer(img)] = id;
-  item->m_historyCount                   = HistoryCount;
-  m_itemHistory[HistoryCount]            = id;
-  HistoryCount++;
-
-  doCompress();
+    shard.addUncompressed(id, item);
+  }
 
-#ifdef _DEBUGTOONZ
-// int itemCount =
-// m_imp->m_uncompressedItems.size()+m_imp->m_compressedItems.size();
-// m_imp->outputDebug();
-#endif
+  // Compression may lock all the shards - it must follow the one above
+  requestCompression();
 }
 
 void TImageCache::remove(const std::string &id) { m_imp->remove(id); }
@@ -1267,38 +1510,66 @@ void TImageCache::Imp::remove(const std::string &id) {
              // imagecache was already freed!
 
   assert(check == magic);
-  TThread::MutexLocker sl(&m_mutex);
 
-  std::map<std::string, std::string>::iterator it1;
-  if ((it1 = m_duplicatedItems.find(id)) !=
-      m_duplicatedItems.end())  // it's a duplicated id...
   {
-    m_duplicatedItems.erase(it1);
-    return;
+    Shard &shard = getShard(id);
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    // No duplicate of id can be added while the pointers are locked
+    TThread::MutexLocker pl(&m_pointersMutex);
+    if (m_duplicatesCount == 0) {
+      doRemove(shard, id);
+      return;
+    }
   }
 
-  for (it1 = m_duplicatedItems.begin(); it1 != m_duplicatedItems.end(); ++it1)
-    if (it1->second == id) break;
+  // Duplicates of id may be found in any shard
+  ShardsLocker locker(this);
+
+  Shard &shard = getShard(id);
 
-  if (it1 != m_duplicatedItems.end())  // it has duplicated, so cannot erase it;
-                                       // I erase the duplicate, and assign its
-                                       // id has the main id
+  DuplicatedItems::iterator it1;
+  if ((it1 = shard.m_duplicatedItems.find(id)) !=
+      shard.m_duplicatedItems.end())  // it's a duplicated id...
   {
-    std::string sonId = it1->first;
-    m_duplicatedItems.erase(it1);
-    remap(sonId, id);
+    shard.m_duplicatedItems.erase(it1);
+    --m_duplicatesCount;
     return;
   }
 
-  std::map<std::string, CacheItemP>::iterator it = m_uncompressedItems.find(id);
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.find(id);
-  if (it != m_uncompressedItems.end()) {
-    const CacheItemP &item = it->second;
-    assert((UncompressedOnMemoryCacheItemP)item);
-    assert(m_itemHistory.find(it->second->m_historyCount) !=
-           m_itemHistory.end());
-    m_itemHistory.erase(it->second->m_historyCount);
-    m_itemsByImagePointer.erase(getPointer(it->second->getImage()));
+  for (int i = 0; i < shardsCount; ++i) {
+    Shard &sonShard = m_shards[i];
+
+    for (it1 = sonShard.m_duplicatedItems.begin();
+         it1 != sonShard.m_duplicatedItems.end(); ++it1)
+      if (it1->second == id) break;
+
+    if (it1 != sonShard.m_duplicatedItems
+                   .end())  // it has duplicated, so cannot erase it;
+                            // I erase the duplicate, and assign its
+                            // id has the main id
+    {
+      std::string sonId = it1->first;
+      sonShard.m_duplicatedItems.erase(it1);
+      --m_duplicatesCount;
+      doRemap(sonId, id, true);
+      return;
+    }
+  }
+
+  doRemove(shard, id);
+}
+
+//------------------------------------------------------------------------------
+
+//! Removes the item under specified id from the shard. Must be invoked with
+//! the shard locked.
+void TImageCache::Imp::doRemove(Shard &shard, const std::string &id) {
+  Items::iterator it  = shard.m_uncompressedItems.find(id);
+  Items::iterator itc = shard.m_compressedItems.find(id);
+  if (it != shard.m_uncompressedItems.end()) {
+    assert((UncompressedOnMemoryCacheItemP)it->second);
+    removePointer(it->second->getImage());
 
 #ifdef _DEBUGTOONZ
     if ((TRasterImageP)it->second->getImage())
@@ -1307,9 +1578,9 @@ void TImageCache::Imp::remove(const std::string &id) {
       ((TToonzImageP)it->second->getImage())->getRaster()->m_cashed = false;
 #endif
 
-    m_uncompressedItems.erase(it);
+    shard.eraseUncompressed(it);
   }
-  if (itc != m_compressedItems.end()) m_compressedItems.erase(itc);
+  if (itc != shard.m_compressedItems.end()) shard.m_compressedItems.erase(itc);
 }
 
 //------------------------------------------------------------------------------
@@ -1320,49 +1591,88 @@ void TImageCache::remap(const std::string &dstId, const std::string &srcId) {
 
 void TImageCache::Imp::remap(const std::string &dstId,
                              const std::string &srcId) {
-  TThread::MutexLocker sl(&m_mutex);
-  std::map<std::string, CacheItemP>::iterator it =
-      m_uncompressedItems.find(srcId);
-  if (it != m_uncompressedItems.end()) {
+  {
+    Shard *srcShard = &getShard(srcId), *dstShard = &getShard(dstId);
+
+    // Lock in index order. Locks are recursive, so the shards may coincide.
+    TThread::MutexLocker sl1(&std::min(srcShard, dstShard)->m_mutex);
+    TThread::MutexLocker sl2(&std::max(srcShard, dstShard)->m_mutex);
+
+    // No duplicate of srcId can be added while the pointers are locked
+    TThread::MutexLocker pl(&m_pointersMutex);
+    if (m_duplicatesCount == 0) {
+      doRemap(dstId, srcId, false);
+      return;
+    }
+  }
+
+  // Duplicates of srcId may be found in any shard
+  ShardsLocker locker(this);
+  doRemap(dstId, srcId, true);
+}
+
+//------------------------------------------------------------------------------
+
+//! Moves the item under srcId to dstId. Must be invoked with both their
+//! shards locked - or all of them, when \b remapDuplicates is true.
+void TImageCache::Imp::doRemap(const std::string &dstId,
+                               const std::string &srcId, bool remapDuplicates) {
+  Shard &srcShard = getShard(srcId), &dstShard = getShard(dstId);
+
+  Items::iterator it = srcShard.m_uncompressedItems.find(srcId);
+  if (it != srcShard.m_uncompressedItems.end()) {
     CacheItemP citem = it->second;
-    assert(m_itemHistory.find(citem->m_historyCount) != m_itemHistory.end());
-    m_itemHistory.erase(citem->m_historyCount);
-    m_itemsByImagePointer.erase(getPointer(citem->getImage()));
-    m_uncompressedItems.erase(it);
-
-    m_uncompressedItems[dstId]                           = citem;
-    m_itemHistory[citem->m_historyCount]                 = dstId;
-    m_itemsByImagePointer[getPointer(citem->getImage())] = dstId;
+    srcShard.eraseUncompressed(it);
+
+    // The owner's rebuild recipe is bound to the old id
+    citem->m_reloadable = false;
+
+    dstShard.addUncompressed(dstId, citem);
+    setPointer(citem->getImage(), dstId);
   }
-  it = m_compressedItems.find(srcId);
-  if (it != m_compressedItems.end()) {
+  it = srcShard.m_compressedItems.find(srcId);
+  if (it != srcShard.m_compressedItems.end()) {
     CacheItemP citem = it->second;
-    m_compressedItems.erase(it);
-    m_compressedItems[dstId] = citem;
+    srcShard.m_compressedItems.erase(it);
+
+    citem->m_reloadable               = false;
+    dstShard.m_compressedItems[dstId] = citem;
   }
-  std::map<std::string, std::string>::iterator it2 =
-      m_duplicatedItems.find(srcId);
-  if (it2 != m_duplicatedItems.end()) {
+
+  if (!remapDuplicates) return;
+
+  DuplicatedItems::iterator it2 = srcShard.m_duplicatedItems.find(srcId);
+  if (it2 != srcShard.m_duplicatedItems.end()) {
     std::string id = it2->second;
-    m_duplicatedItems.erase(it2);
-    m_duplicatedItems[dstId] = id;
+    srcShard.m_duplicatedItems.erase(it2);
+
+    if (dstShard.m_duplicatedItems.count(dstId)) --m_duplicatesCount;
+    dstShard.m_duplicatedItems[dstId] = id;
+  }
+  for (int i = 0; i < shardsCount; ++i) {
+    DuplicatedItems &duplicatedItems = m_shards[i].m_duplicatedItems;
+    for (it2 = duplicatedItems.begin(); it2 != duplicatedItems.end(); ++it2)
+      if (it2->second == srcId) it2->second = dstId;
   }
-  for (it2 = m_duplicatedItems.begin(); it2 != m_duplicatedItems.end(); ++it2)
-    if (it2->second == srcId) it2->second = dstId;
 }
 
 //------------------------------------------------------------------------------
 
 void TImageCache::remapIcons(const std::string &dstId,
                              const std::string &srcId) {
-  std::map<std::string, CacheItemP>::iterator it;
   std::map<std::string, std::string> table;
   std::string prefix = srcId + ":";
   int j              = (int)prefix.length();
-  for (it = m_imp->m_uncompressedItems.begin();
-       it != m_imp->m_uncompressedItems.end(); ++it) {
-    std::string id                      = it->first;
-    if (id.find(prefix) == 0) table[id] = dstId + ":" + id.substr(j);
+  for (int i = 0; i < Imp::shardsCount; ++i) {
+    Imp::Shard &shard = m_imp->m_shards[i];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    Imp::Items::iterator it;
+    for (it = shard.m_uncompressedItems.begin();
+         it != shard.m_uncompressedItems.end(); ++it) {
+      const std::string &id               = it->first;
+      if (id.find(prefix) == 0) table[id] = dstId + ":" + id.substr(j);
+    }
   }
   for (std::map<std::string, std::string>::iterator it2 = table.begin();
        it2 != table.end(); ++it2) {
@@ -1373,12 +1683,21 @@ void TImageCache::remapIcons(const std::string &dstId,
 //------------------------------------------------------------------------------
 
 void TImageCache::clear(bool deleteFolder) {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-  m_imp->m_uncompressedItems.clear();
-  m_imp->m_itemHistory.clear();
-  m_imp->m_compressedItems.clear();
-  m_imp->m_duplicatedItems.clear();
-  m_imp->m_itemsByImagePointer.clear();
+  Imp::ShardsLocker locker(m_imp.get());
+  for (int i = 0; i < Imp::shardsCount; ++i) {
+    Imp::Shard &shard = m_imp->m_shards[i];
+
+    shard.m_uncompressedItems.clear();
+    shard.m_compressedItems.clear();
+    shard.m_duplicatedItems.clear();
+    shard.m_lruFirst = shard.m_lruLast = 0;
+  }
+  m_imp->m_duplicatesCount = 0;
+  UncompressedSize         = 0;
+  {
+    TThread::MutexLocker sl(&m_imp->m_pointersMutex);
+    m_imp->m_itemsByImagePointer.clear();
+  }
   if (deleteFolder && m_imp->m_rootDir != TFilePath())
     TSystem::rmDirTree(m_imp->m_rootDir);
 }
@@ -1386,285 +1705,156 @@ void TImageCache::clear(bool deleteFolder) {
 //------------------------------------------------------------------------------
 
 void TImageCache::clearSceneImages() {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  // note the ';' - which follows ':' in the ascii table
-  m_imp->m_uncompressedItems.erase(
-      m_imp->m_uncompressedItems.begin(),
-      m_imp->m_uncompressedItems.lower_bound("$:"));
-  m_imp->m_uncompressedItems.erase(m_imp->m_uncompressedItems.lower_bound("$;"),
-                                   m_imp->m_uncompressedItems.end());
-
-  m_imp->m_compressedItems.erase(m_imp->m_compressedItems.begin(),
-                                 m_imp->m_compressedItems.lower_bound("$:"));
-  m_imp->m_compressedItems.erase(m_imp->m_compressedItems.lower_bound("$;"),
-                                 m_imp->m_compressedItems.end());
-
-  m_imp->m_duplicatedItems.erase(m_imp->m_duplicatedItems.begin(),
-                                 m_imp->m_duplicatedItems.lower_bound("$:"));
-  m_imp->m_duplicatedItems.erase(m_imp->m_duplicatedItems.lower_bound("$;"),
-                                 m_imp->m_duplicatedItems.end());
-
-  // Clear maps whose id is on the second of map pairs.
-
-  std::map<TUINT32, std::string>::iterator it;
-  for (it = m_imp->m_itemHistory.begin(); it != m_imp->m_itemHistory.end();) {
-    if (it->second.size() >= 2 && it->second[0] == '$' && it->second[1] == ':')
-      ++it;
-    else {
-      std::map<TUINT32, std::string>::iterator app = it;
-      app++;
-      m_imp->m_itemHistory.erase(it);
-      it = app;
-    }
-  }
-
-  std::map<void *, std::string>::iterator jt;
-  for (jt = m_imp->m_itemsByImagePointer.begin();
-       jt != m_imp->m_itemsByImagePointer.end();) {
-    if (jt->second.size() >= 2 && jt->second[0] == '$' && jt->second[1] == ':')
-      ++jt;
-    else {
-      std::map<void *, std::string>::iterator app = jt;
-      app++;
-      m_imp->m_itemsByImagePointer.erase(jt);
-      jt = app;
+  struct locals {
+    static bool isSceneId(const std::string &id) {
+      return !(id.size() >= 2 && id[0] == '$' && id[1] == ':');
     }
-  }
-}
+  };
 
-//------------------------------------------------------------------------------
+  Imp::ShardsLocker locker(m_imp.get());
 
-bool TImageCache::isCached(const std::string &id) const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-  return (m_imp->m_uncompressedItems.find(id) !=
-              m_imp->m_uncompressedItems.end() ||
-          m_imp->m_compressedItems.find(id) != m_imp->m_compressedItems.end() ||
-          m_imp->m_duplicatedItems.find(id) != m_imp->m_duplicatedItems.end());
-}
+  for (int i = 0; i < Imp::shardsCount; ++i) {
+    Imp::Shard &shard = m_imp->m_shards[i];
 
-//------------------------------------------------------------------------------
-#ifdef LEVO
-
-bool TImageCache::getSize(const std::string &id, TDimension &size) const {
-  QMutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
-    TToonzImageP ti = uncompressed->getImage();
-    if (ti) {
-      size = ti->getSize();
-      return true;
+    Imp::Items::iterator it;
+    for (it = shard.m_uncompressedItems.begin();
+         it != shard.m_uncompressedItems.end();) {
+      if (locals::isSceneId(it->first))
+        shard.eraseUncompressed(it++);
+      else
+        ++it;
     }
 
-    TRasterImageP ri = uncompressed->getImage();
-    if (ri && ri->getRaster()) {
-      size = ri->getRaster()->getSize();
-      return true;
-    }
-    return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-  CacheItemP cacheItem = itc->second;
-
-  if (cacheItem->m_imageInfo) {
-    RasterImageInfo *rimageInfo =
-        dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo);
-    if (rimageInfo) {
-      size = rimageInfo->m_size;
-      return true;
-    }
-    ToonzImageInfo *timageInfo =
-        dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo);
-    if (timageInfo) {
-      size = timageInfo->m_size;
-      return true;
+    for (it = shard.m_compressedItems.begin();
+         it != shard.m_compressedItems.end();) {
+      if (locals::isSceneId(it->first))
+        it = shard.m_compressedItems.erase(it);
+      else
+        ++it;
     }
-  }
 
-  return false;
-}
-
-//------------------------------------------------------------------------------
-
-bool TImageCache::getSavebox(const std::string &id, TRect &savebox) const {
-  QMutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
-
-    TToonzImageP ti = uncompressed->getImage();
-    if (ti) {
-      savebox = ti->getSavebox();
-      return true;
-    }
-    TRasterImageP ri = uncompressed->getImage();
-    if (ri) {
-      savebox = ri->getSavebox();
-      return true;
+    Imp::DuplicatedItems::iterator dt;
+    for (dt = shard.m_duplicatedItems.begin();
+         dt != shard.m_duplicatedItems.end();) {
+      if (locals::isSceneId(dt->first)) {
+        dt = shard.m_duplicatedItems.erase(dt);
+        --m_imp->m_duplicatesCount;
+      } else
+        ++dt;
     }
-    return false;
   }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
 
-  CacheItemP cacheItem = itc->second;
+  // Clear the map whose id is on the second of map pairs.
 
-  assert(cacheItem->m_imageInfo);
+  TThread::MutexLocker sl(&m_imp->m_pointersMutex);
 
-  RasterImageInfo *rimageInfo =
-      dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo);
-  if (rimageInfo) {
-    savebox = rimageInfo->m_savebox;
-    return true;
-  }
-#ifndef TNZCORE_LIGHT
-  ToonzImageInfo *timageInfo =
-      dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo);
-  if (timageInfo) {
-    savebox = timageInfo->m_savebox;
-    return true;
+  std::map<void *, std::string>::iterator jt;
+  for (jt = m_imp->m_itemsByImagePointer.begin();
+       jt != m_imp->m_itemsByImagePointer.end();) {
+    if (locals::isSceneId(jt->second))
+      jt = m_imp->m_itemsByImagePointer.erase(jt);
+    else
+      ++jt;
   }
-#endif
-  return false;
 }
 
 //------------------------------------------------------------------------------
 
-bool TImageCache::getDpi(const std::string &id, double &dpiX,
-                         double &dpiY) const {
-  QMutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
-    TToonzImageP ti = uncompressed->getImage();
-    if (ti) {
-      ti->getDpi(dpiX, dpiY);
-      return true;
-    }
-    TRasterImageP ri = uncompressed->getImage();
-    if (ri) {
-      ri->getDpi(dpiX, dpiY);
-      return true;
-    }
-    return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-  CacheItemP cacheItem = itc->second;
-  assert(cacheItem->m_imageInfo);
-
-  RasterImageInfo *rimageInfo =
-      dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo);
-  if (rimageInfo) {
-    dpiX = rimageInfo->m_dpix;
-    dpiY = rimageInfo->m_dpiy;
-    return true;
-  }
-#ifndef TNZCORE_LIGHT
-  ToonzImageInfo *timageInfo =
-      dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo);
-  if (timageInfo) {
-    dpiX = timageInfo->m_dpix;
-    dpiY = timageInfo->m_dpiy;
-    return true;
-  }
-#endif
-  return false;
+bool TImageCache::isCached(const std::string &id) const {
+  Imp::Shard &shard = m_imp->getShard(id);
+  TThread::MutexLocker sl(&shard.m_mutex);
+  return (shard.m_uncompressedItems.find(id) !=
+              shard.m_uncompressedItems.end() ||
+          shard.m_compressedItems.find(id) != shard.m_compressedItems.end() ||
+          shard.m_duplicatedItems.find(id) != shard.m_duplicatedItems.end());
 }
 
 //------------------------------------------------------------------------------
-#endif
 
 bool TImageCache::getSubsampling(const std::string &id, int &subs) const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, std::string>::iterator it1;
-  if ((it1 = m_imp->m_duplicatedItems.find(id)) !=
-      m_imp->m_duplicatedItems.end()) {
-    assert(m_imp->m_duplicatedItems.find(it1->second) ==
-           m_imp->m_duplicatedItems.end());
-    return getSubsampling(it1->second, subs);
-  }
+  Imp::Shard &shard = m_imp->getShard(id);
 
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
+  std::string mainId;
+  {
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    Imp::DuplicatedItems::iterator it1;
+    if ((it1 = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end())
+      mainId = it1->second;
+    else {
+      Imp::Items::iterator it = shard.m_uncompressedItems.find(id);
+      if (it != shard.m_uncompressedItems.end()) {
+        UncompressedOnMemoryCacheItemP uncompressed = it->second;
+        assert(uncompressed);
 #ifndef TNZCORE_LIGHT
-    if (TToonzImageP ti = uncompressed->getImage()) {
-      subs = ti->getSubsampling();
-      return true;
-    }
+        if (TToonzImageP ti = uncompressed->getImage()) {
+          subs = ti->getSubsampling();
+          return true;
+        }
 
-    else
+        else
 #endif
-        if (TRasterImageP ri = uncompressed->getImage()) {
-      subs = ri->getSubsampling();
-      return true;
-    } else
-      return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-  CacheItemP cacheItem = itc->second;
-  assert(cacheItem->m_imageInfo);
-  if (RasterImageInfo *rimageInfo =
-          dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo)) {
-    subs = rimageInfo->m_subs;
-    return true;
-  }
+            if (TRasterImageP ri = uncompressed->getImage()) {
+          subs = ri->getSubsampling();
+          return true;
+        } else
+          return false;
+      }
+
+      Imp::Items::iterator itc = shard.m_compressedItems.find(id);
+      if (itc == shard.m_compressedItems.end()) return false;
+      CacheItemP cacheItem = itc->second;
+      assert(cacheItem->m_imageInfo);
+      if (RasterImageInfo *rimageInfo =
+              dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo)) {
+        subs = rimageInfo->m_subs;
+        return true;
+      }
 #ifndef TNZCORE_LIGHT
-  else if (ToonzImageInfo *timageInfo =
-               dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo)) {
-    subs = timageInfo->m_subs;
-    return true;
-  }
+      else if (ToonzImageInfo *timageInfo =
+                   dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo)) {
+        subs = timageInfo->m_subs;
+        return true;
+      }
 #endif
-  else
-    return false;
+      else
+        return false;
+    }
+  }
+
+  // The main item may belong to another shard - and its lock must not be
+  // taken while holding this one
+  return getSubsampling(mainId, subs);
 }
 
 //------------------------------------------------------------------------------
 
 bool TImageCache::hasBeenModified(const std::string &id, bool reset) const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, std::string>::iterator it;
-  if ((it = m_imp->m_duplicatedItems.find(id)) !=
-      m_imp->m_duplicatedItems.end()) {
-    assert(m_imp->m_duplicatedItems.find(it->second) ==
-           m_imp->m_duplicatedItems.end());
-    return hasBeenModified(it->second, reset);
-  }
+  Imp::Shard &shard = m_imp->getShard(id);
 
-  TImageP img;
+  std::string mainId;
+  {
+    TThread::MutexLocker sl(&shard.m_mutex);
 
-  std::map<std::string, CacheItemP>::iterator itu =
-      m_imp->m_uncompressedItems.find(id);
-  if (itu != m_imp->m_uncompressedItems.end()) {
-    if (reset && itu->second->m_modified) {
-      itu->second->m_modified = false;
-      return true;
-    } else
-      return itu->second->m_modified;
+    Imp::DuplicatedItems::iterator it;
+    if ((it = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end())
+      mainId = it->second;
+    else {
+      Imp::Items::iterator itu = shard.m_uncompressedItems.find(id);
+      if (itu != shard.m_uncompressedItems.end()) {
+        if (reset && itu->second->m_modified) {
+          itu->second->m_modified = false;
+          return true;
+        } else
+          return itu->second->m_modified;
+      }
+      return true;  // not present in cache==modified (for particle purposes...)
+    }
   }
-  return true;  // not present in cache==modified (for particle purposes...)
+
+  return hasBeenModified(mainId, reset);
 }
 
 //------------------------------------------------------------------------------
@@ -1676,78 +1866,97 @@ TImageP TImageCache::get(const std::string &id, bool toBeModified) const {
 //------------------------------------------------------------------------------
 
 TImageP TImageCache::Imp::get(const std::string &id, bool toBeModified) {
-  TThread::MutexLocker sl(&m_mutex);
+  Shard &shard = getShard(id);
 
-  std::map<std::string, std::string>::const_iterator it;
-  if ((it = m_duplicatedItems.find(id)) != m_duplicatedItems.end()) {
-    assert(m_duplicatedItems.find(it->second) == m_duplicatedItems.end());
-    return get(it->second, toBeModified);
-  }
+  std::string mainId;
+  CacheItemP cacheItem;
+  {
+    TThread::MutexLocker sl(&shard.m_mutex);
 
-  TImageP img;
+    DuplicatedItems::const_iterator it;
+    if ((it = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end())
+      mainId = it->second;
+    else {
+      Items::iterator itu = shard.m_uncompressedItems.find(id);
+      if (itu != shard.m_uncompressedItems.end()) {
+        CacheItem *item = itu->second.getPointer();
+        if (item != shard.m_lruLast)  // significa che l'ultimo get non era
+                                      // sulla stessa immagine, quindi  serve
+                                      // aggiornare l'history!
+        {
+          shard.unlink(item);
+          shard.link(item);
+        }
+        if (toBeModified) {
+          item->m_modified   = true;
+          item->m_reloadable = false;
+          shard.m_compressedItems.erase(id);
+        }
+        return item->getImage();
+      }
 
-  std::map<std::string, CacheItemP>::iterator itu =
-      m_uncompressedItems.find(id);
-  if (itu != m_uncompressedItems.end()) {
-    img = itu->second->getImage();
-    if (itu->second->m_historyCount !=
-        HistoryCount - 1)  // significa che l'ultimo get non era sulla stessa
-                           // immagine, quindi  serve aggiornare l'history!
-    {
-      assert(m_itemHistory.find(itu->second->m_historyCount) !=
-             m_itemHistory.end());
-      m_itemHistory.erase(itu->second->m_historyCount);
-      m_itemHistory[HistoryCount] = id;
-      itu->second->m_historyCount = HistoryCount;
-      HistoryCount++;
-    }
-    if (toBeModified) {
-      itu->second->m_modified = true;
-      std::map<std::string, CacheItemP>::iterator itc =
-          m_compressedItems.find(id);
-      if (itc != m_compressedItems.end()) m_compressedItems.erase(itc);
+      Items::iterator itc = shard.m_compressedItems.find(id);
+      if (itc == shard.m_compressedItems.end()) return 0;
+
+      cacheItem = itc->second;
     }
-    return img;
   }
 
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.find(id);
-  if (itc == m_compressedItems.end()) return 0;
+  // The main item may belong to another shard - and its lock must not be
+  // taken while holding this one
+  if (!mainId.empty()) return get(mainId, toBeModified);
+
+  // Decompress without locks - the image allocation may have the whole cache
+  // compressed, and other threads need not wait for it
+  TImageP img = cacheItem->getImage();
 
-  CacheItemP cacheItem = itc->second;
+  CacheItemP uncompressed = new UncompressedOnMemoryCacheItem(img);
+  {
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    // Another thread may have decompressed the item meanwhile - its image is
+    // returned, so that both modify the same one
+    Items::iterator itu = shard.m_uncompressedItems.find(id);
+    if (itu != shard.m_uncompressedItems.end()) {
+      if (toBeModified) {
+        itu->second->m_modified   = true;
+        itu->second->m_reloadable = false;
+        shard.m_compressedItems.erase(id);
+      }
+      return itu->second->getImage();
+    }
 
-  img = cacheItem->getImage();
+    Items::iterator itc = shard.m_compressedItems.find(id);
+    if (itc == shard.m_compressedItems.end() || itc->second != cacheItem)
+      return img;  // removed or replaced meanwhile
 
-  CacheItemP uncompressed;
-  uncompressed                    = new UncompressedOnMemoryCacheItem(img);
-  m_uncompressedItems[itc->first] = uncompressed;
-  m_itemsByImagePointer[getPointer(img)] = itc->first;
+    uncompressed->m_reloadable = cacheItem->m_reloadable && !toBeModified;
 
-  m_itemHistory[HistoryCount]  = itc->first;
-  uncompressed->m_historyCount = HistoryCount;
-  HistoryCount++;
+    shard.addUncompressed(id, uncompressed);
+    setPointer(img, id);
 
-  if (CompressedOnMemoryCacheItemP(cacheItem))
-  // l'immagine compressa non la tengo insieme alla
-  // uncompressa se e' troppo grande
-  {
-    if (10 * cacheItem->getSize() > uncompressed->getSize()) {
-      m_compressedItems.erase(itc);
-      itc = m_compressedItems.end();
-    }
-  } else
-    assert((CompressedOnDiskCacheItemP)cacheItem ||
-           (UncompressedOnDiskCacheItemP)cacheItem);  // deve essere compressa!
+    if (CompressedOnMemoryCacheItemP(cacheItem))
+    // l'immagine compressa non la tengo insieme alla
+    // uncompressa se e' troppo grande
+    {
+      if (10 * cacheItem->getSize() > uncompressed->getSize()) {
+        shard.m_compressedItems.erase(itc);
+        itc = shard.m_compressedItems.end();
+      }
+    } else
+      assert((CompressedOnDiskCacheItemP)cacheItem ||
+             (UncompressedOnDiskCacheItemP)cacheItem);  // deve essere
+                                                        // compressa!
 
-  if (toBeModified && itc != m_compressedItems.end()) {
-    uncompressed->m_modified = true;
-    m_compressedItems.erase(itc);
+    if (toBeModified && itc != shard.m_compressedItems.end()) {
+      uncompressed->m_modified = true;
+      shard.m_compressedItems.erase(itc);
+    }
   }
 
-  uncompressed->m_cantCompress = toBeModified;
   // se la memoria utilizzata e' superiore al massimo consentito, comprime
-  doCompress();
-
-  uncompressed->m_cantCompress = false;
+  requestCompression();
 
 //#define DO_MEMCHECK
 #ifdef DO_MEMCHECK
@@ -1770,15 +1979,19 @@ public:
 }
 
 UINT TImageCache::getMemUsage() const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  int ret = std::accumulate(m_imp->m_uncompressedItems.begin(),
-                            m_imp->m_uncompressedItems.end(), 0,
-                            AccumulateMemUsage());
-
-  return ret + std::accumulate(m_imp->m_compressedItems.begin(),
-                               m_imp->m_compressedItems.end(), 0,
-                               AccumulateMemUsage());
+  int ret = 0;
+  for (int i = 0; i < Imp::shardsCount; ++i) {
+    Imp::Shard &shard = m_imp->m_shards[i];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    ret = std::accumulate(shard.m_uncompressedItems.begin(),
+                          shard.m_uncompressedItems.end(), ret,
+                          AccumulateMemUsage());
+    ret = std::accumulate(shard.m_compressedItems.begin(),
+                          shard.m_compressedItems.end(), ret,
+                          AccumulateMemUsage());
+  }
+  return ret;
 }
 
 //------------------------------------------------------------------------------
@@ -1788,12 +2001,14 @@ UINT TImageCache::getDiskUsage() const { return 0; }
 //------------------------------------------------------------------------------
 
 UINT TImageCache::getMemUsage(const std::string &id) const {
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) return it->second->getSize();
+  Imp::Shard &shard = m_imp->getShard(id);
+  TThread::MutexLocker sl(&shard.m_mutex);
 
-  it = m_imp->m_compressedItems.find(id);
-  if (it != m_imp->m_compressedItems.end()) return it->second->getSize();
+  Imp::Items::iterator it = shard.m_uncompressedItems.find(id);
+  if (it != shard.m_uncompressedItems.end()) return it->second->getSize();
+
+  it = shard.m_compressedItems.find(id);
+  if (it != shard.m_compressedItems.end()) return it->second->getSize();
   return 0;
 }
 
@@ -1802,18 +2017,10 @@ UINT TImageCache::getMemUsage(const std::string &id) const {
 //! Returns the uncompressed image size (in KB) of the image associated with
 //! passd id, or 0 if none was found.
 UINT TImageCache::getUncompressedMemUsage(const std::string &id) const {
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) return it->second->getSize();
-
-  it = m_imp->m_compressedItems.find(id);
-  if (it != m_imp->m_compressedItems.end()) return it->second->getSize();
-
-  return 0;
+  return getMemUsage(id);
 }
 
 //------------------------------------------------------------------------------
-
 /*
 int TImageCache::getItemCount() const
 {
@@ -1828,10 +2035,14 @@ UINT TImageCache::getDiskUsage(const std::string &id) const { return 0; }
 
 void TImageCache::dump(std::ostream &os) const {
   os << "mem: " << getMemUsage() << std::endl;
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.begin();
-  for (; it != m_imp->m_uncompressedItems.end(); ++it) {
-    os << it->first << std::endl;
+  for (int i = 0; i < Imp::shardsCount; ++i) {
+    Imp::Shard &shard = m_imp->m_shards[i];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    Imp::Items::iterator it = shard.m_uncompressedItems.begin();
+    for (; it != shard.m_uncompressedItems.end(); ++it) {
+      os << it->first << std::endl;
+    }
   }
 }
 
@@ -1844,11 +2055,12 @@ void TImageCache::outputMap(UINT chunkRequested, std::string filename) {
 //------------------------------------------------------------------------------
 
 void TImageCache::Imp::outputMap(UINT chunkRequested, std::string filename) {
-  TThread::MutexLocker sl(&m_mutex);
+  ShardsLocker locker(this);
   //#ifdef _DEBUG
   // static int Count = 0;
 
   std::string st = filename /*+toString(Count++)*/ + ".txt";
+
   TFilePath fp(st);
   Tofstream os(fp);
 
@@ -1868,37 +2080,42 @@ void TImageCache::Imp::outputMap(UINT chunkRequested, std::string filename) {
   TUINT64 umsize  = 0;
   TUINT64 udsize  = 0;
 
-  std::map<std::string, CacheItemP>::iterator itu = m_uncompressedItems.begin();
-
-  for (; itu != m_uncompressedItems.end(); ++itu) {
-    UncompressedOnMemoryCacheItemP uitem = itu->second;
-    if (uitem->m_image && hasExternalReferences(uitem->m_image)) {
-      umcount1++;
-      umsize1 += (TUINT64)(itu->second->getSize() / 1024.0);
-    } else if (uitem->m_cantCompress) {
-      umcount2++;
-      umsize2 += (TUINT64)(itu->second->getSize() / 1024.0);
-    } else {
-      umcount3++;
-      umsize3 += (TUINT64)(itu->second->getSize() / 1024.0);
+  for (int i = 0; i < shardsCount; ++i) {
+    Shard &shard = m_shards[i];
+
+    Items::iterator itu = shard.m_uncompressedItems.begin();
+
+    for (; itu != shard.m_uncompressedItems.end(); ++itu) {
+      UncompressedOnMemoryCacheItemP uitem = itu->second;
+      if (uitem->m_image && hasExternalReferences(uitem->m_image)) {
+        umcount1++;
+        umsize1 += (TUINT64)(itu->second->getSize() / 1024.0);
+      } else if (uitem->m_cantCompress) {
+        umcount2++;
+        umsize2 += (TUINT64)(itu->second->getSize() / 1024.0);
+      } else {
+        umcount3++;
+        umsize3 += (TUINT64)(itu->second->getSize() / 1024.0);
+      }
     }
-  }
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for (; itc != m_compressedItems.end(); ++itc) {
-    CacheItemP boh                      = itc->second;
-    CompressedOnMemoryCacheItemP cmitem = itc->second;
-    CompressedOnDiskCacheItemP cditem   = itc->second;
-    UncompressedOnDiskCacheItemP uditem = itc->second;
-    if (cmitem) {
-      cmcount++;
-      cmsize += cmitem->getSize();
-    } else if (cditem) {
-      cdcount++;
-      cdsize += cditem->getSize();
-    } else {
-      assert(uditem);
-      udcount++;
-      udsize += uditem->getSize();
+
+    Items::iterator itc = shard.m_compressedItems.begin();
+    for (; itc != shard.m_compressedItems.end(); ++itc) {
+      CacheItemP boh                      = itc->second;
+      CompressedOnMemoryCacheItemP cmitem = itc->second;
+      CompressedOnDiskCacheItemP cditem   = itc->second;
+      UncompressedOnDiskCacheItemP uditem = itc->second;
+      if (cmitem) {
+        cmcount++;
+        cmsize += cmitem->getSize();
+      } else if (cditem) {
+        cdcount++;
+        cdsize += cditem->getSize();
+      } else {
+        assert(uditem);
+        udcount++;
+        udsize += uditem->getSize();
+      }
     }
   }
 
@@ -1947,6 +2164,66 @@ void TImageCache::compress(const std::string &id) { m_imp->doCompress(id); }
 
 //------------------------------------------------------------------------------
 
+void TImageCache::setMemoryWatermarks(int highMB, int lowMB) {
+  highMB = std::max(highMB, 0);
+  lowMB  = (lowMB > 0) ? std::min(lowMB, highMB) : highMB;
+
+  m_imp->m_highWatermark = highMB * (TINT64)(1 << 20);
+  m_imp->m_lowWatermark  = lowMB * (TINT64)(1 << 20);
+
+  m_imp->requestCompression();
+}
+
+//------------------------------------------------------------------------------
+
+void TImageCache::getMemoryWatermarks(int &highMB, int &lowMB) const {
+  highMB = (int)(m_imp->m_highWatermark >> 20);
+  lowMB  = (int)(m_imp->m_lowWatermark >> 20);
+}
+
+//------------------------------------------------------------------------------
+
+void TImageCache::setReloadable(const std::string &id, bool reloadable) {
+  Imp::Shard &shard = m_imp->getShard(id);
+  TThread::MutexLocker sl(&shard.m_mutex);
+
+  Imp::Items::iterator it = shard.m_uncompressedItems.find(id);
+  if (it != shard.m_uncompressedItems.end())
+    it->second->m_reloadable = reloadable;
+
+  it = shard.m_compressedItems.find(id);
+  if (it != shard.m_compressedItems.end())
+    it->second->m_reloadable = reloadable;
+}
+
+//------------------------------------------------------------------------------
+
+TImageCache::Statistics TImageCache::getStatistics() const {
+  QMutexLocker locker(&m_imp->m_statsMutex);
+  return m_imp->m_stats;
+}
+
+//------------------------------------------------------------------------------
+
+void TImageCache::resetStatistics() {
+  QMutexLocker locker(&m_imp->m_statsMutex);
+  m_imp->m_stats = Statistics();
+}
+
+//------------------------------------------------------------------------------
+
+std::string TImageCache::getStatisticsString() const {
+  Statistics stats = getStatistics();
+
+  return "Image cache: " + std::to_string(stats.m_compressions) +
+         " compressed, " + std::to_string(stats.m_spills) +
+         " moved to disk, " + std::to_string(stats.m_drops) + " released, " +
+         std::to_string(stats.m_backgroundPasses) + " background and " +
+         std::to_string(stats.m_inlinePasses) + " inline passes";
+}
+
+//------------------------------------------------------------------------------
+
 #ifndef TNZCORE_LIGHT
 
 void TImageCache::add(const QString &id, const TImageP &img, bool overwrite) {
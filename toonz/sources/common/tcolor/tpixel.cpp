@@ -5,6 +5,7 @@
 
 const int TPixelRGBM32::maxChannelValue = 0xff;
 const int TPixelRGBM64::maxChannelValue = 0xffff;
+const float TPixelRGBMF::maxChannelValue = 1.f;
 const int TPixelGR8::maxChannelValue    = 0xff;
 const int TPixelGR16::maxChannelValue   = 0xffff;
 
@@ -31,6 +32,17 @@ const TPixelRGBM64 TPixelRGBM64::White(maxChannelValue, maxChannelValue,
 const TPixelRGBM64 TPixelRGBM64::Black(0, 0, 0);
 const TPixelRGBM64 TPixelRGBM64::Transparent(0, 0, 0, 0);
 //---------------------------------------------------
+const TPixelRGBMF TPixelRGBMF::Red(maxChannelValue, 0, 0);
+const TPixelRGBMF TPixelRGBMF::Green(0, maxChannelValue, 0);
+const TPixelRGBMF TPixelRGBMF::Blue(0, 0, maxChannelValue);
+const TPixelRGBMF TPixelRGBMF::Yellow(maxChannelValue, maxChannelValue, 0);
+const TPixelRGBMF TPixelRGBMF::Cyan(0, maxChannelValue, maxChannelValue);
+const TPixelRGBMF TPixelRGBMF::Magenta(maxChannelValue, 0, maxChannelValue);
+const TPixelRGBMF TPixelRGBMF::White(maxChannelValue, maxChannelValue,
+                                     maxChannelValue);
+const TPixelRGBMF TPixelRGBMF::Black(0, 0, 0);
+const TPixelRGBMF TPixelRGBMF::Transparent(0, 0, 0, 0);
+//---------------------------------------------------
 const TPixelD TPixelD::Red(1, 0, 0);
 const TPixelD TPixelD::Green(0, 1, 0);
 const TPixelD TPixelD::Blue(0, 0, 1);
@@ -348,6 +348,59 @@ TPixelD toPixelD(const TPixelGR8 &src) {
   return TPixelD(v, v, v);
 }
 
+//-----------------------------------------------------------------------------
+
+TPixelD toPixelD(const TPixelF &src) {
+  return TPixelD(src.r, src.g, src.b, src.m);
+}
+
+//-----------------------------------------------------------------------------
+
+TPixel32 toPixel32(const TPixelF &src) {
+  const float factor = 255.f;
+  return TPixel32(
+      byteCrop(tround(src.r * factor)), byteCrop(tround(src.g * factor)),
+      byteCrop(tround(src.b * factor)), byteCrop(tround(src.m * factor)));
+}
+
+//-----------------------------------------------------------------------------
+
+TPixel64 toPixel64(const TPixelF &src) {
+  const float factor = 65535.f;
+  return TPixel64(
+      wordCrop(tround(src.r * factor)), wordCrop(tround(src.g * factor)),
+      wordCrop(tround(src.b * factor)), wordCrop(tround(src.m * factor)));
+}
+
+//-----------------------------------------------------------------------------
+
+TPixelF toPixelF(const TPixel32 &src) {
+  const float factor = 1.f / 255.f;
+  return TPixelF(factor * src.r, factor * src.g, factor * src.b,
+                 factor * src.m);
+}
+
+//-----------------------------------------------------------------------------
+
+TPixelF toPixelF(const TPixel64 &src) {
+  const float factor = 1.f / 65535.f;
+  return TPixelF(factor * src.r, factor * src.g, factor * src.b,
+                 factor * src.m);
+}
+
+//-----------------------------------------------------------------------------
+
+TPixelF toPixelF(const TPixelD &src) {
+  return TPixelF(src.r, src.g, src.b, src.m);
+}
+
+//-----------------------------------------------------------------------------
+
+TPixelF toPixelF(const TPixelGR8 &src) {
+  const float v = (float)src.value / 255.f;
+  return TPixelF(v, v, v);
+}
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
@@ -15,6 +15,10 @@
 // STL includes
 #include <set>
 #include <deque>
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <algorithm>
 
 // tcg includes
 #include "tcg/tcg_pool.h"
@@ -167,7 +171,10 @@ void TThread::init() {
 
 //---------------------------------------------------------------------
 
-void TThread::shutdown() { Executor::shutdown(); }
+void TThread::shutdown() {
+  Executor::shutdown();
+  WorkStealingPool::shutdown();
+}
 
 //==============================================================================
 
@@ -230,6 +237,9 @@ public:
   int m_activeLoad;
   int m_maxActiveLoad;
 
+  int m_activeMemory;  //!< In MB
+  int m_maxActiveMemory;
+
   bool m_dedicatedThreads;
   bool m_persistentThreads;
   std::deque<Worker *> m_sleepings;
@@ -279,6 +289,81 @@ public:
 
 //=====================================================================
 
+//===============================
+//    WorkStealingPool class
+//-------------------------------
+
+//! WorkStealingPool dispatches the subtasks submitted through TaskGroup
+//! and parallelFor(). It is completely independent from ExecutorImp - in
+//! particular, it never locks the transition mutex.
+//! Each worker owns a queue: subtasks forked by a worker are pushed to and
+//! popped from the back of its own queue (so the most recent, cache-hot ones
+//! run first), while thieves take the oldest - typically largest - ones from
+//! the front. Subtasks submitted by external threads are spread among the
+//! workers' queues.
+//! Executor's workers running a task, and pool workers running subtasks, are
+//! counted as busy threads. Pool workers only take subtasks while the busy
+//! threads are fewer than the cores, so that forking from Executor tasks
+//! does not oversubscribe the machine - the subtasks left are run by the
+//! threads waiting for them.
+class WorkStealingPool {
+public:
+  struct Task {
+    std::function<void()> m_func;
+    TaskGroup::Imp *m_group;
+  };
+
+  class Worker final : public QThread {
+  public:
+    WorkStealingPool *m_pool;
+    int m_index;
+
+    QMutex m_mutex;  // Guards m_tasks
+    std::deque<Task *> m_tasks;
+
+    Worker(WorkStealingPool *pool, int index) : m_pool(pool), m_index(index) {}
+
+    void run() override;
+  };
+
+  std::vector<Worker *> m_workers;
+
+  std::atomic<int> m_queuedCount;    // Tasks waiting in the queues
+  std::atomic<int> m_sleepingCount;  // Workers waiting on m_wakeCondition
+  std::atomic<unsigned int> m_nextQueue;
+  std::atomic<bool> m_exit;
+  int m_maxBusyCount;
+
+  QMutex m_sleepMutex;
+  QWaitCondition m_wakeCondition;   // Idle workers wait here
+  QWaitCondition m_groupCondition;  // TaskGroup::wait() callers wait here
+
+  WorkStealingPool(int workersCount);
+
+  static WorkStealingPool *instance();
+  static WorkStealingPool *existingInstance();
+  static void shutdown();
+
+  static Worker *currentWorker();
+
+  //! Scoped busy state of a thread outside the pool
+  struct BusyThread {
+    BusyThread() { threadBusy(); }
+    ~BusyThread() { threadIdle(); }
+  };
+
+  static void threadBusy();
+  static void threadIdle();
+  bool acquireThread();
+  void wakeWorker();
+
+  void push(Task *task);
+  Task *take(Worker *worker, TaskGroup::Imp *group = 0);
+  void execute(Task *task);
+};
+
+//=====================================================================
+
 }  // namespace TThread
 
 //=====================================================================
@@ -291,6 +376,13 @@ namespace {
 ExecutorImp *globalImp           = 0;
 ExecutorImpSlots *globalImpSlots = 0;
 bool shutdownVar                 = false;
+
+std::atomic<WorkStealingPool *> globalPool(0);
+QMutex globalPoolMutex;
+bool poolShutdownVar = false;
+
+// Threads busy with either Executor tasks or pool subtasks
+std::atomic<int> busyThreadsCount(0);
 }
 
 //=====================================================================
@@ -332,7 +424,8 @@ inline void ExecutorImp::insertTask(int schedulingPriority, RunnableP &task) {
 //    Runnable methods
 //------------------------
 
-Runnable::Runnable() : TSmartObject(m_classCode), m_id(0) {}
+Runnable::Runnable()
+    : TSmartObject(m_classCode), m_id(0), m_load(0), m_memory(0) {}
 
 //---------------------------------------------------------------------
 
@@ -387,6 +480,17 @@ int Runnable::taskLoad() { return 0; }
 
 //---------------------------------------------------------------------
 
+//! Returns the predicted peak memory of the task, in MB. It is accounted
+//! against the limit set with Executor::setMaxActiveMemory(), which admits
+//! a task only if its memory fits together with the other active tasks' of
+//! the same Executor. A task whose memory exceeds the limit on its own is
+//! still started, once no other task of its Executor is active.
+//! As with the load, the value is considered constant for the duration of
+//! the task. The default is 0, meaning the task is not accounted.
+int Runnable::taskMemory() { return 0; }
+
+//---------------------------------------------------------------------
+
 //! Returns the priority value used to schedule a task for execution. Tasks
 //! with higher priority start before tasks with lower priority. The default
 //! value returned is 5 (halfway from 0 to 10) - but any value other than
@@ -405,7 +509,9 @@ QThread::Priority Runnable::runningPriority() {
 
 inline bool Runnable::customConditions() {
   return (m_id->m_activeTasks < m_id->m_maxActiveTasks) &&
-         (m_id->m_activeLoad + m_load <= m_id->m_maxActiveLoad);
+         (m_id->m_activeLoad + m_load <= m_id->m_maxActiveLoad) &&
+         (m_memory <= 0 || m_id->m_activeMemory == 0 ||
+          m_id->m_activeMemory + m_memory <= m_id->m_maxActiveMemory);
 }
 
 /*!
@@ -517,6 +623,8 @@ ExecutorId::ExecutorId()
     , m_maxActiveTasks(1)
     , m_activeLoad(0)
     , m_maxActiveLoad((std::numeric_limits<int>::max)())
+    , m_activeMemory(0)
+    , m_maxActiveMemory((std::numeric_limits<int>::max)())
     , m_dedicatedThreads(false)
     , m_persistentThreads(false) {
   QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
@@ -588,7 +696,10 @@ void Worker::run() {
       Q_EMIT m_task->started(m_task);
       sl.unlock();
 
-      m_task->run();
+      {
+        WorkStealingPool::BusyThread busy;
+        m_task->run();
+      }
 
       sl.relock();
       Q_EMIT m_task->finished(m_task);
@@ -625,6 +736,7 @@ void Worker::run() {
 inline void Worker::updateCountsOnTake() {
   globalImp->m_activeLoad += m_task->m_load;
   m_task->m_id->m_activeLoad += m_task->m_load;
+  m_task->m_id->m_activeMemory += m_task->m_memory;
   ++m_task->m_id->m_activeTasks;
 }
 
@@ -633,6 +745,7 @@ inline void Worker::updateCountsOnTake() {
 inline void Worker::updateCountsOnRelease() {
   globalImp->m_activeLoad -= m_task->m_load;
   m_task->m_id->m_activeLoad -= m_task->m_load;
+  m_task->m_id->m_activeMemory -= m_task->m_memory;
   --m_task->m_id->m_activeTasks;
 }
 
@@ -927,6 +1040,28 @@ int Executor::maxActiveLoad() const {
   return m_id->m_maxActiveLoad;
 }
 
+//---------------------------------------------------------------------
+
+//! Declares the maximum overall memory, in MB, of the active tasks added by
+//! this Executor - see Runnable::taskMemory(). A non-positive value removes
+//! the limit.
+//! \b NOTE: The same remark for setMaxActiveTasks() holds here.
+void Executor::setMaxActiveMemory(int maxActiveMemory) {
+  QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
+
+  if (maxActiveMemory <= 0)
+    m_id->m_maxActiveMemory = (std::numeric_limits<int>::max)();
+  else
+    m_id->m_maxActiveMemory = maxActiveMemory;
+}
+
+//---------------------------------------------------------------------
+
+int Executor::maxActiveMemory() const {
+  QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
+  return m_id->m_maxActiveMemory;
+}
+
 //=====================================================================
 
 //==================================
@@ -1038,6 +1173,7 @@ void ExecutorImp::refreshAssignments() {
     // Take the task
     RunnableP task = it.value();
     task->m_load   = task->taskLoad();
+    task->m_memory = task->taskMemory();
 
     UCHAR &idWaitingForAnotherTask = m_waitingFlagsPool[task->m_id->m_id];
     if (idWaitingForAnotherTask) continue;
@@ -1108,6 +1244,7 @@ inline void Worker::takeTask() {
     // Take the first task
     RunnableP task = it.value();
     task->m_load   = task->taskLoad();
+    task->m_memory = task->taskMemory();
 
     UCHAR &idWaitingForAnotherTask = waitingFlagsPool[task->m_id->m_id];
     if (idWaitingForAnotherTask) continue;
@@ -1135,3 +1272,400 @@ inline void Worker::takeTask() {
     }
   }
 }
+
+//=====================================================================
+
+//=============================
+//    TaskGroup::Imp class
+//-----------------------------
+
+class TThread::TaskGroup::Imp {
+public:
+  std::atomic<int> m_pendingCount;  // Tasks submitted and not yet done
+  std::atomic<int> m_queuedCount;   // Tasks submitted and not yet taken
+  std::atomic<bool> m_waiting;      // Whether wait() is sleeping
+
+  QMutex m_exceptionMutex;
+  std::exception_ptr m_exception;
+
+  Imp() : m_pendingCount(0), m_queuedCount(0), m_waiting(false) {}
+
+  void setException(std::exception_ptr exception) {
+    QMutexLocker locker(&m_exceptionMutex);
+    if (!m_exception) m_exception = exception;
+  }
+};
+
+//=====================================================================
+
+//==================================
+//    WorkStealingPool methods
+//----------------------------------
+
+WorkStealingPool::WorkStealingPool(int workersCount)
+    : m_queuedCount(0)
+    , m_sleepingCount(0)
+    , m_nextQueue(0)
+    , m_exit(false)
+    , m_maxBusyCount(workersCount + 1) {
+  for (int i = 0; i < workersCount; ++i) {
+    Worker *worker = new Worker(this, i);
+    m_workers.push_back(worker);
+  }
+
+  for (Worker *worker : m_workers) worker->start();
+}
+
+//---------------------------------------------------------------------
+
+//! Returns the pool, allocating it on first use. The calling thread always
+//! takes part in the computation, so one core is left to it. Returns 0 on
+//! single-core machines and after shutdown().
+WorkStealingPool *WorkStealingPool::instance() {
+  WorkStealingPool *pool = globalPool.load();
+  if (pool) return pool->m_exit ? 0 : pool;
+
+  QMutexLocker locker(&globalPoolMutex);
+
+  pool = globalPool.load();
+  if (!pool && !poolShutdownVar) {
+    int workersCount = TSystem::getProcessorCount() - 1;
+    if (workersCount < 1) return 0;
+
+    pool = new WorkStealingPool(workersCount);
+    globalPool.store(pool);
+  }
+
+  return (pool && !pool->m_exit) ? pool : 0;
+}
+
+//---------------------------------------------------------------------
+
+//! Returns the pool if it was allocated, even after shutdown() - waiting
+//! threads still need to drain the queues.
+WorkStealingPool *WorkStealingPool::existingInstance() {
+  return globalPool.load();
+}
+
+//---------------------------------------------------------------------
+
+//! Makes the workers quit. Tasks already queued are processed by the
+//! threads waiting on their groups; tasks submitted later run inline.
+//! As in Executor::shutdown(), workers are not waited for.
+void WorkStealingPool::shutdown() {
+  QMutexLocker locker(&globalPoolMutex);
+
+  poolShutdownVar = true;
+
+  WorkStealingPool *pool = globalPool.load();
+  if (pool) {
+    QMutexLocker sleepLocker(&pool->m_sleepMutex);
+    pool->m_exit = true;
+    pool->m_wakeCondition.wakeAll();
+  }
+}
+
+//---------------------------------------------------------------------
+
+WorkStealingPool::Worker *WorkStealingPool::currentWorker() {
+  return dynamic_cast<Worker *>(QThread::currentThread());
+}
+
+//---------------------------------------------------------------------
+
+void WorkStealingPool::threadBusy() { ++busyThreadsCount; }
+
+//---------------------------------------------------------------------
+
+void WorkStealingPool::threadIdle() {
+  --busyThreadsCount;
+
+  WorkStealingPool *pool = globalPool.load();
+  if (pool && pool->m_sleepingCount > 0) {
+    QMutexLocker sleepLocker(&pool->m_sleepMutex);
+    pool->wakeWorker();
+  }
+}
+
+//---------------------------------------------------------------------
+
+//! Counts the calling pool worker as busy, unless all cores already are.
+bool WorkStealingPool::acquireThread() {
+  int count = busyThreadsCount;
+  while (count < m_maxBusyCount)
+    if (busyThreadsCount.compare_exchange_weak(count, count + 1)) return true;
+
+  return false;
+}
+
+//---------------------------------------------------------------------
+
+//! Wakes a sleeping worker, if there is work for it. Requires m_sleepMutex.
+void WorkStealingPool::wakeWorker() {
+  if (m_sleepingCount > 0 && m_queuedCount > 0) m_wakeCondition.wakeOne();
+}
+
+//---------------------------------------------------------------------
+
+void WorkStealingPool::push(Task *task) {
+  TaskGroup::Imp *group = task->m_group;
+
+  Worker *worker = currentWorker();
+  if (!worker || worker->m_pool != this)
+    worker = m_workers[m_nextQueue++ % m_workers.size()];
+
+  ++group->m_queuedCount;
+  ++m_queuedCount;
+
+  {
+    QMutexLocker locker(&worker->m_mutex);
+    worker->m_tasks.push_back(task);
+  }
+
+  // Sleepers announce themselves under m_sleepMutex *before* checking the
+  // queued counts - so either they see our task, or we see them
+  bool wakeWorker = (m_sleepingCount > 0), wakeWaiter = group->m_waiting;
+
+  if (wakeWorker || wakeWaiter) {
+    QMutexLocker sleepLocker(&m_sleepMutex);
+
+    if (wakeWorker) m_wakeCondition.wakeOne();
+    if (wakeWaiter) m_groupCondition.wakeAll();
+  }
+}
+
+//---------------------------------------------------------------------
+
+//! Takes a task from the back of the specified worker's queue, or steals one
+//! from the front of the others'. \b worker may be 0 for external threads.
+//! If \b group is specified, only its tasks are taken.
+WorkStealingPool::Task *WorkStealingPool::take(Worker *worker,
+                                               TaskGroup::Imp *group) {
+  if (m_queuedCount == 0) return 0;
+
+  Task *task = 0;
+
+  if (worker) {
+    QMutexLocker locker(&worker->m_mutex);
+
+    std::deque<Task *> &tasks = worker->m_tasks;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it)
+      if (!group || (*it)->m_group == group) {
+        task = *it;
+        tasks.erase(std::next(it).base());
+        break;
+      }
+  }
+
+  if (!task) {
+    int w, workersCount = m_workers.size();
+    int first = worker ? worker->m_index + 1 : m_nextQueue.load();
+
+    for (w = 0; w < workersCount && !task; ++w) {
+      Worker *victim = m_workers[(first + w) % workersCount];
+      if (victim == worker) continue;
+
+      QMutexLocker locker(&victim->m_mutex);
+
+      std::deque<Task *> &tasks = victim->m_tasks;
+      for (auto it = tasks.begin(); it != tasks.end(); ++it)
+        if (!group || (*it)->m_group == group) {
+          task = *it;
+          tasks.erase(it);
+          break;
+        }
+    }
+  }
+
+  if (task) {
+    --task->m_group->m_queuedCount;
+    --m_queuedCount;
+  }
+
+  return task;
+}
+
+//---------------------------------------------------------------------
+
+void WorkStealingPool::execute(Task *task) {
+  TaskGroup::Imp *group = task->m_group;
+
+  try {
+    task->m_func();
+  } catch (...) {
+    group->setException(std::current_exception());
+  }
+
+  delete task;
+
+  // The group may be destroyed as soon as its count reaches zero
+  if (--group->m_pendingCount == 0) {
+    QMutexLocker sleepLocker(&m_sleepMutex);
+    m_groupCondition.wakeAll();
+  }
+}
+
+//---------------------------------------------------------------------
+
+void WorkStealingPool::Worker::run() {
+  for (;;) {
+    if (m_pool->acquireThread()) {
+      while (Task *task = m_pool->take(this)) m_pool->execute(task);
+      --busyThreadsCount;
+    }
+
+    // Sleepers announce themselves *before* checking the counts - see
+    // push() and threadIdle()
+    QMutexLocker sleepLocker(&m_pool->m_sleepMutex);
+    if (m_pool->m_exit) return;
+
+    ++m_pool->m_sleepingCount;
+    if (m_pool->m_queuedCount == 0 ||
+        busyThreadsCount >= m_pool->m_maxBusyCount)
+      m_pool->m_wakeCondition.wait(&m_pool->m_sleepMutex);
+    --m_pool->m_sleepingCount;
+  }
+}
+
+//=====================================================================
+
+//===========================
+//    TaskGroup methods
+//---------------------------
+
+TaskGroup::TaskGroup() : m_imp(new Imp) {}
+
+//---------------------------------------------------------------------
+
+TaskGroup::~TaskGroup() {
+  try {
+    wait();
+  } catch (...) {
+  }
+}
+
+//---------------------------------------------------------------------
+
+void TaskGroup::run(const std::function<void()> &task) {
+  WorkStealingPool *pool = WorkStealingPool::instance();
+  if (!pool) {
+    // No pool to submit to - just run it here
+    try {
+      task();
+    } catch (...) {
+      m_imp->setException(std::current_exception());
+    }
+    return;
+  }
+
+  ++m_imp->m_pendingCount;
+
+  WorkStealingPool::Task *poolTask = new WorkStealingPool::Task;
+  poolTask->m_func                 = task;
+  poolTask->m_group                = m_imp.get();
+
+  pool->push(poolTask);
+}
+
+//---------------------------------------------------------------------
+
+void TaskGroup::wait() {
+  WorkStealingPool *pool = WorkStealingPool::existingInstance();
+  WorkStealingPool::Worker *worker =
+      pool ? WorkStealingPool::currentWorker() : 0;
+
+  if (worker && worker->m_pool != pool) worker = 0;
+
+  // Whether the calling thread counts as busy (see WorkStealingPool)
+  bool busyThread =
+      worker || dynamic_cast<TThread::Worker *>(QThread::currentThread());
+
+  while (m_imp->m_pendingCount > 0) {
+    // Help with our queued tasks. Others' are left alone, since the caller
+    // may be holding locks that they need.
+    if (WorkStealingPool::Task *task = pool->take(worker, m_imp.get())) {
+      pool->execute(task);
+      continue;
+    }
+
+    // Our remaining tasks are running elsewhere. Sleep until either they
+    // complete or they fork some new task.
+    QMutexLocker sleepLocker(&pool->m_sleepMutex);
+
+    m_imp->m_waiting = true;
+    if (m_imp->m_pendingCount > 0 && m_imp->m_queuedCount == 0) {
+      // Leave our core to the pool meanwhile
+      if (busyThread) {
+        --busyThreadsCount;
+        pool->wakeWorker();
+      }
+
+      pool->m_groupCondition.wait(&pool->m_sleepMutex);
+
+      if (busyThread) ++busyThreadsCount;
+    }
+    m_imp->m_waiting = false;
+  }
+
+  std::exception_ptr exception;
+  {
+    QMutexLocker locker(&m_imp->m_exceptionMutex);
+    std::swap(exception, m_imp->m_exception);
+  }
+
+  if (exception) std::rethrow_exception(exception);
+}
+
+//=====================================================================
+
+//===========================
+//    parallelFor function
+//---------------------------
+
+namespace {
+
+//! Recursively halves a range, forking the upper halves as subtasks and
+//! processing the last lower one directly
+struct RangeSplitter {
+  TaskGroup &m_group;
+  const std::function<void(int, int)> &m_func;
+  int m_grain;
+
+  RangeSplitter(TaskGroup &group, const std::function<void(int, int)> &func,
+                int grain)
+      : m_group(group), m_func(func), m_grain(grain) {}
+
+  void operator()(int begin, int end) const {
+    while (end - begin > m_grain) {
+      int mid = begin + (end - begin) / 2;
+
+      RangeSplitter splitter(*this);
+      m_group.run([splitter, mid, end]() { splitter(mid, end); });
+
+      end = mid;
+    }
+
+    m_func(begin, end);
+  }
+};
+
+}  // namespace
+
+//---------------------------------------------------------------------
+
+void TThread::parallelFor(int begin, int end, int grain,
+                          const std::function<void(int, int)> &func) {
+  if (begin >= end) return;
+
+  grain = std::max(grain, 1);
+
+  if (end - begin <= grain || !WorkStealingPool::instance()) {
+    func(begin, end);
+    return;
+  }
+
+  TaskGroup group;
+  RangeSplitter(group, func, grain)(begin, end);
+
+  group.wait();
+}
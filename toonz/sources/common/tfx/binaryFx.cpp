@@ -45,6 +45,13 @@ public:
   virtual void process(const TRasterP &up, const TRasterP &down,
                        double frame) = 0;
 
+  //! The processing function receiving the 'up' raster along with its empty
+  //! tiles - by default, it just invokes process() on the dense raster.
+  virtual void processSparse(const TSparseRaster &up, const TRasterP &down,
+                             double frame) {
+    process(up.getRaster(), down, frame);
+  }
+
   //! Whether the 'up' rasters of process() invocations must be allocated to
   //! entirely cover the 'down' counterpart. Should be enabled if the process()
   //! function affects 'down' pixels when the 'up's are fully transparent.
@@ -179,7 +186,8 @@ void TImageCombinationFx::doCompute(TTile &tile, double frame,
                                   tile.getRaster(), frame, info);
 
       // Invoke process() to deal with the actual fx processing
-      TRasterP up(inTile.getRaster()), down(tile.getRaster());
+      TSparseRaster up(inTile.getSparseRaster());
+      TRasterP down(tile.getRaster());
 
       if (canRestrict) {
         // Extract from tile the part corresponding to inTile
@@ -187,9 +195,10 @@ void TImageCombinationFx::doCompute(TTile &tile, double frame,
         down = down->extract(downRect);
       }
 
-      assert(up->getSize() == down->getSize());
-      process(up, down, frame);  // This is the point with the max concentration
-                                 // of allocated resources
+      assert(up.getRaster()->getSize() == down->getSize());
+      processSparse(up, down,
+                    frame);  // This is the point with the max concentration
+                             // of allocated resources
     }
   }
 }
@@ -257,10 +266,17 @@ class OverFx final : public TImageCombinationFx {
 public:
   OverFx() { setName(L"OverFx"); }
 
+  bool canComputeInFloat() const override { return true; }
+
   void process(const TRasterP &up, const TRasterP &down,
                double frame) override {
     TRop::over(down, up);
   }
+
+  void processSparse(const TSparseRaster &up, const TRasterP &down,
+                     double frame) override {
+    TRop::over(down, up);
+  }
 };
 
 //==================================================================
@@ -136,6 +136,8 @@ inline int getRasterType(const TRasterP &ras) {
     return TCacheResource::RGBM64;
   else if ((TRasterCM32P)ras)
     return TCacheResource::CM32;
+  else if ((TRasterFP)ras)
+    return TCacheResource::RGBMF;
 
   return TCacheResource::NONE;
 }
@@ -210,6 +212,8 @@ inline void loadCompressed(const TFilePath &fp, TRasterP &ras,
     ras = TRaster32P(latticeStep, latticeStep);
   else if (rasType == TCacheResource::RGBM64)
     ras = TRaster64P(latticeStep, latticeStep);
+  else if (rasType == TCacheResource::RGBMF)
+    ras = TRasterFP(latticeStep, latticeStep);
   else
     assert(false);
 
@@ -338,6 +342,8 @@ TRasterP TCacheResource::buildCompatibleRaster(const TDimension &size) {
     result = TRaster64P(size);
   else if (m_tileType == CM32)
     result = TRasterCM32P(size);
+  else if (m_tileType == RGBMF)
+    result = TRasterFP(size);
 
   return result;
 }
@@ -396,6 +402,9 @@ inline TRasterP TCacheResource::createCellRaster(int rasterType,
   } else if (rasterType == TCacheResource::CM32) {
     result = TRasterCM32P(latticeStep, latticeStep);
     img    = TToonzImageP(result, result->getBounds());
+  } else if (rasterType == TCacheResource::RGBMF) {
+    result = TRasterFP(latticeStep, latticeStep);
+    img    = TRasterImageP(result);
   }
 
   TImageCache::instance()->add(cacheId, img);
@@ -791,9 +800,12 @@ int TCacheResource::size() const {
   // NOTE: It's better to store the size incrementally. This complies
   // with the possibility of specifying a bbox to fit the stored cells to...
 
-  return m_tileType == NONE ? 0
-                            : m_tileType == RGBM64 ? (m_cellsCount << 11)
-                                                   : (m_cellsCount << 10);
+  return m_tileType == NONE
+             ? 0
+             : m_tileType == RGBMF
+                   ? (m_cellsCount << 12)
+                   : m_tileType == RGBM64 ? (m_cellsCount << 11)
+                                          : (m_cellsCount << 10);
 }
 
 //****************************************************************************************************
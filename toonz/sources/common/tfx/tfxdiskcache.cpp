@@ -0,0 +1,423 @@
+#include "tfxdiskcache.h"
+
+// TnzCore includes
+#include "tsystem.h"
+#include "tcodec.h"
+#include "trastercm.h"
+#include "ttile.h"
+
+// Qt includes
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDirIterator>
+
+// STD includes
+#include <algorithm>
+
+//***************************************************************************************
+//    Local namespace  stuff
+//***************************************************************************************
+
+namespace {
+
+const quint32 entryMagic  = 0x43584654;  // "TFXC"
+const qint32 entryVersion = 1;
+
+// Offset of the access stamp, which is rewritten in place on each hit
+const qint64 accessStampOffset = 8;
+
+// Results computed faster than this (in milliseconds) are not stored
+const int minComputeTime = 20;
+
+// Eviction makes room for some more entries, not just for the last one
+const double evictionRatio = 0.9;
+
+const char *entryExtension = "fxc";
+
+//-----------------------------------------------------------------------------
+
+struct EntryHeader {
+  qint64 m_accessStamp;
+  qint32 m_rasType, m_lx, m_ly;
+  quint32 m_dataSize;
+};
+
+QDataStream &operator<<(QDataStream &ds, const EntryHeader &h) {
+  return ds << entryMagic << entryVersion << h.m_accessStamp << h.m_rasType
+            << h.m_lx << h.m_ly << h.m_dataSize;
+}
+
+bool readHeader(QDataStream &ds, EntryHeader &h) {
+  quint32 magic;
+  qint32 version;
+
+  ds >> magic >> version;
+  if (magic != entryMagic || version != entryVersion) return false;
+
+  ds >> h.m_accessStamp >> h.m_rasType >> h.m_lx >> h.m_ly >> h.m_dataSize;
+  return ds.status() == QDataStream::Ok;
+}
+
+//-----------------------------------------------------------------------------
+
+//! Stamps the access to an entry, for eviction purposes. This is just a
+//! hint: entries in read-only or shared caches keep their stamp.
+void stampAccess(const QString &entryPath) {
+  QFile file(entryPath);
+  if (!file.open(QIODevice::ReadWrite) || !file.seek(accessStampOffset))
+    return;
+
+  QDataStream ds(&file);
+  ds << (qint64)QDateTime::currentMSecsSinceEpoch();
+}
+
+//-----------------------------------------------------------------------------
+
+//! Returns a tag identifying the pixel type of the raster, or 0 if it cannot
+//! be stored.
+qint32 rasterType(const TRasterP &ras) {
+  if (TRaster32P(ras)) return 1;
+  if (TRaster64P(ras)) return 2;
+  if (TRasterCM32P(ras)) return 3;
+  if (TRasterFP(ras)) return 4;
+
+  return 0;
+}
+
+}  // namespace
+
+//***************************************************************************************
+//    TFxDiskCache  implementation
+//***************************************************************************************
+
+TFxDiskCache::TFxDiskCache() : m_maxSize(0), m_size(0) {}
+
+//-----------------------------------------------------------------------------
+
+TFxDiskCache *TFxDiskCache::instance() {
+  static TFxDiskCache theInstance;
+  return &theInstance;
+}
+
+//-----------------------------------------------------------------------------
+
+void TFxDiskCache::setRootDir(const TFilePath &rootDir) {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_rootDir = rootDir;
+  }
+
+  updateSize();
+}
+
+//-----------------------------------------------------------------------------
+
+TFilePath TFxDiskCache::getRootDir() const {
+  QMutexLocker locker(&m_mutex);
+  return m_rootDir;
+}
+
+//-----------------------------------------------------------------------------
+
+void TFxDiskCache::setMaximumSize(int MB) {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_maxSize = std::max(MB, 0) * (TINT64)(1 << 20);
+  }
+
+  updateSize();
+}
+
+//-----------------------------------------------------------------------------
+
+int TFxDiskCache::getMaximumSize() const {
+  QMutexLocker locker(&m_mutex);
+  return (int)(m_maxSize >> 20);
+}
+
+//-----------------------------------------------------------------------------
+
+bool TFxDiskCache::isEnabled() const {
+  QMutexLocker locker(&m_mutex);
+  return !m_rootDir.isEmpty() && m_maxSize > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+TFilePath TFxDiskCache::getEntryPath(const TFxHash &key) const {
+  // Entries are spread in 256 subfolders, to keep folders small
+  std::string name = key.toString();
+  return m_rootDir + name.substr(0, 2) + (name + "." + entryExtension);
+}
+
+//-----------------------------------------------------------------------------
+
+bool TFxDiskCache::load(const TFxHash &key, TTile &tile) {
+  if (key.m_volatile || !isEnabled()) return false;
+
+  TRasterP ras   = tile.getRaster();
+  qint32 rasType = ::rasterType(ras);
+  if (!rasType) return false;
+
+  QString entryPath;
+  {
+    QMutexLocker locker(&m_mutex);
+    entryPath = getEntryPath(key).getQString();
+  }
+
+  auto readEntry = [&](QFile &file) -> bool {
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QDataStream ds(&file);
+
+    EntryHeader header;
+    if (!readHeader(ds, header) || header.m_rasType != rasType ||
+        header.m_lx != ras->getLx() || header.m_ly != ras->getLy())
+      return false;
+
+    // Truncated entries are discarded before allocating their data
+    if ((qint64)header.m_dataSize > file.size() - file.pos()) return false;
+
+    QByteArray data(header.m_dataSize, Qt::Uninitialized);
+    if (ds.readRawData(data.data(), data.size()) != data.size()) return false;
+
+    TRasterP entryRas;
+    try {
+      TRasterCodecLZO codec("LZO", false);
+      if (!codec.decompress((const UCHAR *)data.constData(), data.size(),
+                            entryRas, true))
+        return false;
+    } catch (...) {
+      return false;
+    }
+
+    if (::rasterType(entryRas) != rasType ||
+        entryRas->getSize() != ras->getSize())
+      return false;
+
+    ras->copy(entryRas);
+    return true;
+  };
+
+  QFile file(entryPath);
+  bool found = readEntry(file);
+  file.close();
+
+  if (found) stampAccess(entryPath);
+
+  QMutexLocker locker(&m_mutex);
+
+  if (found)
+    ++m_stats.m_hits, m_stats.m_readBytes += file.size();
+  else
+    ++m_stats.m_misses;
+
+  return found;
+}
+
+//-----------------------------------------------------------------------------
+
+void TFxDiskCache::store(const TFxHash &key, const TTile &tile,
+                         int computeTime) {
+  if (key.m_volatile || computeTime < minComputeTime || !isEnabled()) return;
+
+  TRasterP ras   = tile.getRaster();
+  qint32 rasType = ::rasterType(ras);
+  if (!rasType) return;
+
+  TFilePath entryPath;
+  {
+    QMutexLocker locker(&m_mutex);
+    entryPath = getEntryPath(key);
+  }
+
+  // The codec requires contiguous rows
+  if (ras->getWrap() != ras->getLx()) ras = ras->clone();
+
+  TINT32 dataSize;
+  TRasterCodecLZO codec("LZO", false);
+
+  TRasterP data = codec.compress(ras, 1, dataSize);
+  if (!data) return;
+
+  EntryHeader header;
+  header.m_accessStamp = QDateTime::currentMSecsSinceEpoch();
+  header.m_rasType     = rasType;
+  header.m_lx          = ras->getLx();
+  header.m_ly          = ras->getLy();
+  header.m_dataSize    = dataSize;
+
+  qint64 entrySize = 0;
+
+  try {
+    TSystem::touchParentDir(entryPath);
+  } catch (...) {
+    return;
+  }
+
+  // Write to a temporary file first, so readers never see partial entries
+  QSaveFile file(entryPath.getQString());
+  if (!file.open(QIODevice::WriteOnly)) return;
+
+  QDataStream ds(&file);
+  ds << header;
+
+  data->lock();
+  ds.writeRawData((const char *)data->getRawData(), dataSize);
+  data->unlock();
+
+  if (ds.status() != QDataStream::Ok) {
+    file.cancelWriting();
+    return;
+  }
+
+  entrySize = file.size();
+  if (!file.commit()) return;
+
+  bool overflow;
+  {
+    QMutexLocker locker(&m_mutex);
+
+    ++m_stats.m_stores;
+    m_stats.m_writtenBytes += entrySize;
+
+    m_size += entrySize;
+    overflow = (m_size > m_maxSize);
+  }
+
+  if (overflow) evict();
+}
+
+//-----------------------------------------------------------------------------
+
+void TFxDiskCache::updateSize() {
+  TFilePath rootDir;
+  {
+    QMutexLocker locker(&m_mutex);
+    rootDir = m_rootDir;
+  }
+
+  TINT64 size = 0;
+
+  if (!rootDir.isEmpty()) {
+    QDirIterator it(rootDir.getQString(),
+                    QStringList() << QString("*.") + entryExtension,
+                    QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+      it.next();
+      size += it.fileInfo().size();
+    }
+  }
+
+  bool overflow;
+  {
+    QMutexLocker locker(&m_mutex);
+
+    m_size   = size;
+    overflow = (m_maxSize > 0 && m_size > m_maxSize);
+  }
+
+  if (overflow) evict();
+}
+
+//-----------------------------------------------------------------------------
+
+void TFxDiskCache::evict() {
+  TFilePath rootDir;
+  TINT64 maxSize;
+  {
+    QMutexLocker locker(&m_mutex);
+    rootDir = m_rootDir;
+    maxSize = m_maxSize;
+  }
+
+  if (rootDir.isEmpty()) return;
+
+  struct Entry {
+    qint64 m_accessStamp, m_size;
+    QString m_path;
+
+    bool operator<(const Entry &other) const {
+      return m_accessStamp < other.m_accessStamp;
+    }
+  };
+
+  // Rescan the folder - other processes may be writing in it too
+  std::vector<Entry> entries;
+  TINT64 size = 0;
+
+  QDirIterator it(rootDir.getQString(),
+                  QStringList() << QString("*.") + entryExtension, QDir::Files,
+                  QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    Entry entry;
+    entry.m_path = it.next();
+    entry.m_size = it.fileInfo().size();
+
+    // Unreadable entries go first
+    entry.m_accessStamp = 0;
+
+    QFile file(entry.m_path);
+    if (file.open(QIODevice::ReadOnly)) {
+      QDataStream ds(&file);
+
+      EntryHeader header;
+      if (readHeader(ds, header)) entry.m_accessStamp = header.m_accessStamp;
+    }
+
+    size += entry.m_size;
+    entries.push_back(entry);
+  }
+
+  std::sort(entries.begin(), entries.end());
+
+  TINT64 targetSize = (TINT64)(maxSize * evictionRatio);
+  int evictions     = 0;
+
+  for (const Entry &entry : entries) {
+    if (size <= targetSize) break;
+
+    // Another process may have removed it already
+    if (QFile::remove(entry.m_path)) ++evictions;
+
+    size -= entry.m_size;
+  }
+
+  QMutexLocker locker(&m_mutex);
+
+  m_size = size;
+  m_stats.m_evictions += evictions;
+}
+
+//-----------------------------------------------------------------------------
+
+TFxDiskCache::Statistics TFxDiskCache::getStatistics() const {
+  QMutexLocker locker(&m_mutex);
+  return m_stats;
+}
+
+//-----------------------------------------------------------------------------
+
+void TFxDiskCache::resetStatistics() {
+  QMutexLocker locker(&m_mutex);
+  m_stats = Statistics();
+}
+
+//-----------------------------------------------------------------------------
+
+std::string TFxDiskCache::getStatisticsString() const {
+  Statistics stats = getStatistics();
+
+  TINT64 lookups = stats.m_hits + stats.m_misses;
+  int hitRate    = lookups ? (int)(100 * stats.m_hits / lookups) : 0;
+
+  return "Fx disk cache: " + std::to_string(stats.m_hits) + " hits, " +
+         std::to_string(stats.m_misses) + " misses (" +
+         std::to_string(hitRate) + "% hit rate), " +
+         std::to_string(stats.m_stores) + " stores, " +
+         std::to_string(stats.m_evictions) + " evictions, " +
+         std::to_string(stats.m_readBytes >> 20) + " MB read, " +
+         std::to_string(stats.m_writtenBytes >> 20) + " MB written";
+}
@@ -442,6 +442,27 @@ std::string TMacroFx::getAlias(double frame,
 
 //--------------------------------------------------
 
+TFxHash TMacroFx::buildAliasHash(double frame,
+                                 const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  // Parameters of the contained fxs, in the precision used by getAlias()
+  for (int j = 0; j < (int)m_fxs.size(); j++) {
+    hasher.add(m_fxs[j]->getParams()->getParamCount());
+    for (int i = 0; i < m_fxs[j]->getParams()->getParamCount(); i++) {
+      TParam *param = m_fxs[j]->getParams()->getParam(i);
+      hasher.add(param->getName()).add(param->getValueAlias(frame, 2));
+    }
+  }
+
+  return hasher.result();
+}
+
+//--------------------------------------------------
+
 void TMacroFx::compatibilityTranslatePort(int major, int minor,
                                           std::string &portName) {
   // Reroute translation to the actual fx associated to the port
@@ -64,7 +64,8 @@ inserted, moved or removed.
 
 Level changes are delivered immediately to the ::invalidateLevel(..) method,
 which removes all resources
-whose name contains the level's name. Unfortunately, this cannot be done at
+whose fx alias (stored when the resource is first cached) contains the level's
+name. Unfortunately, this cannot be done at
 frame precision (ie you cannot
 invalidate a single frame of the level, but ALL the level).
 
@@ -569,6 +570,7 @@ void TPassiveCacheManager::reset() {
   m_currentPassiveCacheId   = 0;
   m_fxDataVector.clear();
   m_resources->getTable().clear();
+  m_resourceAliases.clear();
 }
 
 //-------------------------------------------------------------------------
@@ -768,7 +770,12 @@ void TPassiveCacheManager::invalidateLevel(const std::string &levelName) {
     std::set<LockedResourceP> &resources = *it;
     std::set<LockedResourceP>::iterator jt, kt;
     for (jt = resources.begin(); jt != resources.end();) {
-      if ((*jt)->getName().find(levelName) != std::string::npos) {
+      std::map<std::string, std::string>::iterator at =
+          m_resourceAliases.find((*jt)->getName());
+      const std::string &alias =
+          (at == m_resourceAliases.end()) ? (*jt)->getName() : at->second;
+
+      if (alias.find(levelName) != std::string::npos) {
         kt = jt++;
         it->erase(kt);
       } else
@@ -891,6 +898,13 @@ void TPassiveCacheManager::getResource(TCacheResourceP &resource,
         m_fxDataVector[fx->getAttributes()->passiveCacheDataIdx()]
             .m_passiveCacheId;
     m_resources->getTable().value(contextName, passiveCacheId).insert(resource);
+
+    const std::string &name = resource->getName();
+    if (m_resourceAliases.find(name) == m_resourceAliases.end()) {
+      TRasterFx *rasterFx = dynamic_cast<TRasterFx *>(fx.getPointer());
+      m_resourceAliases.insert(std::make_pair(
+          name, rasterFx ? rasterFx->getAlias(frame, rs) : std::string()));
+    }
   }
 }
 
@@ -955,6 +969,30 @@ void TPassiveCacheManager::releaseOldResources() {
   ResourcesTable &table = m_resources->getTable();
   table.erase(contextName);
   table.erase("T");
+
+  pruneResourceAliases();
+}
+
+//-------------------------------------------------------------------------
+
+//! Removes the aliases of the resources no longer stored in the table.
+void TPassiveCacheManager::pruneResourceAliases() {
+  std::set<std::string> names;
+
+  ResourcesTable::Iterator it = m_resources->getTable().begin();
+  for (; it; ++it) {
+    std::set<LockedResourceP>::iterator jt;
+    for (jt = it->begin(); jt != it->end(); ++jt)
+      names.insert((*jt)->getName());
+  }
+
+  std::map<std::string, std::string>::iterator at = m_resourceAliases.begin();
+  while (at != m_resourceAliases.end()) {
+    if (names.count(at->first))
+      ++at;
+    else
+      at = m_resourceAliases.erase(at);
+  }
 }
 
 //-------------------------------------------------------------------------
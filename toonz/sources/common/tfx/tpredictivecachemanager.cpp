@@ -4,6 +4,8 @@
 #include "trasterfx.h"
 
 #include <algorithm>
+#include <deque>
+#include <set>
 
 #include "tpredictivecachemanager.h"
 
@@ -33,6 +35,15 @@ TPredictiveCacheManager *TPredictiveCacheManager::instance() {
       TPredictiveCacheManager::gen()->getManager(TRenderer::renderId()));
 }
 
+//-------------------------------------------------------------------------
+
+namespace {
+
+QMutex statisticsMutex;
+TPredictiveCacheManager::Statistics statistics;
+
+}  // namespace
+
 //************************************************************************************************
 //    TPredictiveCacheManager::Imp definition
 //************************************************************************************************
@@ -43,10 +54,11 @@ TPredictiveCacheManager *TPredictiveCacheManager::instance() {
 
 struct PredictionData {
   const ResourceDeclaration *m_decl;
-  int m_usageCount;
+  std::deque<int> m_uses;  //!< Stamps of the pending uses, in render order
+  bool m_built;            //!< Whether the resource was requested already
 
-  PredictionData(const ResourceDeclaration *declaration)
-      : m_decl(declaration), m_usageCount(1) {}
+  PredictionData(const ResourceDeclaration *declaration, int stamp)
+      : m_decl(declaration), m_uses(1, stamp), m_built(false) {}
 };
 
 //============================================================================================
@@ -61,12 +73,30 @@ public:
   bool m_enabled;
 
   std::map<TCacheResourceP, PredictionData> m_resources;
+  std::set<std::pair<int, TCacheResourceP>>
+      m_nextUses;  //!< Resources by the stamp of their next use
   QMutex m_mutex;
 
+  int m_stamp;         //!< Uses counter of the test run
+  TINT64 m_maxMemory;  //!< Budget of the retained resources, in KB
+  Statistics m_stats;  //!< This render instance's counters
+
 public:
   Imp()
       : m_renderStatus(TRenderer::IDLE)
-      , m_enabled(TRenderer::instance().isPrecomputingEnabled()) {}
+      , m_enabled(TRenderer::instance().isPrecomputingEnabled())
+      , m_stamp(0)
+      , m_maxMemory(0) {}
+
+  ~Imp() {
+    QMutexLocker locker(&statisticsMutex);
+
+    statistics.m_sharedResources += m_stats.m_sharedResources;
+    statistics.m_predictedHits += m_stats.m_predictedHits;
+    statistics.m_hits += m_stats.m_hits;
+    statistics.m_evictions += m_stats.m_evictions;
+    statistics.m_evictedHits += m_stats.m_evictedHits;
+  }
 
   void run(TCacheResourceP &resource, const std::string &alias, const TFxP &fx,
            double frame, const TRenderSettings &rs,
@@ -92,6 +122,8 @@ private:
                             const TFxP &fx, double frame,
                             const TRenderSettings &rs,
                             ResourceDeclaration *resData);
+
+  void evict(const TCacheResourceP &requested);
 };
 
 //************************************************************************************************
@@ -115,6 +147,43 @@ void TPredictiveCacheManager::setBPP(int bpp) {}
 
 //---------------------------------------------------------------------------
 
+void TPredictiveCacheManager::setMaxMemory(int MB) {
+  m_imp->m_maxMemory = std::max(MB, 0) * (TINT64)1024;
+}
+
+//---------------------------------------------------------------------------
+
+TPredictiveCacheManager::Statistics TPredictiveCacheManager::getStatistics() {
+  QMutexLocker locker(&statisticsMutex);
+  return statistics;
+}
+
+//---------------------------------------------------------------------------
+
+void TPredictiveCacheManager::resetStatistics() {
+  QMutexLocker locker(&statisticsMutex);
+  statistics = Statistics();
+}
+
+//---------------------------------------------------------------------------
+
+std::string TPredictiveCacheManager::getStatisticsString() {
+  Statistics stats = getStatistics();
+
+  int hitRate = stats.m_predictedHits
+                    ? (int)(100 * stats.m_hits / stats.m_predictedHits)
+                    : 0;
+
+  return "Render plan: " + std::to_string(stats.m_sharedResources) +
+         " shared resources, " + std::to_string(stats.m_predictedHits) +
+         " predicted hits, " + std::to_string(stats.m_hits) +
+         " actual hits (" + std::to_string(hitRate) + "%), " +
+         std::to_string(stats.m_evictions) + " evictions losing " +
+         std::to_string(stats.m_evictedHits) + " hits";
+}
+
+//---------------------------------------------------------------------------
+
 void TPredictiveCacheManager::getResource(TCacheResourceP &resource,
                                           const std::string &alias,
                                           const TFxP &fx, double frame,
@@ -149,15 +218,18 @@ void TPredictiveCacheManager::Imp::getResourceTestRun(
   // QMutexLocker locker(&m_mutex);    //preComputing is currently
   // single-threaded
 
+  // Tasks are test-run in the order they are started, so the uses counter
+  // orders the uses of all resources in the plan
+  int stamp = m_stamp++;
+
   std::map<TCacheResourceP, PredictionData>::iterator it =
       m_resources.find(resource);
 
   if (it != m_resources.end())
-    it->second.m_usageCount++;
-  else {
-    // Already initializes usageCount at 1
-    m_resources.insert(std::make_pair(resource, PredictionData(resData)));
-  }
+    it->second.m_uses.push_back(stamp);
+  else
+    m_resources.insert(
+        std::make_pair(resource, PredictionData(resData, stamp)));
 }
 
 //---------------------------------------------------------------------------
@@ -187,7 +259,56 @@ void TPredictiveCacheManager::Imp::getResourceComputing(
 
   if (it == m_resources.end()) return;
 
-  if (--it->second.m_usageCount <= 0) m_resources.erase(it);
+  PredictionData &data = it->second;
+
+  if (data.m_built)
+    ++m_stats.m_hits;
+  else
+    data.m_built = true;
+
+  m_nextUses.erase(std::make_pair(data.m_uses.front(), resource));
+  data.m_uses.pop_front();
+
+  if (data.m_uses.empty()) {
+    m_resources.erase(it);
+    return;
+  }
+
+  m_nextUses.insert(std::make_pair(data.m_uses.front(), resource));
+  if (m_maxMemory > 0) evict(resource);
+}
+
+//---------------------------------------------------------------------------
+
+//! Releases retained resources until they fit the memory budget, starting
+//! from the one whose next use is farthest. The requested resource is
+//! spared, since it is going to be used right now.
+void TPredictiveCacheManager::Imp::evict(const TCacheResourceP &requested) {
+  TINT64 size = 0;
+
+  std::map<TCacheResourceP, PredictionData>::iterator it;
+  for (it = m_resources.begin(); it != m_resources.end(); ++it)
+    size += it->first->size();
+
+  // Walk the resources backwards from the farthest next use
+  std::set<std::pair<int, TCacheResourceP>>::iterator nt = m_nextUses.end();
+  while (size > m_maxMemory && nt != m_nextUses.begin()) {
+    --nt;
+
+    TCacheResourceP victim = nt->second;
+    if (victim == requested || victim->size() == 0) continue;
+
+    size -= victim->size();
+
+    it = m_resources.find(victim);
+    assert(it != m_resources.end());
+
+    ++m_stats.m_evictions;
+    m_stats.m_evictedHits += it->second.m_uses.size();
+
+    m_resources.erase(it);
+    nt = m_nextUses.erase(nt);
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -213,8 +334,19 @@ void TPredictiveCacheManager::onRenderStatusEnd(int renderStatus) {
       if (decl->m_tiles.size() == 1 && decl->m_tiles[0].m_refCount == 1) {
         std::map<TCacheResourceP, PredictionData>::iterator jt = it++;
         m_imp->m_resources.erase(jt);
-      } else
+      } else {
+        // The plan is complete - record the predicted reuses
+        int usesCount = it->second.m_uses.size();
+        if (usesCount > 1) {
+          ++m_imp->m_stats.m_sharedResources;
+          m_imp->m_stats.m_predictedHits += usesCount - 1;
+        }
+
+        m_imp->m_nextUses.insert(
+            std::make_pair(it->second.m_uses.front(), it->first));
+
         it++;
+      }
     }
   }
 }
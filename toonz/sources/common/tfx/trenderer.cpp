@@ -12,6 +12,7 @@
 #include "trasterimage.h"
 #include "trop.h"
 #include "timagecache.h"
+#include "tbigmemorymanager.h"
 #include "tstopwatch.h"
 
 // TnzBase includes
@@ -55,6 +56,36 @@ QThreadStorage<TRendererImp **> rendererStorage;
 // Same for render process ids.
 QThreadStorage<unsigned long *> renderIdsStorage;
 
+// Number of render tasks currently running, among all renderers. Frames are
+// split into sub-tiles only while there are cores left to compute them.
+TAtomicVar runningRenderTasks;
+
+//-------------------------------------------------------------------------------
+
+//! Installs a render process on the invoking thread for the object's
+//! lifetime - unless one is already installed, as is the case for the
+//! render task's own thread.
+class RendererInstaller {
+  bool m_install;
+
+public:
+  RendererInstaller(TRendererImp *imp, unsigned long renderId)
+      : m_install(!rendererStorage.hasLocalData() ||
+                  !rendererStorage.localData()) {
+    if (m_install) {
+      rendererStorage.setLocalData(new (TRendererImp *)(imp));
+      renderIdsStorage.setLocalData(new unsigned long(renderId));
+    }
+  }
+
+  ~RendererInstaller() {
+    if (m_install) {
+      rendererStorage.setLocalData(0);
+      renderIdsStorage.setLocalData(0);
+    }
+  }
+};
+
 //-------------------------------------------------------------------------------
 
 // Interlacing functions for field-based rendering
@@ -116,18 +147,21 @@ class RasterItem {
   std::string m_rasterId;
 
 public:
+  TDimension m_size;
   int m_bpp;
   bool m_busy;
 
   //---------------------------------------------------------
 
   RasterItem(const TDimension &size, int bpp, bool busyFlag)
-      : m_rasterId(""), m_bpp(bpp), m_busy(busyFlag) {
+      : m_rasterId(""), m_size(size), m_bpp(bpp), m_busy(busyFlag) {
     TRasterP raster;
     if (bpp == 32)
       raster = TRaster32P(size);
     else if (bpp == 64)
       raster = TRaster64P(size);
+    else if (bpp == 128)
+      raster = TRasterFP(size);
     else
       assert(false);
 
@@ -196,31 +230,44 @@ void RasterPool::clear() {
 
 //---------------------------------------------------------
 
+//! Sets the default specs of returned rasters. Idle rasters with different
+//! specs are released - busy ones may still belong to render instances of a
+//! different size, which run concurrently.
 void RasterPool::setRasterSpecs(const TDimension &size, int bpp) {
   if (size != m_size || bpp != m_bpp) {
     m_size = size;
     m_bpp  = bpp;
-    clear();
+
+    QMutexLocker sl(&m_repositoryLock);
+
+    RasterRepository::iterator it = m_rasterRepository.begin();
+    while (it != m_rasterRepository.end()) {
+      RasterItem *rasItem = *it;
+      if (!rasItem->m_busy &&
+          (rasItem->m_size != size || rasItem->m_bpp != bpp)) {
+        delete rasItem;
+        m_rasterRepository.erase(it++);
+      } else
+        ++it;
+    }
   }
 }
 
 //---------------------------------------------------------
 
-TRasterP RasterPool::getRaster(const TDimension &size, int bpp) {
-  assert(size == m_size && bpp == m_bpp);
-  return getRaster();
-}
+TRasterP RasterPool::getRaster() { return getRaster(m_size, m_bpp); }
 
 //---------------------------------------------------------
 
-//! Returns for the first not-busy raster
-TRasterP RasterPool::getRaster() {
+//! Returns the first not-busy raster with the specified specs
+TRasterP RasterPool::getRaster(const TDimension &size, int bpp) {
   QMutexLocker sl(&m_repositoryLock);
 
   RasterRepository::iterator it = m_rasterRepository.begin();
   while (it != m_rasterRepository.end()) {
     RasterItem *rasItem = *it;
-    if (rasItem->m_busy == false) {
+    if (rasItem->m_busy == false && rasItem->m_size == size &&
+        rasItem->m_bpp == bpp) {
       TRasterP raster = rasItem->getRaster();
 
       if (!raster) {
@@ -237,7 +284,7 @@ TRasterP RasterPool::getRaster() {
     ++it;
   }
 
-  RasterItem *rasItem = new RasterItem(m_size, m_bpp, true);
+  RasterItem *rasItem = new RasterItem(size, bpp, true);
   m_rasterRepository.push_back(rasItem);
 
   return rasItem->getRaster();
@@ -247,6 +294,9 @@ TRasterP RasterPool::getRaster() {
 
 //! Cerca il raster \b r in m_rasterRepository; se lo trova setta a \b false il
 //! campo \b m_busy.
+//! When raster buffers are pooled, the item is released instead: its buffer
+//! is recycled just as well, without idling - and being compressed - in the
+//! image cache.
 void RasterPool::releaseRaster(const TRasterP &r) {
   if (!r) return;
 
@@ -256,7 +306,11 @@ void RasterPool::releaseRaster(const TRasterP &r) {
     RasterItem *rasItem = *it;
     if (rasItem->getRaster()->getRawData() == r->getRawData()) {
       assert(rasItem->m_busy);
-      rasItem->m_busy = false;
+      if (TBigMemoryManager::instance()->isPooling()) {
+        delete rasItem;
+        m_rasterRepository.erase(it);
+      } else
+        rasItem->m_busy = false;
       return;
     }
   }
@@ -315,6 +369,8 @@ public:
   Executor m_executor;
 
   bool m_precomputingEnabled;
+  int m_maxMemory;       //!< Memory budget of the active tasks, in MB
+  int m_maxCacheMemory;  //!< Memory budget of the predictive cache, in MB
   RasterPool m_rasterPool;
 
   std::vector<TRenderResourceManager *> m_managers;
@@ -352,6 +408,11 @@ public:
 
   void setThreadsCount(int nThreads) { m_executor.setMaxActiveTasks(nThreads); }
 
+  void setMaxMemory(int MB) {
+    m_maxMemory = std::max(MB, 0);
+    m_executor.setMaxActiveMemory(m_maxMemory);
+  }
+
   inline void declareRenderStart(unsigned long renderId);
   inline void declareRenderEnd(unsigned long renderId);
   inline void declareFrameStart(double frame);
@@ -392,6 +453,11 @@ class RenderTask final : public TThread::Runnable {
 
   bool m_fieldRender, m_stereoscopic;
 
+  std::vector<TRect> m_subTiles;  //!< Frame subdivision for parallel
+                                  //! rendering - empty if not subdivided
+
+  int m_memory;  //!< Estimated peak memory, in MB - 0 if not estimated
+
   Mutex m_rasterGuard;
   TTile m_tileA;  // in normal and field rendering, Rendered at given frame; in
                   // stereoscopic, rendered left frame
@@ -411,6 +477,11 @@ public:
   void buildTile(TTile &tile);
   void releaseTiles();
 
+  void buildSubTiles();
+  void estimateMemory();
+  void dryComputeTile(const TRasterFxP &fx, double t);
+  void computeTile(const TRasterFxP &fx, TTile &tile, double t);
+
   void onFrameStarted();
   void onFrameCompleted();
   void onFrameFailed(TException &e);
@@ -419,6 +490,7 @@ public:
   void run() override;
 
   int taskLoad() override { return 100; }
+  int taskMemory() override { return m_memory; }
 
   void onFinished(TThread::RunnableP) override;
 };
@@ -612,6 +684,24 @@ void TRenderer::setThreadsCount(int nThreads) {
 
 //---------------------------------------------------------
 
+void TRenderer::setMaxMemory(int MB) { m_imp->setMaxMemory(MB); }
+
+//---------------------------------------------------------
+
+int TRenderer::getMaxMemory() const { return m_imp->m_maxMemory; }
+
+//---------------------------------------------------------
+
+void TRenderer::setMaxCacheMemory(int MB) {
+  m_imp->m_maxCacheMemory = std::max(MB, 0);
+}
+
+//---------------------------------------------------------
+
+int TRenderer::getMaxCacheMemory() const { return m_imp->m_maxCacheMemory; }
+
+//---------------------------------------------------------
+
 void TRenderer::addPort(TRenderPort *port) { m_imp->addPort(port); }
 
 //---------------------------------------------------------
@@ -687,7 +777,9 @@ TRendererImp::TRendererImp(int nThreads)
     : m_executor()
     , m_undoneTasks()
     , m_rendererId(m_rendererIdCounter++)
-    , m_precomputingEnabled(true) {
+    , m_precomputingEnabled(true)
+    , m_maxMemory(0)
+    , m_maxCacheMemory(0) {
   m_executor.setMaxActiveTasks(nThreads);
 
   std::vector<TRenderResourceManagerGenerator *> &generators =
@@ -926,7 +1018,8 @@ RenderTask::RenderTask(unsigned long renderId, unsigned long taskId,
     , m_framePos(framePos)
     , m_rendererImp(rendererImp)
     , m_fieldRender(ri.m_fieldPrevalence != TRenderSettings::NoField)
-    , m_stereoscopic(ri.m_stereoscopic) {
+    , m_stereoscopic(ri.m_stereoscopic)
+    , m_memory(0) {
   m_frames.push_back(frame);
 
   // Connect the onFinished slot
@@ -939,18 +1032,141 @@ RenderTask::RenderTask(unsigned long renderId, unsigned long taskId,
   // in the TRenderSettings
   // is no longer supported.
   m_info.m_shrinkX = m_info.m_shrinkY = 1;
+
+  buildSubTiles();
 }
 
 //---------------------------------------------------------
 
-void RenderTask::preRun() {
+//! Subdivides the frame into a grid of sub-tiles, to be computed in parallel.
+//! The sub-tiles size is also kept within the cache tiles granularity. Fxs
+//! refusing subdivision (see TRasterFx::getMemoryRequirement()), like those
+//! whose result depends on the tile origin, get the whole frame.
+void RenderTask::buildSubTiles() {
+  int tileSize = m_info.m_subTileSize;
+  if (tileSize <= 0) return;
+
+  while (tileSize > 64 &&
+         TRasterFx::memorySize(TRectD(0, 0, tileSize, tileSize),
+                               m_info.m_bpp) > m_info.m_maxTileSize)
+    tileSize /= 2;
+
+  if (m_frameSize.lx <= tileSize && m_frameSize.ly <= tileSize) return;
+
   TRectD geom(m_framePos, TDimensionD(m_frameSize.lx, m_frameSize.ly));
 
-  if (m_fx.m_frameA) m_fx.m_frameA->dryCompute(geom, m_frames[0], m_info);
+  for (const TRasterFxP &rootFx : {m_fx.m_frameA, m_fx.m_frameB}) {
+    if (!rootFx) continue;
 
-  if (m_fx.m_frameB)
+    for (const TFx *fx : calculateSortedFxs(rootFx)) {
+      TRasterFx *rasFx = dynamic_cast<TRasterFx *>(const_cast<TFx *>(fx));
+      if (rasFx && rasFx->getMemoryRequirement(geom, m_frames[0], m_info) < 0)
+        return;
+    }
+  }
+
+  for (int y = 0; y < m_frameSize.ly; y += tileSize)
+    for (int x = 0; x < m_frameSize.lx; x += tileSize) {
+      int x1 = std::min(x + tileSize, m_frameSize.lx) - 1,
+          y1 = std::min(y + tileSize, m_frameSize.ly) - 1;
+
+      m_subTiles.push_back(TRect(x, y, x1, y1));
+    }
+}
+
+//---------------------------------------------------------
+
+//! Estimates the peak memory of the task with a dry-run of its first frame
+//! (frames in a task share the same description). The frame is estimated as
+//! a whole, since sub-tiles may be computed in parallel.
+void RenderTask::estimateMemory() {
+  TRectD geom(m_framePos, TDimensionD(m_frameSize.lx, m_frameSize.ly));
+  int frameMemory = TRasterFx::memorySize(geom, m_info.m_bpp);
+
+  m_memory = 0;
+
+  if (m_fx.m_frameA) {
+    TRasterFxMemoryEstimator estimator;
+    m_fx.m_frameA->dryCompute(geom, m_frames[0], m_info);
+
+    // The output raster is allocated in any case
+    m_memory = std::max(estimator.getPeak(), frameMemory);
+  }
+
+  if (m_fx.m_frameB) {
+    TRasterFxMemoryEstimator estimator;
     m_fx.m_frameB->dryCompute(
         geom, m_fieldRender ? m_frames[0] + 0.5 : m_frames[0], m_info);
+
+    // The first output is still allocated
+    m_memory =
+        std::max(m_memory, frameMemory + std::max(estimator.getPeak(),
+                                                  frameMemory));
+  }
+}
+
+//---------------------------------------------------------
+
+void RenderTask::preRun() {
+  if (m_fx.m_frameA) dryComputeTile(m_fx.m_frameA, m_frames[0]);
+
+  if (m_fx.m_frameB)
+    dryComputeTile(m_fx.m_frameB,
+                   m_fieldRender ? m_frames[0] + 0.5 : m_frames[0]);
+}
+
+//---------------------------------------------------------
+
+//! Predicts the requests of computeTile(), for the cache managers' sake.
+void RenderTask::dryComputeTile(const TRasterFxP &fx, double t) {
+  if (m_subTiles.empty()) {
+    TRectD geom(m_framePos, TDimensionD(m_frameSize.lx, m_frameSize.ly));
+    fx->dryCompute(geom, t, m_info);
+    return;
+  }
+
+  for (const TRect &subTile : m_subTiles) {
+    TRectD geom(m_framePos + TPointD(subTile.x0, subTile.y0),
+                TDimensionD(subTile.getLx(), subTile.getLy()));
+    fx->dryCompute(geom, t, m_info);
+  }
+}
+
+//---------------------------------------------------------
+
+//! Computes the specified tile, in the sub-tiles the frame was divided into
+//! if any - in parallel when there are idle cores.
+void RenderTask::computeTile(const TRasterFxP &fx, TTile &tile, double t) {
+  if (m_subTiles.empty()) {
+    fx->compute(tile, t, m_info);
+    return;
+  }
+
+  TRasterP ras(tile.getRaster());
+  TPointD pos(tile.m_pos);
+
+  TRendererImp *rendererImp = m_rendererImp.getPointer();
+  unsigned long renderId    = m_renderId;
+
+  // Sub-tiles are rendered directly into their part of the frame raster
+  auto computeSubTiles = [&](int begin, int end) {
+    RendererInstaller installer(rendererImp, renderId);
+
+    for (int i = begin; i != end; ++i) {
+      const TRect &subTile = m_subTiles[i];
+
+      TTile part(ras->extract(subTile), pos + TPointD(subTile.x0, subTile.y0));
+      fx->compute(part, t, m_info);
+    }
+  };
+
+  // The sub-tiles are always those declared by preRun(), so that the
+  // predictive cache requests are consumed - they are just computed in
+  // sequence when no core is idle
+  if (runningRenderTasks >= TSystem::getProcessorCount())
+    computeSubTiles(0, (int)m_subTiles.size());
+  else
+    TThread::parallelFor(0, (int)m_subTiles.size(), 1, computeSubTiles);
 }
 
 //---------------------------------------------------------
@@ -979,6 +1195,8 @@ void RenderTask::run() {
     if (fx) const_cast<TFx *>(fx)->callStartRenderFrameHandler(&m_info, t);
   }
 
+  ++runningRenderTasks;
+
   try {
     onFrameStarted();
 
@@ -988,31 +1206,31 @@ void RenderTask::run() {
       // Common case - just build the first tile
       buildTile(m_tileA);
       /*-- 通常はここがFxのレンダリング処理 --*/
-      m_fx.m_frameA->compute(m_tileA, t, m_info);
+      computeTile(m_fx.m_frameA, m_tileA, t);
     } else {
       assert(!(m_stereoscopic && m_fieldRender));
       // Field rendering  or stereoscopic case
       if (m_stereoscopic) {
         buildTile(m_tileA);
-        m_fx.m_frameA->compute(m_tileA, t, m_info);
+        computeTile(m_fx.m_frameA, m_tileA, t);
 
         buildTile(m_tileB);
-        m_fx.m_frameB->compute(m_tileB, t, m_info);
+        computeTile(m_fx.m_frameB, m_tileB, t);
       }
       // if fieldPrevalence, Decide the rendering frames depending on field
       // prevalence
       else if (m_info.m_fieldPrevalence == TRenderSettings::EvenField) {
         buildTile(m_tileA);
-        m_fx.m_frameA->compute(m_tileA, t, m_info);
+        computeTile(m_fx.m_frameA, m_tileA, t);
 
         buildTile(m_tileB);
-        m_fx.m_frameB->compute(m_tileB, t + 0.5, m_info);
+        computeTile(m_fx.m_frameB, m_tileB, t + 0.5);
       } else {
         buildTile(m_tileB);
-        m_fx.m_frameA->compute(m_tileB, t, m_info);
+        computeTile(m_fx.m_frameA, m_tileB, t);
 
         buildTile(m_tileA);
-        m_fx.m_frameB->compute(m_tileA, t + 0.5, m_info);
+        computeTile(m_fx.m_frameB, m_tileA, t + 0.5);
       }
     }
 
@@ -1026,6 +1244,8 @@ void RenderTask::run() {
     onFrameFailed(ex);
   }
 
+  --runningRenderTasks;
+
   // Inform the managers of frame end
   m_rendererImp->declareFrameEnd(t);
 
@@ -1240,6 +1460,21 @@ std::vector<const TFx *> calculateSortedFxs(TRasterFxP rootFx) {
 
 //---------------------------------------------------------
 
+//! Returns whether the fx trees contain fxs rendering through an offscreen
+//! OpenGL surface. For now it is used only in the plasticDeformerFx.
+static bool needsOffscreenSurface(const TFxPair &fxs) {
+  for (const TRasterFxP &root : {fxs.m_frameA, fxs.m_frameB}) {
+    if (!root) continue;
+
+    for (const TFx *fx : calculateSortedFxs(root))
+      if (fx && fx->getFxType() == "plasticDeformerFx") return true;
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------
+
 void TRendererImp::startRendering(
     unsigned long renderId,
     const std::vector<TRenderer::RenderData> &renderDatas) {
@@ -1339,9 +1574,10 @@ void TRendererImp::startRendering(
   //    Preliminary initializations
   //----------------------------------------------------------------------
 
-  // Calculate the overall render area - sum of all render ports' areas
-  TRectD renderArea;
-  {
+  // Calculate the overall render area - sum of all render ports' areas,
+  // unless the request specifies its own
+  TRectD renderArea(renderDatas[0].m_renderArea);
+  if (renderArea.isEmpty()) {
     QReadLocker sl(&m_portsLock);
 
     for (PortContainerIterator it = m_ports.begin(); it != m_ports.end(); ++it)
@@ -1387,9 +1623,11 @@ void TRendererImp::startRendering(
 
   unsigned long tasksIdCounter = 0;
 
-  std::map<std::string, RenderTask *> clusters;
+  // Frames are clustered by the fingerprint of their alias - identical frames
+  // are rendered once, and held for the others
+  std::map<TFxHash, RenderTask *> clusters;
   std::vector<TRenderer::RenderData>::const_iterator it;
-  std::map<std::string, RenderTask *>::iterator jt;
+  std::map<TFxHash, RenderTask *>::iterator jt;
 
   for (it = renderDatas.begin(); it != renderDatas.end(); ++it) {
     // Check for user cancels
@@ -1409,25 +1647,27 @@ void TRendererImp::startRendering(
 
     double frame = renderData.m_frame;
 
-    std::string alias = fx->getAlias(frame, renderData.m_info);
+    TFxHasher hasher;
+    hasher.add(fx->getAliasHash(frame, renderData.m_info));
     if (renderData.m_fxRoot.m_frameB)
-      alias = alias +
-              renderData.m_fxRoot.m_frameB->getAlias(frame, renderData.m_info);
-
-    // If the render contains offscreen render, then prepare the
-    // QOffscreenSurface
-    // in main (GUI) thread. For now it is used only in the plasticDeformerFx.
-    if (alias.find("plasticDeformerFx") != std::string::npos &&
-        QThread::currentThread() == qGuiApp->thread()) {
-      rs.m_offScreenSurface.reset(new QOffscreenSurface());
-      rs.m_offScreenSurface->setFormat(QSurfaceFormat::defaultFormat());
-      rs.m_offScreenSurface->create();
-    }
+      hasher.add(
+          renderData.m_fxRoot.m_frameB->getAliasHash(frame, renderData.m_info));
+
+    TFxHash alias = hasher.result();
 
     // Search the alias among stored clusters - and store the frame
     jt = clusters.find(alias);
 
     if (jt == clusters.end()) {
+      // If the render contains offscreen render, then prepare the
+      // QOffscreenSurface in main (GUI) thread
+      if (QThread::currentThread() == qGuiApp->thread() &&
+          needsOffscreenSurface(renderData.m_fxRoot)) {
+        rs.m_offScreenSurface.reset(new QOffscreenSurface());
+        rs.m_offScreenSurface->setFormat(QSurfaceFormat::defaultFormat());
+        rs.m_offScreenSurface->create();
+      }
+
       RenderTask *newTask =
           new RenderTask(renderId, tasksIdCounter++, renderData.m_frame, rs,
                          renderData.m_fxRoot, pos, frameSize, this);
@@ -1452,6 +1692,23 @@ void TRendererImp::startRendering(
     // Inform the resource managers
     locals::RenderDeclaration renderDecl(this, renderId);
 
+    //----------------------------------------------------------------------
+    //    Memory estimation
+    //----------------------------------------------------------------------
+
+    // With a memory budget, tasks are admitted by their estimated peak memory
+    if (m_maxMemory > 0) {
+      for (kt = tasksVector.begin(); kt != kEnd; ++kt) {
+        if (hasToDie(renderId)) return;
+
+        (*kt)->estimateMemory();
+
+        locals::clearStorage();
+        QCoreApplication::instance()->processEvents();
+        locals::setStorage(this, renderId);
+      }
+    }
+
     //----------------------------------------------------------------------
     //    Precomputing
     //----------------------------------------------------------------------
@@ -1461,6 +1718,7 @@ void TRendererImp::startRendering(
       const TRenderSettings &rs = renderDatas[0].m_info;
       TPredictiveCacheManager::instance()->setMaxTileSize(rs.m_maxTileSize);
       TPredictiveCacheManager::instance()->setBPP(rs.m_bpp);
+      TPredictiveCacheManager::instance()->setMaxMemory(m_maxCacheMemory);
 
       // Perform the first precomputing run - fx usages declaration
       {
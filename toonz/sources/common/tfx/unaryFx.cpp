@@ -28,7 +28,8 @@ void TGeometryFx::doCompute(TTile &tile, double frame,
     return;
   }
 
-  if (!TRaster32P(tile.getRaster()) && !TRaster64P(tile.getRaster()))
+  if (!TRaster32P(tile.getRaster()) && !TRaster64P(tile.getRaster()) &&
+      !TRasterFP(tile.getRaster()))
     throw TException("AffineFx unsupported pixel type");
 
   TAffine aff1 = getPlacement(frame);
@@ -101,6 +102,27 @@ std::string TGeometryFx::getAlias(double frame,
 
 //--------------------------------------------------
 
+TFxHash TGeometryFx::buildAliasHash(double frame,
+                                    const TRenderSettings &info) const {
+  TGeometryFx *tthis = const_cast<TGeometryFx *>(this);
+  TAffine affine     = tthis->getPlacement(frame);
+
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  return hasher.addReal(affine.a11, 5)
+      .addReal(affine.a12, 5)
+      .addReal(affine.a13, 5)
+      .addReal(affine.a21, 5)
+      .addReal(affine.a22, 5)
+      .addReal(affine.a23, 5)
+      .result();
+}
+
+//--------------------------------------------------
+
 void TGeometryFx::transform(double frame, int port, const TRectD &rectOnOutput,
                             const TRenderSettings &infoOnOutput,
                             TRectD &rectOnInput, TRenderSettings &infoOnInput) {
@@ -161,7 +183,18 @@ void ColumnColorFilterFx::doCompute(TTile &tile, double frame,
   TRasterFxP src = m_port.getFx();
   src->compute(tile, frame, ri);
 
-  TRop::applyColorScale(tile.getRaster(), m_colorFilter);
+  if (!tile.hasEmptyTiles()) {
+    TRop::applyColorScale(tile.getRaster(), m_colorFilter);
+    return;
+  }
+
+  // Transparent pixels stay so - the input's empty tiles can be skipped
+  std::vector<TRect> rects;
+  tile.getSparseRaster().getFilledRects(rects);
+
+  TRasterP ras(tile.getRaster());
+  for (const TRect &rect : rects)
+    TRop::applyColorScale(ras->extract(rect), m_colorFilter);
 }
 
 std::string ColumnColorFilterFx::getAlias(double frame,
@@ -181,6 +214,20 @@ std::string ColumnColorFilterFx::getAlias(double frame,
          std::to_string(m_colorFilter.m) + "]";
 }
 
+TFxHash ColumnColorFilterFx::buildAliasHash(double frame,
+                                            const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  return hasher.add(m_colorFilter.r)
+      .add(m_colorFilter.g)
+      .add(m_colorFilter.b)
+      .add(m_colorFilter.m)
+      .result();
+}
+
 //--------------------------------------------------
 
 FX_IDENTIFIER_IS_HIDDEN(ColumnColorFilterFx, "columnColorFilterFx")
@@ -60,7 +60,12 @@ JpgReader::JpgReader() : m_chan(0), m_isOpen(false) {
 JpgReader::~JpgReader() {
   if (m_isOpen) {
     try {
-      jpeg_finish_decompress(&m_cinfo);
+      // Partial reads leave scanlines behind, which finishing would complain
+      // about
+      if (m_cinfo.output_scanline < m_cinfo.output_height)
+        jpeg_abort_decompress(&m_cinfo);
+      else
+        jpeg_finish_decompress(&m_cinfo);
       jpeg_destroy_decompress(&m_cinfo);
     } catch (...) {
     }
@@ -174,6 +179,49 @@ void JpgReader::readLine(char *buffer, int x0, int x1, int shrink) {
   }
 }
 
+bool JpgReader::readRegion(char *buffer, int wrap, const TRect &rect,
+                           int shrink) {
+#ifdef LIBJPEG_TURBO_VERSION_NUMBER
+  // Cropping and skipping scanlines need libjpeg-turbo. Scaling could be
+  // done by the decoder too, but it has to be chosen before
+  // jpeg_start_decompress(), which happens in open().
+  int components = m_cinfo.out_color_components;
+  if (!m_isOpen || m_cinfo.output_scanline != 0 ||
+      !((m_cinfo.out_color_space == JCS_RGB && components == 3) ||
+        components == 1))
+    return false;
+
+  // The decoded columns are widened to the iMCU boundaries
+  JDIMENSION xOffset = rect.x0, width = rect.getLx();
+  jpeg_crop_scanline(&m_cinfo, &xOffset, &width);
+
+  // Rows come top to bottom
+  int topRows = m_info.m_ly - 1 - rect.y1;
+  if (topRows > 0) jpeg_skip_scanlines(&m_cinfo, topRows);
+
+  for (int y = rect.y1; y >= rect.y0; --y) {
+    jpeg_read_scanlines(&m_cinfo, m_buffer, 1);
+    if ((y - rect.y0) % shrink != 0) continue;
+
+    unsigned char *src = m_buffer[0] + (rect.x0 - xOffset) * components;
+    TPixel32 *dst      = (TPixel32 *)buffer + ((y - rect.y0) / shrink) * wrap;
+
+    for (int x = rect.x0; x <= rect.x1; x += shrink, ++dst) {
+      if (components == 3)
+        dst->r = src[0], dst->g = src[1], dst->b = src[2];
+      else
+        dst->r = dst->g = dst->b = src[0];
+      dst->m = (char)255;
+      src += components * shrink;
+    }
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
 int JpgReader::skipLines(int lineCount) {
   for (int i = 0; i < lineCount; i++) {
     int ret = jpeg_read_scanlines(&m_cinfo, m_buffer, 1);
@@ -319,6 +319,18 @@ void readRaster(const TRasterPT<Pix> &ras, Tiio::Reader *reader, int x0, int y0,
 
 //------------------------------------------------------------------------------------
 
+// Lets the reader decode just the loading rect, if it supports that natively
+static bool readRasterRegion(const TRaster32P &ras, Tiio::Reader *reader,
+                             int x0, int y0, int x1, int y1, int shrink) {
+  ras->lock();
+  bool ok = reader->readRegion((char *)ras->getRawData(), ras->getWrap(),
+                               TRect(x0, y0, x1, y1), shrink);
+  ras->unlock();
+  return ok;
+}
+
+//------------------------------------------------------------------------------------
+
 TImageP TImageReader::load0() {
   if (!m_reader && !m_vectorReader) open();
 
@@ -449,8 +461,10 @@ TImageP TImageReader::load0() {
       } else if (info.m_bitsPerSample == 8) {
         //  Standard 32-bit case
         TRaster32P ras(imageDimension);
-        readRaster(ras, m_reader, x0, y0, x1, y1, info.m_lx, info.m_ly,
-                   m_shrink);
+        if ((m_region.isEmpty() && m_shrink == 1) ||
+            !readRasterRegion(ras, m_reader, x0, y0, x1, y1, m_shrink))
+          readRaster(ras, m_reader, x0, y0, x1, y1, info.m_lx, info.m_ly,
+                     m_shrink);
 
         _ras = ras;
       } else
@@ -548,6 +562,10 @@ static void convertForWriting(TRasterP &ras, const TRasterP &rin, int bpp) {
     ras = TRaster64P(rin->getSize());
     TRop::convert(ras, rin);
     break;
+  case 128:
+    ras = TRasterFP(rin->getSize());
+    TRop::convert(ras, rin);
+    break;
   default:
     assert(false);
   }
@@ -574,6 +592,7 @@ void TImageWriter::save(const TImageP &img) {
     TRasterGR8P rasGr = ri->getRaster();
     TRaster32P ras32  = ri->getRaster();
     TRaster64P ras64  = ri->getRaster();
+    TRasterFP rasF    = ri->getRaster();
 
     TEnumProperty *p =
         m_properties
@@ -587,13 +606,11 @@ void TImageWriter::save(const TImageP &img) {
 
     int bpp = p ? std::stoi(p->getValue()) : 32;
 
-    //  bpp       1  8  16 24 32 40  48 56  64
-    int spp[] = {
-        1, 1, 1, 4, 4,
-        0, 4, 0, 4};  // 0s are for pixel sizes which are normally unsupported
-    int bps[] = {
-        1, 8,  16, 8, 8,
-        0, 16, 0,  16};  // by image formats, let alone by Toonz raster ones.
+    //  bpp       1  8  16 24 32 40  48 56  64 ...  128
+    int spp[] = {1, 1, 1, 4, 4, 0, 4, 0, 4, 0, 0, 0, 0, 0, 0, 0, 4};
+    // 0s are for pixel sizes which are normally unsupported
+    int bps[] = {1, 8, 16, 8, 8, 0, 16, 0, 16, 0, 0, 0, 0, 0, 0, 0, 32};
+    // by image formats, let alone by Toonz raster ones.
     // The 24 and 48 cases get automatically promoted to 32 and 64.
     int bypp = bpp / 8;
     assert(bypp < boost::size(spp) && spp[bypp] && bps[bypp]);
@@ -616,6 +633,11 @@ void TImageWriter::save(const TImageP &img) {
         ras = ras64;
       else
         convertForWriting(ras, ras64, bpp);
+    } else if (rasF) {
+      if (bpp == 128)
+        ras = rasF;
+      else
+        convertForWriting(ras, rasF, bpp);
     } else {
       fclose(file);
       throw TImageException(m_path, "unsupported raster type");
@@ -632,7 +654,7 @@ void TImageWriter::save(const TImageP &img) {
     writer->open(file, info);
 
     // add background colors for non alpha-enabled image types
-    if ((ras32 || ras64) && !writer->writeAlphaSupported() &&
+    if ((ras32 || ras64 || rasF) && !writer->writeAlphaSupported() &&
         TImageWriter::getBackgroundColor() != TPixel::Black) {
       if (bpp == 32 || bpp == 24)
         TRop::addBackground(ras, TImageWriter::getBackgroundColor());
@@ -650,6 +672,9 @@ void TImageWriter::save(const TImageP &img) {
       if (bpp == 1 || bpp == 8 || bpp == 24 || bpp == 32 || bpp == 16)
         for (int i = 0; i < ras->getLy(); i++)
           writer->writeLine((char *)ras->getRawData(0, i));
+      else if (bpp == 128)
+        for (int i = 0; i < ras->getLy(); i++)
+          writer->writeLine((float *)ras->getRawData(0, i));
       else
         for (int i = 0; i < ras->getLy(); i++)
           writer->writeLine((short *)ras->getRawData(0, i));
@@ -657,6 +682,9 @@ void TImageWriter::save(const TImageP &img) {
       if (bpp == 1 || bpp == 8 || bpp == 24 || bpp == 32 || bpp == 16)
         for (int i = ras->getLy() - 1; i >= 0; i--)
           writer->writeLine((char *)ras->getRawData(0, i));
+      else if (bpp == 128)
+        for (int i = ras->getLy() - 1; i >= 0; i--)
+          writer->writeLine((float *)ras->getRawData(0, i));
       else
         for (int i = ras->getLy() - 1; i >= 0; i--)
           writer->writeLine((short *)ras->getRawData(0, i));
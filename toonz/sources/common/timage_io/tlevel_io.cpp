@@ -30,6 +30,10 @@ std::map<QString, std::pair<TLevelWriterCreateProc *, bool>> LevelWriterTable;
 
 //-----------------------------------------------------------
 
+bool TLevelReader::m_mappedReadingForTzl = false;
+
+//-----------------------------------------------------------
+
 TLevelReader::TLevelReader(const TFilePath &path)
     : TSmartObject(m_classCode)
     , m_info(0)
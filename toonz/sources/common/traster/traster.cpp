@@ -26,6 +26,7 @@ TRaster::TRaster(int lx, int ly, int pixelSize)
     , m_wrap(lx)
     , m_parent(0)
     , m_bufferOwner(true)
+    , m_poolClass(-1)
     , m_buffer(0)
     , m_lockCount(0)
 #ifdef _DEBUG
@@ -82,6 +83,7 @@ TRaster::TRaster(int lx, int ly, int pixelSize, int wrap, UCHAR *buffer,
     , m_wrap(wrap)
     , m_buffer(buffer)
     , m_bufferOwner(bufferOwner)
+    , m_poolClass(-1)
     , m_lockCount(0)
 #ifdef _DEBUG
     , m_cashed(false)
@@ -0,0 +1,134 @@
+#include "tsparseraster.h"
+
+// STD includes
+#include <algorithm>
+
+//***************************************************************************************
+//    Local namespace  stuff
+//***************************************************************************************
+
+namespace {
+
+bool isZero(const TRasterP &ras, const TRect &rect) {
+  int pixelSize = ras->getPixelSize();
+  int rowSize   = rect.getLx() * pixelSize;
+
+  const UCHAR *row = ras->getRawData() +
+                     (rect.y0 * ras->getWrap() + rect.x0) * pixelSize;
+  for (int y = rect.y0; y <= rect.y1;
+       ++y, row += ras->getWrap() * pixelSize) {
+    // No early exit within rows, so that the loop vectorizes
+    UCHAR bits = 0;
+    for (int i = 0; i < rowSize; ++i) bits |= row[i];
+
+    if (bits) return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+//***************************************************************************************
+//    TSparseRaster  implementation
+//***************************************************************************************
+
+TSparseRaster::TSparseRaster(const TRasterP &ras, bool empty)
+    : m_ras(ras)
+    , m_tileCountX((ras->getLx() + TileSize - 1) / TileSize)
+    , m_tileCountY((ras->getLy() + TileSize - 1) / TileSize)
+    , m_emptyTiles(m_tileCountX * m_tileCountY, empty) {}
+
+//------------------------------------------------------------------------------
+
+TSparseRaster::TSparseRaster(const TRasterP &ras,
+                             const std::vector<bool> &emptyTiles)
+    : TSparseRaster(ras) {
+  assert(emptyTiles.size() == m_emptyTiles.size());
+  if (emptyTiles.size() == m_emptyTiles.size()) m_emptyTiles = emptyTiles;
+}
+
+//------------------------------------------------------------------------------
+
+TSparseRaster TSparseRaster::fromDense(const TRasterP &ras) {
+  TSparseRaster result(ras);
+
+  ras->lock();
+  for (int y = 0; y < result.m_tileCountY; ++y)
+    for (int x = 0; x < result.m_tileCountX; ++x)
+      result.setTileEmpty(x, y, isZero(ras, result.getTileRect(x, y)));
+  ras->unlock();
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+TRect TSparseRaster::getTileRect(int x, int y) const {
+  return TRect(x * TileSize, y * TileSize,
+               std::min((x + 1) * TileSize, m_ras->getLx()) - 1,
+               std::min((y + 1) * TileSize, m_ras->getLy()) - 1);
+}
+
+//------------------------------------------------------------------------------
+
+int TSparseRaster::getEmptyTileCount() const {
+  return (int)std::count(m_emptyTiles.begin(), m_emptyTiles.end(), true);
+}
+
+//------------------------------------------------------------------------------
+
+bool TSparseRaster::isEmpty(const TRect &rect) const {
+  TRect r(rect * m_ras->getBounds());
+  if (r.isEmpty()) return true;
+
+  for (int y = r.y0 / TileSize; y <= r.y1 / TileSize; ++y)
+    for (int x = r.x0 / TileSize; x <= r.x1 / TileSize; ++x)
+      if (!isTileEmpty(x, y)) return false;
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void TSparseRaster::setFilled(const TRect &rect) {
+  TRect r(rect * m_ras->getBounds());
+  if (r.isEmpty()) return;
+
+  for (int y = r.y0 / TileSize; y <= r.y1 / TileSize; ++y)
+    for (int x = r.x0 / TileSize; x <= r.x1 / TileSize; ++x)
+      setTileEmpty(x, y, false);
+}
+
+//------------------------------------------------------------------------------
+
+void TSparseRaster::copyEmptyTiles(const TSparseRaster &src, const TPoint &pos,
+                                   int margin) {
+  TRect srcBounds(src.getRaster()->getBounds());
+
+  for (int y = 0; y < m_tileCountY; ++y)
+    for (int x = 0; x < m_tileCountX; ++x) {
+      TRect srcRect(getTileRect(x, y).enlarge(margin) - pos);
+
+      // Pixels outside src are unknown
+      if (srcBounds.contains(srcRect) && src.isEmpty(srcRect))
+        setTileEmpty(x, y, true);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void TSparseRaster::getFilledRects(std::vector<TRect> &rects) const {
+  for (int y = 0; y < m_tileCountY; ++y)
+    for (int x = 0; x < m_tileCountX;) {
+      if (isTileEmpty(x, y)) {
+        ++x;
+        continue;
+      }
+
+      int x0 = x;
+      while (x < m_tileCountX && !isTileEmpty(x, y)) ++x;
+
+      rects.push_back(getTileRect(x0, y) + getTileRect(x - 1, y));
+    }
+}
@@ -9,6 +9,10 @@
 #include "timagecache.h"
 #include "trasterimage.h"
 
+#include "lzo/lzo1x.h"
+
+#include <QThreadStorage>
+
 //#include "snappy-c.h"
 #if defined(LZ4_STATIC)
 #include "lz4frame_static.h"
@@ -16,10 +20,6 @@
 #include "lz4frame.h"
 #endif
 
-#include <QDir>
-#include <QProcess>
-#include <QCoreApplication>
-
 using namespace std;
 
 namespace {
@@ -30,6 +30,7 @@ class Header {
     Raster32CM,
     RasterGR8,
     RasterGR16,
+    RasterFRGBM,
     RasterUnknown
   };
 
@@ -73,8 +74,13 @@ Header::Header(const TRasterP &ras) {
           if (rasGR16)
             m_rasType = RasterGR16;
           else {
-            assert(!"Unknown RasterType");
-            m_rasType = RasterUnknown;
+            TRasterFP rasF(ras);
+            if (rasF)
+              m_rasType = RasterFRGBM;
+            else {
+              assert(!"Unknown RasterType");
+              m_rasType = RasterUnknown;
+            }
           }
         }
       }
@@ -101,6 +107,9 @@ TRasterP Header::createRaster() const {
   case RasterGR16:
     return TRasterGR16P(m_lx, m_ly);
     break;
+  case RasterFRGBM:
+    return TRasterFP(m_lx, m_ly);
+    break;
   default:
     assert(0);
     return TRasterP();
@@ -125,6 +134,9 @@ int Header::getRasterSize() const {
   case RasterGR8:
     return m_lx * m_ly;
     break;
+  case RasterFRGBM:
+    return 16 * m_lx * m_ly;
+    break;
   default:
     assert(0);
     return 0;
@@ -568,34 +580,42 @@ void TRasterCodecLz4::decompress(const TRasterP &compressedRas,
 //------------------------------------------------------------------------------
 
 namespace {
+// The LZO1X-1 compressor's dictionary, for each thread
+QThreadStorage<QByteArray> lzoWorkMemory;
 
-bool lzoCompress(const QByteArray src, QByteArray &dst) {
-  QDir exeDir(QCoreApplication::applicationDirPath());
-  QString compressExe = exeDir.filePath("lzocompress");
-  QProcess process;
-  process.start(compressExe, QStringList() << QString::number(src.size()));
-  if (!process.waitForStarted()) return false;
-  process.write(src);
-  if (!process.waitForFinished()) return false;
-  dst = process.readAll();
-  return process.exitCode() == 0;
+bool lzoInit() {
+  static const bool initialized = (lzo_init() == LZO_E_OK);
+  return initialized;
 }
 
-bool lzoDecompress(const QByteArray src, int dstSize, QByteArray &dst) {
-  QDir exeDir(QCoreApplication::applicationDirPath());
-  QString decompressExe = exeDir.filePath("lzodecompress");
-  QProcess process;
-  process.start(decompressExe, QStringList() << QString::number(dstSize)
-                                             << QString::number(src.size()));
-  if (!process.waitForStarted()) return false;
-  process.write(src);
-  if (!process.waitForFinished()) return false;
-  dst = process.readAll();
-  return process.exitCode() == 0 && dst.size() == dstSize;
+size_t lzoCompressBound(size_t inSize) {
+  return inSize + inSize / 16 + 64 + 3;
 }
+
+//! Returns the compressed size, or 0 on failure
+size_t lzoCompress(const UCHAR *in, size_t inSize, UCHAR *out) {
+  if (!lzoInit()) return 0;
+
+  if (!lzoWorkMemory.hasLocalData())
+    lzoWorkMemory.setLocalData(
+        QByteArray(LZO1X_1_MEM_COMPRESS, Qt::Uninitialized));
+
+  lzo_uint outSize = 0;
+  int ret = lzo1x_1_compress(in, inSize, out, &outSize,
+                             lzoWorkMemory.localData().data());
+  return (ret == LZO_E_OK) ? outSize : 0;
 }
 
-//------------------------------------------------------------------------------
+//! Decompresses exactly outSize bytes, never overrunning either buffer
+bool lzoDecompress(const UCHAR *in, size_t inSize, UCHAR *out,
+                   size_t outSize) {
+  if (!lzoInit()) return false;
+
+  lzo_uint outLen = outSize;
+  int ret = lzo1x_decompress_safe(in, inSize, out, &outLen, 0);
+  return ret == LZO_E_OK && outLen == outSize;
+}
+}  // namespace
 
 TRasterCodecLZO::TRasterCodecLZO(const std::string &name, bool useCache)
     : TRasterCodec(name), m_raster(), m_useCache(useCache), m_cacheId("") {}
@@ -618,19 +638,7 @@ UINT TRasterCodecLZO::doCompress(const TRasterP &inRas, int allocUnit,
   assert(inRas->getLx() == inRas->getWrap());
 
   size_t inDataSize = inRas->getLx() * inRas->getLy() * inRas->getPixelSize();
-
-  // compress data
-  inRas->lock();
-  char *inData = (char *)inRas->getRawData();
-  QByteArray compressedBuffer;
-  if (!lzoCompress(QByteArray(inData, inDataSize), compressedBuffer))
-    throw TException("LZO compression failed");
-
-  inRas->unlock();
-
-  size_t maxReqSize = compressedBuffer.size();  // we have just done the
-                                                // compression: we know the
-                                                // actual size
+  size_t maxReqSize = lzoCompressBound(inDataSize);
 
   if (m_useCache) {
     if (m_cacheId == "")
@@ -652,15 +660,19 @@ UINT TRasterCodecLZO::doCompress(const TRasterP &inRas, int allocUnit,
       m_raster = outRas;
   }
 
-  size_t outSize = maxReqSize;
   outRas->lock();
-  char *buffer = (char *)outRas->getRawData();  // Change cast types, if needed
+  UCHAR *buffer = outRas->getRawData();
   if (!buffer) {
     outRas->unlock();
     return 0;
   }
-  memcpy(buffer, compressedBuffer.data(), outSize);
+
+  inRas->lock();
+  const UCHAR *inData = inRas->getRawData();
+
+  size_t outSize = lzoCompress(inData, inDataSize, buffer);
   outRas->unlock();
+  inRas->unlock();
 
   return outSize;
 }
@@ -711,36 +723,22 @@ bool TRasterCodecLZO::decompress(const UCHAR *inData, TINT32 inDataSize,
 
   int outDataSize = header->getRasterSize();
 
-  char *mc = (char *)inData + headerSize;
-  int ds   = inDataSize - headerSize;
-
-  size_t outSize = outDataSize;  // Calculate output buffer size
-
-  QByteArray decompressedBuffer;
-  if (!lzoDecompress(QByteArray(mc, ds), outSize, decompressedBuffer))
-    throw TException("LZO decompression failed");
+  const UCHAR *mc = inData + headerSize;
+  size_t ds       = inDataSize - headerSize;
 
   outRas->lock();
-  memcpy(outRas->getRawData(), decompressedBuffer.data(),
-         decompressedBuffer.size());
-  bool rc = true;
-
+  bool ok = lzoDecompress(mc, ds, outRas->getRawData(), outDataSize);
   outRas->unlock();
 
-  /*
-if (rc != true)                                     // Check success code here
-{
-if (safeMode)
-return false;
-else
-{
-throw TException("decompress... something goes bad");
-return false;
-}
-}
-  */
+  if (!ok) {
+    if (safeMode)
+      return false;
+    else {
+      throw TException("LZO decompression failed");
+      return false;
+    }
+  }
 
-  assert(outSize == (size_t)outDataSize);
   return true;
 }
 
@@ -767,26 +765,13 @@ void TRasterCodecLZO::decompress(const TRasterP &compressedRas,
 
   int outDataSize = header.getRasterSize();
 
-  char *mc = (char *)inData + headerSize;
-  int ds   = inDataSize - headerSize;
-
-  size_t outSize = outDataSize;  // Calculate output buffer size
+  const UCHAR *mc = inData + headerSize;
+  size_t ds       = inDataSize - headerSize;
 
-  char *outData = (char *)outRas->getRawData();
-
-  QByteArray decompressedBuffer;
-  if (!lzoDecompress(QByteArray(mc, ds), outSize, decompressedBuffer))
-    throw TException("LZO decompression failed");
   outRas->lock();
-  memcpy(outRas->getRawData(), decompressedBuffer.data(),
-         decompressedBuffer.size());
-  bool rc = true;
-
+  bool ok = lzoDecompress(mc, ds, outRas->getRawData(), outDataSize);
   outRas->unlock();
   compressedRas->unlock();
 
-  if (rc != true)  // Check success code here
-    throw TException("decompress... something goes bad");
-
-  assert(outSize == (size_t)outDataSize);
+  if (!ok) throw TException("LZO decompression failed");
 }
@@ -29,6 +29,24 @@ static void do_convert(const TRaster64P &dst, const TRaster32P &src) {
 
 //-----------------------------------------------------------------------------
 
+//! Converts from and to float rasters. Float channels beyond the integer
+//! range are clamped.
+template <class OutPix, class InPix>
+static void do_convertF(const TRasterPT<OutPix> &dst,
+                        const TRasterPT<InPix> &src) {
+  assert(dst->getSize() == src->getSize());
+  int lx = src->getLx();
+  for (int y = 0; y < src->getLy(); y++) {
+    OutPix *outPix  = dst->pixels(y);
+    InPix *inPix    = src->pixels(y);
+    InPix *inEndPix = inPix + lx;
+    for (; inPix < inEndPix; ++outPix, ++inPix)
+      *outPix = PixelConverter<OutPix>::from(*inPix);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 static void do_convert(const TRasterGR8P &dst, const TRaster32P &src) {
   assert(dst->getSize() == src->getSize());
 
@@ -341,11 +359,13 @@ void TRop::convert(TRasterP dst, const TRasterP &src) {
   TRasterGR8P dst8   = dst;
   TRasterGR16P dst16 = dst;
   TRaster64P dst64   = dst;
+  TRasterFP dstF     = dst;
   TRasterCM32P dstCm = dst;
 
   TRaster32P src32      = src;
   TRasterGR8P src8      = src;
   TRaster64P src64      = src;
+  TRasterFP srcF        = src;
   TRasterYUV422P srcYUV = src;
   TRasterYUV422P dstYUV = dst;
 
@@ -364,6 +384,14 @@ void TRop::convert(TRasterP dst, const TRasterP &src) {
     do_convert(dst16, src64);
   else if (dst32 && src8)
     do_convert(dst32, src8);
+  else if (dstF && src32)
+    do_convertF(dstF, src32);
+  else if (dstF && src64)
+    do_convertF(dstF, src64);
+  else if (dst32 && srcF)
+    do_convertF(dst32, srcF);
+  else if (dst64 && srcF)
+    do_convertF(dst64, srcF);
   else if (dstYUV && src32)
     do_convert(dstYUV, src32);  // Obsolete conversions
   else if (dst32 && srcYUV)
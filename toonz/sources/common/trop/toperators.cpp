@@ -3,6 +3,7 @@
 #include "trop.h"
 #include "tpixel.h"
 #include "tpixelutils.h"
+#include "tsparseraster.h"
 
 // calls to _mm_* functions disabled in code for now (marked as comment)
 // so disable include <emmintrin.h>
@@ -1533,6 +1534,11 @@ void TRop::premultiply(const TRasterP &ras) {
         }
         upRow += ras64->getWrap();
       }
+    } else if (TRasterFP rasF = ras) {
+      for (int y = 0; y < rasF->getLy(); ++y) {
+        TPixelF *upPix = rasF->pixels(y), *endPix = upPix + rasF->getLx();
+        for (; upPix < endPix; ++upPix) premult(*upPix);
+      }
     } else {
       ras->unlock();
       throw TException("TRop::premultiply invalid raster type");
@@ -1576,6 +1582,11 @@ void TRop::depremultiply(const TRasterP &ras) {
         }
         upRow += ras64->getWrap();
       }
+    } else if (TRasterFP rasF = ras) {
+      for (int y = 0; y < rasF->getLy(); ++y) {
+        TPixelF *upPix = rasF->pixels(y), *endPix = upPix + rasF->getLx();
+        for (; upPix < endPix; ++upPix) depremult(*upPix);
+      }
     } else {
       ras->unlock();
       throw TException("TRop::depremultiply invalid raster type");
@@ -1586,6 +1597,24 @@ void TRop::depremultiply(const TRasterP &ras) {
 
 //-----------------------------------------------------------------------------
 
+void TRop::premultiply(const TSparseRaster &ras) {
+  std::vector<TRect> rects;
+  ras.getFilledRects(rects);
+
+  for (TRect &rect : rects) premultiply(ras.getRaster()->extract(rect));
+}
+
+//-----------------------------------------------------------------------------
+
+void TRop::depremultiply(const TSparseRaster &ras) {
+  std::vector<TRect> rects;
+  ras.getFilledRects(rects);
+
+  for (TRect &rect : rects) depremultiply(ras.getRaster()->extract(rect));
+}
+
+//-----------------------------------------------------------------------------
+
 void TRop::expandColor(const TRaster32P &ras32, bool precise) {
   struct locals {
     static void copyRGB(TPixel32 *dst, TPixel32 *src) {
@@ -6,6 +6,7 @@
 #include "tsystem.h"
 #include "tropcm.h"
 #include "tpalette.h"
+#include "tsparseraster.h"
 
 #if defined(_WIN32) && defined(x64)
 #define USE_SSE2
@@ -20,11 +21,15 @@ namespace {
 
 inline bool transp(const TPixel32 &p) { return p.m == 0; }
 inline bool transp(const TPixel64 &p) { return p.m == 0; }
+inline bool transp(const TPixelF &p) {
+  return p.m <= 0.f && p.r == 0.f && p.g == 0.f && p.b == 0.f;
+}
 
 //-----------------------------------------------------------------------------
 
 inline bool opaque(const TPixel32 &p) { return p.m == 0xff; }
 inline bool opaque(const TPixel64 &p) { return p.m == 0xffff; }
+inline bool opaque(const TPixelF &p) { return p.m >= 1.f; }
 
 //-----------------------------------------------------------------------------
 
@@ -160,6 +165,26 @@ void do_overT2(TRasterPT<T> rout, const TRasterPT<T> &rup) {
 
 //-----------------------------------------------------------------------------
 
+//! Unlike the integer version, transparent pixels with some color are added
+//! to the bottom ones.
+void do_overF(TRasterFP rout, const TRasterFP &rup) {
+  assert(rout->getSize() == rup->getSize());
+  for (int y = 0; y < rout->getLy(); y++) {
+    TPixelF *out_pix       = rout->pixels(y);
+    TPixelF *const out_end = out_pix + rout->getLx();
+    const TPixelF *up_pix  = rup->pixels(y);
+
+    for (; out_pix < out_end; ++out_pix, ++up_pix) {
+      if (opaque(*up_pix))
+        *out_pix = *up_pix;
+      else if (!transp(*up_pix))
+        *out_pix = overPix(*out_pix, *up_pix);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 #ifdef USE_SSE2
 
 void do_over_SSE2(TRaster32P rout, const TRaster32P &rup) {
@@ -295,10 +320,13 @@ void TRop::over(const TRasterP &rout, const TRasterP &rdn,
   rup->lock();
   TRaster32P rout32 = cRout, rdn32 = cRdn, rup32 = cRup;
   TRaster64P rout64 = cRout, rdn64 = cRdn, rup64 = cRup;
+  TRasterFP routF = cRout, rdnF = cRdn, rupF = cRup;
   if (rout32 && rdn32 && rup32)
     do_overT3<TPixel32>(rout32, rdn32, rup32);
   else if (rout64 && rdn64 && rup64)
     do_overT3<TPixel64>(rout64, rdn64, rup64);
+  else if (routF && rdnF && rupF)
+    do_overT3<TPixelF>(routF, rdnF, rupF);
   else {
     rout->unlock();
     rdn->unlock();
@@ -325,6 +353,7 @@ void TRop::over(const TRasterP &rout, const TRasterP &rup, const TPoint &pos) {
 
   TRaster32P rout32 = cRout, rup32 = cRup;
   TRaster64P rout64 = cRout, rup64 = cRup;
+  TRasterFP routF = cRout, rupF = cRup;
 
   TRasterGR8P rout8 = cRout, rup8 = cRup;
 
@@ -348,6 +377,13 @@ void TRop::over(const TRasterP &rout, const TRasterP &rup, const TPoint &pos) {
       rup64 = raux;
     }
     do_overT2<TPixel64, USHORT>(rout64, rup64);
+  } else if (routF) {
+    if (!rupF) {
+      TRasterFP raux(cRup->getSize());
+      TRop::convert(raux, cRup);
+      rupF = raux;
+    }
+    do_overF(routF, rupF);
   } else if (rout32 && rup8)
     do_over(rout32, rup8);
   else if (rout8 && rup32)
@@ -368,6 +404,17 @@ void TRop::over(const TRasterP &rout, const TRasterP &rup, const TPoint &pos) {
 
 //-----------------------------------------------------------------------------
 
+void TRop::over(const TRasterP &rout, const TSparseRaster &rup,
+                const TPoint &pos) {
+  std::vector<TRect> rects;
+  rup.getFilledRects(rects);
+
+  for (TRect &rect : rects)
+    over(rout, rup.getRaster()->extract(rect), pos + rect.getP00());
+}
+
+//-----------------------------------------------------------------------------
+
 static void addBackground32(TRaster32P ras, const TPixel32 &col) {
   ras->lock();
   int nrows = ras->getLy();
@@ -26,6 +26,7 @@ using namespace TConsts;
 #include <emmintrin.h>  // per SSE2
 #endif
 
+#include <limits>
 #include <memory>
 
 //===========================================================================
@@ -1103,6 +1104,48 @@ void resample_clear_rgbm(TRasterPT<T> rout, T default_value) {
 
 //---------------------------------------------------------------------------
 
+//! Stores the filtered channels into an integer pixel, rounding and clamping
+//! them to the channel range.
+template <class T>
+inline void setFilteredPixel(T *pix_out, double out_fval_r, double out_fval_g,
+                             double out_fval_b, double out_fval_m) {
+  int out_value_r, out_value_g, out_value_b, out_value_m;
+
+  notLessThan(0.0, out_fval_r);
+  notLessThan(0.0, out_fval_g);
+  notLessThan(0.0, out_fval_b);
+  notLessThan(0.0, out_fval_m);
+  out_value_r = troundp(out_fval_r);
+  out_value_g = troundp(out_fval_g);
+  out_value_b = troundp(out_fval_b);
+  out_value_m = troundp(out_fval_m);
+  notMoreThan(T::maxChannelValue, out_value_r);
+  notMoreThan(T::maxChannelValue, out_value_g);
+  notMoreThan(T::maxChannelValue, out_value_b);
+  notMoreThan(T::maxChannelValue, out_value_m);
+  pix_out->r = out_value_r;
+  pix_out->g = out_value_g;
+  pix_out->b = out_value_b;
+  pix_out->m = out_value_m;
+}
+
+//! Float pixels are not clamped above - values beyond 1 are kept.
+template <>
+inline void setFilteredPixel(TPixelF *pix_out, double out_fval_r,
+                             double out_fval_g, double out_fval_b,
+                             double out_fval_m) {
+  notLessThan(0.0, out_fval_r);
+  notLessThan(0.0, out_fval_g);
+  notLessThan(0.0, out_fval_b);
+  notLessThan(0.0, out_fval_m);
+  pix_out->r = out_fval_r;
+  pix_out->g = out_fval_g;
+  pix_out->b = out_fval_b;
+  pix_out->m = std::min(out_fval_m, 1.0);
+}
+
+//---------------------------------------------------------------------------
+
 template <class T, typename SUMS_TYPE>
 void resample_main_rgbm(TRasterPT<T> rout, const TRasterPT<T> &rin,
                         const TAffine &aff_xy2uv, const TAffine &aff0_uv2fg,
@@ -1139,7 +1182,6 @@ void resample_main_rgbm(TRasterPT<T> rout, const TRasterPT<T> &rin,
   double inv_sum_weights;
   SUMS_TYPE sum_contribs_r, sum_contribs_g, sum_contribs_b, sum_contribs_m;
   double out_fval_r, out_fval_g, out_fval_b, out_fval_m;
-  int out_value_r, out_value_g, out_value_b, out_value_m;
   int i;
 
 #ifdef USE_DOUBLE_TO_INT
@@ -1250,22 +1292,8 @@ void resample_main_rgbm(TRasterPT<T> rout, const TRasterPT<T> &rin,
           out_fval_g      = sum_contribs_g * inv_sum_weights;
           out_fval_b      = sum_contribs_b * inv_sum_weights;
           out_fval_m      = sum_contribs_m * inv_sum_weights;
-          notLessThan(0.0, out_fval_r);
-          notLessThan(0.0, out_fval_g);
-          notLessThan(0.0, out_fval_b);
-          notLessThan(0.0, out_fval_m);
-          out_value_r = troundp(out_fval_r);
-          out_value_g = troundp(out_fval_g);
-          out_value_b = troundp(out_fval_b);
-          out_value_m = troundp(out_fval_m);
-          notMoreThan(T::maxChannelValue, out_value_r);
-          notMoreThan(T::maxChannelValue, out_value_g);
-          notMoreThan(T::maxChannelValue, out_value_b);
-          notMoreThan(T::maxChannelValue, out_value_m);
-          pix_out->r = out_value_r;
-          pix_out->g = out_value_g;
-          pix_out->b = out_value_b;
-          pix_out->m = out_value_m;
+          setFilteredPixel(pix_out, out_fval_r, out_fval_g, out_fval_b,
+                           out_fval_m);
         } else
           // The pixel is copied from the corresponding source...
           *pix_out = buffer_in[ref_u + ref_v * wrap_in];
@@ -1321,22 +1349,8 @@ void resample_main_rgbm(TRasterPT<T> rout, const TRasterPT<T> &rin,
           out_fval_g      = sum_contribs_g * inv_sum_weights;
           out_fval_b      = sum_contribs_b * inv_sum_weights;
           out_fval_m      = sum_contribs_m * inv_sum_weights;
-          notLessThan(0.0, out_fval_r);
-          notLessThan(0.0, out_fval_g);
-          notLessThan(0.0, out_fval_b);
-          notLessThan(0.0, out_fval_m);
-          out_value_r = troundp(out_fval_r);
-          out_value_g = troundp(out_fval_g);
-          out_value_b = troundp(out_fval_b);
-          out_value_m = troundp(out_fval_m);
-          notMoreThan(T::maxChannelValue, out_value_r);
-          notMoreThan(T::maxChannelValue, out_value_g);
-          notMoreThan(T::maxChannelValue, out_value_b);
-          notMoreThan(T::maxChannelValue, out_value_m);
-          pix_out->r = out_value_r;
-          pix_out->g = out_value_g;
-          pix_out->b = out_value_b;
-          pix_out->m = out_value_m;
+          setFilteredPixel(pix_out, out_fval_r, out_fval_g, out_fval_b,
+                           out_fval_m);
         } else
           *pix_out = buffer_in[ref_u + ref_v * wrap_in];
       } else
@@ -2567,9 +2581,15 @@ void rop_resample_rgbm(TRasterPT<T> rout, const TRasterPT<T> &rin,
     }
   }
 
+  if (!std::numeric_limits<typename T::Channel>::is_integer)
+    resample_main_rgbm<T, double>(
+        rout, rin, aff_xy2uv, aff0_uv2fg, min_pix_ref_u, min_pix_ref_v,
+        max_pix_ref_u, max_pix_ref_v, n_pix, pix_ref_u.get(), pix_ref_v.get(),
+        pix_ref_f.get(), pix_ref_g.get(), filter);
+  else
 #ifdef USE_SSE2
-  if ((TSystem::getCPUExtensions() & TSystem::CpuSupportsSse2) &&
-      T::maxChannelValue == 255)
+      if ((TSystem::getCPUExtensions() & TSystem::CpuSupportsSse2) &&
+          T::maxChannelValue == 255)
     resample_main_rgbm_SSE2<T>(rout, rin, aff_xy2uv, aff0_uv2fg, min_pix_ref_u,
                                min_pix_ref_v, max_pix_ref_u, max_pix_ref_v,
                                n_pix, pix_ref_u.get(), pix_ref_v.get(),
@@ -4652,7 +4672,8 @@ void TRop::resample(const TRasterP &rout, const TRasterP &rin,
   rout->lock();
 
   if (filterType == ClosestPixel || filterType == Bilinear) {
-    if ((TRaster64P)rout || (TRaster64P)rin)
+    if ((TRaster64P)rout || (TRaster64P)rin || (TRasterFP)rout ||
+        (TRasterFP)rin)
       filterType = Triangle;
     else {
       quickResample(rout, rin, aff, filterType);
@@ -4684,6 +4705,13 @@ void TRop::resample(const TRasterP &rout, const TRasterP &rin,
           TRop::convert(rin64, rin);
         }
         do_resample<TPixel64>(rout64, rin64, aff, filterType, blur);
+      } else if (TRasterFP routF = rout) {
+        TRasterFP rinF = rin;
+        if (!rinF) {
+          rinF = TRasterFP(rin->getLx(), rin->getLy());
+          TRop::convert(rinF, rin);
+        }
+        do_resample<TPixelF>(routF, rinF, aff, filterType, blur);
       } else {
         TRasterGR8P routGR8 = rout, rinGR8 = rin;
         TRaster32P rin32 = rin;
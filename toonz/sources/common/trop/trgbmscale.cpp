@@ -2,6 +2,7 @@
 
 #include "trop.h"
 #include "tpixelutils.h"
+#include "tsparseraster.h"
 
 /* NOTE: Scale operations can be performed using Look-Up-Tables.
          This is convenient for 8-bit channels, but perhaps not for 16-bit ones:
@@ -275,6 +276,19 @@ void TRop::rgbmScale(TRasterP rout, TRasterP rin, double kr, double kg,
 
 //-----------------------------------------------------------------------------
 
+void TRop::rgbmScale(const TSparseRaster &ras, double kr, double kg,
+                     double kb, double km) {
+  std::vector<TRect> rects;
+  ras.getFilledRects(rects);
+
+  for (TRect &rect : rects) {
+    TRasterP tileRas(ras.getRaster()->extract(rect));
+    rgbmScale(tileRas, tileRas, kr, kg, kb, km);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 void TRop::rgbmAdjust(TRasterP rout, TRasterP rin, const int *in0,
                       const int *in1, const int *out0, const int *out1) {
   if (rout->getSize() != rin->getSize()) throw TRopException("size mismatch");
@@ -141,6 +141,20 @@ pix->b= pix->b*pix->m/T::maxChannelValue;
     }
   }
 }
+
+void doGammaCorrectF(TRasterFP raster, double gamma) {
+  float exponent = 1.0 / gamma;
+
+  for (int j = 0; j < raster->getLy(); j++) {
+    TPixelF *pix = raster->pixels(j), *endPix = pix + raster->getLx();
+    for (; pix < endPix; ++pix) {
+      if (pix->r > 0.f) pix->r = std::pow(pix->r, exponent);
+      if (pix->g > 0.f) pix->g = std::pow(pix->g, exponent);
+      if (pix->b > 0.f) pix->b = std::pow(pix->b, exponent);
+    }
+  }
+}
+
 template <class T, class Q>
 void doGammaCorrectRGBM(TRasterPT<T> raster, double gammar, double gammag,
                         double gammab, double gammam) {
@@ -178,6 +192,8 @@ void TRop::gammaCorrect(TRasterP raster, double gamma) {
     doGammaCorrect<TPixel32, UCHAR>(raster, gamma);
   else if ((TRaster64P)raster)
     doGammaCorrect<TPixel64, USHORT>(raster, gamma);
+  else if ((TRasterFP)raster)
+    doGammaCorrectF(raster, gamma);
   else {
     raster->unlock();
     throw TRopException("isOpaque: unsupported pixel type");
@@ -385,6 +401,7 @@ TTile::TTile(const TRasterP &raster, TPointD pos) : m_pos(pos), m_subRect() {
 void TTile::setRaster(const TRasterP &raster) {
   if (m_rasterId != "") TImageCache::instance()->remove(m_rasterId);
   m_subRect = TRect();
+  m_emptyTiles.clear();
   addInCache(raster);
 }
 
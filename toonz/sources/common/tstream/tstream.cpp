@@ -15,6 +15,9 @@
 
 #include <sstream>
 #include <memory>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 
 using namespace std;
 
@@ -595,13 +598,18 @@ std::string TOStream::getCurrentTagName() {
 /*!
         This class contains TIStream's attributes.
         It is created by memory allocation in the TIStream's constructor.
+
+        The whole document is read in memory when the stream is opened, and
+        tokens are scanned in place: a token is copied only once, when it has
+        been delimited.
 */
 class TIStream::Imp {
 public:
-  istream *m_is;
-  bool m_chanOwner;
+  string m_buffer;  //!< The whole (uncompressed) document
+  const char *m_pos, *m_end;
+  bool m_fail;  //!< Whether a read went past the end, as an istream's failbit
+
   int m_line;
-  string m_strbuffer;
   bool m_compressed;
 
   vector<std::string> m_tagStack;
@@ -615,12 +623,36 @@ public:
 
   VersionNumber m_versionNumber;
 
+  istringstream m_numberStream;  //!< Parses the numbers off the fast path
+
   Imp()
-      : m_is(0)
-      , m_chanOwner(false)
+      : m_pos(0)
+      , m_end(0)
+      , m_fail(true)
       , m_line(0)
       , m_compressed(false)
-      , m_versionNumber(0, 0) {}
+      , m_versionNumber(0, 0) {
+    m_numberStream.imbue(std::locale::classic());
+  }
+
+  void setBuffer() {
+    m_pos  = m_buffer.data();
+    m_end  = m_pos + m_buffer.size();
+    m_fail = false;
+  }
+
+  // istream-like access. Returns -1 at eof
+  int peek() const {
+    return (m_pos < m_end && !m_fail) ? (unsigned char)*m_pos : -1;
+  }
+  bool get(char &c) {
+    if (m_pos < m_end && !m_fail) {
+      c = *m_pos++;
+      return true;
+    }
+    m_fail = true;
+    return false;
+  }
 
   // update m_line if necessary; returns -e if eof
   int getNextChar();
@@ -632,6 +664,9 @@ public:
   bool matchValue(string &value);
 
   void skipCurrentTag();
+
+  bool readInt(int &v);
+  bool readDouble(double &v);
 };
 
 //---------------------------------------------------------------
@@ -649,8 +684,7 @@ TFilePath TIStream::getRepositoryPath() {
 
 int TIStream::Imp::getNextChar() {
   char c;
-  m_is->get(c);
-  if (m_is->eof()) return -1;
+  if (!get(c)) return -1;
   if (c == '\r') m_line++;
   return c;
 }
@@ -658,15 +692,17 @@ int TIStream::Imp::getNextChar() {
 //---------------------------------------------------------------
 
 void TIStream::Imp::skipBlanks() {
-  istream &is = *m_is;
-  istream::int_type c;
-  while (c = is.peek(), (isspace(c) || c == '\r')) getNextChar();
+  if (m_fail) return;
+  while (m_pos < m_end && (isspace((unsigned char)*m_pos) || *m_pos == '\r')) {
+    if (*m_pos == '\r') m_line++;
+    ++m_pos;
+  }
 }
 
 //---------------------------------------------------------------
 
 bool TIStream::Imp::match(char c) {
-  if (m_is->peek() == c) {
+  if (peek() == (unsigned char)c) {
     getNextChar();
     return true;
   } else
@@ -675,42 +711,56 @@ bool TIStream::Imp::match(char c) {
 
 //---------------------------------------------------------------
 
+namespace {
+
+inline bool isIdentChar(unsigned char c) {
+  return isalnum(c) || c == '_' || c == '.' || c == '-';
+}
+
+}  // namespace
+
+//---------------------------------------------------------------
+
 bool TIStream::Imp::matchIdent(string &ident) {
-  istream &is = *m_is;
-  if (!isalnum(is.peek())) return false;
-  ident = "";
-  char c;
-  is.get(c);
-  ident.append(1, c);
-  while (c = is.peek(), isalnum(c) || c == '_' || c == '.' || c == '-') {
-    is.get(c);
-    ident.append(1, c);
-  }
+  int c = peek();
+  if (c < 0 || !isalnum(c)) return false;
+
+  const char *begin = m_pos++;
+  while (m_pos < m_end && isIdentChar(*m_pos)) ++m_pos;
+
+  ident.assign(begin, m_pos);
   return true;
 }
 
 //---------------------------------------------------------------
 
 bool TIStream::Imp::matchValue(string &str) {
-  istream &is = *m_is;
-  char quote  = is.peek();
+  int quote = peek();
+  if (quote != '\'' && quote != '\"') return false;
+  ++m_pos;
+
+  // Values without escapes are copied in one go
+  const char *begin = m_pos;
+  while (m_pos < m_end && *m_pos != quote && *m_pos != '\\') ++m_pos;
+
+  if (m_pos == m_end) {
+    m_fail = true;
+    throw TException("expected '\"'");
+  }
+
+  str.assign(begin, m_pos);
+
   char c;
-  if (!is || (quote != '\'' && quote != '\"')) return false;
-  is.get(c);
-  str = "";
   for (;;) {
-    is.get(c);
-    if (!is) throw TException("expected '\"'");
+    if (!get(c)) throw TException("expected '\"'");
     if (c == quote) break;
     if (c == '\\') {
-      is.get(c);
-      if (!is) throw TException("unexpected EOF");
+      if (!get(c)) throw TException("unexpected EOF");
       if (c != '\'' && c != '\"' && c != '\\')
         throw TException("bad escape sequence");
     }
     str.append(1, c);
   }
-  if (c != quote) throw TException("missing '\"'");
   return true;
 }
 
@@ -726,10 +776,9 @@ bool TIStream::Imp::matchTag() {
   if (match('!')) {
     skipBlanks();
     if (!match('-') || !match('-')) throw TException("expected '<!--' tag");
-    istream &is = *m_is;
     char c;
     int status = 1;
-    while (status != 0 && is.get(c)) switch (status) {
+    while (status != 0 && get(c)) switch (status) {
       case 1:
         if (c == '-') status = 2;
         break;
@@ -756,6 +805,7 @@ bool TIStream::Imp::matchTag() {
 
   if (!matchIdent(tag.m_name)) throw TException("expected identifier");
   skipBlanks();
+  string name, value;
   for (;;) {
     if (match('>')) break;
     if (match('/')) {
@@ -764,11 +814,9 @@ bool TIStream::Imp::matchTag() {
       if (match('>')) break;
       throw TException("expected '>'");
     }
-    string name;
     if (!matchIdent(name)) throw TException("expected identifier");
     skipBlanks();
     if (match('=')) {
-      string value;
       skipBlanks();
       if (!matchValue(value)) throw TException("expected value");
       tag.m_attributes[name] = value;
@@ -782,16 +830,17 @@ bool TIStream::Imp::matchTag() {
 
 void TIStream::Imp::skipCurrentTag() {
   if (m_currentTag.m_type == StreamTag::BeginEndTag) return;
-  istream &is = *m_is;
-  int level   = 1;
+  int level = 1;
   int c;
   for (;;) {
-    if (is.eof()) break;  // unexpected eof
-    c = is.peek();
-    if (c != '<') {
-      getNextChar();
-      continue;
-    }
+    if (m_fail || m_pos == m_end) break;  // unexpected eof
+
+    // Jump to the next tag
+    const char *next = (const char *)memchr(m_pos, '<', m_end - m_pos);
+    if (!next) next = m_end;
+    m_line += (int)std::count(m_pos, next, '\r');
+    m_pos = next;
+    if (m_pos == m_end) break;
 
     // tag found
     c = getNextChar();
@@ -827,29 +876,154 @@ void TIStream::Imp::skipCurrentTag() {
 
 //---------------------------------------------------------------
 
+bool TIStream::Imp::readInt(int &v) {
+  skipBlanks();
+  if (m_fail) return false;
+
+  const char *p = m_pos;
+  bool negative = false;
+  if (p < m_end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+  const char *digits = p;
+  long long value    = 0;
+  while (p < m_end && isdigit((unsigned char)*p) && value <= INT_MAX)
+    value = 10 * value + (*p++ - '0');
+
+  if (p == digits) {
+    m_fail = true;
+    v      = 0;
+    return false;
+  }
+
+  // Out of range values fail, like istream's
+  if (negative) value = -value;
+  if (value < INT_MIN || value > INT_MAX) {
+    while (p < m_end && isdigit((unsigned char)*p)) ++p;
+    m_pos  = p;
+    m_fail = true;
+    v      = (value < 0) ? INT_MIN : INT_MAX;
+    return false;
+  }
+
+  m_pos = p;
+  v     = (int)value;
+  return true;
+}
+
+//---------------------------------------------------------------
+
+bool TIStream::Imp::readDouble(double &v) {
+  static const double powersOf10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                      1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                      1e18, 1e19, 1e20, 1e21, 1e22};
+
+  skipBlanks();
+  if (m_fail || m_pos == m_end) {
+    m_fail = true;
+    return false;
+  }
+
+  // Delimit the number
+  const char *begin = m_pos, *p = m_pos;
+  if (p < m_end && (*p == '-' || *p == '+')) ++p;
+
+  unsigned long long mantissa = 0;
+  int digitsCount = 0, decimalsCount = 0;
+  bool point = false;
+  for (; p < m_end; ++p) {
+    if (isdigit((unsigned char)*p)) {
+      if (mantissa != 0 || *p != '0') ++digitsCount;
+      if (digitsCount <= 19) mantissa = 10 * mantissa + (*p - '0');
+      if (point) ++decimalsCount;
+    } else if (*p == '.' && !point)
+      point = true;
+    else
+      break;
+  }
+
+  bool exponent = false;
+  if (p < m_end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    if (q < m_end && (*q == '-' || *q == '+')) ++q;
+    if (q < m_end && isdigit((unsigned char)*q)) {
+      exponent = true;
+      for (p = q; p < m_end && isdigit((unsigned char)*p);) ++p;
+    }
+  }
+
+  // Exact mantissas divided by exact powers of 10 are correctly rounded,
+  // which covers what TOStream writes. Anything else goes through the
+  // standard parser.
+  if (!exponent && digitsCount <= 15 && decimalsCount <= 22 &&
+      p - begin > (*begin == '-' || *begin == '+') + (point ? 1 : 0)) {
+    v = (double)mantissa / powersOf10[decimalsCount];
+    if (*begin == '-') v = -v;
+    m_pos = p;
+    return true;
+  }
+
+  m_numberStream.clear();
+  m_numberStream.str(string(begin, std::max(p, begin + 1)));
+  m_numberStream >> v;
+
+  if (!m_numberStream) {
+    m_fail = true;
+    return false;
+  }
+
+  m_pos = m_numberStream.eof() ? p : begin + m_numberStream.tellg();
+  return true;
+}
+
+//---------------------------------------------------------------
+
 TIStream::TIStream(const TFilePath &fp) : m_imp(new Imp) {
   m_imp->m_filepath = fp;
-  m_imp->m_is       = new Tifstream(fp);
 
-  if (m_imp->m_is->peek() == 'T')  // non comincia con '<' dev'essere compresso
+  {
+    Tifstream is(fp);
+    if (!is) return;
+
+    is.seekg(0, ios_base::end);
+    streamoff size = is.tellg();
+    is.seekg(0, ios_base::beg);
+
+    if (size > 0) {
+      m_imp->m_buffer.resize((size_t)size);
+      is.read(&m_imp->m_buffer[0], size);
+      m_imp->m_buffer.resize((size_t)is.gcount());
+    }
+  }
+
+  if (!m_imp->m_buffer.empty() &&
+      m_imp->m_buffer[0] ==
+          'T')  // non comincia con '<' dev'essere compresso
   {
     bool swapForEndianess = false;
 
-    unique_ptr<std::istream> is(m_imp->m_is);
-    m_imp->m_is = 0;
+    string compressed;
+    compressed.swap(m_imp->m_buffer);
+
+    const char *is = compressed.data(), *isEnd = is + compressed.size();
+    auto read      = [&](void *dst, size_t size) {
+      if ((size_t)(isEnd - is) < size) throw TException("Corrupted file");
+      memcpy(dst, is, size);
+      is += size;
+    };
 
     char magicBuffer[4];
-    is->read(magicBuffer, 4);
+    read(magicBuffer, 4);
     string magic(magicBuffer, 4);
     size_t in_len, out_len;
 
     if (magic == "TNZC") {
       // Tab3.0 beta
-      is->read((char *)&out_len, sizeof out_len);
-      is->read((char *)&in_len, sizeof in_len);
+      read(&out_len, sizeof out_len);
+      read(&in_len, sizeof in_len);
     } else if (magic == "TABc") {
       TINT32 v;
-      is->read((char *)&v, sizeof v);
+      read(&v, sizeof v);
       printf("magic = %08X\n", v);
 
       if (v == 0x0A0B0C0D)
@@ -861,9 +1035,9 @@ TIStream::TIStream(const TFilePath &fp) : m_imp(new Imp) {
         printf("UH OH!\n");
       }
 
-      is->read((char *)&v, sizeof v);
+      read(&v, sizeof v);
       out_len = swapForEndianess ? swapTINT32(v) : v;
-      is->read((char *)&v, sizeof v);
+      read(&v, sizeof v);
       in_len = swapForEndianess ? swapTINT32(v) : v;
     } else
       throw TException("Bad magic number");
@@ -872,64 +1046,50 @@ TIStream::TIStream(const TFilePath &fp) : m_imp(new Imp) {
                                             // sembrano proprio esagerati
       throw TException("Corrupted file");
 
+    // The compressed data is decoded in place from the file buffer
+    in_len = std::min(in_len, (size_t)(isEnd - is));
+
     LZ4F_decompressionContext_t lz4dctx;
 
     LZ4F_errorCode_t err =
         LZ4F_createDecompressionContext(&lz4dctx, LZ4F_VERSION);
     if (LZ4F_isError(err)) throw TException("Couldn't decompress file");
 
-    char *in = (char *)malloc(in_len);
-    is->read((char *)in, in_len);
-
-    m_imp->m_strbuffer.resize(out_len + 1000);  // per prudenza
-    char *out = (char *)m_imp->m_strbuffer.c_str();
+    m_imp->m_buffer.resize(out_len + 1000);  // per prudenza
+    char *out = &m_imp->m_buffer[0];
 
     size_t check_len = out_len;
 
     // size_t remaining = LZ4F_decompress(lz4dctx, out, &out_len, in, &in_len,
     // NULL);
-    bool ok = lz4decompress(lz4dctx, out, &out_len, in, in_len);
+    bool ok = lz4decompress(lz4dctx, out, &out_len, is, in_len);
     LZ4F_freeDecompressionContext(lz4dctx);
 
-    free(in);
-
     if (!ok) throw TException("Couldn't decompress file");
 
     if (check_len != out_len) throw TException("corrupted file");
 
-    m_imp->m_is = new istringstream(std::string(out, out_len));
+    m_imp->m_buffer.resize(out_len);
   }
 
-  m_imp->m_chanOwner = true;
-}
-
-//---------------------------------------------------------------
-
-/*
-TIStream::TIStream(istream &is)
-         : m_imp(new Imp)
-{
-  m_imp->m_is = &is;
+  m_imp->setBuffer();
 }
-*/
 
 //---------------------------------------------------------------
 
-TIStream::~TIStream() {
-  if (m_imp->m_chanOwner) delete m_imp->m_is;
-}
+TIStream::~TIStream() {}
 
 //---------------------------------------------------------------
 
 TIStream &TIStream::operator>>(int &v) {
-  *(m_imp->m_is) >> v;
+  m_imp->readInt(v);
   return *this;
 }
 
 //---------------------------------------------------------------
 
 TIStream &TIStream::operator>>(double &v) {
-  *(m_imp->m_is) >> v;
+  m_imp->readDouble(v);
   return *this;
 }
 //---------------------------------------------------------------
@@ -943,39 +1103,50 @@ TIStream &TIStream::operator>>(std::wstring &v) {
 
 //---------------------------------------------------------------
 
+namespace {
+
+inline bool isWordChar(unsigned char c) {
+  return isalnum(c) || c == '_' || c == '&' || c == '#' || c == ';' ||
+         c == '%';
+}
+
+}  // namespace
+
+//---------------------------------------------------------------
+
 TIStream &TIStream::operator>>(string &v) {
-  istream &is = *(m_imp->m_is);
-  v           = "";
-  m_imp->skipBlanks();
+  Imp &is = *m_imp;
+  v       = "";
+  is.skipBlanks();
   char c;
-  is.get(c);
+  if (!is.get(c)) return *this;
   if (c == '\"') {
-    is.get(c);
-    while (is && c != '"') {
-      if (c == '\\') {
-        is.get(c);
-        if (!is) throw TException("unexpected EOF");
-        if (c == '"')
-          v.append(1, '"');
-        else if (c == '\\')
-          v.append(1, '\\');
-        else if (c == '\'')
-          v.append(1, '\'');
-        else {
-          v.append(1, '\\');
-          v.append(1, c);
-        }
-      } else
+    // Copy unescaped runs in one go
+    for (;;) {
+      const char *begin = is.m_pos;
+      while (is.m_pos < is.m_end && *is.m_pos != '"' && *is.m_pos != '\\')
+        ++is.m_pos;
+      v.append(begin, is.m_pos);
+
+      if (!is.get(c) || c == '"') break;
+
+      // c == '\\'
+      if (!is.get(c)) throw TException("unexpected EOF");
+      if (c == '"')
+        v.append(1, '"');
+      else if (c == '\\')
+        v.append(1, '\\');
+      else if (c == '\'')
+        v.append(1, '\'');
+      else {
+        v.append(1, '\\');
         v.append(1, c);
-      is.get(c);
+      }
     }
   } else {
-    v.append(1, c);
-    while (c = is.peek(), isalnum(c) || c == '_' || c == '&' || c == '#' ||
-                              c == ';' || c == '%') {
-      is.get(c);
-      v.append(1, c);
-    }
+    const char *begin = is.m_pos - 1;
+    while (is.m_pos < is.m_end && isWordChar(*is.m_pos)) ++is.m_pos;
+    v.assign(begin, is.m_pos);
   }
 
   return *this;
@@ -984,55 +1155,26 @@ TIStream &TIStream::operator>>(string &v) {
 //---------------------------------------------------------------
 
 TIStream &TIStream::operator>>(QString &v) {
-  istream &is = *(m_imp->m_is);
-  v           = "";
-  m_imp->skipBlanks();
-  char c;
-  is.get(c);
-  if (c == '\"') {
-    is.get(c);
-    while (is && c != '"') {
-      if (c == '\\') {
-        is.get(c);
-        if (!is) throw TException("unexpected EOF");
-        if (c == '"')
-          v.append('"');
-        else if (c == '\\')
-          v.append('\\');
-        else if (c == '\'')
-          v.append('\'');
-        else {
-          v.append('\\');
-          v.append(c);
-        }
-      } else
-        v.append(c);
-      is.get(c);
-    }
-  } else {
-    v.append(c);
-    while (c = is.peek(), isalnum(c) || c == '_' || c == '&' || c == '#' ||
-                              c == ';' || c == '%') {
-      is.get(c);
-      v.append(c);
-    }
-  }
-
+  // Characters are taken as Latin-1, as they always were
+  string s;
+  operator>>(s);
+  v = QString::fromLatin1(s.data(), (int)s.size());
   return *this;
 }
 
 //---------------------------------------------------------------
 
 string TIStream::getString() {
-  istream &is = *(m_imp->m_is);
-  string v    = "";
-  m_imp->skipBlanks();
-  char c = is.peek();
+  Imp &is  = *m_imp;
+  string v = "";
+  is.skipBlanks();
+  int c = is.peek();
   while (c != '<') {
-    is.get(c);
+    char ch;
+    is.get(ch);
     c = is.peek();
-    if (!is) throw TException("unexpected EOF");
-    v.append(1, c);
+    if (c < 0) throw TException("unexpected EOF");
+    v.append(1, (char)c);
   }
   return v;
 }
@@ -1040,12 +1182,11 @@ string TIStream::getString() {
 //---------------------------------------------------------------
 
 TIStream &TIStream::operator>>(TPixel32 &v) {
-  istream &is = *(m_imp->m_is);
-  int r, g, b, m;
-  is >> r;
-  is >> g;
-  is >> b;
-  is >> m;
+  int r = 0, g = 0, b = 0, m = 0;
+  m_imp->readInt(r);
+  m_imp->readInt(g);
+  m_imp->readInt(b);
+  m_imp->readInt(m);
   v.r = r;
   v.g = g;
   v.b = b;
@@ -1055,12 +1196,11 @@ TIStream &TIStream::operator>>(TPixel32 &v) {
 //---------------------------------------------------------------
 
 TIStream &TIStream::operator>>(TPixel64 &v) {
-  istream &is = *(m_imp->m_is);
-  int r, g, b, m;
-  is >> r;
-  is >> g;
-  is >> b;
-  is >> m;
+  int r = 0, g = 0, b = 0, m = 0;
+  m_imp->readInt(r);
+  m_imp->readInt(g);
+  m_imp->readInt(b);
+  m_imp->readInt(m);
   v.r = r;
   v.g = g;
   v.b = b;
@@ -1071,42 +1211,36 @@ TIStream &TIStream::operator>>(TPixel64 &v) {
 //---------------------------------------------------------------
 
 TIStream &TIStream::operator>>(TFilePath &v) {
-  istream &is = *(m_imp->m_is);
+  Imp &is = *m_imp;
   string s;
   char c;
-  m_imp->skipBlanks();
-  is.get(c);
+  is.skipBlanks();
+  if (!is.get(c)) return *this;
   if (c == '"') {
-    is.get(c);
-    bool escapeChar = false;
     // If processing double-quote ("), if it's escaped, keep reading.
-    while (is && (c != '"' || escapeChar)) {
-      // if(c=='\\')
-      //   is.get(c);
-      if (c == '\\' && !escapeChar)
-        escapeChar = true;
-      else
-        escapeChar = false;
-      s.append(1, c);
-      is.get(c);
+    const char *begin = is.m_pos;
+    bool escapeChar   = false;
+    while (is.m_pos < is.m_end && (*is.m_pos != '"' || escapeChar)) {
+      escapeChar = (*is.m_pos == '\\' && !escapeChar);
+      ++is.m_pos;
     }
+    s.assign(begin, is.m_pos);
+    is.get(c);
   } else {
     // il filepath non e' fra virgolette:
     // puo' contenere solo caratteri alfanumerici, % e _
-    s.append(1, c);
-    while (is) {
-      c = is.peek();
-      if (!isalnum(c) && c != '%' && c != '_') break;
-      is.get(c);
-      s.append(1, c);
-    }
+    const char *begin = is.m_pos - 1;
+    while (is.m_pos < is.m_end &&
+           (isalnum((unsigned char)*is.m_pos) || *is.m_pos == '%' ||
+            *is.m_pos == '_'))
+      ++is.m_pos;
+    s.assign(begin, is.m_pos);
   }
 
   v = TFilePath(s);
   return *this;
 }
 //---------------------------------------------------------------
-
 TIStream &TIStream::operator>>(TPersist &v) {
   v.loadData(*this);
   return *this;
@@ -1170,7 +1304,7 @@ bool TIStream::eos() {
   if (m_imp->matchTag())
     return m_imp->m_currentTag.m_type == StreamTag::EndTag;
   else
-    return !(*m_imp->m_is);
+    return m_imp->m_fail;
 }
 
 //---------------------------------------------------------------
@@ -1254,15 +1388,15 @@ void TIStream::closeChild() {
 
 bool TIStream::match(char c) const {
   m_imp->skipBlanks();
-  if (m_imp->m_is->peek() != c) return false;
-  m_imp->m_is->get(c);
+  if (m_imp->peek() != (unsigned char)c) return false;
+  m_imp->get(c);
   if (c == '\r') m_imp->m_line++;
   return true;
 }
 
 //---------------------------------------------------------------
 
-TIStream::operator bool() const { return (m_imp->m_is && *m_imp->m_is); }
+TIStream::operator bool() const { return !m_imp->m_fail; }
 
 //---------------------------------------------------------------
 
@@ -6,8 +6,17 @@
 #include "tsystem.h"
 #include "tconvert.h"
 #include <set>
+#include <atomic>
 #include "tfilepath_io.h"
 
+#include <QThreadStorage>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #ifdef _DEBUG
 std::set<TRaster *> Rasters;
 #endif
@@ -22,11 +31,11 @@ std::set<TRaster *> Rasters;
 
 class Chunkinfo {
 public:
-  TUINT32 m_size;
+  TUINT64 m_size;
   // int m_locks;
   std::vector<TRaster *> m_rasters;
   // bool m_putInNormalMemory;
-  Chunkinfo(TUINT32 size, TRaster *ras)  //, bool putInNormalMemory=false)
+  Chunkinfo(TUINT64 size, TRaster *ras)  //, bool putInNormalMemory=false)
       : m_size(size)
         //, m_locks(0)
         ,
@@ -43,6 +52,292 @@ public:
   /*, m_putInNormalMemory(false)*/ {}
 };
 
+//==============================================================================
+
+namespace {
+
+// Smaller buffers are left to the heap
+const TUINT64 MinPooledSize = 64 << 10;
+
+// Size classes per power of two: a pooled buffer is at most a fourth larger
+// than requested. The pages past the requested size are never touched, so
+// the system does not even commit them.
+const int ClassesPerOctave = 4;
+const int ClassesCount     = 48 * ClassesPerOctave;
+
+#ifdef MADV_HUGEPAGE
+const TUINT64 HugePageSize = 2 << 20;
+#endif
+
+TUINT64 getClassSize(int sizeClass) {
+  TUINT64 base = MinPooledSize << (sizeClass / ClassesPerOctave);
+  return base + (base / ClassesPerOctave) * (sizeClass % ClassesPerOctave);
+}
+
+int getSizeClass(TUINT64 size) {
+  int sizeClass = 0;
+  TUINT64 base  = MinPooledSize;
+  while (base * 2 < size) {
+    base <<= 1;
+    sizeClass += ClassesPerOctave;
+  }
+
+  if (size <= base) return sizeClass;
+
+  TUINT64 step = base / ClassesPerOctave;
+  return sizeClass + (int)((size - base + step - 1) / step);
+}
+
+//! Takes a zeroed, page-aligned buffer from the system, backed by huge pages
+//! where available.
+UCHAR *mapBuffer(TUINT64 size) {
+#ifdef _WIN32
+  return (UCHAR *)VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT,
+                               PAGE_READWRITE);
+#else
+  void *buffer = mmap(0, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) return 0;
+
+#ifdef MADV_HUGEPAGE
+  if (size >= HugePageSize) madvise(buffer, size, MADV_HUGEPAGE);
+#endif
+
+  return (UCHAR *)buffer;
+#endif
+}
+
+void unmapBuffer(UCHAR *buffer, TUINT64 size) {
+#ifdef _WIN32
+  VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+  munmap(buffer, size);
+#endif
+}
+
+}  // namespace
+
+//==============================================================================
+
+//! Keeps the idle raster buffers in free lists by size class, up to a maximum
+//! total size. Besides, each thread keeps one buffer per class for itself, so
+//! that the temporary rasters of a thread are recycled without locking. The
+//! maximum size accounts for the threads' buffers too.
+class RasterBufferPool {
+  struct ThreadCache {
+    RasterBufferPool *m_pool;
+    UCHAR *m_buffers[ClassesCount];
+    TUINT64 m_size;
+    int m_trimCount;  //!< The pool's trims seen by the thread
+
+    ThreadCache(RasterBufferPool *pool)
+        : m_pool(pool), m_size(0), m_trimCount(pool->m_trimCount) {
+      std::fill(m_buffers, m_buffers + ClassesCount, (UCHAR *)0);
+    }
+
+    ~ThreadCache() { flush(true); }
+
+    //! Gives the buffers back to the pool - or to the system, if \b keep is
+    //! false.
+    void flush(bool keep);
+  };
+
+  TThread::Mutex m_mutex;
+  std::vector<UCHAR *> m_freeLists[ClassesCount];
+  std::atomic<TUINT64> m_idleSize;  // Shared and threads' idle buffers
+  TUINT64 m_maxIdleSize, m_maxThreadCacheSize;
+
+  // Threads give their idle buffers back to the system as they see a trim
+  std::atomic<int> m_trimCount;
+
+  QThreadStorage<ThreadCache *> m_threadCaches;
+
+  std::atomic<TINT64> m_mappedBuffers, m_reusedBuffers, m_threadReuses,
+      m_unmappedBuffers;
+
+public:
+  RasterBufferPool(TUINT64 maxIdleSize)
+      : m_idleSize(0)
+      , m_maxIdleSize(maxIdleSize)
+      , m_maxThreadCacheSize(std::min(maxIdleSize / 8, (TUINT64)256 << 20))
+      , m_trimCount(0)
+      , m_mappedBuffers(0)
+      , m_reusedBuffers(0)
+      , m_threadReuses(0)
+      , m_unmappedBuffers(0) {}
+
+  UCHAR *allocate(TUINT64 size, int &sizeClass);
+  void release(UCHAR *buffer, int sizeClass);
+  void trim();
+
+  TBigMemoryManager::PoolStatistics getStatistics() const;
+
+private:
+  ThreadCache *getThreadCache();
+  bool reserveIdle(TUINT64 size);
+  void releaseShared(UCHAR *buffer, int sizeClass);
+};
+
+//------------------------------------------------------------------------------
+
+void RasterBufferPool::ThreadCache::flush(bool keep) {
+  for (int c = 0; c < ClassesCount; ++c) {
+    UCHAR *buffer = m_buffers[c];
+    if (!buffer) continue;
+
+    m_buffers[c] = 0;
+    m_pool->m_idleSize -= getClassSize(c);
+
+    if (keep)
+      m_pool->releaseShared(buffer, c);
+    else {
+      unmapBuffer(buffer, getClassSize(c));
+      ++m_pool->m_unmappedBuffers;
+    }
+  }
+
+  m_size = 0;
+}
+
+//------------------------------------------------------------------------------
+
+//! Returns the calling thread's cache, emptied if the pool was trimmed since
+//! its last access.
+RasterBufferPool::ThreadCache *RasterBufferPool::getThreadCache() {
+  if (!m_threadCaches.hasLocalData())
+    m_threadCaches.setLocalData(new ThreadCache(this));
+
+  ThreadCache *cache = m_threadCaches.localData();
+
+  int trimCount = m_trimCount;
+  if (cache->m_trimCount != trimCount) {
+    cache->flush(false);
+    cache->m_trimCount = trimCount;
+  }
+
+  return cache;
+}
+
+//------------------------------------------------------------------------------
+
+//! Accounts for a new idle buffer of specified size, returning false if it
+//! does not fit in the maximum idle size.
+bool RasterBufferPool::reserveIdle(TUINT64 size) {
+  TUINT64 idleSize = m_idleSize;
+  do {
+    if (idleSize + size > m_maxIdleSize) return false;
+  } while (!m_idleSize.compare_exchange_weak(idleSize, idleSize + size));
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+//! Returns a zeroed buffer of at least the specified size, or 0 if the system
+//! has no memory left.
+UCHAR *RasterBufferPool::allocate(TUINT64 size, int &sizeClass) {
+  int c         = getSizeClass(size);
+  UCHAR *buffer = 0;
+
+  ThreadCache *cache = getThreadCache();
+  if ((buffer = cache->m_buffers[c])) {
+    cache->m_buffers[c] = 0;
+    cache->m_size -= getClassSize(c);
+    m_idleSize -= getClassSize(c);
+    ++m_threadReuses;
+  } else {
+    TThread::MutexLocker sl(&m_mutex);
+
+    std::vector<UCHAR *> &freeList = m_freeLists[c];
+    if (!freeList.empty()) {
+      buffer = freeList.back();
+      freeList.pop_back();
+      m_idleSize -= getClassSize(c);
+    }
+  }
+
+  if (buffer) {
+    memset(buffer, 0, size);
+    ++m_reusedBuffers;
+  } else {
+    if (!(buffer = mapBuffer(getClassSize(c)))) return 0;
+    ++m_mappedBuffers;
+  }
+
+  sizeClass = c;
+  return buffer;
+}
+
+//------------------------------------------------------------------------------
+
+void RasterBufferPool::release(UCHAR *buffer, int sizeClass) {
+  TUINT64 size       = getClassSize(sizeClass);
+  ThreadCache *cache = getThreadCache();
+
+  if (!cache->m_buffers[sizeClass] &&
+      cache->m_size + size <= m_maxThreadCacheSize && reserveIdle(size)) {
+    cache->m_buffers[sizeClass] = buffer;
+    cache->m_size += size;
+    return;
+  }
+
+  releaseShared(buffer, sizeClass);
+}
+
+//------------------------------------------------------------------------------
+
+void RasterBufferPool::releaseShared(UCHAR *buffer, int sizeClass) {
+  TUINT64 size = getClassSize(sizeClass);
+
+  if (reserveIdle(size)) {
+    TThread::MutexLocker sl(&m_mutex);
+    m_freeLists[sizeClass].push_back(buffer);
+    return;
+  }
+
+  unmapBuffer(buffer, size);
+  ++m_unmappedBuffers;
+}
+
+//------------------------------------------------------------------------------
+
+//! Gives the shared idle buffers, and those cached by the calling thread,
+//! back to the system. The other threads release theirs on their next access
+//! to the pool.
+void RasterBufferPool::trim() {
+  ++m_trimCount;
+  getThreadCache();
+
+  std::vector<UCHAR *> freeLists[ClassesCount];
+
+  {
+    TThread::MutexLocker sl(&m_mutex);
+    for (int c = 0; c < ClassesCount; ++c) {
+      freeLists[c].swap(m_freeLists[c]);
+      m_idleSize -= freeLists[c].size() * getClassSize(c);
+    }
+  }
+
+  for (int c = 0; c < ClassesCount; ++c)
+    for (UCHAR *buffer : freeLists[c]) {
+      unmapBuffer(buffer, getClassSize(c));
+      ++m_unmappedBuffers;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+TBigMemoryManager::PoolStatistics RasterBufferPool::getStatistics() const {
+  TBigMemoryManager::PoolStatistics stats;
+  stats.m_mappedBuffers   = m_mappedBuffers;
+  stats.m_reusedBuffers   = m_reusedBuffers;
+  stats.m_threadReuses    = m_threadReuses;
+  stats.m_unmappedBuffers = m_unmappedBuffers;
+  return stats;
+}
+
+//==============================================================================
+
 //------------------------------------------------------------
 
 //! Sets the global callback handler for the 'Run out of contiguous memory'
@@ -102,7 +397,7 @@ theManager = 0;
 
 //------------------------------------------------------------------------------
 
-UCHAR *TBigMemoryManager::allocate(UINT &size) {
+UCHAR *TBigMemoryManager::allocate(TUINT64 &size) {
   TThread::MutexLocker sl(&m_mutex);
   UCHAR *chunk = (UCHAR *)calloc(size, 1);
   while (chunk == 0 && size > 128 * 1024 * 1024) {
@@ -119,6 +414,7 @@ TBigMemoryManager::TBigMemoryManager()
     , m_theMemory(0)
     , m_availableMemory(0)
     , m_allocatedMemory(0)
+    , m_pool(0)
 #ifdef _DEBUG
     , m_totRasterMemInKb(0)
 #endif
@@ -127,12 +423,13 @@ TBigMemoryManager::TBigMemoryManager()
 
 //------------------------------------------------------------------------------
 
-bool TBigMemoryManager::init(TUINT32 sizeinKb) {
+bool TBigMemoryManager::init(TUINT64 sizeinKb) {
   TThread::MutexLocker sl(&m_mutex);
 
   if (sizeinKb == 0) return true;
+  if (m_pool) return false;
 
-  if (sizeinKb >= 2 * 1024 * 1024) {
+  if (sizeof(void *) == 4 && sizeinKb >= 2 * 1024 * 1024) {
     //  MessageBox( NULL, "TRONCO!!!", "Warning", MB_OK);
     sizeinKb = (TUINT32)(1.8 * 1024 * 1024);
   }
@@ -157,6 +454,42 @@ bool TBigMemoryManager::init(TUINT32 sizeinKb) {
   return true;
 }
 
+//------------------------------------------------------------------------------
+
+bool TBigMemoryManager::initPools(TUINT64 idleSizeInKb) {
+  TThread::MutexLocker sl(&m_mutex);
+
+  if (m_theMemory || m_pool) return false;
+
+  m_pool = new RasterBufferPool(idleSizeInKb << 10);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void TBigMemoryManager::releaseIdleBuffers() {
+  if (m_pool) m_pool->trim();
+}
+
+//------------------------------------------------------------------------------
+
+TBigMemoryManager::PoolStatistics TBigMemoryManager::getPoolStatistics()
+    const {
+  return m_pool ? m_pool->getStatistics() : PoolStatistics();
+}
+
+//------------------------------------------------------------------------------
+
+std::string TBigMemoryManager::getPoolStatisticsString() const {
+  PoolStatistics stats = getPoolStatistics();
+
+  return "Raster pool: " + std::to_string(stats.m_mappedBuffers) +
+         " buffers allocated, " + std::to_string(stats.m_reusedBuffers) +
+         " reused (" + std::to_string(stats.m_threadReuses) +
+         " by the same thread), " + std::to_string(stats.m_unmappedBuffers) +
+         " released";
+}
+
 //------------------------------------------------------------------------------
 /*
 void TBigMemoryManager::lock(UCHAR *buffer)
@@ -192,18 +525,18 @@ assert(locks>0);
 
 //------------------------------------------------------------------------------
 
-UCHAR *TBigMemoryManager::getBuffer(UINT size) {
+UCHAR *TBigMemoryManager::getBuffer(TUINT64 size) {
   if (m_theMemory == 0) return (UCHAR *)calloc(size, 1);
 
   std::map<UCHAR *, Chunkinfo>::iterator it = m_chunks.begin();
   UCHAR *buffer     = m_theMemory;
-  TUINT32 chunkSize = 0;
+  TUINT64 chunkSize = 0;
   UCHAR *address    = 0;
   while (it != m_chunks.end()) {
     /*if (it->second.m_putInNormalMemory)
 {it++; continue;}*/
 
-    if ((TUINT32)((it->first) - (buffer + chunkSize)) >= size) {
+    if ((TUINT64)((it->first) - (buffer + chunkSize)) >= size) {
       address = buffer + chunkSize;
       break;
     }
@@ -221,9 +554,9 @@ UCHAR *TBigMemoryManager::getBuffer(UINT size) {
 #ifdef _DEBUG
 
 void TBigMemoryManager::getRasterInfo(int &rasterCount,
-                                      TUINT32 &totRasterMemInKb,
+                                      TUINT64 &totRasterMemInKb,
                                       int &notCachedRasterCount,
-                                      TUINT32 &notCachedRasterMemInKb) {
+                                      TUINT64 &notCachedRasterMemInKb) {
   totRasterMemInKb       = 0;
   notCachedRasterMemInKb = 0;
   notCachedRasterCount   = 0;
@@ -257,7 +590,7 @@ bool TBigMemoryManager::putRaster(TRaster *ras, bool canPutOnDisk) {
   checkConsistency();
 #endif
 
-  TUINT32 size = ras->getLx() * ras->getLy() * ras->getPixelSize();
+  TUINT64 size = (TUINT64)ras->getLx() * ras->getLy() * ras->getPixelSize();
 
   if (size == 0) {
     ras->m_buffer = 0;
@@ -267,12 +600,29 @@ bool TBigMemoryManager::putRaster(TRaster *ras, bool canPutOnDisk) {
   if (m_theMemory == 0)  // il bigmemorymanager e' inattivo
   {
     if (!ras->m_parent) {
-      int sizeKB       = size >> 10;
+      int sizeKB       = (int)(size >> 10);
       allocationPeakKB = std::max(allocationPeakKB, sizeKB);
       allocationSumKB += sizeKB;
       allocationCount++;
     }
 
+    if (!ras->m_parent && m_pool && size >= MinPooledSize) {
+      ras->m_buffer = m_pool->allocate(size, ras->m_poolClass);
+      if (!ras->m_buffer) {
+        // Out of memory - give the idle buffers back first
+        m_pool->trim();
+        ras->m_buffer = m_pool->allocate(size, ras->m_poolClass);
+      }
+
+      if (ras->m_buffer) {
+#ifdef _DEBUG
+        m_totRasterMemInKb += size >> 10;
+        Rasters.insert(ras);
+#endif
+        return true;
+      }
+    }
+
     if (!ras->m_parent && !(ras->m_buffer = (UCHAR *)calloc(size, 1))) {
       // MessageBox( NULL, "Ouch!can't allocate!", "Warning", MB_OK);
       // non c'e' memoria; provo a comprimere
@@ -432,6 +782,17 @@ void TBigMemoryManager::printMap() {
 #endif
 
 bool TBigMemoryManager::releaseRaster(TRaster *ras) {
+  if (ras->m_poolClass >= 0) {
+    assert(!ras->m_parent && ras->m_bufferOwner);
+    m_pool->release(ras->m_buffer, ras->m_poolClass);
+#ifdef _DEBUG
+    m_totRasterMemInKb -=
+        ((TUINT64)ras->getPixelSize() * ras->getLx() * ras->getLy()) >> 10;
+    Rasters.erase(ras);
+#endif
+    return false;
+  }
+
   TThread::MutexLocker sl(&m_mutex);
   UCHAR *buffer = (ras->m_parent) ? (ras->m_parent->m_buffer) : (ras->m_buffer);
   std::map<UCHAR *, Chunkinfo>::iterator it = m_chunks.find(buffer);
@@ -502,14 +863,14 @@ void TBigMemoryManager::checkConsistency() {
   // int size = m_chunks.size();
   std::map<UCHAR *, Chunkinfo>::iterator it = m_chunks.begin();
   UCHAR *endAddress = m_theMemory;
-  TUINT32 freeMem = 0, allocMem = 0;
+  TUINT64 freeMem = 0, allocMem = 0;
 
   while (it != m_chunks.end()) {
     count++;
     // assert(it->second.m_rasters.size()==0 || it->second.m_rasters.size()>0);
 
     if (endAddress != 0 /*&& !it->second.m_putInNormalMemory*/) {
-      freeMem += (TUINT32)(it->first - endAddress);
+      freeMem += (TUINT64)(it->first - endAddress);
       allocMem += it->second.m_size;
     }
     assert(endAddress <= it->first);
@@ -523,12 +884,12 @@ void TBigMemoryManager::checkConsistency() {
       UCHAR *buf1 = (ras->m_parent) ? ras->m_parent->m_buffer : ras->m_buffer;
       UCHAR *buf2 = it->first;
       assert(buf1 == buf2);
-      UINT size;
+      TUINT64 size;
       if (ras->m_parent)
-        size = ras->m_parent->getLx() * ras->m_parent->getLy() *
+        size = (TUINT64)ras->m_parent->getLx() * ras->m_parent->getLy() *
                ras->m_parent->getPixelSize();
       else
-        size = ras->getLx() * ras->getLy() * ras->getPixelSize();
+        size = (TUINT64)ras->getLx() * ras->getLy() * ras->getPixelSize();
       assert(size == it->second.m_size);
     }
     it++;
@@ -544,7 +905,7 @@ void TBigMemoryManager::checkConsistency() {
 //------------------------------------------------------------------------------
 
 std::map<UCHAR *, Chunkinfo>::iterator TBigMemoryManager::shiftBlock(
-    const std::map<UCHAR *, Chunkinfo>::iterator &it, TUINT32 offset) {
+    const std::map<UCHAR *, Chunkinfo>::iterator &it, TUINT64 offset) {
   UCHAR *newAddress = it->first - offset;
 
   if (offset > it->second.m_size)
@@ -591,7 +952,7 @@ std::map<UCHAR *, Chunkinfo>::iterator TBigMemoryManager::shiftBlock(
 
 //------------------------------------------------------------------------------
 
-UCHAR *TBigMemoryManager::remap(TUINT32 size)  // size==0 -> remappo tutto
+UCHAR *TBigMemoryManager::remap(TUINT64 size)  // size==0 -> remappo tutto
 {
   bool locked = false;
 // QMutexLocker sl(m_mutex); //gia' scopata
@@ -604,12 +965,12 @@ UCHAR *TBigMemoryManager::remap(TUINT32 size)  // size==0 -> remappo tutto
 
   try {
     UCHAR *buffer     = m_theMemory;
-    TUINT32 chunkSize = 0;
+    TUINT64 chunkSize = 0;
     while (it != m_chunks.end()) {
       /*if (it->second.m_putInNormalMemory)
 {it++; continue;}*/
 
-      TUINT32 gap = (TUINT32)((it->first) - (buffer + chunkSize));
+      TUINT64 gap = (TUINT64)((it->first) - (buffer + chunkSize));
       if (size > 0 && gap >= size)  // trovato chunk sufficiente
         return buffer + chunkSize;
       else if (gap > 0 && it->second.m_size > 0)  // c'e' un frammento di
@@ -657,7 +1018,7 @@ UCHAR *TBigMemoryManager::remap(TUINT32 size)  // size==0 -> remappo tutto
 
 //------------------------------------------------------------------------------
 
-void TBigMemoryManager::printLog(TUINT32 size) {
+void TBigMemoryManager::printLog(TUINT64 size) {
   TFilePath fp("C:\\memorymaplog.txt");
   Tofstream os(fp);
 
@@ -666,10 +1027,10 @@ void TBigMemoryManager::printLog(TUINT32 size) {
   os << "memoria libera: " << m_availableMemory / 1024 << " KB\n\n\n";
 
   std::map<UCHAR *, Chunkinfo>::iterator it = m_chunks.begin();
-  UCHAR *buffer  = m_theMemory;
-  UINT chunkSize = 0;
+  UCHAR *buffer     = m_theMemory;
+  TUINT64 chunkSize = 0;
   for (; it != m_chunks.end(); it++) {
-    TUINT32 gap = (TUINT32)((it->first) - (buffer + chunkSize));
+    TUINT64 gap = (TUINT64)((it->first) - (buffer + chunkSize));
     if (gap > 0) os << "- gap di " << gap / 1024 << " KB\n";
     if (it->second.m_size > 0)
       os << "- raster di " << it->second.m_size / 1024 << " KB"
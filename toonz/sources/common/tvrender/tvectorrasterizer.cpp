@@ -0,0 +1,463 @@
+#include "tvectorrasterizer.h"
+
+// TnzCore includes
+#include "tvectorimage.h"
+#include "tvectorrenderdata.h"
+#include "tstroke.h"
+#include "tregion.h"
+#include "tpalette.h"
+#include "tsimplecolorstyles.h"
+#include "tcolorfunctions.h"
+#include "tstrokeoutline.h"
+#include "drawutil.h"
+#include "tutil.h"
+
+// Qt includes
+#include <QMutexLocker>
+
+// STD includes
+#include <algorithm>
+
+//***************************************************************************************
+//    Local namespace  stuff
+//***************************************************************************************
+
+namespace {
+
+/*!
+  Accumulates the signed area covered by closed contours, pixel by pixel.
+  Each line contributes to the pixels it crosses the difference of coverage
+  it induces on the pixels at its right; summing the buffer along a row then
+  yields the winding number at each pixel, with exact partial values on the
+  contours. Positively oriented contours add a positive winding.
+*/
+class CoverageBuffer {
+  int m_lx, m_ly, m_wrap;
+  std::vector<float> m_buffer;
+
+public:
+  void reset(int lx, int ly) {
+    m_lx = lx, m_ly = ly, m_wrap = lx + 2;
+    m_buffer.assign(m_wrap * m_ly, 0.0f);
+  }
+
+  const float *row(int y) const { return &m_buffer[y * m_wrap]; }
+
+  void addLine(TPointD p0, TPointD p1) {
+    // Lines beyond the vertical borders still cover the pixels at their
+    // right. Split them there, and flatten the outer parts on the border.
+    double borders[2] = {0.0, (double)m_lx};
+    for (double b : borders) {
+      if ((p0.x < b && b < p1.x) || (p1.x < b && b < p0.x)) {
+        TPointD p(b, p0.y + (b - p0.x) * (p1.y - p0.y) / (p1.x - p0.x));
+        addLine(p0, p);
+        addLine(p, p1);
+        return;
+      }
+    }
+
+    p0.x = tcrop(p0.x, 0.0, (double)m_lx);
+    p1.x = tcrop(p1.x, 0.0, (double)m_lx);
+
+    addClippedLine(p0, p1);
+  }
+
+private:
+  void addClippedLine(TPointD p0, TPointD p1) {
+    if (p0.y == p1.y) return;
+
+    double dir = -1.0;
+    if (p0.y > p1.y) std::swap(p0, p1), dir = 1.0;
+
+    double dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    double x    = (p0.y < 0.0) ? p0.x - p0.y * dxdy : p0.x;
+
+    int yStart = std::max((int)std::floor(p0.y), 0),
+        yEnd   = std::min((int)std::ceil(p1.y), m_ly);
+
+    for (int y = yStart; y < yEnd; ++y) {
+      float *buf = &m_buffer[y * m_wrap];
+
+      double dy    = std::min(y + 1.0, p1.y) - std::max((double)y, p0.y);
+      double xNext = x + dxdy * dy;
+      double d     = dy * dir;
+
+      // Rounding errors may push clipped lines slightly past the borders
+      x     = tcrop(x, 0.0, (double)m_lx);
+      xNext = tcrop(xNext, 0.0, (double)m_lx);
+
+      double xa = std::min(x, xNext), xb = std::max(x, xNext);
+      double xaFloor = std::floor(xa), xbCeil = std::ceil(xb);
+      int xai = (int)xaFloor, xbi = (int)xbCeil;
+
+      if (xbi <= xai + 1) {
+        // The line stays within a pixel column
+        double xm = 0.5 * (x + xNext) - xaFloor;
+        buf[xai] += d * (1.0 - xm);
+        buf[xai + 1] += d * xm;
+      } else {
+        double s   = 1.0 / (xb - xa);
+        double xaf = xa - xaFloor, xbf = xb - xbCeil + 1.0;
+        double a0 = 0.5 * s * (1.0 - xaf) * (1.0 - xaf),
+               am = 0.5 * s * xbf * xbf;
+
+        buf[xai] += d * a0;
+
+        if (xbi == xai + 2)
+          buf[xai + 1] += d * (1.0 - a0 - am);
+        else {
+          double a1 = s * (1.5 - xaf);
+          buf[xai + 1] += d * (a1 - a0);
+
+          for (int xi = xai + 2; xi < xbi - 1; ++xi) buf[xi] += d * s;
+
+          double a2 = a1 + (xbi - xai - 3) * s;
+          buf[xbi - 1] += d * (1.0 - a2 - am);
+        }
+
+        buf[xbi] += d * am;
+      }
+
+      x = xNext;
+    }
+  }
+};
+
+//-----------------------------------------------------------------------------
+
+//! Blends the color over the raster, weighted by the coverage in the buffer
+template <typename PIXEL>
+void blendCoverage(const TRasterPT<PIXEL> &ras, const TRect &rect,
+                   const CoverageBuffer &buffer, const TPixel32 &color,
+                   bool antialias) {
+  typedef typename PIXEL::Channel Channel;
+
+  const double maxValue = PIXEL::maxChannelValue;
+
+  // Premultiplied color, normalized
+  double m = color.m / 255.0, r = m * color.r / 255.0,
+         g = m * color.g / 255.0, b = m * color.b / 255.0;
+
+  int lx = rect.getLx(), ly = rect.getLy();
+
+  for (int y = 0; y < ly; ++y) {
+    const float *buf = buffer.row(y);
+    PIXEL *pix       = ras->pixels(rect.y0 + y) + rect.x0;
+
+    double winding = 0.0;
+
+    for (int x = 0; x < lx; ++x, ++pix) {
+      winding += buf[x];
+
+      double cover = tcrop(winding, 0.0, 1.0);
+      if (!antialias) cover = (cover >= 0.5) ? 1.0 : 0.0;
+
+      if (cover <= 0.0) continue;
+
+      double k = 1.0 - cover * m;
+      pix->r   = (Channel)(maxValue * cover * r + k * pix->r + 0.5);
+      pix->g   = (Channel)(maxValue * cover * g + k * pix->g + 0.5);
+      pix->b   = (Channel)(maxValue * cover * b + k * pix->b + 0.5);
+      pix->m   = (Channel)(maxValue * cover * m + k * pix->m + 0.5);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+//! Twice the signed area of the contour
+double signedArea(const TPointD *begin, const TPointD *end) {
+  double area = 0.0;
+  for (const TPointD *p = begin, *q = end - 1; p != end; q = p++)
+    area += q->x * p->y - p->x * q->y;
+
+  return area;
+}
+
+//-----------------------------------------------------------------------------
+
+//! Builds the outline of a region, as the OpenGL renderer does. Backward edges
+//! are sampled forward, so that adjacent regions share the same vertices.
+void regionPolyline(std::vector<TPointD> &polyline, const TRegion *region,
+                    double pixelSize) {
+  std::vector<TPointD> edgePolyline;
+
+  UINT e, eCount = region->getEdgeCount();
+  for (e = 0; e < eCount; ++e) {
+    const TEdge &edge = *region->getEdge(e);
+    if (edge.m_index < 0 || !edge.m_s) continue;
+
+    if (edge.m_w0 > edge.m_w1) {
+      edgePolyline.clear();
+      stroke2polyline(edgePolyline, *edge.m_s, pixelSize, edge.m_w1,
+                      edge.m_w0, true);
+      polyline.insert(polyline.end(), edgePolyline.rbegin(),
+                      edgePolyline.rend());
+    } else
+      stroke2polyline(polyline, *edge.m_s, pixelSize, edge.m_w0, edge.m_w1);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+bool isZeroThick(const TStroke *stroke) {
+  for (int i = 0; i < stroke->getControlPointCount(); ++i)
+    if (stroke->getControlPoint(i).thick != 0) return false;
+
+  return true;
+}
+
+}  // namespace
+
+//***************************************************************************************
+//    TVectorRasterizer  implementation
+//***************************************************************************************
+
+TVectorRasterizer::TVectorRasterizer(const TVectorImage *vi,
+                                     const TVectorRenderData &_rd)
+    : m_clippingRect(_rd.m_clippingRect), m_supported(true) {
+  TVectorRenderData rd(_rd);
+  if (!rd.m_palette) rd.m_palette = vi->getPalette();
+
+  // Check modes, guided drawing and entered groups are left to OpenGL
+  if (!rd.m_palette || !rd.m_alphaChannel || rd.m_tcheckEnabled ||
+      rd.m_inkCheckEnabled || rd.m_ink1CheckEnabled ||
+      rd.m_paintCheckEnabled || rd.m_showGuidedDrawing || rd.m_is3dView) {
+    m_supported = false;
+    return;
+  }
+
+  QMutexLocker sl(vi->getMutex());
+
+  if (!rd.m_isIcon && vi->isInsideGroup() > 0) {
+    m_supported = false;
+    return;
+  }
+
+  double det = fabs(rd.m_aff.det());
+  if (det < TConsts::epsilon) return;
+
+  double pixelSize = 1.0 / sqrt(det);
+
+  // Same drawing order as tglDraw(): each group draws its regions first,
+  // then its strokes
+  UINT s, sCount = vi->getStrokeCount(), r, rCount = vi->getRegionCount();
+  for (s = 0; s < sCount && m_supported;) {
+    UINT groupStart = s;
+
+    if (rd.m_drawRegions)
+      for (r = 0; r < rCount; ++r)
+        if (vi->sameGroupStrokeAndRegion(groupStart, r))
+          addRegion(vi->getRegion(r), rd, pixelSize);
+
+    for (; s < sCount && vi->sameGroup(s, groupStart); ++s)
+      addStroke(vi->getStroke(s), rd);
+  }
+
+  if (!m_supported) m_shapes.clear();
+}
+
+//-----------------------------------------------------------------------------
+
+//! Returns whether shapes of the specified style must be drawn, and their
+//! color. Visible styles other than plain solid colors make the image
+//! unsupported.
+bool TVectorRasterizer::getColor(const TColorStyle *style,
+                                 const TVectorRenderData &rd,
+                                 TPixel32 &color) {
+  if (!style) return false;
+
+  bool visible   = false;
+  int colorCount = style->getColorParamCount();
+  if (colorCount == 0)  // for example textures
+    visible = true;
+  else
+    for (int j = 0; j < colorCount && !visible; ++j) {
+      TPixel32 paramColor = style->getColorParamValue(j);
+      if (rd.m_cf) paramColor = (*rd.m_cf)(paramColor);
+      if (paramColor.m != 0) visible = true;
+    }
+
+  if (!visible || !style->isEnabled()) return false;
+
+  // Derived styles, or outline modifiers, draw in their own way
+  const TSolidColorStyle *solidStyle =
+      dynamic_cast<const TSolidColorStyle *>(style);
+  if (!solidStyle || solidStyle->getTagId() != 3 ||
+      solidStyle->getRegionOutlineModifier()) {
+    m_supported = false;
+    return false;
+  }
+
+  color = solidStyle->getMainColor();
+  if (rd.m_cf) color = (*rd.m_cf)(color);
+
+  return color.m != 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void TVectorRasterizer::addRegion(const TRegion *region,
+                                  const TVectorRenderData &rd,
+                                  double pixelSize) {
+  TRectD bbox = rd.m_aff * region->getBBox();
+  if (m_clippingRect != TRect() && !bbox.overlaps(convert(m_clippingRect)))
+    return;
+
+  Shape shape;
+  if (getColor(rd.m_palette->getStyle(region->getStyle()), rd,
+               shape.m_color)) {
+    // The region's outline, and its subregions' as holes
+    regionPolyline(shape.m_points, region, pixelSize);
+    shape.m_contourEnds.push_back(shape.m_points.size());
+
+    UINT i, subCount = region->getSubregionCount();
+    for (i = 0; i < subCount; ++i) {
+      std::vector<TPointD> hole;
+      regionPolyline(hole, region->getSubregion(i), pixelSize);
+
+      shape.m_points.insert(shape.m_points.end(), hole.rbegin(), hole.rend());
+      shape.m_contourEnds.push_back(shape.m_points.size());
+    }
+
+    for (TPointD &p : shape.m_points) p = rd.m_aff * p;
+
+    // As in the GLU tessellator, the orientation yielding a positive total
+    // area fills
+    double area = 0.0;
+    int begin   = 0;
+    for (int end : shape.m_contourEnds) {
+      area += signedArea(&shape.m_points[begin], &shape.m_points[0] + end);
+      begin = end;
+    }
+
+    if (area < 0.0) {
+      begin = 0;
+      for (int end : shape.m_contourEnds) {
+        std::reverse(shape.m_points.begin() + begin,
+                     shape.m_points.begin() + end);
+        begin = end;
+      }
+    }
+
+    shape.m_antialias = rd.m_antiAliasing && rd.m_regionAntialias;
+    closeShape(shape);
+  }
+
+  UINT i, subCount = region->getSubregionCount();
+  for (i = 0; i < subCount && m_supported; ++i)
+    addRegion(region->getSubregion(i), rd, pixelSize);
+}
+
+//-----------------------------------------------------------------------------
+
+void TVectorRasterizer::addStroke(const TStroke *stroke,
+                                  const TVectorRenderData &rd) {
+  TRectD bbox = rd.m_aff * stroke->getBBox();
+  if (m_clippingRect != TRect() && !bbox.overlaps(convert(m_clippingRect)))
+    return;
+
+  const TColorStyle *style = rd.m_palette->getStyle(stroke->getStyle());
+
+  // Invisible strokes must be invisible
+  if (!rd.m_show0ThickStrokes && isZeroThick(stroke) &&
+      dynamic_cast<const TSolidColorStyle *>(style))
+    return;
+
+  Shape shape;
+  if (!getColor(style, rd, shape.m_color)) return;
+
+  // Centerline strokes are drawn as OpenGL lines
+  if (stroke->isCenterLine()) {
+    m_supported = false;
+    return;
+  }
+
+  TStrokeOutline outline;
+  static_cast<const TSolidColorStyle *>(style)->computeOutline(
+      stroke, outline, TOutlineUtil::OutlineParameter());
+
+  // The outline is a strip of quads. Each one is added as a positively
+  // oriented contour, so that the overlaps at tight turns fill only once.
+  const std::vector<TOutlinePoint> &v = outline.getArray();
+
+  size_t i, count = v.size() & ~1;
+  for (i = 0; i + 3 < count; i += 2) {
+    TPointD quad[4] = {rd.m_aff * TPointD(v[i].x, v[i].y),
+                       rd.m_aff * TPointD(v[i + 1].x, v[i + 1].y),
+                       rd.m_aff * TPointD(v[i + 3].x, v[i + 3].y),
+                       rd.m_aff * TPointD(v[i + 2].x, v[i + 2].y)};
+
+    double area = signedArea(quad, quad + 4);
+    if (area == 0.0) continue;
+
+    if (area < 0.0) std::swap(quad[1], quad[3]);
+
+    shape.m_points.insert(shape.m_points.end(), quad, quad + 4);
+
+    shape.m_contourEnds.push_back(shape.m_points.size());
+  }
+
+  shape.m_antialias = rd.m_antiAliasing;
+  closeShape(shape);
+}
+
+//-----------------------------------------------------------------------------
+
+void TVectorRasterizer::closeShape(Shape &shape) {
+  if (shape.m_points.empty()) return;
+
+  TRectD bbox(shape.m_points[0], shape.m_points[0]);
+  for (const TPointD &p : shape.m_points) bbox += TRectD(p, p);
+
+  shape.m_bbox = TRect(tfloor(bbox.x0), tfloor(bbox.y0), tceil(bbox.x1) - 1,
+                       tceil(bbox.y1) - 1);
+
+  m_shapes.push_back(Shape());
+  std::swap(m_shapes.back(), shape);
+}
+
+//-----------------------------------------------------------------------------
+
+void TVectorRasterizer::rasterize(const TRasterP &ras) const {
+  TRaster32P ras32(ras);
+  TRaster64P ras64(ras);
+  assert(ras32 || ras64);
+
+  TRect clipRect = ras->getBounds();
+  if (m_clippingRect != TRect()) clipRect *= m_clippingRect;
+
+  CoverageBuffer buffer;
+
+  ras->lock();
+
+  for (const Shape &shape : m_shapes) {
+    TRect rect = shape.m_bbox * clipRect;
+    if (rect.isEmpty()) continue;
+
+    buffer.reset(rect.getLx(), rect.getLy());
+
+    TPointD origin(rect.x0, rect.y0);
+
+    int begin = 0;
+    for (int end : shape.m_contourEnds) {
+      for (int i = begin, j = end - 1; i < end; j = i++)
+        buffer.addLine(shape.m_points[j] - origin, shape.m_points[i] - origin);
+
+      begin = end;
+    }
+
+    if (ras32)
+      blendCoverage(ras32, rect, buffer, shape.m_color, shape.m_antialias);
+    else if (ras64)
+      blendCoverage(ras64, rect, buffer, shape.m_color, shape.m_antialias);
+  }
+
+  ras->unlock();
+}
+
+//-----------------------------------------------------------------------------
+
+void TVectorRasterizer::getBBoxes(std::vector<TRect> &bboxes) const {
+  for (const Shape &shape : m_shapes) bboxes.push_back(shape.m_bbox);
+}
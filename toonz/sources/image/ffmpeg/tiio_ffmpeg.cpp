@@ -7,17 +7,436 @@
 #include <QDir>
 #include <QtGui/QImage>
 #include <QRegExp>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
 #include "toonz/preferences.h"
 #include "toonz/toonzfolders.h"
 #include "tmsgcore.h"
 
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <list>
+#include <memory>
+
+namespace {
+
+//! Returns ffmpeg's name of the TPixel32 memory layout.
+QString rawPixelFormat() {
+#if defined(TNZ_MACHINE_CHANNEL_ORDER_BGRM)
+  return "bgra";
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_MBGR)
+  return "abgr";
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_RGBM)
+  return "rgba";
+#else
+  return "argb";
+#endif
+}
+
+}  // namespace
+
+//===========================================================
+//
+//  FfmpegStreamer
+//
+//===========================================================
+
+//! Runs the ffmpeg process of a streamed encode. Frames queued by the level
+//! writer are written to the process' standard input from this thread, which
+//! is the only one touching the QProcess - level writers may be called from
+//! any render thread.
+class FfmpegStreamer final : public QThread {
+  QString m_program;
+  QStringList m_args;
+  int m_timeout;
+
+  QMutex m_mutex;
+  QWaitCondition m_frameAdded, m_frameTaken;
+  std::deque<QByteArray> m_frames;
+  bool m_finished, m_failed;
+  QString m_errorString;
+
+  // Frames waiting for ffmpeg. Rendering blocks beyond this point, so that
+  // a slow encoder does not pile up raw frames in memory.
+  static const size_t MaxQueuedFrames = 3;
+
+public:
+  FfmpegStreamer(const QString &program, const QStringList &args, int timeout)
+      : m_program(program)
+      , m_args(args)
+      , m_timeout(timeout)
+      , m_finished(false)
+      , m_failed(false) {}
+
+  //! Queues a frame, waiting while the queue is full. Returns false if the
+  //! encode has failed.
+  bool addFrame(const QByteArray &frame) {
+    QMutexLocker sl(&m_mutex);
+    while (!m_failed && m_frames.size() >= MaxQueuedFrames)
+      m_frameTaken.wait(&m_mutex);
+    if (m_failed) return false;
+
+    m_frames.push_back(frame);
+    m_frameAdded.wakeOne();
+    return true;
+  }
+
+  //! Closes the stream, and waits for ffmpeg to encode the queued frames.
+  bool finish() {
+    {
+      QMutexLocker sl(&m_mutex);
+      m_finished = true;
+      m_frameAdded.wakeOne();
+    }
+    wait();
+    return !m_failed;
+  }
+
+  QString errorString() {
+    QMutexLocker sl(&m_mutex);
+    return m_errorString;
+  }
+
+protected:
+  void run() override {
+    QProcess ffmpeg;
+    ffmpeg.start(m_program, m_args);
+    if (!ffmpeg.waitForStarted(m_timeout)) {
+      fail(QObject::tr("FFmpeg could not be started."));
+      return;
+    }
+
+    // Only the tail of ffmpeg's log is kept, for error reporting
+    QByteArray log;
+
+    for (;;) {
+      QByteArray frame;
+      {
+        QMutexLocker sl(&m_mutex);
+        while (!m_finished && m_frames.empty()) m_frameAdded.wait(&m_mutex);
+        if (m_frames.empty()) break;
+
+        frame = m_frames.front();
+        m_frames.pop_front();
+        m_frameTaken.wakeAll();
+      }
+
+      bool ok = (ffmpeg.write(frame) == frame.size());
+      while (ok && ffmpeg.bytesToWrite() > 0)
+        ok = ffmpeg.waitForBytesWritten(m_timeout);
+
+      log = (log + ffmpeg.readAllStandardError()).right(4096);
+      if (!ok) {
+        ffmpeg.kill();
+        ffmpeg.waitForFinished();
+        log = (log + ffmpeg.readAllStandardError()).right(4096);
+        fail(QObject::tr("FFmpeg stopped accepting frames.") + "\n" +
+             QString::fromLocal8Bit(log));
+        return;
+      }
+    }
+
+    ffmpeg.closeWriteChannel();
+    if (!ffmpeg.waitForFinished(m_timeout)) {
+      ffmpeg.kill();
+      ffmpeg.waitForFinished();
+      fail(QObject::tr("FFmpeg timed out."));
+      return;
+    }
+
+    log = (log + ffmpeg.readAllStandardError()).right(4096);
+    if (ffmpeg.exitStatus() != QProcess::NormalExit || ffmpeg.exitCode() != 0)
+      fail(QObject::tr("FFmpeg failed to encode the movie.") + "\n" +
+           QString::fromLocal8Bit(log));
+  }
+
+private:
+  void fail(const QString &errorString) {
+    QMutexLocker sl(&m_mutex);
+    m_failed      = true;
+    m_errorString = errorString;
+    m_frames.clear();
+    m_frameTaken.wakeAll();
+  }
+};
+
+//===========================================================
+//
+//  FfmpegDecoder
+//
+//===========================================================
+
+//! Decodes a movie on demand through a long-lived ffmpeg process, which
+//! outputs raw frames on a pipe. Recently decoded frames are kept in a small
+//! ring, bounded in bytes, and a few frames past the last request are decoded
+//! ahead for sequential access. Requests behind the process, or too far ahead
+//! of it, restart ffmpeg at the requested frame.
+//!
+//! As with FfmpegStreamer, the process lives in a thread of its own:
+//! frames are requested by the image loading threads.
+class FfmpegDecoder final : public QThread {
+  QString m_program, m_moviePath;
+  TDimension m_size;
+  int m_timeout;
+  int m_ringSize, m_readAhead;
+
+  QMutex m_requestMutex;  // Serializes getFrame() callers
+  QMutex m_mutex;
+  QWaitCondition m_requestChanged, m_frameDecoded;
+  std::map<int, QByteArray> m_frames;  // The ring, by frame index
+  int m_request;      // Frame being waited for, or -1
+  int m_unavailable;  // Last request past the end of the movie
+  int m_lastRequest;
+  bool m_quit;
+
+  // Memory held by the ring of each decoder (see MaxDecoders)
+  static const qint64 RingBytes = 64 << 20;
+  static const int MaxRingSize  = 16;
+  // Skipping up to this many frames is cheaper than a restart
+  static const int MaxSkip = 32;
+
+public:
+  FfmpegDecoder(const QString &program, const QString &moviePath,
+                const TDimension &size, int timeout)
+      : m_program(program)
+      , m_moviePath(moviePath)
+      , m_size(size)
+      , m_timeout(timeout)
+      , m_request(-1)
+      , m_unavailable(-1)
+      , m_lastRequest(1)
+      , m_quit(false) {
+    qint64 frameSize =
+        std::max<qint64>(1, (qint64)m_size.lx * m_size.ly * sizeof(TPixel32));
+    m_ringSize  = (int)std::min((qint64)MaxRingSize, RingBytes / frameSize);
+    m_ringSize  = std::max(m_ringSize, 2);
+    m_readAhead = m_ringSize / 2;
+
+    start();
+  }
+
+  ~FfmpegDecoder() {
+    {
+      QMutexLocker sl(&m_mutex);
+      m_quit = true;
+      m_requestChanged.wakeAll();
+    }
+    wait();
+  }
+
+  const QString &moviePath() const { return m_moviePath; }
+  const TDimension &size() const { return m_size; }
+
+  //! Returns the raw data of frame \b index (1-based, as in the level), or
+  //! an empty array if it could not be decoded.
+  QByteArray getFrame(int index) {
+    QMutexLocker rl(&m_requestMutex);
+    QMutexLocker sl(&m_mutex);
+
+    m_lastRequest = index;
+    for (;;) {
+      std::map<int, QByteArray>::iterator it = m_frames.find(index);
+      if (it != m_frames.end()) return it->second;
+      if (m_unavailable == index) {
+        m_unavailable = -1;
+        return QByteArray();
+      }
+
+      m_request = index;
+      m_requestChanged.wakeAll();
+      m_frameDecoded.wait(&m_mutex);
+    }
+  }
+
+protected:
+  void run() override {
+    QProcess *ffmpeg = 0;
+    int pos          = -1;  // Index of the next frame the process outputs
+    bool endOfStream = false;
+
+    QMutexLocker sl(&m_mutex);
+    while (!m_quit) {
+      int request = m_request;
+      if (request >= 0 && m_frames.count(request)) request = m_request = -1;
+
+      if (request < 0) {
+        // Decode ahead of the last request, if the process is there
+        if (!ffmpeg || endOfStream || pos < m_lastRequest ||
+            pos > m_lastRequest + m_readAhead || m_frames.count(pos)) {
+          m_requestChanged.wait(&m_mutex);
+          continue;
+        }
+      } else if (!ffmpeg || request < pos || request > pos + MaxSkip) {
+        sl.unlock();
+        delete ffmpeg;
+        ffmpeg      = startProcess(request);
+        pos         = request;
+        endOfStream = (ffmpeg == 0);
+        sl.relock();
+      }
+
+      if (endOfStream) {
+        // The requested frame is not in the movie
+        m_unavailable = m_request;
+        m_request     = -1;
+        m_frameDecoded.wakeAll();
+        continue;
+      }
+
+      sl.unlock();
+      QByteArray frame = readFrame(ffmpeg);
+      sl.relock();
+
+      if (frame.isEmpty()) {
+        endOfStream = true;
+        continue;
+      }
+
+      m_frames[pos++] = frame;
+
+      // Drop the frame farthest from the last request
+      if ((int)m_frames.size() > m_ringSize) {
+        std::map<int, QByteArray>::iterator first = m_frames.begin(),
+                                            last  = --m_frames.end();
+        if (m_lastRequest - first->first > last->first - m_lastRequest)
+          m_frames.erase(first);
+        else
+          m_frames.erase(last);
+      }
+
+      m_frameDecoded.wakeAll();
+    }
+
+    sl.unlock();
+    delete ffmpeg;
+  }
+
+private:
+  QProcess *startProcess(int frameIndex) {
+    QStringList args;
+    args << "-v";
+    args << "error";
+    args << "-i";
+    args << m_moviePath;
+    if (frameIndex > 1) {
+      // Select by decoded frame number: seeking by time assumes a constant
+      // frame rate, which variable rate movies and gifs don't have
+      args << "-vf";
+      args << QString("select=gte(n\\,%1)").arg(frameIndex - 1);
+    }
+    // Output the decoded frames as they are, without duplicating or
+    // dropping any to match a frame rate
+    args << "-vsync";
+    args << "0";
+    args << "-f";
+    args << "rawvideo";
+    args << "-pix_fmt";
+    args << rawPixelFormat();
+    args << "-";
+
+    QProcess *ffmpeg = new QProcess;
+    ffmpeg->setStandardErrorFile(QProcess::nullDevice());
+    ffmpeg->start(m_program, args);
+    if (!ffmpeg->waitForStarted(m_timeout)) {
+      delete ffmpeg;
+      return 0;
+    }
+    return ffmpeg;
+  }
+
+  QByteArray readFrame(QProcess *ffmpeg) {
+    qint64 frameSize = (qint64)m_size.lx * m_size.ly * sizeof(TPixel32);
+    QByteArray frame(frameSize, Qt::Uninitialized);
+
+    qint64 read = 0;
+    while (read < frameSize) {
+      if (ffmpeg->bytesAvailable() == 0 &&
+          !ffmpeg->waitForReadyRead(m_timeout))
+        return QByteArray();
+      read += ffmpeg->read(frame.data() + read, frameSize - read);
+    }
+    return frame;
+  }
+};
+
+//-----------------------------------------------------------
+
+namespace {
+
+QMutex decodersMutex;
+// Level readers are short-lived - decoders are shared by path, and kept
+// alive for a few movies at a time. The most recently used comes first.
+std::list<std::shared_ptr<FfmpegDecoder>> decoders;
+const size_t MaxDecoders = 4;
+
+//! Stops the decoders' threads and processes. Invoked as the application
+//! object is destroyed - the static list would outlive it.
+void releaseDecoders() {
+  std::list<std::shared_ptr<FfmpegDecoder>> released;
+  {
+    QMutexLocker sl(&decodersMutex);
+    released.swap(decoders);
+  }
+
+  // Decoders wait for their thread to finish as they are deleted
+  released.clear();
+}
+
+std::shared_ptr<FfmpegDecoder> getDecoder(const QString &program,
+                                          const TFilePath &path,
+                                          const TDimension &size,
+                                          int timeout) {
+  // The modification time tells a rewritten movie from the cached one
+  QString key = path.getQString() + "|" +
+                QFileInfo(path.getQString()).lastModified().toString(Qt::ISODate);
+
+  QMutexLocker sl(&decodersMutex);
+
+  static bool releaseRegistered = false;
+  if (!releaseRegistered && QCoreApplication::instance()) {
+    qAddPostRoutine(releaseDecoders);
+    releaseRegistered = true;
+  }
+
+  std::list<std::shared_ptr<FfmpegDecoder>>::iterator it;
+  for (it = decoders.begin(); it != decoders.end(); ++it)
+    if ((*it)->objectName() == key && (*it)->size() == size) {
+      decoders.splice(decoders.begin(), decoders, it);
+      return decoders.front();
+    }
+
+  std::shared_ptr<FfmpegDecoder> decoder(new FfmpegDecoder(
+      program, path.getQString(), size, timeout));
+  decoder->setObjectName(key);
+  decoders.push_front(decoder);
+  if (decoders.size() > MaxDecoders) decoders.pop_back();
+
+  return decoder;
+}
+
+}  // namespace
+
+//===========================================================
+//
+//  Ffmpeg
+//
+//===========================================================
+
 Ffmpeg::Ffmpeg() {
   m_ffmpegPath         = Preferences::instance()->getFfmpegPath();
   m_ffmpegTimeout      = Preferences::instance()->getFfmpegTimeout() * 1000;
   std::string strPath  = m_ffmpegPath.toStdString();
   m_intermediateFormat = "png";
 }
-Ffmpeg::~Ffmpeg() {}
+Ffmpeg::~Ffmpeg() {
+  if (m_streamer) finishStreaming();
+}
 
 bool Ffmpeg::checkFfmpeg() {
   // check the user defined path in preferences first
@@ -181,6 +600,105 @@ void Ffmpeg::runFfmpeg(QStringList preIArgs, QStringList postIArgs,
   }
 }
 
+void Ffmpeg::startStreaming(QStringList preIArgs, QStringList postIArgs,
+                            const TDimension &size) {
+  assert(!m_streamer);
+  m_lx = size.lx, m_ly = size.ly;
+  m_bpp = sizeof(TPixel32);
+
+  QStringList args;
+  args = args + preIArgs;
+  args << "-f";
+  args << "rawvideo";
+  args << "-pix_fmt";
+  args << rawPixelFormat();
+  args << "-s";
+  args << QString::number(m_lx) + "x" + QString::number(m_ly);
+  args << "-i";
+  args << "-";
+  if (m_hasSoundTrack) args = args + m_audioArgs;
+  args = args + postIArgs;
+  args << "-y";
+  args << m_path.getQString();
+
+  m_streamer = new FfmpegStreamer(m_ffmpegPath + "/ffmpeg", args,
+                                  m_ffmpegTimeout);
+  m_streamer->start();
+}
+
+void Ffmpeg::addFrameToStream(const TImageP &img, int frameIndex) {
+  assert(m_streamer);
+  TRasterImageP image(img);
+  TRaster32P ras = image ? image->getRaster() : TRaster32P();
+  if (!ras || ras->getLx() != m_lx || ras->getLy() != m_ly)
+    throw TImageException(m_path, "unsupported frame format.");
+
+  if (m_nextStreamedFrame < 0) m_nextStreamedFrame = frameIndex;
+  if (frameIndex < m_nextStreamedFrame || m_pendingFrames.contains(frameIndex))
+    throw TImageException(m_path, "frame saved out of sequence.");
+
+  // ffmpeg wants the rows top to bottom
+  int rowSize = m_lx * m_bpp;
+  QByteArray frame(rowSize * m_ly, Qt::Uninitialized);
+  ras->lock();
+  for (int y = 0; y < m_ly; ++y)
+    memcpy(frame.data() + (m_ly - 1 - y) * rowSize, ras->pixels(y), rowSize);
+  ras->unlock();
+
+  m_pendingFrames.insert(frameIndex, frame);
+  streamPendingFrames(false);
+}
+
+void Ffmpeg::streamFrame(const QByteArray &frame) {
+  if (!m_streamer->addFrame(frame))
+    throw TImageException(m_path,
+                          m_streamer->errorString().toStdString());
+
+  m_lastStreamedFrame = frame;
+  ++m_nextStreamedFrame;
+  ++m_frameCount;
+}
+
+void Ffmpeg::streamPendingFrames(bool flush) {
+  // Frames ahead of a missing one are held back, in case it is still to
+  // come. Past the limit, or when flushing, the gap is filled repeating
+  // the previous frame.
+  const int maxPendingFrames = 8;
+
+  while (!m_pendingFrames.isEmpty()) {
+    QMap<int, QByteArray>::iterator it = m_pendingFrames.begin();
+    if (it.key() > m_nextStreamedFrame && !flush &&
+        m_pendingFrames.size() <= maxPendingFrames)
+      break;
+
+    while (m_nextStreamedFrame < it.key()) streamFrame(m_lastStreamedFrame);
+    streamFrame(it.value());
+    m_pendingFrames.erase(it);
+  }
+}
+
+bool Ffmpeg::finishStreaming() {
+  assert(m_streamer);
+  bool ok = true;
+  try {
+    streamPendingFrames(true);
+  } catch (...) {
+    ok = false;
+  }
+  m_pendingFrames.clear();
+  m_lastStreamedFrame.clear();
+  m_nextStreamedFrame = -1;
+
+  ok = m_streamer->finish() && ok;
+  if (!ok)
+    DVGui::warning(QObject::tr("Failed to write %1:\n%2")
+                       .arg(m_path.getQString())
+                       .arg(m_streamer->errorString()));
+  delete m_streamer;
+  m_streamer = 0;
+  return ok;
+}
+
 QString Ffmpeg::runFfprobe(QStringList args) {
   QProcess ffmpeg;
   ffmpeg.start(m_ffmpegPath + "/ffprobe", args);
@@ -305,6 +823,26 @@ TRasterImageP Ffmpeg::getImage(int frameIndex) {
   return TRasterImageP();
 }
 
+TRasterImageP Ffmpeg::decodeImage(int frameIndex) {
+  if (m_lx <= 0 || m_ly <= 0) return TRasterImageP();
+
+  std::shared_ptr<FfmpegDecoder> decoder =
+      getDecoder(m_ffmpegPath + "/ffmpeg", m_path, TDimension(m_lx, m_ly),
+                 m_ffmpegTimeout);
+  QByteArray frame = decoder->getFrame(frameIndex);
+  if (frame.isEmpty()) return TRasterImageP();
+
+  // ffmpeg outputs the rows top to bottom
+  TRaster32P ret(m_lx, m_ly);
+  int rowSize = m_lx * sizeof(TPixel32);
+  ret->lock();
+  for (int y = 0; y < m_ly; ++y)
+    memcpy(ret->pixels(y), frame.constData() + (m_ly - 1 - y) * rowSize,
+           rowSize);
+  ret->unlock();
+  return TRasterImageP(ret);
+}
+
 double Ffmpeg::getFrameRate() {
   QStringList fpsArgs;
   int fpsNum = 0, fpsDen = 0;
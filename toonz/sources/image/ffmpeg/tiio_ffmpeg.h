@@ -7,8 +7,11 @@
 #include "tlevel_io.h"
 #include "trasterimage.h"
 #include <QVector>
+#include <QMap>
 #include <QStringList>
 
+class FfmpegStreamer;
+
 struct ffmpegFileInfo {
   int m_lx, m_ly, m_frameCount;
   double m_frameRate;
@@ -23,6 +26,16 @@ public:
                  bool includesInPath, bool includesOutPath,
                  bool overWriteFiles);
   void runFfmpeg(QStringList preIArgs, QStringList postIArgs, TFilePath path);
+  // Streaming mode: a single ffmpeg process is started with the first frame
+  // and fed raw frames through its standard input, instead of encoding an
+  // intermediate image sequence at the end. Frames are streamed in index
+  // order, starting from the first one added; missing frames repeat the
+  // previous one.
+  void startStreaming(QStringList preIArgs, QStringList postIArgs,
+                      const TDimension &size);
+  bool isStreaming() const { return m_streamer != 0; }
+  void addFrameToStream(const TImageP &image, int frameIndex);
+  bool finishStreaming();
   QString runFfprobe(QStringList args);
   void cleanUpFiles();
   void addToCleanUp(QString);
@@ -38,6 +51,9 @@ public:
   int getFrameCount();
   void getFramesFromMovie(int frame = -1);
   TRasterImageP getImage(int frameIndex);
+  // Decodes a single frame through a shared, long-lived ffmpeg process.
+  // Needs the movie info, see getInfo().
+  TRasterImageP decodeImage(int frameIndex);
   TFilePath getFfmpegCache();
   ffmpegFileInfo getInfo();
   void disablePrecompute();
@@ -51,9 +67,16 @@ private:
   bool m_ffmpegExists = false, m_ffprobeExists = false, m_hasSoundTrack = false;
   TFilePath m_path;
   QVector<QString> m_cleanUpList;
+  FfmpegStreamer *m_streamer = 0;
+  QMap<int, QByteArray> m_pendingFrames;  // Streamed frames, waiting for
+                                          // the preceding ones
+  QByteArray m_lastStreamedFrame;
+  int m_nextStreamedFrame = -1;
   QStringList m_audioArgs;
   TUINT32 m_sampleRate;
   QString cleanPathSymbols();
+  void streamFrame(const QByteArray &frame);
+  void streamPendingFrames(bool flush);
 };
 
 #endif
@@ -55,62 +55,7 @@ TLevelWriterGif::TLevelWriterGif(const TFilePath &path, TPropertyGroup *winfo)
 //-----------------------------------------------------------
 
 TLevelWriterGif::~TLevelWriterGif() {
-  QStringList preIArgs;
-  QStringList postIArgs;
-  QStringList palettePreIArgs;
-  QStringList palettePostIArgs;
-
-  int outLx = m_lx;
-  int outLy = m_ly;
-
-  // set scaling
-  outLx = m_lx * m_scale / 100;
-  outLy = m_ly * m_scale / 100;
-  // ffmpeg doesn't like resolutions that aren't divisible by 2.
-  if (outLx % 2 != 0) outLx++;
-  if (outLy % 2 != 0) outLy++;
-
-  QString palette;
-  QString filters = "scale=" + QString::number(outLx) + ":-1:flags=lanczos";
-  QString paletteFilters = filters + " [x]; [x][1:v] paletteuse";
-  if (m_palette) {
-    palette = ffmpegWriter->getFfmpegCache().getQString() + "//" +
-              QString::fromStdString(m_path.getName()) + "palette.png";
-    palettePreIArgs << "-v";
-    palettePreIArgs << "warning";
-
-    palettePostIArgs << "-vf";
-    palettePostIArgs << filters + ",palettegen";
-    palettePostIArgs << palette;
-
-    // write the palette
-    ffmpegWriter->runFfmpeg(palettePreIArgs, palettePostIArgs, false, true,
-                            true);
-    ffmpegWriter->addToCleanUp(palette);
-  }
-
-  preIArgs << "-v";
-  preIArgs << "warning";
-  preIArgs << "-r";
-  preIArgs << QString::number((m_frameRate < 1 ? 12.0 : m_frameRate));
-  if (m_palette) {
-    postIArgs << "-i";
-    postIArgs << palette;
-    postIArgs << "-lavfi";
-    postIArgs << paletteFilters;
-  } else {
-    postIArgs << "-lavfi";
-    postIArgs << filters;
-  }
-
-  if (!m_looping) {
-    postIArgs << "-loop";
-    postIArgs << "-1";
-  }
-
-  std::string outPath = m_path.getQString().toStdString();
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
+  if (ffmpegWriter->isStreaming()) ffmpegWriter->finishStreaming();
   ffmpegWriter->cleanUpFiles();
 }
 
@@ -137,10 +82,47 @@ void TLevelWriterGif::saveSoundTrack(TSoundTrack *st) { return; }
 //-----------------------------------------------------------
 
 void TLevelWriterGif::save(const TImageP &img, int frameIndex) {
-  TRasterImageP image(img);
-  m_lx = image->getRaster()->getLx();
-  m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  // The encoder is started with the first frame, once its size is known
+  if (!ffmpegWriter->isStreaming()) {
+    TRasterImageP image(img);
+    if (!image) throw TImageException(m_path, "unsupported image type.");
+    m_lx = image->getRaster()->getLx();
+    m_ly = image->getRaster()->getLy();
+
+    QStringList preIArgs;
+    QStringList postIArgs;
+
+    int outLx = m_lx;
+    int outLy = m_ly;
+
+    // set scaling
+    outLx = m_lx * m_scale / 100;
+    outLy = m_ly * m_scale / 100;
+    // ffmpeg doesn't like resolutions that aren't divisible by 2.
+    if (outLx % 2 != 0) outLx++;
+    if (outLy % 2 != 0) outLy++;
+
+    QString filters = "scale=" + QString::number(outLx) + ":-1:flags=lanczos";
+    // The palette is generated from the whole stream, then applied to it
+    QString paletteFilters =
+        filters + ",split [a][b]; [a] palettegen [p]; [b][p] paletteuse";
+
+    preIArgs << "-v";
+    preIArgs << "warning";
+    preIArgs << "-r";
+    preIArgs << QString::number((m_frameRate < 1 ? 12.0 : m_frameRate));
+
+    postIArgs << "-lavfi";
+    postIArgs << (m_palette ? paletteFilters : filters);
+
+    if (!m_looping) {
+      postIArgs << "-loop";
+      postIArgs << "-1";
+    }
+
+    ffmpegWriter->startStreaming(preIArgs, postIArgs, TDimension(m_lx, m_ly));
+  }
+  ffmpegWriter->addFrameToStream(img, frameIndex);
 }
 
 //===========================================================
@@ -208,6 +190,7 @@ TLevelReaderGif::TLevelReaderGif(const TFilePath &path)
 
 TLevelReaderGif::~TLevelReaderGif() {
   // ffmpegReader->cleanUpFiles();
+  delete ffmpegReader;
 }
 
 //-----------------------------------------------------------
@@ -237,11 +220,7 @@ TDimension TLevelReaderGif::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderGif::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeImage(frameIndex);
 }
 
 Tiio::GifWriterProperties::GifWriterProperties()
@@ -57,41 +57,7 @@ TLevelWriterMp4::TLevelWriterMp4(const TFilePath &path, TPropertyGroup *winfo)
 //-----------------------------------------------------------
 
 TLevelWriterMp4::~TLevelWriterMp4() {
-  // QProcess createMp4;
-  QStringList preIArgs;
-  QStringList postIArgs;
-
-  int outLx = m_lx;
-  int outLy = m_ly;
-
-  // set scaling
-  if (m_scale != 0) {
-    outLx = m_lx * m_scale / 100;
-    outLy = m_ly * m_scale / 100;
-  }
-  // ffmpeg doesn't like resolutions that aren't divisible by 2.
-  if (outLx % 2 != 0) outLx++;
-  if (outLy % 2 != 0) outLy++;
-
-  // calculate quality (bitrate)
-  int pixelCount   = m_lx * m_ly;
-  int bitRate      = pixelCount / 150;  // crude but gets decent values
-  double quality   = m_vidQuality / 100.0;
-  double tempRate  = (double)bitRate * quality;
-  int finalBitrate = (int)tempRate;
-  int crf          = 51 - (m_vidQuality * 51 / 100);
-
-  preIArgs << "-framerate";
-  preIArgs << QString::number(m_frameRate);
-
-  postIArgs << "-pix_fmt";
-  postIArgs << "yuv420p";
-  postIArgs << "-s";
-  postIArgs << QString::number(outLx) + "x" + QString::number(outLy);
-  postIArgs << "-b";
-  postIArgs << QString::number(finalBitrate) + "k";
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
+  if (ffmpegWriter->isStreaming()) ffmpegWriter->finishStreaming();
   ffmpegWriter->cleanUpFiles();
 }
 
@@ -119,10 +85,48 @@ void TLevelWriterMp4::saveSoundTrack(TSoundTrack *st) {
 //-----------------------------------------------------------
 
 void TLevelWriterMp4::save(const TImageP &img, int frameIndex) {
-  TRasterImageP image(img);
-  m_lx = image->getRaster()->getLx();
-  m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  // The encoder is started with the first frame, once its size is known
+  if (!ffmpegWriter->isStreaming()) {
+    TRasterImageP image(img);
+    if (!image) throw TImageException(m_path, "unsupported image type.");
+    m_lx = image->getRaster()->getLx();
+    m_ly = image->getRaster()->getLy();
+
+    QStringList preIArgs;
+    QStringList postIArgs;
+
+    int outLx = m_lx;
+    int outLy = m_ly;
+
+    // set scaling
+    if (m_scale != 0) {
+      outLx = m_lx * m_scale / 100;
+      outLy = m_ly * m_scale / 100;
+    }
+    // ffmpeg doesn't like resolutions that aren't divisible by 2.
+    if (outLx % 2 != 0) outLx++;
+    if (outLy % 2 != 0) outLy++;
+
+    // calculate quality (bitrate)
+    int pixelCount   = m_lx * m_ly;
+    int bitRate      = pixelCount / 150;  // crude but gets decent values
+    double quality   = m_vidQuality / 100.0;
+    double tempRate  = (double)bitRate * quality;
+    int finalBitrate = (int)tempRate;
+
+    preIArgs << "-framerate";
+    preIArgs << QString::number(m_frameRate);
+
+    postIArgs << "-pix_fmt";
+    postIArgs << "yuv420p";
+    postIArgs << "-s";
+    postIArgs << QString::number(outLx) + "x" + QString::number(outLy);
+    postIArgs << "-b";
+    postIArgs << QString::number(finalBitrate) + "k";
+
+    ffmpegWriter->startStreaming(preIArgs, postIArgs, TDimension(m_lx, m_ly));
+  }
+  ffmpegWriter->addFrameToStream(img, frameIndex);
 }
 
 //===========================================================
@@ -187,6 +191,7 @@ TLevelReaderMp4::TLevelReaderMp4(const TFilePath &path) : TLevelReader(path) {
 
 TLevelReaderMp4::~TLevelReaderMp4() {
   // ffmpegReader->cleanUpFiles();
+  delete ffmpegReader;
 }
 
 //-----------------------------------------------------------
@@ -217,11 +222,7 @@ TDimension TLevelReaderMp4::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderMp4::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeImage(frameIndex);
 }
 
 Tiio::Mp4WriterProperties::Mp4WriterProperties()
@@ -61,7 +61,6 @@ public:
   // void *m_decompressedBuffer;
 private:
   Ffmpeg *ffmpegReader;
-  bool ffmpegFramesCreated = false;
   TDimension m_size;
   int m_frameCount, m_lx, m_ly;
 };
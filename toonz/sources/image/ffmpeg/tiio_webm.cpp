@@ -52,47 +52,7 @@ TLevelWriterWebm::TLevelWriterWebm(const TFilePath &path, TPropertyGroup *winfo)
 //-----------------------------------------------------------
 
 TLevelWriterWebm::~TLevelWriterWebm() {
-  // QProcess createWebm;
-  QStringList preIArgs;
-  QStringList postIArgs;
-
-  int outLx = m_lx;
-  int outLy = m_ly;
-
-  // set scaling
-  if (m_scale != 0) {
-    outLx = m_lx * m_scale / 100;
-    outLy = m_ly * m_scale / 100;
-  }
-  // ffmpeg doesn't like resolutions that aren't divisible by 2.
-  if (outLx % 2 != 0) outLx++;
-  if (outLy % 2 != 0) outLy++;
-
-  // calculate quality (bitrate)
-  int pixelCount   = m_lx * m_ly;
-  int bitRate      = pixelCount / 150;  // crude but gets decent values
-  double quality   = m_vidQuality / 100.0;
-  double tempRate  = (double)bitRate * quality;
-  int finalBitrate = (int)tempRate;
-  int crf          = 51 - (m_vidQuality * 51 / 100);
-
-  preIArgs << "-framerate";
-  preIArgs << QString::number(m_frameRate);
-
-  postIArgs << "-auto-alt-ref";
-  postIArgs << "0";
-  postIArgs << "-c:v";
-  postIArgs << "libvpx";
-  postIArgs << "-s";
-  postIArgs << QString::number(outLx) + "x" + QString::number(outLy);
-  postIArgs << "-b";
-  postIArgs << QString::number(finalBitrate) + "k";
-  postIArgs << "-speed";
-  postIArgs << "3";
-  postIArgs << "-quality";
-  postIArgs << "good";
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
+  if (ffmpegWriter->isStreaming()) ffmpegWriter->finishStreaming();
   ffmpegWriter->cleanUpFiles();
 }
 
@@ -120,10 +80,54 @@ void TLevelWriterWebm::saveSoundTrack(TSoundTrack *st) {
 //-----------------------------------------------------------
 
 void TLevelWriterWebm::save(const TImageP &img, int frameIndex) {
-  TRasterImageP image(img);
-  m_lx = image->getRaster()->getLx();
-  m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  // The encoder is started with the first frame, once its size is known
+  if (!ffmpegWriter->isStreaming()) {
+    TRasterImageP image(img);
+    if (!image) throw TImageException(m_path, "unsupported image type.");
+    m_lx = image->getRaster()->getLx();
+    m_ly = image->getRaster()->getLy();
+
+    QStringList preIArgs;
+    QStringList postIArgs;
+
+    int outLx = m_lx;
+    int outLy = m_ly;
+
+    // set scaling
+    if (m_scale != 0) {
+      outLx = m_lx * m_scale / 100;
+      outLy = m_ly * m_scale / 100;
+    }
+    // ffmpeg doesn't like resolutions that aren't divisible by 2.
+    if (outLx % 2 != 0) outLx++;
+    if (outLy % 2 != 0) outLy++;
+
+    // calculate quality (bitrate)
+    int pixelCount   = m_lx * m_ly;
+    int bitRate      = pixelCount / 150;  // crude but gets decent values
+    double quality   = m_vidQuality / 100.0;
+    double tempRate  = (double)bitRate * quality;
+    int finalBitrate = (int)tempRate;
+
+    preIArgs << "-framerate";
+    preIArgs << QString::number(m_frameRate);
+
+    postIArgs << "-auto-alt-ref";
+    postIArgs << "0";
+    postIArgs << "-c:v";
+    postIArgs << "libvpx";
+    postIArgs << "-s";
+    postIArgs << QString::number(outLx) + "x" + QString::number(outLy);
+    postIArgs << "-b";
+    postIArgs << QString::number(finalBitrate) + "k";
+    postIArgs << "-speed";
+    postIArgs << "3";
+    postIArgs << "-quality";
+    postIArgs << "good";
+
+    ffmpegWriter->startStreaming(preIArgs, postIArgs, TDimension(m_lx, m_ly));
+  }
+  ffmpegWriter->addFrameToStream(img, frameIndex);
 }
 
 //===========================================================
@@ -188,6 +192,7 @@ TLevelReaderWebm::TLevelReaderWebm(const TFilePath &path) : TLevelReader(path) {
 
 TLevelReaderWebm::~TLevelReaderWebm() {
   // ffmpegReader->cleanUpFiles();
+  delete ffmpegReader;
 }
 
 //-----------------------------------------------------------
@@ -218,11 +223,7 @@ TDimension TLevelReaderWebm::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderWebm::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeImage(frameIndex);
 }
 
 Tiio::WebmWriterProperties::WebmWriterProperties()
@@ -346,6 +346,31 @@ public:
 
   Tiio::RowOrder getRowOrder() const override { return Tiio::TOP2BOTTOM; }
 
+  bool readRegion(char *buffer, int wrap, const TRect &rect,
+                  int shrink) override {
+    if (m_interlace_type == 1 || m_y != 0) return false;
+
+    // Rows come top to bottom: the ones above the region are decoded but not
+    // converted, and reading stops after its bottom row
+    std::unique_ptr<TPixel32[]> line(new TPixel32[m_info.m_lx]);
+    png_bytep row_pointer = m_rowBuffer.get();
+
+    skipLines(m_info.m_ly - 1 - rect.y1);
+
+    for (int y = rect.y1; y >= rect.y0; --y) {
+      m_y++;
+      png_read_row(m_png_ptr, row_pointer, NULL);
+      if ((y - rect.y0) % shrink != 0) continue;
+
+      writeRow((char *)line.get());
+
+      TPixel32 *pix = (TPixel32 *)buffer + ((y - rect.y0) / shrink) * wrap;
+      for (int x = rect.x0; x <= rect.x1; x += shrink) *pix++ = line[x];
+    }
+
+    return true;
+  }
+
   void writeRow(char *buffer) {
     if (m_color_type == PNG_COLOR_TYPE_RGB_ALPHA ||
         m_color_type == PNG_COLOR_TYPE_GRAY_ALPHA ||
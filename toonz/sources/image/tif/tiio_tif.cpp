@@ -66,6 +66,8 @@ public:
   int skipLines(int lineCount) override;
   void readLine(char *buffer, int x0, int x1, int shrink) override;
   void readLine(short *buffer, int x0, int x1, int shrink) override;
+  bool readRegion(char *buffer, int wrap, const TRect &rect,
+                  int shrink) override;
 };
 
 //------------------------------------------------------------
@@ -666,6 +668,64 @@ void TifReader::readLine(char *buffer, int x0, int x1, int shrink) {
 
 //============================================================
 
+bool TifReader::readRegion(char *buffer, int wrap, const TRect &rect,
+                           int shrink) {
+  if (m_isTzi || m_info.m_bitsPerSample != 8 || m_row != 0) return false;
+
+  uint16 orient = ORIENTATION_TOPLEFT;
+  TIFFGetField(m_tiff, TIFFTAG_ORIENTATION, &orient);
+  if (orient != ORIENTATION_TOPLEFT && orient != ORIENTATION_BOTLEFT)
+    return false;
+
+  char emsg[1024] = "";
+  TIFFRGBAImage img;
+  if (!TIFFRGBAImageOK(m_tiff, emsg) ||
+      !TIFFRGBAImageBegin(&img, m_tiff, 0, emsg))
+    return false;
+
+  // TIFFRGBAImageGet() decodes only the strips or tiles overlapping the
+  // window, and returns it bottom-up whatever the file orientation
+  int lx         = rect.getLx();
+  int ly         = rect.getLy();
+  img.col_offset = rect.x0;
+  img.row_offset =
+      (orient == ORIENTATION_TOPLEFT) ? m_info.m_ly - 1 - rect.y1 : rect.y0;
+
+  // Decode straight into the output unless it has to be subsampled
+  TRasterGR8P tmpRas;
+  uint32 *raster;
+  if (shrink == 1 && wrap == lx)
+    raster = (uint32 *)buffer;
+  else {
+    tmpRas = TRasterGR8P(lx * ly * sizeof(uint32), 1);
+    tmpRas->lock();
+    raster = (uint32 *)tmpRas->getRawData();
+  }
+
+  int ok = TIFFRGBAImageGet(&img, raster, lx, ly);
+  TIFFRGBAImageEnd(&img);
+
+  if (ok) {
+    for (int y = 0; y < ly; y += shrink) {
+      uint32 *v     = raster + y * lx;
+      TPixel32 *pix = (TPixel32 *)buffer + (y / shrink) * wrap;
+
+      for (int x = 0; x < lx; x += shrink, ++pix) {
+        uint32 c = v[x];
+        pix->r   = (UCHAR)TIFFGetR(c);
+        pix->g   = (UCHAR)TIFFGetG(c);
+        pix->b   = (UCHAR)TIFFGetB(c);
+        pix->m   = (UCHAR)TIFFGetA(c);
+      }
+    }
+  }
+
+  if (tmpRas) tmpRas->unlock();
+  return ok != 0;
+}
+
+//============================================================
+
 Tiio::TifWriterProperties::TifWriterProperties()
     : m_byteOrdering("Byte Ordering")
     , m_compressionType("Compression Type")
@@ -706,6 +766,7 @@ Tiio::TifWriterProperties::TifWriterProperties()
   // nearby...                   -.-'
   m_bitsPerPixel.addValue(L"32(RGBM)");
   m_bitsPerPixel.addValue(L"64(RGBM)");
+  m_bitsPerPixel.addValue(L"128(RGBM Float)");
 
   m_bitsPerPixel.setValue(L"32(RGBM)");
 
@@ -736,6 +797,7 @@ void Tiio::TifWriterProperties::updateTranslation() {
   m_bitsPerPixel.setItemUIName(L" 8(GREYTONES)", tr(" 8(GREYTONES)"));
   m_bitsPerPixel.setItemUIName(L"32(RGBM)", tr("32(RGBM)"));
   m_bitsPerPixel.setItemUIName(L"64(RGBM)", tr("64(RGBM)"));
+  m_bitsPerPixel.setItemUIName(L"128(RGBM Float)", tr("128(RGBM Float)"));
   m_orientation.setQStringName(tr("Orientation"));
   m_orientation.setItemUIName(TNZ_INFO_ORIENT_TOPLEFT, tr("Top Left"));
   m_orientation.setItemUIName(TNZ_INFO_ORIENT_TOPRIGHT, tr("Top Right"));
@@ -766,6 +828,7 @@ public:
   void open(FILE *file, const TImageInfo &info) override;
   void writeLine(char *buffer) override;
   void writeLine(short *buffer) override;
+  void writeLine(float *buffer) override;
 
   void flush() override;
 
@@ -773,7 +836,7 @@ public:
 
   // m_bpp is set to "Bits Per Pixel" property value in the function open()
   bool writeAlphaSupported() const override {
-    return (m_bpp == 32 || m_bpp == 64);
+    return (m_bpp == 32 || m_bpp == 64 || m_bpp == 128);
   }
 };
 
@@ -815,7 +878,7 @@ void TifWriter::open(FILE *file, const TImageInfo &info) {
   std::string str = ::to_string(p->getValue());
   m_bpp           = atoi(str.c_str());
   assert(m_bpp == 1 || m_bpp == 8 || m_bpp == 16 || m_bpp == 24 ||
-         m_bpp == 32 || m_bpp == 48 || m_bpp == 64);
+         m_bpp == 32 || m_bpp == 48 || m_bpp == 64 || m_bpp == 128);
 
   int fd = fileno(file);
 #if 0
@@ -889,12 +952,15 @@ void TifWriter::open(FILE *file, const TImageInfo &info) {
 
   int bitsPerSample =
       (m_bpp == 1) ? 1 : ((m_bpp == 8 || m_bpp == 24 || m_bpp == 32) ? 8 : 16);
+  if (m_bpp == 128) bitsPerSample = 32;
 
   TIFFSetField(m_tiff, TIFFTAG_IMAGEWIDTH, m_info.m_lx);
   TIFFSetField(m_tiff, TIFFTAG_IMAGELENGTH, m_info.m_ly);
   TIFFSetField(m_tiff, TIFFTAG_BITSPERSAMPLE, bitsPerSample);
   TIFFSetField(m_tiff, TIFFTAG_SAMPLESPERPIXEL, m_bpp / bitsPerSample);
   TIFFSetField(m_tiff, TIFFTAG_ORIENTATION, orientation);
+  if (m_bpp == 128)
+    TIFFSetField(m_tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
 
   if (m_bpp == 1)
     TIFFSetField(m_tiff, TIFFTAG_COMPRESSION, COMPRESSION_CCITTFAX4);
@@ -992,6 +1058,29 @@ void TifWriter::writeLine(short *buffer) {
 
 //------------------------------------------------------------
 
+void TifWriter::writeLine(float *buffer) {
+  assert(m_bpp == 128);
+
+  int delta = 1;
+  int start = 0;
+  if (m_RightToLeft) {
+    delta = -1;
+    start = m_info.m_lx - 1;
+  }
+  TPixelF *pix = ((TPixelF *)buffer) + start;
+  for (int i = 0; i < m_info.m_lx; i++) {
+    float *b = (float *)m_lineBuffer + i * 4;
+    b[0]     = pix->r;
+    b[1]     = pix->g;
+    b[2]     = pix->b;
+    b[3]     = pix->m;
+    pix      = pix + delta;
+  }
+  TIFFWriteScanline(m_tiff, m_lineBuffer, m_row++, 0);
+}
+
+//------------------------------------------------------------
+
 void TifWriter::fillBits(UCHAR *bufout, UCHAR *bufin, int lx, int incr) {
   int lx1 = lx / 8 + ((lx % 8) ? 1 : 0);
 
@@ -6,6 +6,10 @@
 #include "tlevel_io.h"
 #include <set>
 
+#include <QMutex>
+
+class QFile;
+
 class TImageWriterTzl;
 class TImageReaderTzl;
 
@@ -29,6 +33,8 @@ private:
 
 typedef std::map<TFrameId, TzlChunk> TzlOffsetMap;
 class TRasterCodecLZO;
+struct TzlImageData;
+class TzlSavePipeline;
 
 class TLevelWriterTzl final : public TLevelWriter {
   // bool m_paletteWritten;
@@ -57,6 +63,7 @@ class TLevelWriterTzl final : public TLevelWriter {
   TDimension m_currentIconSize;  // If file exists this is the current IconSize
                                  // in the file
   TRasterCodecLZO *m_codec;
+  TzlSavePipeline *m_savePipeline;  // Created by the first parallel save
 
   bool m_overwritePaletteFlag;
 
@@ -117,6 +124,20 @@ private:
   void doSave(const TImageP &img, const TFrameId &fid);
   // Save image on disk. If isIcon is true save image as icon.
   void saveImage(const TImageP &img, const TFrameId &fid, bool isIcon = false);
+  // Checks the image and copies its savebox for compression. Updates the
+  // file header if needed.
+  bool prepareImage(const TImageP &img, bool isIcon, TzlImageData &data);
+  // Writes a compressed image, assigning it a chunk in the file.
+  void writeImage(const TzlImageData &data, const TFrameId &fid, bool isIcon);
+  // Writes the oldest frame in the save pipeline, if compressed. If wait is
+  // true, waits for it. Returns false if no frame was written.
+  bool writeCompletedFrame(bool wait);
+  // Writes the frames compressed by the save pipeline, in submission order.
+  // If wait is true, waits for all of them.
+  void writeCompletedFrames(bool wait);
+  // Writes all the frames in the save pipeline. It must be called before
+  // anything reading the offset tables.
+  void flushSavePipeline();
   void createIcon(const TImageP &imgIn, TImageP &imgOut);
   bool convertToLatestVersion();
   void writeHeader(const TDimension &size);
@@ -162,8 +183,31 @@ Return an image with Reader information
           */
   bool getIconSize(TDimension &iconSize);
 
+  //! Read-only view of the frames' offset table
+  const TzlOffsetMap &getFrameOffsTable() const { return m_frameOffsTable; }
+  //! Read-only view of the icons' offset table
+  const TzlOffsetMap &getIconOffsTable() const { return m_iconOffsTable; }
+
+  /*!
+    Copies \b size bytes at file offset \b offs into \b data. Can be called
+    concurrently: without a mapped file, accesses to the channel are
+    serialized.
+  */
+  bool readChunk(TINT32 offs, void *data, TINT32 size);
+  /*!
+    Returns the \b size bytes at file offset \b offs in the memory-mapped
+    file, or 0 if the file is not mapped (see
+    TLevelReader::setMappedReadingForTzl()). Data is valid as long as the
+    reader lives.
+  */
+  const UCHAR *getMappedChunk(TINT32 offs, TINT32 size) const;
+
 private:
   FILE *m_chan;
+  QMutex m_chanMutex;  //!< Serializes seek + read sequences on m_chan
+  QFile *m_mappedFile;
+  const UCHAR *m_mappedData;
+  qint64 m_mappedSize;
   TLevelP m_level;
   TDimension m_res;
   double m_xDpi, m_yDpi;
@@ -56,6 +56,7 @@ public:
   bool canHandle(const TRenderSettings &info, double frame) override {
     return true;
   }
+  bool handlesSparseTiles() const override { return true; }
 
   bool doGetBBox(double frame, TRectD &bBox,
                  const TRenderSettings &info) override;
@@ -66,6 +67,8 @@ public:
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 };
 
 #endif  // TBASEFX_INCLUDED
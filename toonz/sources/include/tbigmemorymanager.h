@@ -4,6 +4,7 @@
 #define _TBIGMEMORYMANAGER_
 
 class Chunkinfo;
+class RasterBufferPool;
 
 #undef DVAPI
 #undef DVVAR
@@ -23,37 +24,65 @@ class DVAPI TBigMemoryManager {
   TThread::Mutex m_mutex;
   UCHAR *m_theMemory;
   std::map<UCHAR *, Chunkinfo> m_chunks;
-  UCHAR *allocate(UINT &size);
+  UCHAR *allocate(TUINT64 &size);
 
-  TUINT32 m_availableMemory, m_allocatedMemory;
+  TUINT64 m_availableMemory, m_allocatedMemory;
   std::map<UCHAR *, Chunkinfo>::iterator shiftBlock(
-      const std::map<UCHAR *, Chunkinfo>::iterator &it, TUINT32 offset);
+      const std::map<UCHAR *, Chunkinfo>::iterator &it, TUINT64 offset);
   TRaster *findRaster(TRaster *ras);
   void checkConsistency();
-  UCHAR *remap(TUINT32 RequestedSize);
-  void printLog(TUINT32 size);
+  UCHAR *remap(TUINT64 RequestedSize);
+  void printLog(TUINT64 size);
+
+  RasterBufferPool *m_pool;
+
+public:
+  struct PoolStatistics {
+    TINT64 m_mappedBuffers;    //!< Buffers taken from the system
+    TINT64 m_reusedBuffers;    //!< Buffers served from the free lists...
+    TINT64 m_threadReuses;     //!< ...of which from the per-thread caches
+    TINT64 m_unmappedBuffers;  //!< Buffers given back to the system
+
+    PoolStatistics()
+        : m_mappedBuffers(0)
+        , m_reusedBuffers(0)
+        , m_threadReuses(0)
+        , m_unmappedBuffers(0) {}
+  };
 
 public:
   TBigMemoryManager();
   ~TBigMemoryManager();
-  bool init(TUINT32 sizeinKb);
+  bool init(TUINT64 sizeinKb);
   bool putRaster(TRaster *ras, bool canPutOnDisk = true);
   bool releaseRaster(TRaster *ras);
   void lock(UCHAR *buffer);
   void unlock(UCHAR *buffer);
-  UCHAR *getBuffer(UINT size);
+  UCHAR *getBuffer(TUINT64 size);
   static TBigMemoryManager *instance();
   bool isActive() const { return m_theMemory != 0; }
+
+  //! Serves the buffers of new rasters from free lists of size classes,
+  //! keeping up to the specified amount of idle buffers for reuse. It is an
+  //! alternative to init(), for 64-bit builds: buffers are never moved, so
+  //! rasters need no locking.
+  bool initPools(TUINT64 idleSizeInKb);
+  bool isPooling() const { return m_pool != 0; }
+  //! Gives the idle pooled buffers back to the system.
+  void releaseIdleBuffers();
+  PoolStatistics getPoolStatistics() const;
+  std::string getPoolStatisticsString() const;
+
   // void releaseSubraster(UCHAR *chunk, TRaster*subRas);
-  TUINT32 getAvailableMemoryinKb() const {
+  TUINT64 getAvailableMemoryinKb() const {
     assert(m_theMemory != 0);
     return m_availableMemory >> 10;
   }
-  void getRasterInfo(int &rasterCount, TUINT32 &totRasterMemInKb,
+  void getRasterInfo(int &rasterCount, TUINT64 &totRasterMemInKb,
                      int &notCachedRasterCount,
-                     TUINT32 &notCachedRasterMemInKb);
+                     TUINT64 &notCachedRasterMemInKb);
 #ifdef _DEBUG
-  TUINT32 m_totRasterMemInKb;
+  TUINT64 m_totRasterMemInKb;
   void printMap();
 #endif
   int getAllocationPeak();
@@ -0,0 +1,117 @@
+#pragma once
+
+#ifndef TFXDISKCACHE_H
+#define TFXDISKCACHE_H
+
+// TnzCore includes
+#include "tfilepath.h"
+
+// TnzBase includes
+#include "tfxhash.h"
+
+// Qt includes
+#include <QMutex>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TFX_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//=========================================================
+
+//  Forward declarations
+
+class TTile;
+
+//=========================================================
+
+//******************************************************************************
+//    TFxDiskCache  declaration
+//******************************************************************************
+
+/*!
+  TFxDiskCache stores fx render results on disk, so that they survive the
+  process which rendered them. Every Toonz process pointed to the same folder
+  (the GUI previewer, tcomposer instances) shares its content.
+
+  Entries are keyed by a TFxHash covering the fx subtree, the render settings
+  and the tile geometry - see TRasterFx::compute(). Each one is an
+  LZO-compressed raster in its own file, stamped with its last access time.
+  When the folder exceeds the maximum size, the least recently accessed
+  entries are removed.
+
+  Only results that took some time to compute are stored - cheaper ones are
+  not worth the disk traffic.
+
+  The cache is disabled until both a folder and a positive maximum size are
+  assigned.
+*/
+
+class DVAPI TFxDiskCache {
+public:
+  struct Statistics {
+    TINT64 m_hits, m_misses;  //!< Lookups outcome
+    TINT64 m_stores;          //!< Stored entries
+    TINT64 m_evictions;       //!< Entries removed to make room
+    TINT64 m_readBytes, m_writtenBytes;
+
+    Statistics()
+        : m_hits(0)
+        , m_misses(0)
+        , m_stores(0)
+        , m_evictions(0)
+        , m_readBytes(0)
+        , m_writtenBytes(0) {}
+  };
+
+private:
+  TFilePath m_rootDir;
+  TINT64 m_maxSize;  //!< In bytes
+  TINT64 m_size;     //!< Estimated folder size, in bytes
+
+  Statistics m_stats;
+  mutable QMutex m_mutex;
+
+public:
+  static TFxDiskCache *instance();
+
+  //! Sets the cache folder. An empty path disables the cache.
+  void setRootDir(const TFilePath &rootDir);
+  TFilePath getRootDir() const;
+
+  //! Sets the maximum size of the cache folder, in MB. Zero disables the
+  //! cache.
+  void setMaximumSize(int MB);
+  int getMaximumSize() const;
+
+  bool isEnabled() const;
+
+  //! Fills the tile's raster with the entry of specified key, returning
+  //! whether it was found. The entry must match the raster's size and type.
+  bool load(const TFxHash &key, TTile &tile);
+
+  //! Stores the tile's raster as the entry of specified key. \b computeTime
+  //! is the time spent calculating it, in milliseconds.
+  void store(const TFxHash &key, const TTile &tile, int computeTime);
+
+  Statistics getStatistics() const;
+  void resetStatistics();
+
+  //! Returns a one-line, human readable summary of the statistics.
+  std::string getStatisticsString() const;
+
+private:
+  TFxDiskCache();
+
+  TFilePath getEntryPath(const TFxHash &key) const;
+
+  void updateSize();
+  void evict();
+};
+
+#endif  // TFXDISKCACHE_H
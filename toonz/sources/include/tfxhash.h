@@ -0,0 +1,143 @@
+#pragma once
+
+#ifndef TFXHASH_H
+#define TFXHASH_H
+
+// TnzCore includes
+#include "tnztypes.h"
+
+// STD includes
+#include <string>
+#include <cstring>
+#include <cmath>
+
+//=========================================================
+
+//******************************************************************************
+//    TFxHash  declaration
+//******************************************************************************
+
+/*!
+  TFxHash is the 128-bit digest identifying a rendered fx subtree. It is the
+  compact counterpart of the string returned by TRasterFx::getAlias(), and is
+  used by the render cache to name its resources.
+
+  A hash is \a volatile when it covers data that may change without changing
+  the hash - typically unsaved edits of a level. Volatile hashes are fine
+  within a session, but must not key caches persisting across sessions. The
+  flag does not take part in comparisons.
+*/
+
+class TFxHash {
+public:
+  TUINT64 m_h1, m_h2;
+  bool m_volatile;
+
+public:
+  TFxHash() : m_h1(0), m_h2(0), m_volatile(false) {}
+  TFxHash(TUINT64 h1, TUINT64 h2, bool isVolatile = false)
+      : m_h1(h1), m_h2(h2), m_volatile(isVolatile) {}
+
+  bool operator==(const TFxHash &other) const {
+    return m_h1 == other.m_h1 && m_h2 == other.m_h2;
+  }
+  bool operator!=(const TFxHash &other) const { return !operator==(other); }
+
+  bool operator<(const TFxHash &other) const {
+    return m_h1 < other.m_h1 || (m_h1 == other.m_h1 && m_h2 < other.m_h2);
+  }
+
+  //! Returns the hash as 32 hexadecimal digits.
+  std::string toString() const {
+    static const char digits[] = "0123456789abcdef";
+
+    std::string result(32, '0');
+    for (int i = 0; i < 16; ++i) {
+      result[15 - i] = digits[(m_h1 >> (4 * i)) & 0xf];
+      result[31 - i] = digits[(m_h2 >> (4 * i)) & 0xf];
+    }
+
+    return result;
+  }
+};
+
+//******************************************************************************
+//    TFxHasher  declaration
+//******************************************************************************
+
+/*!
+  TFxHasher accumulates values into a TFxHash. The digest depends on the order
+  of the added values, so that a sequence of \a add() calls plays the role of
+  the concatenations building a string alias. Adding a volatile hash makes
+  the result volatile too.
+
+  \note The hash is meant to tell rendered objects apart, not to resist
+  attacks. Each 64-bit lane is mixed with the splitmix64 finalizer.
+*/
+
+class TFxHasher {
+  TUINT64 m_h1, m_h2;
+  bool m_volatile;
+
+public:
+  TFxHasher()
+      : m_h1(0x9e3779b97f4a7c15ULL)
+      , m_h2(0xc2b2ae3d27d4eb4fULL)
+      , m_volatile(false) {}
+
+  TFxHasher &add(TUINT64 value) {
+    m_h1 = mix(m_h1 ^ value);
+    m_h2 = mix(m_h2 + value + (m_h1 >> 7));
+    return *this;
+  }
+
+  TFxHasher &add(const TFxHash &hash) {
+    m_volatile = m_volatile || hash.m_volatile;
+    return add(hash.m_h1).add(hash.m_h2);
+  }
+
+  TFxHasher &add(const std::string &str) {
+    size_t size = str.size(), i;
+    add((TUINT64)size);
+
+    for (i = 0; i + 8 <= size; i += 8) {
+      TUINT64 word;
+      memcpy(&word, str.data() + i, 8);
+      add(word);
+    }
+
+    if (i < size) {
+      TUINT64 word = 0;
+      memcpy(&word, str.data() + i, size - i);
+      add(word);
+    }
+
+    return *this;
+  }
+
+  //! Adds a real value rounded to the specified decimals - like the string
+  //! aliases do, so that -0 and near-zero values hash as 0.
+  TFxHasher &addReal(double value, int decimals) {
+    return add((TUINT64)std::llround(value * std::pow(10.0, decimals)));
+  }
+
+  //! Marks the result as volatile.
+  TFxHasher &setVolatile() {
+    m_volatile = true;
+    return *this;
+  }
+
+  TFxHash result() const { return TFxHash(m_h1, m_h2, m_volatile); }
+
+private:
+  static TUINT64 mix(TUINT64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+};
+
+#endif  // TFXHASH_H
@@ -4,6 +4,7 @@
 #define TIIO_INCLUDED
 
 #include "tcommon.h"
+#include "tgeometry.h"
 #include <string>
 #include <QStringList>
 #include "timageinfo.h"
@@ -58,6 +59,17 @@ public:
   // If not implemented returns 0;
   virtual int skipLines(int lineCount) = 0;
 
+  // Reads the pixels of rect (in image coordinates, y pointing up), one every
+  // shrink in both directions, as 32-bit pixels. Rows are stored bottom to
+  // top in buffer, wrap pixels apart. Rect is contained in the image, and its
+  // sides are multiples of shrink plus 1.
+  // It must be called on a freshly opened reader. Returns false if the
+  // format has no native support for it: callers then use readLine().
+  virtual bool readRegion(char *buffer, int wrap, const TRect &rect,
+                          int shrink) {
+    return false;
+  }
+
   virtual RowOrder getRowOrder() const { return BOTTOM2TOP; }
   virtual bool read16BitIsEnabled() const { return false; }
 
@@ -101,6 +113,7 @@ public:
 
   virtual void writeLine(char *buffer) = 0;
   virtual void writeLine(short *) { assert(false); }
+  virtual void writeLine(float *) { assert(false); }
 
   virtual void flush() {}
 
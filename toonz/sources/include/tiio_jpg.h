@@ -45,6 +45,8 @@ public:
 
   void readLine(char *buffer, int x0, int x1, int shrink) override;
   int skipLines(int lineCount) override;
+  bool readRegion(char *buffer, int wrap, const TRect &rect,
+                  int shrink) override;
 };
 
 DVAPI Tiio::ReaderMaker makeJpgReader;
@@ -64,6 +64,22 @@ since it prevents abuses
 of system memory. This is especially true on 32-bit OSes.
 */
 class DVAPI TImageCache {
+public:
+  struct Statistics {
+    TINT64 m_compressions;  //!< Items compressed in memory
+    TINT64 m_spills;        //!< Items moved to disk
+    TINT64 m_drops;         //!< Reloadable items released
+    TINT64 m_backgroundPasses, m_inlinePasses;  //!< Compression passes
+
+    Statistics()
+        : m_compressions(0)
+        , m_spills(0)
+        , m_drops(0)
+        , m_backgroundPasses(0)
+        , m_inlinePasses(0) {}
+  };
+
+private:
   class Imp;
   std::unique_ptr<Imp> m_imp;
 
@@ -137,7 +153,7 @@ public:
 
   void dump(std::ostream &os) const;  // per debug
 
-  UCHAR *compressAndMalloc(TUINT32 requestedSize);  // compress in the cache
+  UCHAR *compressAndMalloc(TUINT64 requestedSize);  // compress in the cache
                                                     // till it can allocate the
                                                     // requested memory
 
@@ -155,6 +171,25 @@ public:
   // compress id (in memory)
   void compress(const std::string &id);
 
+  //! Sets the memory watermarks of uncompressed images, in MB. Above \b
+  //! highMB, a background thread compresses them down to \b lowMB - which
+  //! defaults to \b highMB. Zero disables the watermarks, leaving compression
+  //! to shortages of system memory.
+  void setMemoryWatermarks(int highMB, int lowMB = 0);
+  void getMemoryWatermarks(int &highMB, int &lowMB) const;
+
+  //! Declares that the owner of the image under specified id can rebuild it
+  //! (eg reloading it from file) should it go missing. Under memory pressure,
+  //! such images are released rather than compressed - until they are
+  //! retrieved to be modified.
+  void setReloadable(const std::string &id, bool reloadable);
+
+  Statistics getStatistics() const;
+  void resetStatistics();
+
+  //! Returns a one-line, human readable summary of the statistics.
+  std::string getStatisticsString() const;
+
 private:
   TImageCache();
   ~TImageCache();
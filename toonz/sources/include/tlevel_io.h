@@ -48,8 +48,17 @@ protected:
   TImageInfo *m_info;
   TFilePath m_path;
   TContentHistory *m_contentHistory;
+  static bool m_mappedReadingForTzl;
 
 public:
+  /*!
+    Lets tlv readers memory-map their file, so that any number of threads can
+    decode its frames concurrently. The file must not be rewritten while it is
+    mapped: meant for read-only processes, like the command-line renderer.
+  */
+  static void setMappedReadingForTzl(bool activated) {
+    m_mappedReadingForTzl = activated;
+  }
   TLevelReader(const TFilePath &path);
   virtual ~TLevelReader();
 
@@ -72,6 +72,8 @@ public:
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 
   void loadData(TIStream &is) override;
   void saveData(TOStream &os) override;
@@ -54,6 +54,18 @@ public:
     virtual ~Listener() {}
   };
 
+  //! Statistics about the saving of movie-type outputs. Their frames are
+  //! saved in sequence by a dedicated writer thread, fed by a bounded queue.
+  struct WriterStatistics {
+    int m_maxQueuedFrames;     //!< Peak of rendered frames waiting to be saved
+    qint64 m_writerStallTime;  //!< Msecs the writer waited for frames
+    qint64 m_renderStallTime;  //!< Msecs render threads waited for room in
+                               //!< the queue
+
+    WriterStatistics()
+        : m_maxQueuedFrames(0), m_writerStallTime(0), m_renderStallTime(0) {}
+  };
+
 public:
   MovieRenderer(ToonzScene *scene, const TFilePath &moviePath,
                 int threadCount = 1, bool cacheResults = true);
@@ -68,12 +80,30 @@ public:
   void enablePrecomputing(bool on);
   bool isPrecomputingEnabled() const;
 
+  //! Sets the memory budget of the frames rendered at once, in MB - see
+  //! TRenderer::setMaxMemory().
+  void setMaxMemory(int MB);
+
+  //! Sets the memory budget of the intermediate results retained across
+  //! frames, in MB - see TRenderer::setMaxCacheMemory().
+  void setMaxCacheMemory(int MB);
+
   TRenderer *getTRenderer();
 
   void addFrame(double frame, const TFxPair &fx);
 
   void start();
 
+  WriterStatistics getWriterStatistics() const;
+
+  //! Returns a one-line, human readable summary of the writer statistics -
+  //! or an empty string if the output is not a movie type.
+  std::string getWriterStatisticsString() const;
+
+  //! Returns the number of frames saved from the raster of an identical,
+  //! earlier frame instead of being rendered.
+  int getHeldFrameCount() const;
+
 public slots:
 
   void onCanceled();
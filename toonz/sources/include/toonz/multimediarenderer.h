@@ -82,6 +82,14 @@ public:
   void enablePrecomputing(bool on);
   bool isPrecomputingEnabled() const;
 
+  //! Sets the memory budget of the frames rendered at once, in MB - see
+  //! TRenderer::setMaxMemory().
+  void setMaxMemory(int MB);
+
+  //! Sets the memory budget of the intermediate results retained across
+  //! frames, in MB - see TRenderer::setMaxCacheMemory().
+  void setMaxCacheMemory(int MB);
+
   enum { COLUMNS = 1, LAYERS = 2 };
   int getMultimediaMode() const;
 
@@ -44,6 +44,8 @@ public:
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
   bool doGetBBox(double frame, TRectD &bbox,
                  const TRenderSettings &info) override;
 
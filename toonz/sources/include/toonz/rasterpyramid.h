@@ -0,0 +1,115 @@
+#pragma once
+
+#ifndef RASTERPYRAMID_H
+#define RASTERPYRAMID_H
+
+// TnzCore includes
+#include "tfilepath.h"
+#include "timageinfo.h"
+#include "trasterimage.h"
+
+// Qt includes
+#include <QMutex>
+#include <QWaitCondition>
+
+// STD includes
+#include <set>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TOONZLIB_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//=====================================================
+
+//***************************************************************************************
+//    RasterPyramidCache  declaration
+//***************************************************************************************
+
+/*!
+  RasterPyramidCache stores downsampled copies (1/2, 1/4 and 1/8) of large
+  fullcolor images in sidecar files, so that shrunk loads skip the decoding
+  of the full resolution image.
+
+  Each frame file gets its own sidecar in the cache folder, holding the
+  LZ4-compressed pyramid levels together with the size and modification time
+  of the source. A sidecar whose source has changed since is rebuilt on the
+  next request.
+
+  Pyramid levels are box-filtered, and have the same size as the images
+  loaded with TImageReader::setShrink(): the level of factor \a f is
+  ceil(lx / f) x ceil(ly / f) pixels.
+
+  The folder is kept within a maximum size, by removing the least recently
+  built sidecars. The cache is disabled until both a folder and a maximum
+  size are assigned.
+*/
+
+class DVAPI RasterPyramidCache {
+  TFilePath m_rootDir;
+  TINT64 m_maxSize;  //!< In bytes
+  TINT64 m_size;     //!< Estimated folder size, in bytes
+
+  std::set<QString> m_building;  //!< Sidecars being built
+  QWaitCondition m_buildDone;
+  mutable QMutex m_mutex;
+
+public:
+  static RasterPyramidCache *instance();
+
+  //! Sets the sidecars folder. An empty path disables the cache.
+  void setRootDir(const TFilePath &rootDir);
+  TFilePath getRootDir() const;
+
+  //! Sets the maximum size of the sidecars folder, in MB. Zero disables the
+  //! cache.
+  void setMaximumSize(int MB);
+  int getMaximumSize() const;
+
+  bool isEnabled() const;
+
+  //! Returns the pyramid level serving the specified shrink factor, ie
+  //! the largest power of 2 dividing it, up to 8. Returns 1 when no pyramid
+  //! level helps.
+  static int levelShrink(int shrink);
+
+  //! Returns whether images like the specified one are worth a pyramid.
+  static bool isSuitable(const TFilePath &levelPath, const TImageInfo &info);
+
+  //! Returns whether the frame's sidecar is up to date, and holds the pyramid
+  //! level serving the specified shrink factor. Does not build it.
+  bool hasLevel(const TFilePath &levelPath, const TFrameId &fid, int shrink,
+                bool is64bit) const;
+
+  //! Box-filters the raster down by the specified power of 2, just like
+  //! pyramid levels are built.
+  static TRasterP shrink(const TRasterP &ras, int level);
+
+  /*!
+    Loads the specified frame at the given shrink factor from its pyramid,
+    building the sidecar first if needed. Shrink factors which are not a
+    pyramid level are completed by pixel subsampling. As with
+    TImageReader::enable16BitRead(), \b is64bit allows 64-bit rasters to be
+    returned for 16-bit sources.
+
+    Returns a null image if the cache is disabled, the frame is not suitable
+    or anything fails - callers are expected to load the frame normally then.
+  */
+  TRasterImageP load(const TFilePath &levelPath, const TFrameId &fid,
+                     int shrink, bool is64bit);
+
+private:
+  RasterPyramidCache();
+
+  TFilePath getSidecarPath(const TFilePath &framePath, bool is64bit) const;
+
+  void updateSize();
+  void evict();
+};
+
+#endif  // RASTERPYRAMID_H
@@ -84,6 +84,7 @@ public:
   TXshColumn *getXshColumn() const override;
 
   bool isCachable() const override { return m_isCachable; }
+  bool handlesSparseTiles() const override { return true; }
 
   bool canHandle(const TRenderSettings &info, double frame) override;
   TAffine handledAffine(const TRenderSettings &info, double frame) override;
@@ -94,6 +95,8 @@ public:
                  const TRenderSettings &info) override;
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
   int getMemoryRequirement(const TRectD &rect, double frame,
                            const TRenderSettings &info) override;
 
@@ -156,6 +159,8 @@ public:
                  const TRenderSettings &info) override;
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
   TAffine getDpiAff(int frame);
 
   void doCompute(TTile &tile, double frame, const TRenderSettings &) override;
@@ -196,11 +201,16 @@ public:
     return true;
   }
 
+  // The zerary fx converts float tiles itself, if needed
+  bool canComputeInFloat() const override { return true; }
+
   TFxTimeRegion getTimeRegion() const override;
   bool doGetBBox(double frame, TRectD &bBox,
                  const TRenderSettings &info) override;
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 
   void doCompute(TTile &tile, double frame, const TRenderSettings &) override;
 
@@ -234,6 +244,8 @@ public:
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 
   void doCompute(TTile &tile, double frame, const TRenderSettings &) override;
   bool doGetBBox(double frame, TRectD &bBox,
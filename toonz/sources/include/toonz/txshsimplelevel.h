@@ -272,6 +272,15 @@ Editable range is contained in \b m_editableRange.
   void load() override;
   void load(const std::vector<TFrameId> &fIds);
 
+  /*!
+    Same as load(), except that unsupported images are reported in
+    \b errorMessage instead of a message box - and false is returned.
+
+    Distinct levels can be loaded this way concurrently, provided that any
+    level range set with setLoadingLevelRange() is not enabled.
+  */
+  bool load(QString &errorMessage);
+
   //! Saves the level to disk, with the same path deduction from load()
   void save() override;
 
@@ -61,6 +61,9 @@ private:
   std::vector<FxData> m_fxDataVector;
   std::set<std::string> m_invalidatedLevels;
   ResourcesContainer *m_resources;
+  // Resource names are hashes - the fx aliases naming the levels each stored
+  // resource depends on are kept here, for level invalidation
+  std::map<std::string, std::string> m_resourceAliases;
   std::map<std::string, UCHAR> m_contextNames;
   std::map<unsigned long, std::string> m_contextNamesByRenderId;
 
@@ -132,6 +135,7 @@ private:
 
   std::string getContextName();
   void releaseOldResources();
+  void pruneResourceAliases();
 };
 
 #endif  // TPASSIVECACHEMANAGER_INCLUDED
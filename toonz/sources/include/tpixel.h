@@ -26,6 +26,8 @@ class TPixelRGBM64;
 class TPixelRGB555;
 //! POSSIBLY UNUSED! r:5,g:6,b:5; 2 byte/pixel
 class TPixelRGB565;
+//! Float r,g,b,m; 16 byte/pixel
+class TPixelRGBMF;
 //! Double r,g,b,m ; 16 byte/pixel
 class TPixelD;
 
@@ -255,6 +257,72 @@ typedef TPixelRGBM64 TPixel64;
 
 //-----------------------------------------------------------------------------
 
+/*! The floating point pixel type: r,g,b,m; 1 float/channel, premultiplied
+    like the integer types. Channels span [0, 1] - though, unlike those, they
+    are not clamped, so that the values beyond 1 are kept along the render.
+    Channel ordering follows that of TPixel32 and TPixel64. */
+
+class DVAPI DV_ALIGNED(16) TPixelRGBMF {
+public:
+  static const float maxChannelValue;
+  typedef float Channel;
+
+#ifdef TNZ_MACHINE_CHANNEL_ORDER_BGRM
+  Channel b, g, r, m;
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_MRGB)
+  Channel m, r, g, b;
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_RGBM)
+  Channel r, g, b, m;
+#else
+  undefined machine order !!!!
+#endif
+
+#ifdef TNZ_MACHINE_CHANNEL_ORDER_MRGB
+  TPixelRGBMF() : m(maxChannelValue), r(0), g(0), b(0){};
+  TPixelRGBMF(float rr, float gg, float bb, float mm = maxChannelValue)
+      : m(mm), r(rr), g(gg), b(bb){};
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_RGBM)
+  TPixelRGBMF() : r(0), g(0), b(0), m(maxChannelValue){};
+  TPixelRGBMF(float rr, float gg, float bb, float mm = maxChannelValue)
+      : r(rr), g(gg), b(bb), m(mm){};
+#else
+  TPixelRGBMF() : b(0), g(0), r(0), m(maxChannelValue){};
+  TPixelRGBMF(float rr, float gg, float bb, float mm = maxChannelValue)
+      : b(bb), g(gg), r(rr), m(mm){};
+#endif
+
+  inline bool operator==(const TPixelRGBMF &p) const {
+    return r == p.r && g == p.g && b == p.b && m == p.m;
+  }
+  inline bool operator!=(const TPixelRGBMF &p) const { return !operator==(p); }
+
+  inline bool operator<(const TPixelRGBMF &p) const {
+    return r < p.r ||
+           (r == p.r &&
+            (g < p.g || (g == p.g && (b < p.b || (b == p.b && (m < p.m))))));
+  }
+  inline bool operator>=(const TPixelRGBMF &p) const { return !operator<(p); }
+  inline bool operator>(const TPixelRGBMF &p) const {
+    return !operator<(p) && !operator==(p);
+  }
+  inline bool operator<=(const TPixelRGBMF &p) const { return !operator>(p); }
+
+  static const TPixelRGBMF Red;
+  static const TPixelRGBMF Green;
+  static const TPixelRGBMF Blue;
+  static const TPixelRGBMF Yellow;
+  static const TPixelRGBMF Cyan;
+  static const TPixelRGBMF Magenta;
+  static const TPixelRGBMF White;
+  static const TPixelRGBMF Black;
+  static const TPixelRGBMF Transparent;
+};
+
+//! TPixelF is a shortcut for TPixelRGBMF. Use it!
+typedef TPixelRGBMF TPixelF;
+
+//-----------------------------------------------------------------------------
+
 class DVAPI TPixelD {
 public:
   typedef double Channel;
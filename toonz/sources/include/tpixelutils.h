@@ -212,6 +212,17 @@ inline TPixel64 overPix(const TPixel64 &bot, const TPixel64 &top) {
 
 //-----------------------------------------------------------------------------
 
+//! Float pixels are composited without clamping the color channels.
+inline TPixelF overPix(const TPixelF &bot, const TPixelF &top) {
+  if (top.m >= 1.f) return top;
+
+  float k = 1.f - top.m;
+  return TPixelF(top.r + bot.r * k, top.g + bot.g * k, top.b + bot.b * k,
+                 std::min(top.m + bot.m * k, 1.f));
+}
+
+//-----------------------------------------------------------------------------
+
 inline TPixel32 quickOverPix(const TPixel32 &bot, const TPixelGR8 &top) {
   return quickOverPixGRT<TPixel32, TPixelGR8, UCHAR>(bot, top);
 }
@@ -359,6 +370,21 @@ inline void depremult(TPixel64 &pix) {
   pix.b      = std::min(pix.b * fac, 65535.0);
 }
 
+inline void premult(TPixelF &pix) {
+  pix.r = pix.r * pix.m;
+  pix.g = pix.g * pix.m;
+  pix.b = pix.b * pix.m;
+}
+
+inline void depremult(TPixelF &pix) {
+  if (pix.m <= 0.f) return;
+
+  float fac = 1.f / pix.m;
+  pix.r     = pix.r * fac;
+  pix.g     = pix.g * fac;
+  pix.b     = pix.b * fac;
+}
+
 //-----------------------------------------------------------------------------
 
 template <typename Chan>
@@ -393,6 +419,15 @@ inline TPixel64 depremultiply(const TPixel64 &pix) {
                   pix.b * 65535.0 / pix.m, pix.m);
 }
 
+inline TPixelF premultiply(const TPixelF &pix) {
+  return TPixelF(pix.r * pix.m, pix.g * pix.m, pix.b * pix.m, pix.m);
+}
+
+inline TPixelF depremultiply(const TPixelF &pix) {
+  return (pix.m <= 0.f) ? pix : TPixelF(pix.r / pix.m, pix.g / pix.m,
+                                        pix.b / pix.m, pix.m);
+}
+
 //-----------------------------------------------------------------------------
 
 //! onversion between RGB and HSV colorspace
@@ -437,14 +472,22 @@ DVAPI void rgb2hls(double r, double g, double b, double *h, double *l,
 DVAPI TPixel32 toPixel32(const TPixel64 &);
 DVAPI TPixel32 toPixel32(const TPixelD &);
 DVAPI TPixel32 toPixel32(const TPixelGR8 &);
+DVAPI TPixel32 toPixel32(const TPixelF &);
 
 DVAPI TPixel64 toPixel64(const TPixel32 &);
 DVAPI TPixel64 toPixel64(const TPixelD &);
 DVAPI TPixel64 toPixel64(const TPixelGR8 &);
+DVAPI TPixel64 toPixel64(const TPixelF &);
 
 DVAPI TPixelD toPixelD(const TPixel32 &);
 DVAPI TPixelD toPixelD(const TPixel64 &);
 DVAPI TPixelD toPixelD(const TPixelGR8 &);
+DVAPI TPixelD toPixelD(const TPixelF &);
+
+DVAPI TPixelF toPixelF(const TPixel32 &);
+DVAPI TPixelF toPixelF(const TPixel64 &);
+DVAPI TPixelF toPixelF(const TPixelD &);
+DVAPI TPixelF toPixelF(const TPixelGR8 &);
 
 //
 // nel caso in cui il tipo di destinazione sia il parametro di un template
@@ -461,6 +504,7 @@ public:
   inline static T from(const TPixel64 &pix);
   inline static T from(const TPixelD &pix);
   inline static T from(const TPixelGR8 &pix);
+  inline static T from(const TPixelF &pix);
 };
 
 template <>
@@ -470,6 +514,7 @@ public:
   inline static TPixel32 from(const TPixel64 &pix) { return toPixel32(pix); }
   inline static TPixel32 from(const TPixelD &pix) { return toPixel32(pix); }
   inline static TPixel32 from(const TPixelGR8 &pix) { return toPixel32(pix); }
+  inline static TPixel32 from(const TPixelF &pix) { return toPixel32(pix); }
 };
 
 template <>
@@ -479,6 +524,7 @@ public:
   inline static TPixel64 from(const TPixel64 &pix) { return pix; }
   inline static TPixel64 from(const TPixelD &pix) { return toPixel64(pix); }
   inline static TPixel64 from(const TPixelGR8 &pix) { return toPixel64(pix); }
+  inline static TPixel64 from(const TPixelF &pix) { return toPixel64(pix); }
 };
 
 template <>
@@ -488,6 +534,17 @@ public:
   inline static TPixelD from(const TPixel64 &pix) { return toPixelD(pix); }
   inline static TPixelD from(const TPixelD &pix) { return pix; }
   inline static TPixelD from(const TPixelGR8 &pix) { return toPixelD(pix); }
+  inline static TPixelD from(const TPixelF &pix) { return toPixelD(pix); }
+};
+
+template <>
+class PixelConverter<TPixelF> {
+public:
+  inline static TPixelF from(const TPixel32 &pix) { return toPixelF(pix); }
+  inline static TPixelF from(const TPixel64 &pix) { return toPixelF(pix); }
+  inline static TPixelF from(const TPixelD &pix) { return toPixelF(pix); }
+  inline static TPixelF from(const TPixelGR8 &pix) { return toPixelF(pix); }
+  inline static TPixelF from(const TPixelF &pix) { return pix; }
 };
 
 //---------------------------------------------------------------------------------------
@@ -30,6 +30,16 @@
 The TPredictiveCacheManager is the TFxCacheManagerDelegate used to cache
 intermediate
 render results due to predictive analysis of the scene schematic.
+
+The test run of the precomputing stage walks the fx trees of all the render
+tasks, in the order they are started. This yields the render plan: for each
+resource used more than once (held cells, static backgrounds, subtrees
+whose parameters do not animate), the sequence of its uses. Resources are
+then retained until their last use.
+
+When a memory budget is set, the retained resources exceeding it are evicted
+by next-use distance (Belady's policy): the resource whose next use comes
+last is released first, and rebuilt when requested again.
 */
 
 class DVAPI TPredictiveCacheManager final : public TFxCacheManagerDelegate {
@@ -38,6 +48,23 @@ class DVAPI TPredictiveCacheManager final : public TFxCacheManagerDelegate {
   class Imp;
   std::unique_ptr<Imp> m_imp;
 
+public:
+  //! Process-wide counters, accumulated over all render instances.
+  struct Statistics {
+    TINT64 m_sharedResources;  //!< Resources planned for reuse
+    TINT64 m_predictedHits;    //!< Planned reuses
+    TINT64 m_hits;             //!< Reuses served by retained resources
+    TINT64 m_evictions;        //!< Resources released to fit the budget
+    TINT64 m_evictedHits;      //!< Planned reuses lost by evictions
+
+    Statistics()
+        : m_sharedResources(0)
+        , m_predictedHits(0)
+        , m_hits(0)
+        , m_evictions(0)
+        , m_evictedHits(0) {}
+  };
+
 public:
   TPredictiveCacheManager();
   ~TPredictiveCacheManager();
@@ -50,6 +77,16 @@ public:
   void setMaxTileSize(int maxTileSize);
   void setBPP(int bpp);
 
+  //! Sets the memory budget of the retained resources, in MB. Zero (the
+  //! default) retains all of them until their last use.
+  void setMaxMemory(int MB);
+
+  static Statistics getStatistics();
+  static void resetStatistics();
+
+  //! Returns a one-line, human readable summary of the statistics.
+  static std::string getStatisticsString();
+
   void getResource(TCacheResourceP &resource, const std::string &alias,
                    const TFxP &fx, double frame, const TRenderSettings &rs,
                    ResourceDeclaration *resData) override;
@@ -85,6 +85,7 @@ protected:
   TRaster *m_parent;  // nel caso di sotto-raster
   UCHAR *m_buffer;
   bool m_bufferOwner;
+  int m_poolClass;  // size class of the buffer if pooled, -1 otherwise
   // i costruttori sono qui per centralizzare la gestione della memoria
   // e' comunque impossibile fare new TRaster perche' e' una classe astratta
   // (clone, extract)
@@ -429,6 +430,9 @@ template class DVAPI TRasterPT<TPixel32>;
 template class DVAPI TSmartPointerT<TRasterT<TPixel64>>;
 template class DVAPI TRasterPT<TPixel64>;
 
+template class DVAPI TSmartPointerT<TRasterT<TPixelF>>;
+template class DVAPI TRasterPT<TPixelF>;
+
 template class DVAPI TSmartPointerT<TRasterT<TPixelGR8>>;
 template class DVAPI TRasterPT<TPixelGR8>;
 
@@ -445,6 +449,7 @@ template class DVAPI TRasterPT<TPixelCY>;
 
 typedef TRasterPT<TPixel32> TRaster32P;
 typedef TRasterPT<TPixel64> TRaster64P;
+typedef TRasterPT<TPixelF> TRasterFP;
 typedef TRasterPT<TPixelGR8> TRasterGR8P;
 typedef TRasterPT<TPixelGR16> TRasterGR16P;
 typedef TRasterPT<TPixelGRD> TRasterGRDP;
@@ -8,6 +8,7 @@
 
 // TnzBase includes
 #include "tfx.h"
+#include "tfxhash.h"
 #include "trasterfxrenderdata.h"
 #include <QOffscreenSurface>
 
@@ -113,14 +114,17 @@ public:
                                //! inches. \sa m_stereoscopic. \note Should be
   //! moved to TOutputProperties.
 
-  int m_bpp;  //!< Bits-per-pixel required in the output frame. \remark This
-              //! data
+  int m_bpp;  //!< Bits-per-pixel required in the output frame: 32, 64 or
+              //! 128 for float tiles. \remark This data
   //!  must be accompanied by a tile of the suitable type. \sa
   //!  TRasterFx::compute().
   int m_maxTileSize;  //!< Maximum size (in MegaBytes) of a tile cachable during
                       //! a render process.
   //!  Used by the predictive cache manager to subdivide an fx calculation into
   //!  tiles. \sa TRasterFx::compute().
+  int m_subTileSize;  //!< Edge (in pixels) of the sub-tiles that TRenderer
+                      //! computes
+  //!  in parallel inside each frame. 0 (default) renders frames as a whole.
   int m_shrinkX,  //!< Required horizontal shrink. \warning Obsolete, do not
                   //! use. \todo Must be removed.
       m_shrinkY;  //!< Required vertical shrink. \warning Obsolete, do not use.
@@ -138,6 +142,9 @@ public:
   //!  implement a simplified render during user interactions.
   bool m_userCachable;  //!< Whether the user can manually cache this render
                         //! request. \sa TRasterFx::compute()
+  bool m_cpuVectorRasterizer;  //!< Whether vector levels are rendered on the
+                               //! CPU where possible, instead of OpenGL.
+  //!  Off by default - the output differs slightly. \sa TVectorRasterizer
 
   // Toonz-relevant data (used by Toonz, fx writers should *IGNORE* them while
   // rendering a single fx)
@@ -222,7 +229,8 @@ quality).
 \n\n
   Further methods whose reimplementation depends on the fx itself are
 getAlias(), which must return
-  a string uniquely descripting a rendered object, and getMemoryRequirement() to
+  a string uniquely descripting a rendered object (together with its hashed
+counterpart buildAliasHash()), and getMemoryRequirement() to
 declare the amount of
   memory that will be used by the fx.
 */
@@ -237,6 +245,20 @@ protected:
   virtual void doDryCompute(TRectD &rect, double frame,
                             const TRenderSettings &info);
 
+  //! Builds the alias hash of this fx. The default implementation hashes the
+  //! fx type, the inputs' hashes and the parameter values at \b frame.
+  //! \note Fxs reimplementing getAlias() must reimplement this too, hashing
+  //! the same information. Hashes are memoized per fx and frame, so only the
+  //! fx-specific data in \b info may affect them.
+  virtual TFxHash buildAliasHash(double frame,
+                                 const TRenderSettings &info) const;
+
+  //! Adds the hashes of the fxs connected to the input ports.
+  void addInputsAliasHash(TFxHasher &hasher, double frame,
+                          const TRenderSettings &info) const;
+  //! Adds the name and value at \b frame of each parameter.
+  void addParamsAliasHash(TFxHasher &hasher, double frame) const;
+
 public:
   TRasterFx();
   ~TRasterFx();
@@ -254,6 +276,17 @@ public:
 
   virtual bool isCachable() const { return true; }
 
+  //! Whether doCompute() keeps the empty tiles declared on its output tile
+  //! (see TTile::setEmptyTiles()) valid - either by declaring them itself, or
+  //! by processing only the filled tiles of its input computed in place.
+  //! Otherwise, they are discarded after doCompute().
+  virtual bool handlesSparseTiles() const { return false; }
+
+  //! Whether doCompute() supports float tiles (TRasterFP). Otherwise, float
+  //! tiles are computed as 64-bit ones and converted - so float-aware fxs
+  //! chained together pass their tiles along without conversions.
+  virtual bool canComputeInFloat() const { return false; }
+
   virtual void transform(double frame, int port, const TRectD &rectOnOutput,
                          const TRenderSettings &infoOnOutput,
                          TRectD &rectOnInput, TRenderSettings &infoOnInput);
@@ -273,6 +306,12 @@ public:
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
 
+  //! Returns the structural hash of the subtree rooted at this fx - the
+  //! compact counterpart of getAlias(), used as render cache key. Hashes are
+  //! built bottom-up, and each one is calculated only once per frame in a
+  //! render instance.
+  TFxHash getAliasHash(double frame, const TRenderSettings &info) const;
+
   virtual void dryCompute(TRectD &rect, double frame,
                           const TRenderSettings &info);
 
@@ -325,6 +364,52 @@ template class DVAPI TFxPortT<TRasterFx>;
 #endif
 typedef TFxPortT<TRasterFx> TRasterFxPort;
 
+//******************************************************************************
+//    TRasterFxMemoryEstimator  declaration
+//******************************************************************************
+
+/*!
+  TRasterFxMemoryEstimator turns the dry-computations performed in its thread
+  into an estimate of the peak memory of the corresponding computation.
+
+  While an estimator is alive, TRasterFx::dryCompute() does not talk to the
+  cache managers. Each node instead declares its tile, and its
+  getMemoryRequirement() on top of the tiles of its inputs. Input tiles are
+  assumed to be released once their node has been computed. Caching is
+  ignored - the estimate is an upper bound in this respect.
+
+  Estimators are used by TRenderer to admit frame tasks within a memory
+  budget - see TRenderer::setMaxMemory().
+*/
+
+class DVAPI TRasterFxMemoryEstimator {
+  TINT64 m_allocated, m_peak;  //!< In bytes
+
+public:
+  //! Installs the estimator in the current thread. Estimators do not nest.
+  TRasterFxMemoryEstimator();
+  ~TRasterFxMemoryEstimator();
+
+  //! Returns the estimator installed in the current thread, if any.
+  static TRasterFxMemoryEstimator *current();
+
+  //! Returns the estimated peak memory, in MB rounded up.
+  int getPeak() const { return (int)((m_peak + (1 << 20) - 1) >> 20); }
+
+  //! Declares the tile computed by a node.
+  void addTile(const TRectD &rect, int bpp);
+  //! Declares a temporary allocation, on top of the current ones.
+  void addTemporary(int MB);
+
+  TINT64 getAllocated() const { return m_allocated; }
+  void setAllocated(TINT64 allocated) { m_allocated = allocated; }
+
+private:
+  // not implemented
+  TRasterFxMemoryEstimator(const TRasterFxMemoryEstimator &);
+  TRasterFxMemoryEstimator &operator=(const TRasterFxMemoryEstimator &);
+};
+
 //******************************************************************************
 //    TGeometryFx  declaration
 //******************************************************************************
@@ -342,10 +427,18 @@ public:
   bool doGetBBox(double frame, TRectD &bbox,
                  const TRenderSettings &info) override;
 
+  bool canComputeInFloat() const override { return true; }
+
+  // The input is computed in place, with the placement composed in the render
+  // affine - so its empty tiles are already in the output reference
+  bool handlesSparseTiles() const override { return true; }
+
   virtual bool checkTimeRegion() const { return false; }
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 
   void transform(double frame, int port, const TRectD &rectOnOutput,
                  const TRenderSettings &infoOnOutput, TRectD &rectOnInput,
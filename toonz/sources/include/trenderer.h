@@ -186,6 +186,8 @@ public:
     TRenderSettings m_info;
     TFxPair m_fxRoot;  // The second of pair is used for field interlacing or
                        // stereoscopic render.
+    TRectD m_renderArea;  // When not empty, overrides the ports' render area.
+                          // Only the first RenderData's is considered.
 
     RenderData(double frame, const TRenderSettings &info, const TFxPair &fxRoot)
         : m_frame(frame), m_info(info), m_fxRoot(fxRoot) {}
@@ -217,6 +219,21 @@ public:
 
   void setThreadsCount(int nThreads);
 
+  //! Sets the memory budget, in MB, of the frames rendered at once. When
+  //! positive, each frame task's peak memory is estimated with a dry-run
+  //! before the render starts, and tasks are only started as long as their
+  //! estimates fit the budget - light frames use all the threads, heavy ones
+  //! fewer. A frame exceeding the budget alone is rendered alone. Zero (the
+  //! default) disables the check.
+  void setMaxMemory(int MB);
+  int getMaxMemory() const;
+
+  //! Sets the memory budget, in MB, of the intermediate results retained
+  //! across frames for later reuse - see TPredictiveCacheManager. Zero (the
+  //! default) retains them all until their last use.
+  void setMaxCacheMemory(int MB);
+  int getMaxCacheMemory() const;
+
   static TRenderer instance();
 
   unsigned long rendererId();
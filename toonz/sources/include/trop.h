@@ -20,6 +20,8 @@
 class TPalette;
 typedef TSmartPointerT<TPalette> TPaletteP;
 
+class TSparseRaster;
+
 extern "C" {
 struct _RASTER;
 }
@@ -96,6 +98,11 @@ DVAPI void rgbmScale(TRasterP rout, TRasterP rin, double kr, double kg,
                      double kb, double km, double ar = 0.0, double ag = 0.0,
                      double ab = 0.0, double am = 0.0);
 
+//! Scales the channels of \b ras's filled tiles, in place - empty tiles stay
+//! empty.
+DVAPI void rgbmScale(const TSparseRaster &ras, double kr, double kg, double kb,
+                     double km);
+
 /*! Transforms each input channel interval into the corresponding channel
    interval,
       cropping values if necessary.
@@ -123,6 +130,10 @@ DVAPI void over(const TRasterP &out, const TRasterP &dn, const TRasterP &up);
 //! \b pos
 DVAPI void over(const TRasterP &out, const TRasterP &up,
                 const TPoint &pos = TPoint());
+//! Make the image over of the filled tiles of the \b up raster on the \b out
+//! raster starting from \b pos
+DVAPI void over(const TRasterP &out, const TSparseRaster &up,
+                const TPoint &pos = TPoint());
 //! Make the image over of the \b up raster on the \b out raster
 DVAPI void over(const TRasterP &out, const TRasterP &up, const TAffine &aff,
                 ResampleFilterType filterType = Triangle);
@@ -291,6 +302,12 @@ DVAPI void premultiply(const TRasterP &ras);
 //! Make a depremultiply of all raster pixels
 DVAPI void depremultiply(const TRasterP &ras);
 
+//! Make a premultiply of the pixels of the filled tiles
+DVAPI void premultiply(const TSparseRaster &ras);
+
+//! Make a depremultiply of the pixels of the filled tiles
+DVAPI void depremultiply(const TSparseRaster &ras);
+
 // called from meshtexturizer in order to remove unwanted black contour
 // appears at the border of the plastic-deformed texture.
 // this function will "expand" color channels of the border pixels to
@@ -0,0 +1,102 @@
+#pragma once
+
+#ifndef TSPARSERASTER_H
+#define TSPARSERASTER_H
+
+// TnzCore includes
+#include "traster.h"
+
+// STD includes
+#include <vector>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TRASTER_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//**********************************************************************************
+//    TSparseRaster  declaration
+//**********************************************************************************
+
+/*!
+  \brief    A raster divided in fixed-size tiles, some of which are known to be
+            empty.
+
+  \details  Empty tiles have all their pixels zero - fully transparent, for
+            fullcolor rasters. The pixels are stored in a common dense raster,
+            so the dense counterpart is always at hand with getRaster(); the
+            tiles only tell which parts of it the raster operations supporting
+            sparse rasters (see TRop) can skip.
+
+            Tiles are TileSize pixels wide, starting from the raster origin -
+            the last row and column may be smaller. Tiles are filled unless
+            declared empty: a wrongly filled tile is just processed, while a
+            wrongly empty one would be skipped.
+*/
+
+class DVAPI TSparseRaster {
+public:
+  static const int TileSize = 64;
+
+private:
+  TRasterP m_ras;
+  int m_tileCountX, m_tileCountY;
+  std::vector<bool> m_emptyTiles;
+
+public:
+  TSparseRaster() : m_tileCountX(0), m_tileCountY(0) {}
+
+  //! Builds a sparse raster whose tiles are all filled - or all empty.
+  explicit TSparseRaster(const TRasterP &ras, bool empty = false);
+
+  //! Builds a sparse raster with the specified empty tiles, as returned by
+  //! getEmptyTiles() on a raster of the same size.
+  TSparseRaster(const TRasterP &ras, const std::vector<bool> &emptyTiles);
+
+  //! Builds a sparse raster whose tiles are empty where \b ras is zero.
+  static TSparseRaster fromDense(const TRasterP &ras);
+
+  //! Returns the dense raster.
+  const TRasterP &getRaster() const { return m_ras; }
+
+  int getTileCountX() const { return m_tileCountX; }
+  int getTileCountY() const { return m_tileCountY; }
+
+  //! Returns the tile's pixels, in the raster reference.
+  TRect getTileRect(int x, int y) const;
+
+  bool isTileEmpty(int x, int y) const {
+    return m_emptyTiles[y * m_tileCountX + x];
+  }
+  void setTileEmpty(int x, int y, bool empty) {
+    m_emptyTiles[y * m_tileCountX + x] = empty;
+  }
+
+  int getEmptyTileCount() const;
+  bool hasEmptyTiles() const { return getEmptyTileCount() > 0; }
+  const std::vector<bool> &getEmptyTiles() const { return m_emptyTiles; }
+
+  //! Returns whether all the tiles touched by \b rect are empty.
+  bool isEmpty(const TRect &rect) const;
+
+  //! Marks the tiles touched by \b rect as filled.
+  void setFilled(const TRect &rect);
+
+  //! Marks as empty the tiles whose pixels come entirely from empty tiles of
+  //! \b src, placed at \b pos with respect to this raster. Each pixel is
+  //! considered to come from the pixels of \b src within \b margin from it -
+  //! so that resampled sources can be accounted for, too.
+  void copyEmptyTiles(const TSparseRaster &src, const TPoint &pos,
+                      int margin = 0);
+
+  //! Returns the filled areas as rects, merging the adjacent filled tiles of
+  //! each row of tiles.
+  void getFilledRects(std::vector<TRect> &rects) const;
+};
+
+#endif  // TSPARSERASTER_H
@@ -7,6 +7,9 @@
 
 #include <QThread>
 
+#include <functional>
+#include <memory>
+
 #undef DVAPI
 #undef DVVAR
 #ifdef TNZCORE_EXPORTS
@@ -31,7 +34,8 @@ void DVAPI shutdown();
 //------------------------------------------------------------------------------
 
 // Forward declarations
-class ExecutorId;  // Private
+class ExecutorId;        // Private
+class WorkStealingPool;  // Private
 class Runnable;
 
 }  // namespace TThread
@@ -123,6 +127,7 @@ class DVAPI Runnable : public QObject, public TSmartObject {
   ExecutorId *m_id;
 
   int m_load;
+  int m_memory;
   int m_schedulingPriority;
 
   friend class Executor;     // Needed to confront Executor's and Runnable's ids
@@ -138,6 +143,7 @@ public:
   virtual void run() = 0;
 
   virtual int taskLoad();
+  virtual int taskMemory();
   virtual int schedulingPriority();
   virtual QThread::Priority runningPriority();
 
@@ -205,6 +211,8 @@ both granting
   For example, use setMaxActiveTasks(1) to force the execution of 1 task only at
 a time,
   or setMaxActiveLoad(100) to set a single CPU core available for the group.
+  Similarly, setMaxActiveMemory() bounds the sum of the tasks' declared memory
+  (see Runnable::taskMemory()).
 
   \sa \b Runnable class documentation.
 */
@@ -226,9 +234,11 @@ public:
 
   void setMaxActiveTasks(int count);
   void setMaxActiveLoad(int load);
+  void setMaxActiveMemory(int MB);
 
   int maxActiveTasks() const;
   int maxActiveLoad() const;
+  int maxActiveMemory() const;
 
   void setDedicatedThreads(bool dedicated, bool persistent = true);
 
@@ -238,6 +248,78 @@ private:
   Executor(const Executor &);
 };
 
+//------------------------------------------------------------------------------
+
+/*!
+  TaskGroup collects short-lived subtasks forked from inside some running
+  code, typically the run() of a Runnable or an fx computation, and lets the
+  forking thread wait for all of them.
+
+  Subtasks are not Runnables: they carry no signals, priorities or loads, and
+  are dispatched by a work-stealing pool which is independent from the
+  Executor's task manager. The pool hosts one thread less than the machine
+  cores - each worker keeps its own queue of subtasks, and idle workers steal
+  from the others. Pool workers share the cores with the Executor's threads:
+  they only run while the threads busy with tasks or subtasks are fewer than
+  the cores.
+\n \n
+  The thread calling wait() does not just sleep: it executes the group's
+  pending subtasks itself until the group is complete. Thus the calling thread
+  always counts as one of the cores in use, and groups may be nested at will -
+  subtasks can fork and wait on groups of their own without deadlocking the
+  pool. Subtasks of other groups are never run by a waiting thread, so that
+  locks held by the caller do not leak into unrelated code.
+\n \n
+  If a subtask throws, the first exception is rethrown by wait(); the
+  remaining subtasks are still executed. The destructor waits for pending
+  subtasks, but discards their exceptions.
+
+  \sa \b parallelFor() function.
+*/
+class DVAPI TaskGroup {
+  class Imp;
+  std::unique_ptr<Imp> m_imp;
+
+  friend class WorkStealingPool;
+
+public:
+  TaskGroup();
+  ~TaskGroup();
+
+  //! Submits a subtask to the pool.
+  void run(const std::function<void()> &task);
+
+  //! Helps executing the group's subtasks until all of them are done.
+  void wait();
+
+private:
+  // not implemented
+  TaskGroup &operator=(const TaskGroup &);
+  TaskGroup(const TaskGroup &);
+};
+
+//------------------------------------------------------------------------------
+
+/*!
+  Calls \b func on subranges of the [begin, end) range, in parallel on the
+  work-stealing pool shared with TaskGroup, and returns once the whole range
+  has been processed.
+
+  The range is split in halves recursively until subranges are no longer than
+  \b grain, so that idle workers steal large chunks and busy ones keep small
+  ones. Choose \b grain so that a subrange amounts to some tens of
+  microseconds of work at least.
+
+  The calling thread processes subranges too, so parallelFor() can be safely
+  invoked from Executor tasks and from code already running inside another
+  parallelFor(). Small ranges, and calls made after shutdown(), are processed
+  directly by the calling thread.
+
+  Exceptions thrown by \b func are rethrown to the caller.
+*/
+void DVAPI parallelFor(int begin, int end, int grain,
+                       const std::function<void(int, int)> &func);
+
 }  // namespace TThread
 
 #endif  // TTHREAD_H
@@ -7,6 +7,7 @@
 #include "trasterimage.h"
 #include "ttoonzimage.h"
 #include "timagecache.h"
+#include "tsparseraster.h"
 #undef DVAPI
 #undef DVVAR
 #ifdef TRASTER_EXPORTS
@@ -21,6 +22,7 @@ class DVAPI TTile {
 private:
   std::string m_rasterId;
   TRect m_subRect;
+  std::vector<bool> m_emptyTiles;
   TTile(const TTile &);
   TTile &operator=(const TTile &);
   void addInCache(const TRasterP &raster);
@@ -34,6 +36,22 @@ public:
   ~TTile();
 
   void setRaster(const TRasterP &raster);
+
+  //! Returns the raster, with the tiles which the fx computing it declared
+  //! empty (see TRasterFx::handlesSparseTiles()).
+  TSparseRaster getSparseRaster() const {
+    return m_emptyTiles.empty() ? TSparseRaster(getRaster())
+                                : TSparseRaster(getRaster(), m_emptyTiles);
+  }
+
+  //! Declares the empty tiles of the raster, which must be  ras's.
+  void setEmptyTiles(const TSparseRaster &ras) {
+    m_emptyTiles.clear();
+    if (ras.hasEmptyTiles()) m_emptyTiles = ras.getEmptyTiles();
+  }
+  void clearEmptyTiles() { m_emptyTiles.clear(); }
+  bool hasEmptyTiles() const { return !m_emptyTiles.empty(); }
+
   inline const TRasterP getRaster() const {
     TImageP img        = TImageCache::instance()->get(m_rasterId, true);
     TRasterImageP rimg = (TRasterImageP)img;
@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef TVECTORRASTERIZER_H
+#define TVECTORRASTERIZER_H
+
+// TnzCore includes
+#include "tgeometry.h"
+#include "tpixel.h"
+#include "traster.h"
+
+// STD includes
+#include <vector>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TVRENDER_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//========================================================================
+
+//    Forward declarations
+
+class TVectorImage;
+class TVectorRenderData;
+class TStroke;
+class TRegion;
+class TColorStyle;
+
+//========================================================================
+
+//**********************************************************************************
+//    TVectorRasterizer  declaration
+//**********************************************************************************
+
+/*!
+  \brief    Renders vector images on the CPU, without any OpenGL context.
+
+  \details  The rasterizer approximates what tglDraw() renders for images
+            whose visible styles are all plain TSolidColorStyle: regions are
+            filled with the positive winding rule, strokes along their
+            outline, and both are antialiased by exact area coverage. Images
+            using other styles (textures, patterns, custom styles),
+            centerline strokes or the check modes of TVectorRenderData are not
+            supported - see isSupported().
+
+            The output is not pixel-identical to OpenGL's. OpenGL also draws
+            smoothed lines along the stroke outlines (drawAntialiasedOutline()),
+            which widen the strokes' antialiased edges by about half a pixel:
+            edge pixels may differ by up to half their coverage, and strokes
+            thinner than a couple of pixels come out lighter here. Interior
+            pixels match. For this reason renders use the rasterizer only on
+            request, see TRenderSettings::m_cpuVectorRasterizer.
+
+            The image geometry and the style colors are extracted at
+            construction, under the image mutex. rasterize() accesses neither
+            the image nor its palette, so any number of threads may rasterize
+            concurrently.
+*/
+
+class DVAPI TVectorRasterizer {
+  //! A filled, single-colored area, in raster coordinates
+  struct Shape {
+    TPixel32 m_color;                //!< Color, with the color function applied
+    std::vector<TPointD> m_points;   //!< Vertices of all the contours
+    std::vector<int> m_contourEnds;  //!< End of each contour in m_points
+    TRect m_bbox;                    //!< Pixels touched by the contours
+    bool m_antialias;
+  };
+
+  std::vector<Shape> m_shapes;
+  TRect m_clippingRect;
+  bool m_supported;
+
+public:
+  TVectorRasterizer(const TVectorImage *vi, const TVectorRenderData &rd);
+
+  //! Returns whether the image can be rendered by the rasterizer. Callers
+  //! should fall back to OpenGL rendering otherwise.
+  bool isSupported() const { return m_supported; }
+
+  //! Draws the image over the specified 32 or 64-bit raster, as the OpenGL
+  //! renderer would with the alpha channel enabled (premultiplied over).
+  void rasterize(const TRasterP &ras) const;
+
+  //! Returns the boxes of the pixels rasterize() may draw, one per shape.
+  void getBBoxes(std::vector<TRect> &bboxes) const;
+
+private:
+  void addRegion(const TRegion *region, const TVectorRenderData &rd,
+                 double pixelSize);
+  void addStroke(const TStroke *stroke, const TVectorRenderData &rd);
+
+  bool getColor(const TColorStyle *style, const TVectorRenderData &rd,
+                TPixel32 &color);
+  void closeShape(Shape &shape);
+};
+
+#endif  // TVECTORRASTERIZER_H
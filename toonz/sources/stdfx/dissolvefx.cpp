@@ -39,6 +39,12 @@ public:
   bool canHandle(const TRenderSettings &info, double frame) override {
     return true;
   }
+
+  // The pattern restarts with each computed tile - tiles must not be split
+  int getMemoryRequirement(const TRectD &rect, double frame,
+                           const TRenderSettings &info) override {
+    return -1;
+  }
 };
 
 template <typename PIXEL>
@@ -40,6 +40,8 @@ public:
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 
   void doDryCompute(TRectD &rect, double frame,
                     const TRenderSettings &info) override;
@@ -104,6 +106,22 @@ std::string ExternalPaletteFx::getAlias(double frame,
 
 //-------------------------------------------------------------------
 
+TFxHash ExternalPaletteFx::buildAliasHash(double frame,
+                                          const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(TRasterFx::buildAliasHash(frame, info));
+
+  if (m_expalette.isConnected()) {
+    TFx *fx = m_expalette.getFx();
+    TPaletteP plt(getPalette(fx, frame));
+    if (plt && plt->isAnimated()) hasher.addReal(frame, 6);
+  }
+
+  return hasher.result();
+}
+
+//-------------------------------------------------------------------
+
 void ExternalPaletteFx::doDryCompute(TRectD &rect, double frame,
                                      const TRenderSettings &ri) {
   if (!m_input.isConnected()) return;
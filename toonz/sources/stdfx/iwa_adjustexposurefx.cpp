@@ -59,6 +59,24 @@ void Iwa_AdjustExposureFx::setOutputRaster(float4 *srcMem, const RASTER dstRas,
   }
 }
 
+/*------------------------------------------------------------
+ floatのタイルには量子化せずに格納
+------------------------------------------------------------*/
+template <>
+void Iwa_AdjustExposureFx::setOutputRaster<TRasterFP, TPixelF>(
+    float4 *srcMem, const TRasterFP dstRas, TDimensionI dim) {
+  float4 *chan_p = srcMem;
+  for (int j = 0; j < dim.ly; j++) {
+    TPixelF *pix = dstRas->pixels(j);
+    for (int i = 0; i < dim.lx; i++, pix++, chan_p++) {
+      pix->r = (*chan_p).x;
+      pix->g = (*chan_p).y;
+      pix->b = (*chan_p).z;
+      pix->m = (*chan_p).w;
+    }
+  }
+}
+
 //------------------------------------------------
 
 Iwa_AdjustExposureFx::Iwa_AdjustExposureFx()
@@ -95,10 +113,13 @@ void Iwa_AdjustExposureFx::doCompute(TTile &tile, double frame,
 
   TRaster32P ras32 = tile.getRaster();
   TRaster64P ras64 = tile.getRaster();
+  TRasterFP rasF   = tile.getRaster();
   if (ras32)
     setSourceRaster<TRaster32P, TPixel32>(ras32, tile_host, dim);
   else if (ras64)
     setSourceRaster<TRaster64P, TPixel64>(ras64, tile_host, dim);
+  else if (rasF)
+    setSourceRaster<TRasterFP, TPixelF>(rasF, tile_host, dim);
 
   doCompute_CPU(tile, frame, settings, dim, tile_host);
 
@@ -108,6 +129,8 @@ void Iwa_AdjustExposureFx::doCompute(TTile &tile, double frame,
     setOutputRaster<TRaster32P, TPixel32>(tile_host, ras32, dim);
   else if (ras64)
     setOutputRaster<TRaster64P, TPixel64>(tile_host, ras64, dim);
+  else if (rasF)
+    setOutputRaster<TRasterFP, TPixelF>(tile_host, rasF, dim);
 
   tile_host_ras->unlock();
 }
@@ -44,6 +44,7 @@ public:
                  const TRenderSettings &info) override;
 
   bool canHandle(const TRenderSettings &info, double frame) override;
+  bool canComputeInFloat() const override { return true; }
 };
 
 #endif
\ No newline at end of file
@@ -242,6 +242,53 @@ void MyThread::compositLayerToTile(const RASTER layerRas,
   }
 }
 
+//------------------------------------------------------------
+// Float tiles keep the values above 1. Their alpha is computed in 16 bits.
+//------------------------------------------------------------
+template <>
+void MyThread::compositLayerToTile<TRasterFP, TPixelF, TRasterGR16P,
+                                   TPixelGR16>(const TRasterFP layerRas,
+                                               const TRasterFP outTileRas,
+                                               const TRasterGR16P alphaRas,
+                                               TDimensionI dim, int2 margin) {
+  int j = margin.y;
+  for (int out_j = 0; out_j < outTileRas->getLy(); j++, out_j++) {
+    TPixelF* outPix      = outTileRas->pixels(out_j);
+    TPixelGR16* alphaPix = alphaRas->pixels(j) + margin.x;
+
+    int i = margin.x;
+    for (int out_i = 0; out_i < outTileRas->getLx();
+         i++, out_i++, alphaPix++, outPix++) {
+      // If the layer pixel is transparent, keep the result pizel as-is.
+      float alpha =
+          (float)alphaPix->value / (float)TPixelGR16::maxChannelValue;
+      if (alpha == 0.0f) continue;
+
+      float& dnVal = (m_channel == Red)
+                         ? outPix->r
+                         : (m_channel == Green) ? outPix->g : outPix->b;
+
+      float exposure = m_kissfft_comp_in[getCoord(i, j, dim.lx, dim.ly)].r /
+                       (dim.lx * dim.ly);
+      float val;
+      if (alpha == 1.0f || dnVal == 0.0f)
+        val = exposureToValue(exposure);
+      else {
+        val = exposureToValue(exposure + valueToExposure(dnVal) * (1 - alpha));
+        // not used for now
+        if (m_doLightenComp) val = std::max(val, dnVal);
+      }
+
+      // clamp the negative (or undefined) values only
+      dnVal = (val > 0.0f) ? val : 0.0f;
+
+      //"over" composite the alpha channel here
+      if (m_channel == Red && outPix->m < 1.0f)
+        outPix->m = alpha + outPix->m * (1.0f - alpha);
+    }
+  }
+}
+
 //------------------------------------------------------------
 
 void MyThread::run() {
@@ -259,6 +306,7 @@ void MyThread::run() {
 
   TRaster32P ras32 = (TRaster32P)m_layerTileRas;
   TRaster64P ras64 = (TRaster64P)m_layerTileRas;
+  TRasterFP rasF   = (TRasterFP)m_layerTileRas;
   // Prepare data for FFT.
   // Convert the RGB values to the exposure, then multiply it by the alpha
   // channel value
@@ -268,6 +316,8 @@ void MyThread::run() {
       setLayerRaster<TRaster32P, TPixel32>(ras32, m_kissfft_comp_in, dim);
     else if (ras64)
       setLayerRaster<TRaster64P, TPixel64>(ras64, m_kissfft_comp_in, dim);
+    else if (rasF)
+      setLayerRaster<TRasterFP, TPixelF>(rasF, m_kissfft_comp_in, dim);
     else {
       lock.unlock();
       return;
@@ -317,6 +367,7 @@ void MyThread::run() {
 
     TRaster32P ras32 = (TRaster32P)m_layerTileRas;
     TRaster64P ras64 = (TRaster64P)m_layerTileRas;
+    TRasterFP rasF   = (TRasterFP)m_layerTileRas;
 
     if (ras32) {
       compositLayerToTile<TRaster32P, TPixel32, TRasterGR8P, TPixelGR8>(
@@ -326,6 +377,10 @@ void MyThread::run() {
       compositLayerToTile<TRaster64P, TPixel64, TRasterGR16P, TPixelGR16>(
           ras64, (TRaster64P)m_outTileRas, (TRasterGR16P)m_tmpAlphaRas, dim,
           margin);
+    } else if (rasF) {
+      compositLayerToTile<TRasterFP, TPixelF, TRasterGR16P, TPixelGR16>(
+          rasF, (TRasterFP)m_outTileRas, (TRasterGR16P)m_tmpAlphaRas, dim,
+          margin);
     } else {
       lock.unlock();
       return;
@@ -605,9 +660,10 @@ void Iwa_BokehFx::doCompute(TTile& tile, double frame,
     {
       TRaster32P ras32(tile.getRaster());
       TRaster64P ras64(tile.getRaster());
+      TRasterFP rasF(tile.getRaster());
       if (ras32)
         tmpAlphaRas = TRasterGR8P(dimOut);
-      else if (ras64)
+      else if (ras64 || rasF)
         tmpAlphaRas = TRasterGR16P(dimOut);
     }
     tmpAlphaRas->lock();
@@ -951,6 +1007,7 @@ void Iwa_BokehFx::calcAlfaChannelBokeh(kiss_fft_cpx* kissfft_comp_iris,
 
   TRaster32P ras32 = (TRaster32P)layerTile.getRaster();
   TRaster64P ras64 = (TRaster64P)layerTile.getRaster();
+  TRasterFP rasF   = (TRasterFP)layerTile.getRaster();
   if (ras32) {
     for (int j = 0; j < ly; j++) {
       TPixel32* pix = ras32->pixels(j);
@@ -967,6 +1024,14 @@ void Iwa_BokehFx::calcAlfaChannelBokeh(kiss_fft_cpx* kissfft_comp_iris,
         pix++;
       }
     }
+  } else if (rasF) {
+    for (int j = 0; j < ly; j++) {
+      TPixelF* pix = rasF->pixels(j);
+      for (int i = 0; i < lx; i++) {
+        kissfft_comp_in[j * lx + i].r = pix->m;
+        pix++;
+      }
+    }
   } else
     return;
 
@@ -1014,7 +1079,7 @@ void Iwa_BokehFx::calcAlfaChannelBokeh(kiss_fft_cpx* kissfft_comp_iris,
         pix++;
       }
     }
-  } else if (ras64) {
+  } else if (ras64 || rasF) {
     TRasterGR16P alphaRas16(tmpAlphaRas);
     for (int j = 0; j < ly; j++) {
       TPixelGR16* pix = alphaRas16->pixels(j);
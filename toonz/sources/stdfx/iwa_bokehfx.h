@@ -144,6 +144,7 @@ public:
   bool doGetBBox(double frame, TRectD &bBox, const TRenderSettings &info);
 
   bool canHandle(const TRenderSettings &info, double frame);
+  bool canComputeInFloat() const override { return true; }
 };
 
 #endif
\ No newline at end of file
@@ -91,6 +91,35 @@ double Iwa_GlareFx::getSizePixelAmount(const double val, const TAffine affine) {
   /*--- return the length of the vector ---*/
   return sqrt(vect.x * vect.x + vect.y * vect.y);
 }
+//--------------------------------------------------------------
+// Float tiles keep the values above 1. Specialized before its use in
+// doCompute()
+template <>
+void Iwa_GlareFx::setChannelToResult<TRasterFP, TPixelF>(
+    const TRasterFP ras, kiss_fft_cpx* buf, int channel,
+    const TDimensionI& dimOut) {
+  int margin_x = (dimOut.lx - ras->getSize().lx) / 2;
+  int margin_y = (dimOut.ly - ras->getSize().ly) / 2;
+
+  for (int j = 0; j < ras->getLy(); j++) {
+    TPixelF* pix = ras->pixels(j);
+    for (int i = 0; i < ras->getLx(); i++, pix++) {
+      kiss_fft_cpx fft_val =
+          buf[getCoord(i + margin_x, j + margin_y, dimOut.lx, dimOut.ly)];
+      double val = fft_val.r / (dimOut.lx * dimOut.ly);
+      if (val < 0.0) val = 0.0;
+      if (channel == 0)
+        pix->r = (float)val;
+      else if (channel == 1)
+        pix->g = (float)val;
+      else if (channel == 2) {
+        pix->b = (float)val;
+        pix->m = TPixelF::maxChannelValue;
+      }
+    }
+  }
+}
+
 //--------------------------------------------------------------
 
 void Iwa_GlareFx::doCompute(TTile& tile, double frame,
@@ -173,10 +202,13 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
   tile.getRaster()->clear();
   TRaster32P ras32 = tile.getRaster();
   TRaster64P ras64 = tile.getRaster();
+  TRasterFP rasF   = tile.getRaster();
   if (ras32)
     ras32->fill(TPixel32::Transparent);
   else if (ras64)
     ras64->fill(TPixel64::Transparent);
+  else if (rasF)
+    rasF->fill(TPixelF::Transparent);
 
   // filter preview mode
   if (renderMode == RendeMode_FilterPreview) {
@@ -189,6 +221,9 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
     else if (ras64)
       setFilterPreviewToResult<TRaster64P, TPixel64>(ras64, glare_pattern,
                                                      dimIris, margin);
+    else if (rasF)
+      setFilterPreviewToResult<TRasterFP, TPixelF>(rasF, glare_pattern,
+                                                   dimIris, margin);
 
     return;
   }
@@ -254,6 +289,9 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
     else if (ras64)
       setSourceTileToBuffer<TRaster64P, TPixel64>(sourceTile.getRaster(),
                                                   kissfft_comp_tmp);
+    else if (rasF)
+      setSourceTileToBuffer<TRasterFP, TPixelF>(sourceTile.getRaster(),
+                                                kissfft_comp_tmp);
   }
   // FFT the source
   kiss_fftnd(plan_fwd, kissfft_comp_tmp, kissfft_comp_source);
@@ -283,6 +321,9 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
     else if (ras64)
       setChannelToResult<TRaster64P, TPixel64>(ras64, kissfft_comp_tmp, ch,
                                                dimOut);
+    else if (rasF)
+      setChannelToResult<TRasterFP, TPixelF>(rasF, kissfft_comp_tmp, ch,
+                                             dimOut);
   }
 
   kiss_fft_free(plan_fwd);
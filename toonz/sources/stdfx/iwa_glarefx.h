@@ -94,6 +94,7 @@ public:
   bool doGetBBox(double frame, TRectD &bBox, const TRenderSettings &info);
 
   bool canHandle(const TRenderSettings &info, double frame);
+  bool canComputeInFloat() const override { return true; }
 
   void getParamUIs(TParamUIConcept *&concepts, int &length) override;
 };
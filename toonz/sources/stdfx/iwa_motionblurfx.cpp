@@ -951,4 +951,19 @@ std::string Iwa_MotionBlurCompFx::getAlias(double frame,
          "]";
 }
 
+//------------------------------------------------------------------
+
+TFxHash Iwa_MotionBlurCompFx::buildAliasHash(double frame,
+                                             const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  hasher.addReal(frame, 6).add(getIdentifier());
+  addParamsAliasHash(hasher, frame);
+
+  return hasher.result();
+}
+
 FX_PLUGIN_IDENTIFIER(Iwa_MotionBlurCompFx, "iwa_MotionBlurCompFx")
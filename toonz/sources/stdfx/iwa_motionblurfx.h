@@ -133,6 +133,8 @@ public:
           エイリアスは毎フレーム変える -*/
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 };
 
 #endif
\ No newline at end of file
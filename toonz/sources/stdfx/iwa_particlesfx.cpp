@@ -391,6 +391,21 @@ std::string Iwa_TiledParticlesFx::getAlias(double frame,
 
 //------------------------------------------------------------------
 
+TFxHash Iwa_TiledParticlesFx::buildAliasHash(double frame,
+                                             const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  hasher.addReal(frame, 6).add(getIdentifier());
+  addParamsAliasHash(hasher, frame);
+
+  return hasher.result();
+}
+
+//------------------------------------------------------------------
+
 bool Iwa_TiledParticlesFx::allowUserCacheOnPort(int portNum) {
   // Only control port are currently allowed to cache upon explicit user's
   // request
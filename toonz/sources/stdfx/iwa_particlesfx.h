@@ -153,6 +153,8 @@ public:
 
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
   bool doGetBBox(double frame, TRectD &bBox,
                  const TRenderSettings &info) override;
   TFxTimeRegion getTimeRegion() const override {
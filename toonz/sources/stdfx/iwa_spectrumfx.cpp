@@ -10,6 +10,21 @@ Iwa_SpectrumFx
 
 namespace {
 const float PI = 3.14159265f;
+
+/*- チャンネル範囲にクランプ -*/
+template <typename PIXEL>
+inline typename PIXEL::Channel valueToChannel(float value) {
+  float val = value * (float)PIXEL::maxChannelValue + 0.5f;
+  return (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
+                                       ? (float)PIXEL::maxChannelValue
+                                       : val);
+}
+
+/*- floatのタイルには量子化せずに格納 -*/
+template <>
+inline float valueToChannel<TPixelF>(float value) {
+  return value;
+}
 }
 
 /*------------------------------------
@@ -273,6 +288,7 @@ void Iwa_SpectrumFx::doCompute(TTile &tile, double frame,
 
   TRaster32P ras32 = (TRaster32P)tile.getRaster();
   TRaster64P ras64 = (TRaster64P)tile.getRaster();
+  TRasterFP rasF   = (TRasterFP)tile.getRaster();
   {
     if (ras32) {
       if (lightRas)
@@ -290,6 +306,14 @@ void Iwa_SpectrumFx::doCompute(TTile &tile, double frame,
             (float)m_lightIntensity->getValue(frame));
       else
         convertRaster<TRaster64P, TPixel64>(ras64, dim, bubbleColor);
+    } else if (rasF) {
+      if (lightRas)
+        convertRasterWithLight<TRasterFP, TPixelF>(
+            rasF, dim, bubbleColor, (TRasterFP)lightRas,
+            (float)m_lightThres->getValue(frame),
+            (float)m_lightIntensity->getValue(frame));
+      else
+        convertRaster<TRasterFP, TPixelF>(rasF, dim, bubbleColor);
     }
   }
 
@@ -323,6 +347,8 @@ void Iwa_SpectrumFx::convertRaster(const RASTER ras, TDimensionI dim,
 
       /*- 反転 -*/
       brightness = 1.0f - brightness;
+      /*- Float sources may be brighter than white -*/
+      if (brightness < 0.0f) brightness = 0.0f;
       /*- 輝度MAXの場合 -*/
       if (brightness >= 1.0f) {
         spec_r = bubbleColor[255].x * aa;
@@ -344,20 +370,9 @@ void Iwa_SpectrumFx::convertRaster(const RASTER ras, TDimensionI dim,
         spec_b *= aa;
       }
       /*- 元のピクセルに書き戻す -*/
-      float val;
-      /*- チャンネル範囲にクランプ -*/
-      val    = spec_r * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->r = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = spec_g * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->g = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = spec_b * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->b = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
+      pix->r = valueToChannel<PIXEL>(spec_r);
+      pix->g = valueToChannel<PIXEL>(spec_g);
+      pix->b = valueToChannel<PIXEL>(spec_b);
 
       pix++;
     }
@@ -394,6 +409,8 @@ void Iwa_SpectrumFx::convertRasterWithLight(const RASTER ras, TDimensionI dim,
 
       /*- 反転 -*/
       brightness = 1.0f - brightness;
+      /*- Float sources may be brighter than white -*/
+      if (brightness < 0.0f) brightness = 0.0f;
       /*- 輝度MAXの場合 -*/
       if (brightness >= 1.0f) {
         spec_r = bubbleColor[255].x;
@@ -435,20 +452,9 @@ void Iwa_SpectrumFx::convertRasterWithLight(const RASTER ras, TDimensionI dim,
       spec_b *= aa;
 
       /*- 元のピクセルに書き戻す -*/
-      float val;
-      /*- チャンネル範囲にクランプ -*/
-      val    = spec_r * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->r = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = spec_g * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->g = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = spec_b * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->b = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
+      pix->r = valueToChannel<PIXEL>(spec_r);
+      pix->g = valueToChannel<PIXEL>(spec_g);
+      pix->b = valueToChannel<PIXEL>(spec_b);
 
       pix->m = light_pix->m;
 
@@ -503,23 +509,10 @@ void Iwa_SpectrumFx::outputRasters(const RASTER outRas,
   for (int j = 0; j < dim.ly; j++) {
     PIXEL *pix = outRas->pixels(j);
     for (int i = 0; i < dim.lx; i++) {
-      float val;
-      val    = (*chann_p).x * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->r = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = (*chann_p).y * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->g = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = (*chann_p).z * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->b = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
-      val    = (*chann_p).w * (float)PIXEL::maxChannelValue + 0.5f;
-      pix->m = (typename PIXEL::Channel)((val > (float)PIXEL::maxChannelValue)
-                                             ? (float)PIXEL::maxChannelValue
-                                             : val);
+      pix->r = valueToChannel<PIXEL>((*chann_p).x);
+      pix->g = valueToChannel<PIXEL>((*chann_p).y);
+      pix->b = valueToChannel<PIXEL>((*chann_p).z);
+      pix->m = valueToChannel<PIXEL>((*chann_p).w);
       pix++;
       chann_p++;
     }
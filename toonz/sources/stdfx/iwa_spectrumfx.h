@@ -77,6 +77,7 @@ public:
                  const TRenderSettings &info) override;
 
   bool canHandle(const TRenderSettings &info, double frame) override;
+  bool canComputeInFloat() const override { return true; }
 };
 
 #endif
@@ -219,6 +219,22 @@ std::string Iwa_TextFx::getAlias(double frame,
 
 //------------------------------------------------------------------
 
+TFxHash Iwa_TextFx::buildAliasHash(double frame,
+                                   const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  // Texts from the nearby column change at every frame
+  if (m_targetType->getValue() != INPUT_TEXT) hasher.addReal(frame, 6);
+
+  hasher.add(getIdentifier());
+  addParamsAliasHash(hasher, frame);
+
+  return hasher.result();
+}
+
+//------------------------------------------------------------------
+
 template <typename RASTER, typename PIXEL>
 void Iwa_TextFx::putTextImage(const RASTER srcRas, TPoint &pos, QImage &img) {
   for (int j = 0; j < img.height(); j++) {
@@ -119,6 +119,19 @@ std::string Iwa_TimeCodeFx::getAlias(double frame,
 
 //------------------------------------------------------------------
 
+TFxHash Iwa_TimeCodeFx::buildAliasHash(double frame,
+                                       const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  hasher.addReal(frame, 6).add(getIdentifier());
+  addParamsAliasHash(hasher, frame);
+
+  return hasher.result();
+}
+
+//------------------------------------------------------------------
+
 QString Iwa_TimeCodeFx::getTimeCodeStr(double frame,
                                        const TRenderSettings &ri) {
   int f = (int)frame + m_startFrame->getValue();
@@ -467,6 +467,19 @@ public:
     return alias + std::to_string(id) + "," + std::to_string(frame) + "," +
            std::to_string(value) + "]";
   }
+
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override {
+    TFxHasher hasher;
+    hasher.add(getFxType());
+
+    addInputsAliasHash(hasher, frame, info);
+
+    return hasher.add(getIdentifier())
+        .addReal(frame, 6)
+        .addReal(m_intensity->getValue(frame), 6)
+        .result();
+  }
 };
 
 //-------------------------------------------------------------------
@@ -328,6 +328,21 @@ std::string ParticlesFx::getAlias(double frame,
 
 //------------------------------------------------------------------
 
+TFxHash ParticlesFx::buildAliasHash(double frame,
+                                    const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  hasher.addReal(frame, 6).add(getIdentifier());
+  addParamsAliasHash(hasher, frame);
+
+  return hasher.result();
+}
+
+//------------------------------------------------------------------
+
 bool ParticlesFx::allowUserCacheOnPort(int portNum) {
   // Only control port are currently allowed to cache upon explicit user's
   // request
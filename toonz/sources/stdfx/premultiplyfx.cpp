@@ -27,6 +27,8 @@ public:
   bool canHandle(const TRenderSettings &info, double frame) override {
     return true;
   }
+  bool handlesSparseTiles() const override { return true; }
+  bool canComputeInFloat() const override { return true; }
 };
 
 //------------------------------------------------------------------------------
@@ -37,7 +39,8 @@ void PremultiplyFx::doCompute(TTile &tile, double frame,
 
   m_input->compute(tile, frame, ri);
 
-  TRop::premultiply(tile.getRaster());
+  // Empty tiles stay empty
+  TRop::premultiply(tile.getSparseRaster());
 }
 
 FX_PLUGIN_IDENTIFIER(PremultiplyFx, "premultiplyFx");
@@ -43,6 +43,7 @@ public:
   bool canHandle(const TRenderSettings &info, double frame) override {
     return true;
   }
+  bool handlesSparseTiles() const override { return true; }
 };
 
 //------------------------------------------------------------------------------
@@ -60,7 +61,8 @@ void RGBMScaleFx::doCompute(TTile &tile, double frame,
   // TRaster32P raster32 = tile.getRaster();
   // assert(raster32); // per ora gestisco solo i Raster32
 
-  TRop::rgbmScale(tile.getRaster(), tile.getRaster(), red, green, blue, matte);
+  // Empty tiles stay empty
+  TRop::rgbmScale(tile.getSparseRaster(), red, green, blue, matte);
 }
 
 FX_PLUGIN_IDENTIFIER(RGBMScaleFx, "rgbmScaleFx");
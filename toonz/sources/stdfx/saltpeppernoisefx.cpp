@@ -39,10 +39,18 @@ public:
   void doCompute(TTile &tile, double frame, const TRenderSettings &ri) override;
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override;
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override;
 
   bool canHandle(const TRenderSettings &info, double frame) override {
     return true;
   }
+
+  // The noise restarts with each computed tile - tiles must not be split
+  int getMemoryRequirement(const TRectD &rect, double frame,
+                           const TRenderSettings &info) override {
+    return -1;
+  }
 };
 
 template <typename PIXEL>
@@ -130,4 +138,17 @@ std::string SaltPepperNoiseFx::getAlias(double frame,
   return alias;
 }
 
+//------------------------------------------------------------------
+
+TFxHash SaltPepperNoiseFx::buildAliasHash(double frame,
+                                          const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(TRasterFx::buildAliasHash(frame, info));
+
+  // Animated noise changes at every frame
+  if (m_Animate->getValue()) hasher.addReal(frame, 6);
+
+  return hasher.result();
+}
+
 FX_PLUGIN_IDENTIFIER(SaltPepperNoiseFx, "saltpepperNoiseFx");
@@ -29,6 +29,7 @@
 #include "toonz/multimediarenderer.h"
 #include "toutputproperties.h"
 #include "toonz/imagestyles.h"
+#include "toonz/rasterpyramid.h"
 #include "tproperty.h"
 
 // TnzSound includes
@@ -36,6 +37,7 @@
 
 // TnzImage includes
 #include "timage_io.h"
+#include "tlevel_io.h"
 #include "tnzimage.h"
 
 #ifdef _WIN32
@@ -47,6 +49,8 @@
 #include "tunit.h"
 #include "tenv.h"
 #include "tpassivecachemanager.h"
+#include "tpredictivecachemanager.h"
+#include "tfxdiskcache.h"
 //#include "tcacheresourcepool.h"
 
 // TnzCore includes
@@ -399,7 +403,8 @@ bool MyMultimediaRenderListener::onFrameFailed(int frame, int column,
 
 static std::pair<int, int> generateMovie(ToonzScene *scene, const TFilePath &fp,
                                          int r0, int r1, int step, int shrink,
-                                         int threadCount, int maxTileSize) {
+                                         int threadCount, int maxTileSize,
+                                         int maxMemory, int maxCacheMemory) {
   QWaitCondition renderCompleted;
 
   // riporto gli indici a base zero
@@ -467,6 +472,8 @@ static std::pair<int, int> generateMovie(ToonzScene *scene, const TFilePath &fp,
     multimediaRenderer.setRenderSettings(rs);
     multimediaRenderer.setDpi(cameraXDpi, cameraYDpi);
     multimediaRenderer.enablePrecomputing(true);
+    multimediaRenderer.setMaxMemory(maxMemory);
+    multimediaRenderer.setMaxCacheMemory(maxCacheMemory);
     for (int i = 0; i < numFrames; i += step, r += stepd)
       multimediaRenderer.addFrame(r);
 
@@ -506,6 +513,8 @@ static std::pair<int, int> generateMovie(ToonzScene *scene, const TFilePath &fp,
     movieRenderer.setDpi(cameraXDpi, cameraYDpi);
 
     movieRenderer.enablePrecomputing(true);
+    movieRenderer.setMaxMemory(maxMemory);
+    movieRenderer.setMaxCacheMemory(maxCacheMemory);
 
     MyMovieRenderListener *listener =
         new MyMovieRenderListener(fp, tceil((numFrames) / (float)step),
@@ -542,6 +551,20 @@ static std::pair<int, int> generateMovie(ToonzScene *scene, const TFilePath &fp,
 
     //----------------- tcomposer's main thread loops here ----------------
 
+    std::string writerStats = movieRenderer.getWriterStatisticsString();
+    if (!writerStats.empty()) {
+      cout << writerStats << endl;
+      m_userLog->info(writerStats);
+    }
+
+    int heldFrames = movieRenderer.getHeldFrameCount();
+    if (heldFrames > 0) {
+      std::string msg =
+          std::to_string(heldFrames) + " held frame(s) reused, not rendered";
+      cout << msg << endl;
+      m_userLog->info(msg);
+    }
+
     // int frameCompleted = listener->m_frameCompletedCount;
     std::pair<int, int> framePair =
         std::make_pair(listener->m_frameCompletedCount, listener->m_frameCount);
@@ -580,9 +603,22 @@ int main(int argc, char *argv[]) {
   StringQualifier nthreads("-nthreads n", "Number of rendering threads");
   StringQualifier tileSize("-maxtilesize n",
                            "Enable tile rendering of max n MB per tile");
+  IntQualifier fxCache("-fxcache n",
+                       "Enable the persistent fx render cache of max n MB");
+  IntQualifier pyramidCache("-pyramidcache n",
+                            "Enable the raster pyramid cache of max n MB");
+  IntQualifier maxMemory("-maxmemory n",
+                         "Limit the frames rendered at once to n MB");
+  IntQualifier cacheMemory("-cachememory n",
+                           "Limit the results reused across frames to n MB");
+  IntQualifier imageCache("-imagecache n",
+                          "Compress cached images in background above n MB");
+  IntQualifier rasterPool("-rasterpool n",
+                          "Recycle raster buffers, keeping up to n MB idle");
   StringQualifier tmsg("-tmsg val", "only internal use");
   usageLine = srcName + dstName + range + stepOpt + shrinkOpt + multimedia +
-              farmData + idq + nthreads + tileSize + tmsg;
+              farmData + idq + nthreads + tileSize + fxCache + pyramidCache +
+              maxMemory + cacheMemory + imageCache + rasterPool + tmsg;
 
   // system path qualifiers
   std::map<QString, std::unique_ptr<TCli::QualifierT<TFilePath>>>
@@ -759,6 +795,10 @@ int main(int argc, char *argv[]) {
     initImageIo();
     Tiio::defineStd();
     initSoundIo();
+
+    // Levels are never rewritten while rendering: let the render threads
+    // decode tlv frames concurrently from the mapped files
+    TLevelReader::setMappedReadingForTzl(true);
     initStdFx();
     initColorFx();
 
@@ -939,6 +979,84 @@ int main(int argc, char *argv[]) {
     if (maxTileSize != (std::numeric_limits<int>::max)())
       m_userLog->info("Render tile: " + std::to_string(maxTileSize));
 
+    // Memory budget of the frames rendered at once
+    int renderMemory = 0;
+    if (maxMemory.isSelected()) {
+      renderMemory = maxMemory.getValue();
+      if (renderMemory <= 0) {
+        cout << "Qualifier 'maxmemory': bad input" << endl;
+        exit(1);
+      }
+
+      m_userLog->info("Render memory: " + std::to_string(renderMemory) +
+                      " MB");
+    }
+
+    // Memory budget of the intermediate results reused across frames
+    int renderCacheMemory = 0;
+    if (cacheMemory.isSelected()) {
+      renderCacheMemory = cacheMemory.getValue();
+      if (renderCacheMemory <= 0) {
+        cout << "Qualifier 'cachememory': bad input" << endl;
+        exit(1);
+      }
+
+      m_userLog->info("Render cache memory: " +
+                      std::to_string(renderCacheMemory) + " MB");
+    }
+
+    // Images cached beyond this are compressed down to 3/4 of it
+    if (imageCache.isSelected()) {
+      if (imageCache.getValue() <= 0) {
+        cout << "Qualifier 'imagecache': bad input" << endl;
+        exit(1);
+      }
+
+      TImageCache::instance()->setMemoryWatermarks(
+          imageCache.getValue(), imageCache.getValue() * 3 / 4);
+      m_userLog->info("Image cache watermark: " +
+                      std::to_string(imageCache.getValue()) + " MB");
+    }
+
+    // Raster buffers are served from size-class free lists
+    if (rasterPool.isSelected()) {
+      if (rasterPool.getValue() <= 0) {
+        cout << "Qualifier 'rasterpool': bad input" << endl;
+        exit(1);
+      }
+
+      if (TBigMemoryManager::instance()->initPools(
+              (TUINT64)rasterPool.getValue() << 10))
+        m_userLog->info("Raster pool: " +
+                        std::to_string(rasterPool.getValue()) + " MB");
+    }
+
+    // Persistent fx render cache, shared with other render processes
+    if (fxCache.isSelected()) {
+      if (fxCache.getValue() <= 0) {
+        cout << "Qualifier 'fxcache': bad input" << endl;
+        exit(1);
+      }
+
+      TFxDiskCache::instance()->setRootDir(cacheRoot + "fxrender");
+      TFxDiskCache::instance()->setMaximumSize(fxCache.getValue());
+      m_userLog->info("Fx disk cache: " + std::to_string(fxCache.getValue()) +
+                      " MB");
+    }
+
+    // Downsampled copies of large raster images, shared with other processes
+    if (pyramidCache.isSelected()) {
+      if (pyramidCache.getValue() <= 0) {
+        cout << "Qualifier 'pyramidcache': bad input" << endl;
+        exit(1);
+      }
+
+      RasterPyramidCache::instance()->setRootDir(cacheRoot + "pyramid");
+      RasterPyramidCache::instance()->setMaximumSize(pyramidCache.getValue());
+      m_userLog->info("Raster pyramid cache: " +
+                      std::to_string(pyramidCache.getValue()) + " MB");
+    }
+
     // Disable the Passive cache manager. It has no sense if it cannot write on
     // disk...
     // TCacheResourcePool::instance();   //Needs to be instanced before
@@ -964,7 +1082,8 @@ int main(int argc, char *argv[]) {
 #endif
 
     framePair = generateMovie(scene, theDstFilePath, r0, r1, step, shrink,
-                              threadCount, maxTileSize);
+                              threadCount, maxTileSize, renderMemory,
+                              renderCacheMemory);
 
     Sw1.stop();
 
@@ -986,6 +1105,19 @@ int main(int argc, char *argv[]) {
         " seconds spent on saving" + "\n" +
         ::to_string(TStopWatch::global(8).getTotalTime() / 1000.0, 2) +
         " seconds spent on rendering" + "\n";
+    if (TFxDiskCache::instance()->isEnabled())
+      msg2 += TFxDiskCache::instance()->getStatisticsString() + "\n";
+    if (TPredictiveCacheManager::getStatistics().m_sharedResources > 0)
+      msg2 += TPredictiveCacheManager::getStatisticsString() + "\n";
+
+    TImageCache::Statistics imageCacheStats =
+        TImageCache::instance()->getStatistics();
+    if (imageCacheStats.m_backgroundPasses + imageCacheStats.m_inlinePasses >
+        0)
+      msg2 += TImageCache::instance()->getStatisticsString() + "\n";
+    if (TBigMemoryManager::instance()->isPooling())
+      msg2 += TBigMemoryManager::instance()->getPoolStatisticsString() + "\n";
+
     cout << msg + msg2;
     m_userLog->info(msg + msg2);
     DVGui::info(QString::fromStdString(msg));
@@ -5,6 +5,8 @@
 // Core-system includes
 #include "tsystem.h"
 #include "tthreadmessage.h"
+#include "tstopwatch.h"
+#include "tenv.h"
 
 // Fx basics
 #include "tparamcontainer.h"
@@ -15,12 +17,18 @@
 #include "timagecache.h"
 #include "trasterimage.h"
 #include "trop.h"
+#include "tsparseraster.h"
 
 // Optimization components
 #include "trenderresourcemanager.h"
 #include "tfxcachemanager.h"
+#include "tfxdiskcache.h"
 #include "trenderer.h"
 
+// Qt includes
+#include <QMutex>
+#include <QThreadStorage>
+
 // Diagnostics
 //#define DIAGNOSTICS
 #ifdef DIAGNOSTICS
@@ -171,16 +179,60 @@ inline QString qTraduce(const TAffine &aff) {
 
 //--------------------------------------------------
 
-inline std::string traduce(const TAffine &aff) {
-  return
-      // Observe that toString distinguishes + and - 0. That is a problem
-      // when comparing aliases - so near 0 values are explicitly rounded to 0.
-      (areAlmostEqual(aff.a11, 0.0) ? "0" : ::to_string(aff.a11, 5)) + "," +
-      (areAlmostEqual(aff.a12, 0.0) ? "0" : ::to_string(aff.a12, 5)) + "," +
-      (areAlmostEqual(aff.a13, 0.0) ? "0" : ::to_string(aff.a13, 5)) + "," +
-      (areAlmostEqual(aff.a21, 0.0) ? "0" : ::to_string(aff.a21, 5)) + "," +
-      (areAlmostEqual(aff.a22, 0.0) ? "0" : ::to_string(aff.a22, 5)) + "," +
-      (areAlmostEqual(aff.a23, 0.0) ? "0" : ::to_string(aff.a23, 5));
+//! Returns the hash naming the cache resources which store the results of
+//! \b fx with the specified render settings.
+TFxHash getResourceHash(const TRasterFx *fx, double frame,
+                        const TRenderSettings &info) {
+  const TAffine &aff = info.m_affine;
+
+  return TFxHasher()
+      .add(fx->getAliasHash(frame, info))
+      .addReal(aff.a11, 5)
+      .addReal(aff.a12, 5)
+      .addReal(aff.a13, 5)
+      .addReal(aff.a21, 5)
+      .addReal(aff.a22, 5)
+      .addReal(aff.a23, 5)
+      .add(info.m_bpp)
+      .result();
+}
+
+//--------------------------------------------------
+
+//! Returns the key of a tile in the fx disk cache. Unlike resource names,
+//! which are only compared within the same render settings, it has to cover
+//! every setting that affects the result.
+TFxHash getDiskCacheKey(const TFxHash &resourceHash,
+                        const TRenderSettings &info, const TTile &tile) {
+  // Results from other releases are not trusted
+  static const std::string version = TEnv::getApplicationFullName();
+
+  TDimension size(tile.getRaster()->getSize());
+  const TRectD &cameraBox = info.m_cameraBox;
+
+  return TFxHasher()
+      .add(version)
+      .add(resourceHash)
+      .add(info.m_quality)
+      .add(info.m_fieldPrevalence)
+      .addReal(info.m_gamma, 5)
+      .addReal(info.m_timeStretchFrom, 5)
+      .addReal(info.m_timeStretchTo, 5)
+      .add(info.m_stereoscopic)
+      .addReal(info.m_stereoscopicShift, 5)
+      .add(info.m_shrinkX)
+      .add(info.m_shrinkY)
+      .add(info.m_isSwatch)
+      .add(info.m_cpuVectorRasterizer)
+      .addReal(cameraBox.x0, 3)
+      .addReal(cameraBox.y0, 3)
+      .addReal(cameraBox.x1, 3)
+      .addReal(cameraBox.y1, 3)
+      .addReal(tile.m_pos.x, 3)
+      .addReal(tile.m_pos.y, 3)
+      .add(size.lx)
+      .add(size.ly)
+      .result();
 }
 
 }  // Local namespace
@@ -203,6 +255,70 @@ void removeRenderCache(const std::string &alias) {
   TFxCacheManager::instance()->remove(alias);
 }
 
+//==============================================================================
+//
+// AliasHashManager
+//
+//------------------------------------------------------------------------------
+
+//! Stores the alias hashes calculated during a render instance, so that each
+//! fx hashes its subtree only once per frame. Hashed fxs are retained until
+//! the render ends, so that their addresses cannot be reused meanwhile.
+class AliasHashManager final : public TRenderResourceManager {
+  T_RENDER_RESOURCE_MANAGER
+
+  struct FxHashes {
+    TFxP m_fx;
+    std::map<std::pair<double, TFxHash>, TFxHash> m_hashes;
+  };
+
+  std::map<const TFx *, FxHashes> m_fxHashes;
+  QMutex m_mutex;
+
+public:
+  static AliasHashManager *instance() {
+    return static_cast<AliasHashManager *>(
+        AliasHashManager::gen()->getManager(TRenderer::renderId()));
+  }
+
+  bool find(const TFx *fx, double frame, const TFxHash &dataHash,
+            TFxHash &hash) {
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_fxHashes.find(fx);
+    if (it == m_fxHashes.end()) return false;
+
+    auto jt = it->second.m_hashes.find(std::make_pair(frame, dataHash));
+    if (jt == it->second.m_hashes.end()) return false;
+
+    hash = jt->second;
+    return true;
+  }
+
+  void insert(TFx *fx, double frame, const TFxHash &dataHash,
+              const TFxHash &hash) {
+    QMutexLocker locker(&m_mutex);
+
+    FxHashes &fxHashes = m_fxHashes[fx];
+    if (!fxHashes.m_fx) fxHashes.m_fx = TFxP(fx);
+
+    fxHashes.m_hashes[std::make_pair(frame, dataHash)] = hash;
+  }
+};
+
+//------------------------------------------------------------------------------
+
+class AliasHashManagerGenerator final : public TRenderResourceManagerGenerator {
+public:
+  AliasHashManagerGenerator() : TRenderResourceManagerGenerator(true) {}
+
+  TRenderResourceManager *operator()() override {
+    return new AliasHashManager;
+  }
+};
+
+MANAGER_FILESCOPE_DECLARATION(AliasHashManager, AliasHashManagerGenerator);
+
 //==============================================================================
 //
 // TrFx   (Affine Transformer Fx)
@@ -239,6 +355,10 @@ public:
 
   //-----------------------------------------------------------
 
+  bool handlesSparseTiles() const override { return true; }
+
+  //-----------------------------------------------------------
+
   std::string getAlias(double frame,
                        const TRenderSettings &info) const override {
     // NOTE: TrFx are not present at this recursive level. Affines dealing is
@@ -250,6 +370,16 @@ public:
 
   //-----------------------------------------------------------
 
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override {
+    return TFxHasher()
+        .add(getFxType())
+        .add(m_fx->getAliasHash(frame, info))
+        .result();
+  }
+
+  //-----------------------------------------------------------
+
   bool doGetBBox(double frame, TRectD &bBox,
                  const TRenderSettings &info) override {
     // NOTE: TrFx are not present at this recursive level. Affines dealing is
@@ -281,6 +411,24 @@ public:
 
     infoIn.m_affine = appliedAff;
     TRasterFx::applyAffine(tile, inTile, infoIn);
+
+    // Translations keep the input's empty tiles, shifted - resampled pixels
+    // gather their neighbours within the filter radius, too
+    if (inTile.hasEmptyTiles() && appliedAff.isTranslation()) {
+      TPointD diff(tile.m_pos - inTile.m_pos -
+                   TPointD(appliedAff.a13, appliedAff.a23));
+      TPoint diffI(convert(diff));
+
+      int margin = (fabs(diff.x - diffI.x) < 0.01 &&
+                    fabs(diff.y - diffI.y) < 0.01)
+                       ? 0
+                       : getResampleFilterRadius(info) + 1;
+
+      TSparseRaster sparseRas(tile.getRaster());
+      sparseRas.copyEmptyTiles(inTile.getSparseRaster(),
+                               TPoint(-diffI.x, -diffI.y), margin);
+      tile.setEmptyTiles(sparseRas);
+    }
   }
 
   //-----------------------------------------------------------
@@ -362,6 +510,7 @@ FX_IDENTIFIER_IS_HIDDEN(TrFx, "trFx")
 // tfxcachemanager.cpp
 class FxResourceBuilder final : public ResourceBuilder {
   TRasterFxP m_rfx;
+  TFxHash m_resourceHash;
   double m_frame;
   const TRenderSettings *m_rs;
 
@@ -372,10 +521,12 @@ class FxResourceBuilder final : public ResourceBuilder {
   TRectD m_outRect;
 
 public:
-  FxResourceBuilder(const std::string &resourceName, const TRasterFxP &fx,
+  FxResourceBuilder(const std::string &resourceName,
+                    const TFxHash &resourceHash, const TRasterFxP &fx,
                     const TRenderSettings &rs, double frame)
       : ResourceBuilder(resourceName, fx.getPointer(), frame, rs)
       , m_rfx(fx)
+      , m_resourceHash(resourceHash)
       , m_frame(frame)
       , m_rs(&rs)
       , m_currTile(0) {}
@@ -441,17 +592,38 @@ void FxResourceBuilder::buildTileToCalculate(const TRectD &tileGeom) {
 //------------------------------------------------------------------------------
 
 void FxResourceBuilder::compute(const TRectD &tileRect) {
-#ifdef DIAGNOSTICS
   TStopWatch sw;
   sw.start();
-#endif
 
   buildTileToCalculate(tileRect);
+
+  // The result may have been stored on disk by a previous session
+  TFxDiskCache *diskCache = TFxDiskCache::instance();
+
+  bool useDiskCache = m_rfx->isCachable() && diskCache->isEnabled();
+
+  TFxHash diskKey;
+  if (useDiskCache) {
+    diskKey = getDiskCacheKey(m_resourceHash, *m_rs, *m_currTile);
+    if (diskCache->load(diskKey, *m_currTile)) return;
+  }
+
   m_rfx->doCompute(*m_currTile, m_frame, *m_rs);
 
-#ifdef DIAGNOSTICS
+  // Empty tiles are only trusted from the fxs declaring them
+  if (!m_rfx->handlesSparseTiles()) m_currTile->clearEmptyTiles();
+
   sw.stop();
 
+  // Canceled computations may leave incomplete results
+  bool canceled =
+      (m_rs->m_isCanceled && *m_rs->m_isCanceled) ||
+      TRenderer::instance().isAborted(TRenderer::renderId());
+
+  if (useDiskCache && !canceled)
+    diskCache->store(diskKey, *m_currTile, sw.getTotalTime());
+
+#ifdef DIAGNOSTICS
   DIAGNOSTICS_THRSET("FComputeTime", sw.getTotalTime());
 #endif
 }
@@ -624,6 +796,68 @@ std::string TRasterFx::getAlias(double frame,
 
 //--------------------------------------------------
 
+TFxHash TRasterFx::getAliasHash(double frame,
+                                const TRenderSettings &info) const {
+  // Transformer fxs are temporaries, and cheap to hash anyway
+  AliasHashManager *manager =
+      dynamic_cast<const TrFx *>(this) ? 0 : AliasHashManager::instance();
+  if (!manager) return buildAliasHash(frame, info);
+
+  // Fx-specific render data is the only part of the render settings which
+  // may enter aliases
+  TFxHasher dataHasher;
+  for (const TRasterFxRenderDataP &data : info.m_data)
+    if (data) dataHasher.add(data->toString());
+
+  TFxHash dataHash = dataHasher.result(), hash;
+  if (manager->find(this, frame, dataHash, hash)) return hash;
+
+  hash = buildAliasHash(frame, info);
+  manager->insert(const_cast<TRasterFx *>(this), frame, dataHash, hash);
+
+  return hash;
+}
+
+//--------------------------------------------------
+
+TFxHash TRasterFx::buildAliasHash(double frame,
+                                  const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+  addParamsAliasHash(hasher, frame);
+
+  return hasher.result();
+}
+
+//--------------------------------------------------
+
+void TRasterFx::addInputsAliasHash(TFxHasher &hasher, double frame,
+                                   const TRenderSettings &info) const {
+  // Disconnected ports are hashed too, so that inputs cannot swap places
+  for (int i = 0; i < getInputPortCount(); ++i) {
+    TFxPort *port = getInputPort(i);
+    if (port->isConnected()) {
+      TRasterFxP ifx = port->getFx();
+      assert(ifx);
+      hasher.add(ifx->getAliasHash(frame, info));
+    } else
+      hasher.add(TFxHash());
+  }
+}
+
+//--------------------------------------------------
+
+void TRasterFx::addParamsAliasHash(TFxHasher &hasher, double frame) const {
+  for (int i = 0; i < getParams()->getParamCount(); ++i) {
+    TParam *param = getParams()->getParam(i);
+    hasher.add(param->getName()).add(param->getValueAlias(frame, 3));
+  }
+}
+
+//--------------------------------------------------
+
 void TRasterFx::dryCompute(TRectD &rect, double frame,
                            const TRenderSettings &info) {
   if (checkActiveTimeRegion() && !getActiveTimeRegion().contains(frame)) return;
@@ -676,8 +910,30 @@ void TRasterFx::dryCompute(TRectD &rect, double frame,
     return;
   }
 
-  std::string alias = getAlias(frame, info) + "[" + ::traduce(info.m_affine) +
-                      "][" + std::to_string(info.m_bpp) + "]";
+  // Memory estimation - simulate the allocations, without caching
+  if (TRasterFxMemoryEstimator *estimator =
+          TRasterFxMemoryEstimator::current()) {
+    TRectD bbox;
+    getBBox(frame, bbox, info);
+    enlargeToI(bbox);
+
+    TRectD interestingRect(rect * bbox);
+    if (myIsEmpty(interestingRect)) return;
+
+    estimator->addTile(interestingRect, info.m_bpp);
+
+    TINT64 allocated = estimator->getAllocated();
+    doDryCompute(interestingRect, frame, info);
+
+    estimator->addTemporary(
+        getMemoryRequirement(interestingRect, frame, info));
+    estimator->setAllocated(allocated);  // Inputs are released here
+
+    return;
+  }
+
+  TFxHash resourceHash = getResourceHash(this, frame, info);
+  std::string alias    = resourceHash.toString();
 
   int renderStatus =
       TRenderer::instance().getRenderStatus(TRenderer::renderId());
@@ -707,7 +963,7 @@ void TRasterFx::dryCompute(TRectD &rect, double frame,
     if (myIsEmpty(interestingRect)) return;
 
     // Invoke the fx-specific simulation process
-    FxResourceBuilder rBuilder(alias, this, info, frame);
+    FxResourceBuilder rBuilder(alias, resourceHash, this, info, frame);
     rBuilder.simBuild(interestingRect);
   }
 }
@@ -763,6 +1019,7 @@ void TRasterFx::allocateAndCompute(TTile &tile, const TPointD &pos,
   if (templateRas) {
     TRaster32P ras32(templateRas);
     TRaster64P ras64(templateRas);
+    TRasterFP rasF(templateRas);
     templateRas = 0;  // Release the reference to templateRas before allocation
 
     TRasterP tileRas;
@@ -770,6 +1027,8 @@ void TRasterFx::allocateAndCompute(TTile &tile, const TPointD &pos,
       tileRas = TRaster32P(size.lx, size.ly);
     else if (ras64)
       tileRas = TRaster64P(size.lx, size.ly);
+    else if (rasF)
+      tileRas = TRasterFP(size.lx, size.ly);
     else {
       assert(false);
       return;
@@ -783,6 +1042,9 @@ void TRasterFx::allocateAndCompute(TTile &tile, const TPointD &pos,
     } else if (info.m_bpp == 64) {
       TRaster64P tileRas(size.lx, size.ly);
       tile.setRaster(tileRas);
+    } else if (info.m_bpp == 128) {
+      TRasterFP tileRas(size.lx, size.ly);
+      tile.setRaster(tileRas);
     } else
       assert(false);
   }
@@ -819,6 +1081,18 @@ void TRasterFx::compute(TTile &tile, double frame,
     return;
   }
 
+  // Fxs not supporting float tiles compute a 64-bit one, converted back
+  if ((TRasterFP)tile.getRaster() && !canComputeInFloat()) {
+    TRenderSettings info64(info);
+    info64.m_bpp = 64;
+
+    TTile tile64(TRaster64P(tile.getRaster()->getSize()), tile.m_pos);
+    compute(tile64, frame, info64);
+
+    TRop::convert(tile.getRaster(), tile64.getRaster());
+    return;
+  }
+
   // If the input tile has a fractionary position, it is passed to the
   // rendersettings' accumulated affine. At the same time, the integer part of
   // such affine is transferred to the tile.
@@ -856,13 +1130,15 @@ void TRasterFx::compute(TTile &tile, double frame,
     return;
   }
 
+  // The tile is going to be overwritten
+  tile.clearEmptyTiles();
+
   // Retrieve tile's geometry
   TRectD tilePlacement = myConvert(tile.getRaster()->getBounds()) + tile.m_pos;
 
   // Build the fx result alias (in other words, its name)
-  std::string alias = getAlias(frame, info) + "[" + ::traduce(info.m_affine) +
-                      "][" + std::to_string(info.m_bpp) +
-                      "]";  // To be moved below
+  TFxHash resourceHash = getResourceHash(this, frame, info);
+  std::string alias    = resourceHash.toString();  // To be moved below
 
   TRectD bbox;
   getBBox(frame, bbox, info);
@@ -891,9 +1167,17 @@ void TRasterFx::compute(TTile &tile, double frame,
 #endif
 
   // Invoke the fx-specific computation process
-  FxResourceBuilder rBuilder(alias, this, info, frame);
+  FxResourceBuilder rBuilder(alias, resourceHash, this, info, frame);
   rBuilder.build(interestingTile);
 
+  // Forward the empty tiles declared by the fx
+  if (interestingTile.hasEmptyTiles()) {
+    TSparseRaster sparseRas(tile.getRaster());
+    sparseRas.copyEmptyTiles(interestingTile.getSparseRaster(),
+                             interestingRectI.getP00());
+    tile.setEmptyTiles(sparseRas);
+  }
+
 #ifdef DIAGNOSTICS
   sw.stop();
 
@@ -1065,6 +1349,7 @@ TRenderSettings::TRenderSettings()
     , m_stereoscopicShift(0.05)
     , m_bpp(32)
     , m_maxTileSize((std::numeric_limits<int>::max)())
+    , m_subTileSize(0)
     , m_shrinkX(1)
     , m_shrinkY(1)
     , m_quality(StandardResampleQuality)
@@ -1073,6 +1358,7 @@ TRenderSettings::TRenderSettings()
     , m_isSwatch(false)
     , m_applyShrinkToViewer(false)
     , m_userCachable(true)
+    , m_cpuVectorRasterizer(false)
     , m_isCanceled(NULL) {}
 
 //------------------------------------------------------------------------------
@@ -1092,7 +1378,7 @@ std::string TRenderSettings::toString() const {
       "," + std::to_string(m_affine.a21) + "," + std::to_string(m_affine.a22) +
       "," + std::to_string(m_affine.a23) + ";" + std::to_string(m_maxTileSize) +
       ";" + std::to_string(m_isSwatch) + ";" + std::to_string(m_userCachable) +
-      ";{";
+      ";" + std::to_string(m_cpuVectorRasterizer) + ";{";
   if (!m_data.empty()) {
     ss += m_data[0]->toString();
     for (int i = 1; i < (int)m_data.size(); i++)
@@ -1113,9 +1399,11 @@ bool TRenderSettings::operator==(const TRenderSettings &rhs) const {
       m_timeStretchTo != rhs.m_timeStretchTo || m_shrinkX != rhs.m_shrinkX ||
       m_shrinkY != rhs.m_shrinkY ||
       m_applyShrinkToViewer != rhs.m_applyShrinkToViewer ||
-      m_maxTileSize != rhs.m_maxTileSize || m_affine != rhs.m_affine ||
+      m_maxTileSize != rhs.m_maxTileSize ||
+      m_subTileSize != rhs.m_subTileSize || m_affine != rhs.m_affine ||
       m_mark != rhs.m_mark || m_isSwatch != rhs.m_isSwatch ||
-      m_userCachable != rhs.m_userCachable)
+      m_userCachable != rhs.m_userCachable ||
+      m_cpuVectorRasterizer != rhs.m_cpuVectorRasterizer)
     return false;
 
   return std::equal(m_data.begin(), m_data.end(), rhs.m_data.begin(), areEqual);
@@ -1126,3 +1414,50 @@ bool TRenderSettings::operator==(const TRenderSettings &rhs) const {
 bool TRenderSettings::operator!=(const TRenderSettings &rhs) const {
   return !operator==(rhs);
 }
+
+//==============================================================================
+//
+// TRasterFxMemoryEstimator
+//
+//------------------------------------------------------------------------------
+
+namespace {
+QThreadStorage<TRasterFxMemoryEstimator **> estimatorStorage;
+}
+
+//------------------------------------------------------------------------------
+
+TRasterFxMemoryEstimator::TRasterFxMemoryEstimator()
+    : m_allocated(0), m_peak(0) {
+  assert(!current());
+  estimatorStorage.setLocalData(new (TRasterFxMemoryEstimator *)(this));
+}
+
+//------------------------------------------------------------------------------
+
+TRasterFxMemoryEstimator::~TRasterFxMemoryEstimator() {
+  estimatorStorage.setLocalData(0);
+}
+
+//------------------------------------------------------------------------------
+
+TRasterFxMemoryEstimator *TRasterFxMemoryEstimator::current() {
+  return estimatorStorage.hasLocalData() && estimatorStorage.localData()
+             ? *estimatorStorage.localData()
+             : 0;
+}
+
+//------------------------------------------------------------------------------
+
+void TRasterFxMemoryEstimator::addTile(const TRectD &rect, int bpp) {
+  if (rect.x1 <= rect.x0 || rect.y1 <= rect.y0) return;
+
+  m_allocated += (TINT64)tceil(rect.getLx()) * tceil(rect.getLy()) * (bpp >> 3);
+  m_peak = std::max(m_peak, m_allocated);
+}
+
+//------------------------------------------------------------------------------
+
+void TRasterFxMemoryEstimator::addTemporary(int MB) {
+  if (MB > 0) m_peak = std::max(m_peak, m_allocated + ((TINT64)MB << 20));
+}
@@ -608,7 +608,7 @@ bool FlipBook::doSaveImages(TFilePath fp) {
 
   // Open a notice that the previewFx is rendered in 8bpc regardless of the
   // output settings.
-  if (m_isPreviewFx && outputSettings->getRenderSettings().m_bpp == 64) {
+  if (m_isPreviewFx && outputSettings->getRenderSettings().m_bpp >= 64) {
     QString question =
         "Save previewed images :\nImages will be saved in 8 bit per channel "
         "with this command.\nDo you want to save images?";
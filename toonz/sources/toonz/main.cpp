@@ -34,6 +34,7 @@
 #include "toonz/txshsimplelevel.h"
 #include "toonz/tproject.h"
 #include "toonz/scriptengine.h"
+#include "toonz/rasterpyramid.h"
 
 // TnzSound includes
 #include "tnzsound.h"
@@ -45,6 +46,7 @@
 #include "permissionsmanager.h"
 #include "tenv.h"
 #include "tcli.h"
+#include "tfxdiskcache.h"
 
 // TnzCore includes
 #include "tsystem.h"
@@ -89,6 +91,8 @@
 using namespace DVGui;
 
 TEnv::IntVar EnvSoftwareCurrentFontSize("SoftwareCurrentFontSize", 12);
+TEnv::IntVar EnvRasterPyramidCacheSize("RasterPyramidCacheSize", 0);  // In MB
+TEnv::IntVar EnvFxDiskCacheSize("FxDiskCacheSize", 0);  // In MB
 
 const char *rootVarName     = "TOONZROOT";
 const char *systemVarPrefix = "TOONZ";
@@ -349,6 +353,18 @@ project->setUseScenePath(TProject::Extras, false);
   TFilePath cacheDir               = ToonzFolder::getCacheRootFolder();
   if (cacheDir.isEmpty()) cacheDir = TEnv::getStuffDir() + "cache";
   TImageCache::instance()->setRootDir(cacheDir);
+
+  // Downsampled copies of large raster images
+  if (EnvRasterPyramidCacheSize > 0) {
+    RasterPyramidCache::instance()->setRootDir(cacheDir + "pyramid");
+    RasterPyramidCache::instance()->setMaximumSize(EnvRasterPyramidCacheSize);
+  }
+
+  // Fx render results, shared with tcomposer
+  if (EnvFxDiskCacheSize > 0) {
+    TFxDiskCache::instance()->setRootDir(cacheDir + "fxrender");
+    TFxDiskCache::instance()->setMaximumSize(EnvFxDiskCacheSize);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -3165,6 +3165,10 @@ void MainWindow::clearCacheFolder() {
   //    To be cleared on the end of rendering, on exist and on launch.
   // 3. $CACHE/temp : untitled scene data.
   //    To be deleted on switching or exiting scenes. Remains on crash.
+  // 4. $CACHE/pyramid : downsampled copies of large raster images.
+  //    Rebuilt on demand.
+  // 5. $CACHE/fxrender : fx render results persisting across sessions.
+  //    Rebuilt on demand.
 
   // So, this function will delete all files / folders in $CACHE
   // except the following items:
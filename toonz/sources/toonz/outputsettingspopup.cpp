@@ -128,7 +128,7 @@ ResampleOption quality2index(TRenderSettings::ResampleQuality quality) {
   return c_standard;
 }
 
-enum ChannelWidth { c_8bit, c_16bit };
+enum ChannelWidth { c_8bit, c_16bit, c_float };
 
 enum DominantField { c_odd, c_even, c_none };
 
@@ -259,6 +259,11 @@ OutputSettingsPopup::OutputSettingsPopup(bool isPreview)
   m_threadsComboOm = new QComboBox();
   // Granularity
   m_rasterGranularityOm = new QComboBox();
+  // Parallel tiles
+  m_subTileSizeOm = new QComboBox();
+  // Vector levels rendered without OpenGL
+  m_cpuVectorRasterizerChk =
+      new DVGui::CheckBox(tr("Render Vectors on CPU"), this);
 
   //----プロパティの設定
 
@@ -288,6 +293,8 @@ OutputSettingsPopup::OutputSettingsPopup(bool isPreview)
   // Channel Width
   m_channelWidthOm->addItem(tr("8 bit"), "8 bit");
   m_channelWidthOm->addItem(tr("16 bit"), "16 bit");
+  m_channelWidthOm->addItem(tr("32 bit Floating point"),
+                            "32 bit Floating point");
 
   if (!isPreview) {
     showOtherSettingsButton->setObjectName("OutputSettingsShowButton");
@@ -340,6 +347,10 @@ OutputSettingsPopup::OutputSettingsPopup(bool isPreview)
   granularityChoices << tr("None") << tr("Large") << tr("Medium")
                      << tr("Small");
   m_rasterGranularityOm->addItems(granularityChoices);
+  m_subTileSizeOm->addItem(tr("None"), 0);
+  m_subTileSizeOm->addItem(tr("Large"), 1024);
+  m_subTileSizeOm->addItem(tr("Medium"), 512);
+  m_subTileSizeOm->addItem(tr("Small"), 256);
 
   //----layout
 
@@ -485,8 +496,13 @@ OutputSettingsPopup::OutputSettingsPopup(bool isPreview)
         bottomGridLay->addWidget(new QLabel(tr("Render Tile:"), this), 3, 0,
                                  Qt::AlignRight | Qt::AlignVCenter);
         bottomGridLay->addWidget(m_rasterGranularityOm, 3, 1, 1, 2);
+        // Parallel tiles
+        bottomGridLay->addWidget(new QLabel(tr("Parallel Tiles:"), this), 4,
+                                 0, Qt::AlignRight | Qt::AlignVCenter);
+        bottomGridLay->addWidget(m_subTileSizeOm, 4, 1, 1, 2);
+        bottomGridLay->addWidget(m_cpuVectorRasterizerChk, 5, 1, 1, 2);
         if (m_subcameraChk) {
-          bottomGridLay->addWidget(m_subcameraChk, 4, 1, 1, 2);
+          bottomGridLay->addWidget(m_subcameraChk, 6, 1, 1, 2);
         }
       }
       bottomGridLay->setColumnStretch(0, 0);
@@ -648,6 +664,10 @@ OutputSettingsPopup::OutputSettingsPopup(bool isPreview)
                        SLOT(onThreadsComboChanged(int)));
   ret = ret && connect(m_rasterGranularityOm, SIGNAL(currentIndexChanged(int)),
                        SLOT(onRasterGranularityChanged(int)));
+  ret = ret && connect(m_subTileSizeOm, SIGNAL(currentIndexChanged(int)),
+                       SLOT(onSubTileSizeChanged(int)));
+  ret = ret && connect(m_cpuVectorRasterizerChk, SIGNAL(stateChanged(int)),
+                       SLOT(onCpuVectorRasterizerChecked(int)));
 
   if (m_subcameraChk)
     ret = ret && connect(m_subcameraChk, SIGNAL(stateChanged(int)),
@@ -757,6 +777,8 @@ void OutputSettingsPopup::updateField() {
     m_channelWidthOm->setCurrentIndex(c_8bit);
     m_threadsComboOm->setCurrentIndex(0);
     m_rasterGranularityOm->setCurrentIndex(0);
+    m_subTileSizeOm->setCurrentIndex(0);
+    m_cpuVectorRasterizerChk->setCheckState(Qt::Unchecked);
 
     if (m_subcameraChk) m_subcameraChk->setCheckState(Qt::Unchecked);
     return;
@@ -838,6 +860,9 @@ void OutputSettingsPopup::updateField() {
   case 64:
     m_channelWidthOm->setCurrentIndex(c_16bit);
     break;
+  case 128:
+    m_channelWidthOm->setCurrentIndex(c_float);
+    break;
   default:
     m_channelWidthOm->setCurrentIndex(c_8bit);
     break;
@@ -849,6 +874,14 @@ void OutputSettingsPopup::updateField() {
   // Raster granularity
   m_rasterGranularityOm->setCurrentIndex(prop->getMaxTileSizeIndex());
 
+  // Parallel tiles - sizes set elsewhere fall back to the nearest choice
+  int subTileIndex = m_subTileSizeOm->findData(renderSettings.m_subTileSize);
+  if (subTileIndex < 0) subTileIndex = renderSettings.m_subTileSize ? 2 : 0;
+  m_subTileSizeOm->setCurrentIndex(subTileIndex);
+
+  m_cpuVectorRasterizerChk->setCheckState(
+      renderSettings.m_cpuVectorRasterizer ? Qt::Checked : Qt::Unchecked);
+
   if (m_isPreviewSettings) return;
 
   m_doStereoscopy->setChecked(renderSettings.m_stereoscopic);
@@ -1171,8 +1204,10 @@ void OutputSettingsPopup::onChannelWidthChanged(int type) {
   TRenderSettings rs      = prop->getRenderSettings();
   if (type == c_8bit)
     rs.m_bpp = 32;
-  else
+  else if (type == c_16bit)
     rs.m_bpp = 64;
+  else
+    rs.m_bpp = 128;
   prop->setRenderSettings(rs);
   TApp::instance()->getCurrentScene()->setDirtyFlag(true);
   if (m_presetCombo) m_presetCombo->setCurrentIndex(0);
@@ -1277,6 +1312,30 @@ void OutputSettingsPopup::onRasterGranularityChanged(int type) {
   TApp::instance()->getCurrentScene()->setDirtyFlag(true);
 }
 
+//-----------------------------------------------------------------------------
+
+void OutputSettingsPopup::onSubTileSizeChanged(int index) {
+  if (!getCurrentScene()) return;
+  TOutputProperties *prop = getProperties();
+  TRenderSettings rs      = prop->getRenderSettings();
+  rs.m_subTileSize        = m_subTileSizeOm->itemData(index).toInt();
+  prop->setRenderSettings(rs);
+
+  TApp::instance()->getCurrentScene()->setDirtyFlag(true);
+}
+
+//-----------------------------------------------------------------------------
+
+void OutputSettingsPopup::onCpuVectorRasterizerChecked(int state) {
+  if (!getCurrentScene()) return;
+  TOutputProperties *prop  = getProperties();
+  TRenderSettings rs       = prop->getRenderSettings();
+  rs.m_cpuVectorRasterizer = (state == Qt::Checked);
+  prop->setRenderSettings(rs);
+
+  TApp::instance()->getCurrentScene()->setDirtyFlag(true);
+}
+
 //-----------------------------------------------------------------------------
 /*! OutputSettingsのPreset登録
 */
@@ -1569,8 +1628,10 @@ void OutputSettingsPopup::onPresetSelected(const QString &str) {
         m_channelWidthOm->setCurrentIndex(index);
         if (index == c_8bit)
           rs.m_bpp = 32;
-        else
+        else if (index == c_16bit)
           rs.m_bpp = 64;
+        else
+          rs.m_bpp = 128;
       }
     }
 
@@ -45,6 +45,8 @@ class OutputSettingsPopup : public DVGui::Dialog {
   DVGui::CheckBox *m_doStereoscopy;
   DVGui::DoubleLineEdit *m_stereoShift;
   QComboBox *m_rasterGranularityOm;
+  QComboBox *m_subTileSizeOm;
+  DVGui::CheckBox *m_cpuVectorRasterizerChk;
   QComboBox *m_threadsComboOm;
 
   DVGui::DoubleLineEdit *m_frameRateFld;
@@ -90,6 +92,8 @@ protected slots:
   void onMultimediaChanged(int mode);
   void onThreadsComboChanged(int type);
   void onRasterGranularityChanged(int type);
+  void onSubTileSizeChanged(int index);
+  void onCpuVectorRasterizerChecked(int state);
   void onStereoChecked(int);
   void onStereoChanged();
   void onRenderClicked();
@@ -2,6 +2,7 @@
 
 // System-core includes
 #include "tsystem.h"
+#include "tenv.h"
 #include "tthreadmessage.h"
 #include "timagecache.h"
 #include "tstopwatch.h"
@@ -17,6 +18,7 @@
 
 // Fx-related includes
 #include "tfxutil.h"
+#include "trasterfx.h"
 
 // Cache management includes
 #include "tpassivecachemanager.h"
@@ -95,6 +97,8 @@ so that the following getRaster() will forcibly recalculate the requested frame.
 
 #define CACHEID "RenderCache"
 
+TEnv::IntVar PreviewProgressiveRendering("PreviewProgressiveRendering", 1);
+
 namespace {
 bool suspendedRendering        = false;
 Previewer *previewerInstance   = 0;
@@ -104,6 +108,11 @@ QTimer levelChangedTimer, fxChangedTimer, xsheetChangedTimer,
     objectChangedTimer;
 const int notificationDelay = 300;
 
+// Progressive rendering: rects larger than minProgressiveArea pixels are first
+// rendered at coarseShrinkFactor times the preview shrink
+const int coarseShrinkFactor = 4;
+const int minProgressiveArea = 256 * 256;
+
 //-------------------------------------------------------------------------
 
 void buildNodeTreeDescription(std::string &desc, const TFxP &root);
@@ -128,13 +137,29 @@ class Previewer::Imp final : public TRenderPort {
 public:
   // All useful infos about a frame under Previewer's management
   struct FrameInfo {
+  public:
+    // A leaf of the frame's over-tree, and the plane rect it covers
+    struct Contribution {
+      std::string m_key;  // The leaf's alias and placement
+      TRect m_rect;
+    };
+
   public:
     std::string m_alias;       // The alias of m_fx
     unsigned long m_renderId;  // The render process Id - passed by TRenderer
     QRegion m_renderedRegion;  // The plane region already rendered for m_fx
     TRect m_rectUnderRender;   // Plane region currently under render
 
-    FrameInfo() : m_renderId((unsigned long)-1) {}
+    unsigned long m_coarseRenderId;  // The render Id of the coarse pass
+    TRect m_coarseRect;  // Plane region covered by the coarse pass
+
+    std::string m_structure;  // The layout of m_fx's over-tree - empty if the
+                              // tree could not be analyzed
+    std::vector<Contribution> m_contributions;  // m_fx's over-tree leaves
+
+    FrameInfo()
+        : m_renderId((unsigned long)-1)
+        , m_coarseRenderId((unsigned long)-1) {}
   };
 
 public:
@@ -172,7 +197,8 @@ public:
   void notifyFailed(int frame);
   void notifyUpdate();
 
-  TFxPair buildSceneFx(int frame);
+  // The scene tree is built at coarseFactor times the preview shrink
+  TFxPair buildSceneFx(int frame, int coarseFactor = 1);
 
   // Updater methods. These refresh the manager's status, but do not launch new
   // renders
@@ -191,6 +217,23 @@ public:
   void updateCamera();
   void updatePreviewRect();  // This is automatically invoked by refreshFrame()
 
+  // Conversions between the plane (m_cameraRes-relative pixels) and the
+  // render area
+  TPointD getPlaneOrigin() const;
+  TRectD toRenderArea(const TRect &planeRect) const;
+  TRect toPlaneRect(const TRectD &renderArea) const;
+
+  // Dirty region tracking. updateFrameInfo() stores the frame's new alias and
+  // over-tree, returning the plane rect they invalidated.
+  TRect updateFrameInfo(FrameInfo &info, int frame, const TFxPair &fxPair,
+                        const std::string &keyword = std::string());
+  void addContributions(FrameInfo &info, const TRasterFxP &fx, double frame,
+                        const TAffine &aff);
+  void invalidate(FrameInfo &info, const TRect &planeRect);
+
+  void abortRenders(FrameInfo &info);
+  void abortRefinements(int currentFrame);
+
   // Use this method to re-render the passed frame. Infos specified with the
   // update* methods
   // are assumed correct.
@@ -267,31 +310,30 @@ Previewer::Imp::~Imp() {
 
 //-----------------------------------------------------------------------------
 
-TFxPair Previewer::Imp::buildSceneFx(int frame) {
+TFxPair Previewer::Imp::buildSceneFx(int frame, int coarseFactor) {
   TFxPair fxPair;
 
+  int shrink =
+      (m_renderSettings.m_applyShrinkToViewer ? m_renderSettings.m_shrinkX
+                                              : 1) *
+      coarseFactor;
+
   TApp *app         = TApp::instance();
   ToonzScene *scene = app->getCurrentScene()->getScene();
   TXsheet *xsh      = scene->getXsheet();
   if (m_renderSettings.m_stereoscopic) {
     scene->shiftCameraX(-m_renderSettings.m_stereoscopicShift / 2.0);
     fxPair.m_frameA = ::buildSceneFx(
-        scene, xsh, frame, TOutputProperties::AllLevels,
-        m_renderSettings.m_applyShrinkToViewer ? m_renderSettings.m_shrinkX : 1,
-        false);
+        scene, xsh, frame, TOutputProperties::AllLevels, shrink, false);
 
     scene->shiftCameraX(m_renderSettings.m_stereoscopicShift);
     fxPair.m_frameB = ::buildSceneFx(
-        scene, xsh, frame, TOutputProperties::AllLevels,
-        m_renderSettings.m_applyShrinkToViewer ? m_renderSettings.m_shrinkX : 1,
-        false);
+        scene, xsh, frame, TOutputProperties::AllLevels, shrink, false);
 
     scene->shiftCameraX(-m_renderSettings.m_stereoscopicShift / 2.0);
   } else
     fxPair.m_frameA = ::buildSceneFx(
-        scene, xsh, frame, TOutputProperties::AllLevels,
-        m_renderSettings.m_applyShrinkToViewer ? m_renderSettings.m_shrinkX : 1,
-        false);
+        scene, xsh, frame, TOutputProperties::AllLevels, shrink, false);
 
   return fxPair;
 }
@@ -450,9 +492,204 @@ void Previewer::Imp::updatePreviewRect() {
   m_previewRect = TRect(previewRectD.x0, previewRectD.y0, previewRectD.x1 - 1,
                         previewRectD.y1 - 1);
 
-  previewRectD += m_cameraPos + shrinkedRelPos;
+  setRenderArea(toRenderArea(m_previewRect));
+}
+
+//-----------------------------------------------------------------------------
+
+//! Returns the render area position of the plane's origin.
+TPointD Previewer::Imp::getPlaneOrigin() const {
+  int shrinkX = m_renderSettings.m_shrinkX;
+  int shrinkY = m_renderSettings.m_shrinkY;
+
+  return m_cameraPos + TPointD((m_renderArea.x0 - m_cameraPos.x) / shrinkX,
+                               (m_renderArea.y0 - m_cameraPos.y) / shrinkY);
+}
+
+//-----------------------------------------------------------------------------
+
+TRectD Previewer::Imp::toRenderArea(const TRect &planeRect) const {
+  return TRectD(planeRect.x0, planeRect.y0, planeRect.x1 + 1,
+                planeRect.y1 + 1) +
+         getPlaneOrigin();
+}
+
+//-----------------------------------------------------------------------------
+
+//! Returns the plane pixels touched by the passed render area, clamped to the
+//! camera.
+TRect Previewer::Imp::toPlaneRect(const TRectD &renderArea) const {
+  TRectD rect = renderArea - getPlaneOrigin();
+  rect *= TRectD(0, 0, m_cameraRes.lx, m_cameraRes.ly);
+
+  if (rect.isEmpty()) return TRect();
+
+  return TRect(tfloor(rect.x0), tfloor(rect.y0), tceil(rect.x1) - 1,
+               tceil(rect.y1) - 1);
+}
+
+//-----------------------------------------------------------------------------
+
+/*!
+  Collects the leaves of the over-tree rooted at \b fx - the subtrees whose
+  renders are placed by affines and composited by over fxs only. Overs work
+  pixel by pixel, so a change in a leaf invalidates just the pixels its placed
+  bounding box covered before and after the change.
+*/
+void Previewer::Imp::addContributions(FrameInfo &info, const TRasterFxP &fx,
+                                      double frame, const TAffine &aff) {
+  if (!fx) {
+    info.m_structure += "-";
+    return;
+  }
+
+  auto inputFx = [](TFx *fx, int p) -> TRasterFxP {
+    TRasterFxPort *port = dynamic_cast<TRasterFxPort *>(fx->getInputPort(p));
+    return port ? TRasterFxP(port->getFx()) : TRasterFxP();
+  };
+
+  TGeometryFx *geomFx = dynamic_cast<TGeometryFx *>(fx.getPointer());
+  if (geomFx && geomFx->getInputPortCount() == 1) {
+    // Same as TGeometryFx::doGetBBox()
+    TAffine placement;
+    if (geomFx->getActiveTimeRegion().contains(frame))
+      placement = geomFx->getPlacement(frame);
+
+    addContributions(info, inputFx(geomFx, 0), frame, aff * placement);
+    return;
+  }
+
+  if (fx->getFxType() == "overFx") {
+    info.m_structure += "O(";
+
+    int p, pCount = fx->getInputPortCount();
+    for (p = 0; p != pCount; ++p)
+      addContributions(info, inputFx(fx.getPointer(), p), frame, aff);
+
+    info.m_structure += ")";
+    return;
+  }
+
+  TRenderSettings leafInfo(m_renderSettings);
+  leafInfo.m_shrinkX = 1;  // As TRenderer does
+  leafInfo.m_shrinkY = 1;
+  leafInfo.m_affine  = m_renderSettings.m_affine * aff;
+
+  FrameInfo::Contribution contribution;
+  contribution.m_key = fx->getAlias(frame, leafInfo) + "[" +
+                       std::to_string(aff.a11) + "," +
+                       std::to_string(aff.a12) + "," +
+                       std::to_string(aff.a13) + "," +
+                       std::to_string(aff.a21) + "," +
+                       std::to_string(aff.a22) + "," +
+                       std::to_string(aff.a23) + "]";
+
+  TRectD bbox;
+  fx->getBBox(frame, bbox, leafInfo);
+
+  contribution.m_rect = (bbox == TConsts::infiniteRectD)
+                            ? TRect(m_cameraRes)
+                            : toPlaneRect(leafInfo.m_affine * bbox);
+
+  info.m_structure += "L";
+  info.m_contributions.push_back(contribution);
+}
+
+//-----------------------------------------------------------------------------
+
+TRect Previewer::Imp::updateFrameInfo(FrameInfo &info, int frame,
+                                      const TFxPair &fxPair,
+                                      const std::string &keyword) {
+  std::string oldAlias, oldStructure;
+  std::vector<FrameInfo::Contribution> oldContributions;
+
+  oldAlias.swap(info.m_alias);
+  oldStructure.swap(info.m_structure);
+  oldContributions.swap(info.m_contributions);
+
+  info.m_alias =
+      fxPair.m_frameA ? fxPair.m_frameA->getAlias(frame, m_renderSettings) : "";
+  if (fxPair.m_frameB)
+    info.m_alias =
+        info.m_alias + fxPair.m_frameB->getAlias(frame, m_renderSettings);
+
+  // Stereoscopic renders are not analyzed
+  if (fxPair.m_frameA && !fxPair.m_frameB)
+    addContributions(info, fxPair.m_frameA, frame, TAffine());
+
+  auto hasKeyword = [&keyword](const std::string &str) {
+    return !keyword.empty() && str.find(keyword) != std::string::npos;
+  };
+
+  if (info.m_alias == oldAlias && !hasKeyword(oldAlias)) return TRect();
+
+  // Unless the layout is unchanged, fall back to the whole frame
+  if (info.m_structure.empty() || info.m_structure != oldStructure)
+    return TRect(m_cameraRes);
+
+  TRect dirtyRect;
+
+  std::vector<FrameInfo::Contribution>::size_type c,
+      cCount = info.m_contributions.size();
+  for (c = 0; c != cCount; ++c) {
+    const FrameInfo::Contribution &oldC = oldContributions[c],
+                                  &newC = info.m_contributions[c];
+
+    if (oldC.m_key != newC.m_key || oldC.m_rect != newC.m_rect ||
+        hasKeyword(newC.m_key))
+      dirtyRect += oldC.m_rect + newC.m_rect;
+  }
+
+  return dirtyRect;
+}
+
+//-----------------------------------------------------------------------------
+
+//! Removes the passed plane rect from the frame's rendered region. Renders
+//! in progress over the rect are aborted.
+void Previewer::Imp::invalidate(FrameInfo &info, const TRect &planeRect) {
+  if (planeRect.isEmpty()) return;
+
+  info.m_renderedRegion -= toQRect(planeRect);
+
+  if (!(info.m_rectUnderRender * planeRect).isEmpty()) abortRenders(info);
+}
+
+//-----------------------------------------------------------------------------
+
+//! Aborts the frame's render, along with its coarse pass.
+void Previewer::Imp::abortRenders(FrameInfo &info) {
+  m_renderer.abortRendering(info.m_renderId);
+  m_renderer.abortRendering(info.m_coarseRenderId);
 
-  setRenderArea(previewRectD);
+  info.m_renderId        = (unsigned long)-1;
+  info.m_rectUnderRender = TRect();
+  info.m_coarseRenderId  = (unsigned long)-1;
+  info.m_coarseRect      = TRect();
+}
+
+//-----------------------------------------------------------------------------
+
+//! Aborts the full resolution renders which followed a coarse pass, except
+//! the current frame's. They are stale once the user moved to another frame -
+//! the coarse image stays, and will be refined when the frame is shown again.
+void Previewer::Imp::abortRefinements(int currentFrame) {
+  // Playback needs all the frames
+  if (TApp::instance()->getCurrentFrame()->isPlaying()) return;
+
+  std::map<int, FrameInfo>::iterator it;
+  for (it = m_frames.begin(); it != m_frames.end(); ++it) {
+    FrameInfo &info = it->second;
+
+    if (it->first == currentFrame || info.m_coarseRect.isEmpty() ||
+        info.m_rectUnderRender.isEmpty())
+      continue;
+
+    abortRenders(info);
+
+    if (it->first < (int)m_pbStatus.size())
+      m_pbStatus[it->first] = FlipSlider::PBFrameNotStarted;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -462,17 +699,8 @@ void Previewer::Imp::updateAliases() {
   for (it = m_frames.begin(); it != m_frames.end(); ++it) {
     TFxPair fxPair = buildSceneFx(it->first);
 
-    std::string newAlias =
-        fxPair.m_frameA ? fxPair.m_frameA->getAlias(it->first, m_renderSettings)
-                        : "";
-    newAlias = newAlias + (fxPair.m_frameB ? fxPair.m_frameB->getAlias(
-                                                 it->first, m_renderSettings)
-                                           : "");
-
-    if (newAlias != it->second.m_alias) {
-      // Clear the remaining frame infos
-      it->second.m_renderedRegion = QRegion();
-    }
+    // Only the changed part of the frame will be re-rendered
+    invalidate(it->second, updateFrameInfo(it->second, it->first, fxPair));
   }
 }
 
@@ -482,22 +710,12 @@ void Previewer::Imp::updateAliasKeyword(const std::string &keyword) {
   std::map<int, FrameInfo>::iterator it;
   for (it = m_frames.begin(); it != m_frames.end(); ++it) {
     if (it->second.m_alias.find(keyword) != std::string::npos) {
-      TFxPair fxPair     = buildSceneFx(it->first);
-      it->second.m_alias = fxPair.m_frameA ? fxPair.m_frameA->getAlias(
-                                                 it->first, m_renderSettings)
-                                           : "";
-      it->second.m_alias = it->second.m_alias +
-                           (fxPair.m_frameB ? fxPair.m_frameB->getAlias(
-                                                  it->first, m_renderSettings)
-                                            : "");
-
-      // Clear the remaining frame infos
-      it->second.m_renderedRegion = QRegion();
-
-      // No need to release the cached image... eventually, clear it
-      TRasterImageP ri = TImageCache::instance()->get(
-          m_cachePrefix + std::to_string(it->first), true);
-      if (ri) ri->getRaster()->clear();
+      TFxPair fxPair = buildSceneFx(it->first);
+
+      // The cached image is kept - the invalidated part will be re-rendered
+      // over it
+      invalidate(it->second,
+                 updateFrameInfo(it->second, it->first, fxPair, keyword));
     }
   }
 }
@@ -513,6 +731,10 @@ void Previewer::Imp::refreshFrame(int frame) {
 
   if (m_previewRect.getLx() <= 0 || m_previewRect.getLy() <= 0) return;
 
+  // The rect to render - only the part of the preview rect which is not
+  // already available
+  TRect renderRect(m_previewRect);
+
   // Retrieve the FrameInfo for passed frame
   std::map<int, FrameInfo>::iterator it = m_frames.find(frame);
   if (it != m_frames.end()) {
@@ -520,12 +742,18 @@ void Previewer::Imp::refreshFrame(int frame) {
     // region, quit
     if (::contains(it->second.m_renderedRegion, m_previewRect)) return;
 
-    // Then, check the m_previewRect against the frame's m_rectUnderRendering.
+    renderRect = toTRect(QRegion(toQRect(m_previewRect))
+                             .subtracted(it->second.m_renderedRegion)
+                             .boundingRect());
+
+    // Then, check the rect against the frame's m_rectUnderRendering.
     // Ensure that we're not re-launching the very same render.
-    if (it->second.m_rectUnderRender == m_previewRect) return;
+    if (!it->second.m_rectUnderRender.isEmpty() &&
+        it->second.m_rectUnderRender.contains(renderRect))
+      return;
 
     // Stop any frame's previously running render process
-    m_renderer.abortRendering(it->second.m_renderId);
+    abortRenders(it->second);
   } else {
     it = m_frames.insert(std::make_pair(frame, FrameInfo())).first;
 
@@ -539,22 +767,58 @@ void Previewer::Imp::refreshFrame(int frame) {
   TFxPair fxPair = buildSceneFx(frame);
 
   // Update the RenderInfos associated with frame
-  it->second.m_rectUnderRender = m_previewRect;
-  it->second.m_alias = fxPair.m_frameA->getAlias(frame, m_renderSettings);
-  if (fxPair.m_frameB)
-    it->second.m_alias =
-        it->second.m_alias + fxPair.m_frameB->getAlias(frame, m_renderSettings);
+  it->second.m_rectUnderRender = renderRect;
+  updateFrameInfo(it->second, frame, fxPair);
 
-  // Retrieve the renderId of the rendering instance
-  it->second.m_renderId = m_renderer.nextRenderId();
   std::string contextName("P");
   contextName += m_subcamera ? "SC" : "FU";
   contextName += std::to_string(frame);
+
+  bool progressive =
+      PreviewProgressiveRendering != 0 && !fxPair.m_frameB &&
+      renderRect.getLx() * renderRect.getLy() >= minProgressiveArea;
+
+  if (progressive) {
+    abortRefinements(frame);
+
+    // The coarse pass is queued first, so it is shown well before the
+    // full resolution render completes. Its tree is the same, at a larger
+    // shrink about the camera corner - so is its render area.
+    TFxPair coarseFxPair = buildSceneFx(frame, coarseShrinkFactor);
+
+    TRectD area = toRenderArea(renderRect) - m_cameraPos;
+    TRectD coarseArea(
+        area.x0 / coarseShrinkFactor, area.y0 / coarseShrinkFactor,
+        area.x1 / coarseShrinkFactor, area.y1 / coarseShrinkFactor);
+    coarseArea += m_cameraPos;
+
+    it->second.m_coarseRect     = renderRect;
+    it->second.m_coarseRenderId = m_renderer.nextRenderId();
+    TPassiveCacheManager::instance()->setContextName(
+        it->second.m_coarseRenderId, contextName + "C");
+
+    std::vector<TRenderer::RenderData> *coarseDatas =
+        new std::vector<TRenderer::RenderData>;
+    coarseDatas->push_back(
+        TRenderer::RenderData(frame, m_renderSettings, coarseFxPair));
+    coarseDatas->back().m_renderArea = coarseArea;
+
+    m_renderer.startRendering(coarseDatas);
+  }
+
+  // Retrieve the renderId of the rendering instance
+  it->second.m_renderId = m_renderer.nextRenderId();
   TPassiveCacheManager::instance()->setContextName(it->second.m_renderId,
                                                    contextName);
 
   // Start the render
-  m_renderer.startRendering(frame, m_renderSettings, fxPair);
+  std::vector<TRenderer::RenderData> *renderDatas =
+      new std::vector<TRenderer::RenderData>;
+  renderDatas->push_back(
+      TRenderer::RenderData(frame, m_renderSettings, fxPair));
+  renderDatas->back().m_renderArea = toRenderArea(renderRect);
+
+  m_renderer.startRendering(renderDatas);
 }
 
 //-----------------------------------------------------------------------------
@@ -668,12 +932,26 @@ void Previewer::Imp::doOnRenderRasterCompleted(const RenderData &renderData) {
   int renderId = renderData.m_renderId;
   int frame    = renderData.m_frames[0];
 
-  if (renderData.m_rasB) {
-    assert(m_renderSettings.m_stereoscopic);
-    TRop::makeStereoRaster(renderData.m_rasA, renderData.m_rasB);
+  TRasterP ras(renderData.m_rasA), rasB(renderData.m_rasB);
+
+  // Viewers can't display float rasters - convert them to 32-bit, as
+  // PreviewFxManager does
+  if (ras->getPixelSize() == 16) {
+    TRaster32P aux(ras->getLx(), ras->getLy());
+    TRop::convert(aux, ras);
+    ras = aux;
+
+    if (rasB) {
+      TRaster32P auxB(rasB->getLx(), rasB->getLy());
+      TRop::convert(auxB, rasB);
+      rasB = auxB;
+    }
   }
 
-  TRasterP ras(renderData.m_rasA);
+  if (rasB) {
+    assert(m_renderSettings.m_stereoscopic);
+    TRop::makeStereoRaster(ras, rasB);
+  }
 
   m_computingFrameCount--;
 
@@ -682,7 +960,14 @@ void Previewer::Imp::doOnRenderRasterCompleted(const RenderData &renderData) {
   if (it == m_frames.end()) return;
 
   // Ensure that the render process id is the same
-  if (renderId != it->second.m_renderId) return;
+  bool coarse = (renderId == it->second.m_coarseRenderId);
+  if (coarse) {
+    it->second.m_coarseRenderId = (unsigned long)-1;
+
+    // Useless if the full resolution render already completed
+    if (it->second.m_rectUnderRender.isEmpty()) return;
+  } else if (renderId != it->second.m_renderId)
+    return;
 
   // Store the rendered image in the cache - this is done in the MAIN thread due
   // to the necessity of accessing it->second.m_rectUnderRender for raster
@@ -699,6 +984,23 @@ void Previewer::Imp::doOnRenderRasterCompleted(const RenderData &renderData) {
     cachedRas = ras->create(m_cameraRes.lx, m_cameraRes.ly);
     cachedRas->clear();
     ri = TRasterImageP(cachedRas);
+
+    // Anything rendered before is lost
+    it->second.m_renderedRegion = QRegion();
+  }
+
+  if (coarse) {
+    // Enlarge the coarse pass over its rect, without declaring it rendered
+    TRect coarseRect(it->second.m_coarseRect);
+    cachedRas = cachedRas->extract(coarseRect);
+    if (cachedRas) {
+      TRop::resample(cachedRas, ras, TScale(coarseShrinkFactor),
+                     TRop::Bilinear);
+      TImageCache::instance()->add(str, ri);
+    }
+
+    notifyUpdate();
+    return;
   }
 
   // Finally, copy the rendered raster over the cached one
@@ -715,6 +1017,11 @@ void Previewer::Imp::doOnRenderRasterCompleted(const RenderData &renderData) {
   it->second.m_renderedRegion += toQRect(it->second.m_rectUnderRender);
   it->second.m_rectUnderRender = TRect();
 
+  // A coarse pass still running is now useless
+  m_renderer.abortRendering(it->second.m_coarseRenderId);
+  it->second.m_coarseRenderId = (unsigned long)-1;
+  it->second.m_coarseRect     = TRect();
+
   // Update the progress bar status
   if (frame < m_pbStatus.size())
     m_pbStatus[frame] = FlipSlider::PBFrameFinished;
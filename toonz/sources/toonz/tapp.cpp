@@ -191,8 +191,13 @@ TApp::TApp()
   Preferences *preferences = Preferences::instance();
 
   if (preferences->isRasterOptimizedMemory()) {
-    if (!TBigMemoryManager::instance()->init(
-            (int)(/*15*1024*/ TSystem::getFreeMemorySize(true) * .8)))
+    // On 64-bit builds raster buffers are recycled from size classes, rather
+    // than carved out of a single preallocated block
+    if (sizeof(void *) == 8)
+      TBigMemoryManager::instance()->initPools(
+          (TUINT64)(TSystem::getFreeMemorySize(true) * .25));
+    else if (!TBigMemoryManager::instance()->init(
+                 (int)(/*15*1024*/ TSystem::getFreeMemorySize(true) * .8)))
       DVGui::warning(tr("Error allocating memory: not enough memory."));
   }
   ret = ret &&
@@ -24,6 +24,7 @@
 #include "toonz/levelproperties.h"
 #include "toonz/txshsimplelevel.h"
 #include "toonz/fill.h"
+#include "toonz/rasterpyramid.h"
 
 // Qt includes
 #include <QImage>
@@ -113,8 +114,18 @@ TImageP ImageLoader::build(int imFlags, void *extData) {
     if (data->m_icon && m_path.getType() == "tlv")
       img = ir->loadIcon();  // TODO: Why just in the tlv case??
     else {
-      ir->setShrink(subsampling);
-      img = ir->load();
+      // Large fullcolor images are better shrunk from their pyramid
+      if (subsampling > 1 && data->m_sl->getType() == OVL_XSHLEVEL) {
+        const TImageInfo *info = ir->getImageInfo();
+        if (info && RasterPyramidCache::isSuitable(m_path, *info))
+          img = RasterPyramidCache::instance()->load(m_path, m_fid,
+                                                     subsampling, enable64bit);
+      }
+
+      if (!img) {
+        ir->setShrink(subsampling);
+        img = ir->load();
+      }
     }
 
     ir->enable16BitRead(false);
@@ -339,11 +339,12 @@ TImageP ImageManager::getImage(const std::string &id, int imFlags,
   // Now, fetch the image.
   TImageP img;
 
+  // Unmodified images may have been released by the cache, and are rebuilt
   if (builder->m_cached) {
     if (modified || builder->isImageCompatible(imFlags, extData)) {
       img = TImageCache::instance()->get(id, _toBeModified);
 
-      assert(img);
+      assert(img || !modified);
       if (img) return img;
     }
   }
@@ -357,7 +358,7 @@ TImageP ImageManager::getImage(const std::string &id, int imFlags,
     if (modified || builder->isImageCompatible(imFlags, extData)) {
       img = TImageCache::instance()->get(id, _toBeModified);
 
-      assert(img);
+      assert(img || !modified);
       if (img) return img;
     }
   }
@@ -374,6 +375,9 @@ TImageP ImageManager::getImage(const std::string &id, int imFlags,
     builder->m_modified = _toBeModified;
 
     TImageCache::instance()->add(id, img, true);
+
+    // The image can be loaded again, as long as it is not modified
+    if (!_toBeModified) TImageCache::instance()->setReloadable(id, true);
   }
 
   return img;
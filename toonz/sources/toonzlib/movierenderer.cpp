@@ -25,8 +25,14 @@
 // tcg includes
 #include "tcg/tcg_macros.h"
 
+// STD includes
+#include <functional>
+
 // Qt includes
 #include <QCoreApplication>
+#include <QThread>
+#include <QWaitCondition>
+#include <QElapsedTimer>
 
 #include "toonz/movierenderer.h"
 
@@ -91,6 +97,32 @@ QString getPreviewName(unsigned long renderSessionId) {
   return "previewed" + QString::number(renderSessionId) + ".noext";
 }
 
+//---------------------------------------------------------
+
+//! Times the saving procedure, as long as any thread is saving
+struct SaveTimer {
+  int &m_count;
+  SaveTimer(int &count) : m_count(count) {
+    if (m_count++ == 0) TStopWatch::global(0).start();
+  }
+  ~SaveTimer() {
+    if (--m_count == 0) TStopWatch::global(0).stop();
+  }
+};
+
+//---------------------------------------------------------
+
+//! Runs a function in the main thread
+class MainThreadCall final : public TThread::Message {
+  std::function<void()> m_func;
+
+public:
+  MainThreadCall(const std::function<void()> &func) : m_func(func) {}
+
+  TThread::Message *clone() const override { return new MainThreadCall(*this); }
+  void onDeliver() override { m_func(); }
+};
+
 }  // namespace
 
 //**************************************************************************
@@ -119,7 +151,20 @@ public:
   ---*/
   std::map<double, bool> m_toBeAppliedGamma;
 
-  TThread::Mutex m_mutex;
+  QMutex m_mutex;
+
+  // Movie-type outputs are saved in sequence by a dedicated writer thread.
+  // m_toBeSaved is its reorder queue, bounded to m_maxQueuedFrames rendered
+  // rasters - render threads wait for room when they get too far ahead of it.
+  // Frames held from an earlier raster share it, and are not counted.
+  class Writer;
+  std::unique_ptr<Writer> m_writer;
+  QWaitCondition m_frameQueued, m_frameWritten;
+  int m_maxQueuedFrames, m_queuedRenders;
+  bool m_renderFinished;
+
+  MovieRenderer::WriterStatistics m_writerStats;
+  int m_heldFrames;
 
   int m_renderSessionId;
   long m_whiteSample;
@@ -159,15 +204,32 @@ public:
   //! frames were successfully saved, and
   //! the associated time-adjusted level frame.
   std::pair<bool, int> saveFrame(double frame,
-                                 const std::pair<TRasterP, TRasterP> &rasters);
+                                 const std::pair<TRasterP, TRasterP> &rasters,
+                                 bool applyGamma);
+  void notifySavedFrame(const std::pair<bool, int> &savedFrame);
   std::string getRenderCacheId();
 
+  bool isNextToSave(double frame) const;
+  void writeFrames();
+  void finalize();
+
   // returns board duration in frame
   int addBoard();
 };
 
 //---------------------------------------------------------
 
+//! The thread saving movie-type outputs - see writeFrames()
+class MovieRenderer::Imp::Writer final : public QThread {
+  Imp *m_imp;
+
+public:
+  Writer(Imp *imp) : m_imp(imp) {}
+  void run() override { m_imp->writeFrames(); }
+};
+
+//---------------------------------------------------------
+
 MovieRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
                         int threadCount, bool cacheResults)
     : m_scene(scene)
@@ -177,6 +239,10 @@ MovieRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
     , m_xDpi(72)
     , m_yDpi(72)
     , m_renderSessionId(RenderSessionId++)
+    , m_maxQueuedFrames(2 * std::max(threadCount, 1) + 2)
+    , m_queuedRenders(0)
+    , m_renderFinished(false)
+    , m_heldFrames(0)
     , m_nextFrameIdxToSave(0)
     , m_savingThreadsCount(0)
     , m_whiteSample(0)
@@ -296,6 +362,12 @@ void MovieRenderer::Imp::prepareForStart() {
       m_levelUpdaterA.reset();
       m_levelUpdaterB.reset();
     }
+
+    if (m_movieType && m_levelUpdaterA.get() &&
+        !m_framesToBeRendered.empty()) {
+      m_writer.reset(new Writer(this));
+      m_writer->start();
+    }
   }
 }
 
@@ -360,7 +432,8 @@ void MovieRenderer::Imp::postProcessImage(const TRasterImageP &img,
                                           const TRasterP &mark, int frame) {
   img->setDpi(m_xDpi, m_yDpi);
 
-  if (img->getRaster()->getPixelSize() == 8 && !has64bitOutputSupport) {
+  // Float rasters are converted by the writers supporting 64-bit output
+  if (img->getRaster()->getPixelSize() != 4 && !has64bitOutputSupport) {
     TRaster32P aux(img->getRaster()->getLx(), img->getRaster()->getLy());
     TRop::convert(aux, img->getRaster());
     img->setRaster(aux);
@@ -375,7 +448,8 @@ void MovieRenderer::Imp::postProcessImage(const TRasterImageP &img,
 //---------------------------------------------------------------------
 
 std::pair<bool, int> MovieRenderer::Imp::saveFrame(
-    double frame, const std::pair<TRasterP, TRasterP> &rasters) {
+    double frame, const std::pair<TRasterP, TRasterP> &rasters,
+    bool applyGamma) {
   bool success = false;
 
   // Build the frame number to write to
@@ -414,7 +488,7 @@ std::pair<bool, int> MovieRenderer::Imp::saveFrame(
     /*--- 同じラスタのキャッシュを使いまわすとき、
     最初のものだけガンマをかけ、以降はそれを使いまわすようにする。
 ---*/
-    if (m_renderSettings.m_gamma != 1.0 && m_toBeAppliedGamma[frame]) {
+    if (m_renderSettings.m_gamma != 1.0 && applyGamma) {
       TRop::gammaCorrect(rasterA, m_renderSettings.m_gamma);
       if (rasterB) TRop::gammaCorrect(rasterB, m_renderSettings.m_gamma);
     }
@@ -438,9 +512,9 @@ std::pair<bool, int> MovieRenderer::Imp::saveFrame(
       // Should no more throw from here on
 
       if (m_cacheResults) {
-        if (imgA->getRaster()->getPixelSize() == 8) {
-          // Convert 64-bit images to 32 - cached images are supposed to be
-          // 32-bit
+        if (imgA->getRaster()->getPixelSize() != 4) {
+          // Convert 64-bit and float images to 32 - cached images are
+          // supposed to be 32-bit
           TRaster32P aux(imgA->getRaster()->getLx(),
                          imgA->getRaster()->getLy());
 
@@ -496,6 +570,20 @@ void MovieRenderer::Imp::doRenderRasterCompleted(const RenderData &renderData) {
     }
   }
 
+  if (m_writer) {
+    // Wait for room in the writer's queue. The frame it waits for is always
+    // accepted - it is rendered before any later one, so this cannot lock.
+    QElapsedTimer stallTimer;
+    stallTimer.start();
+
+    while (m_queuedRenders >= m_maxQueuedFrames &&
+           !isNextToSave(renderData.m_frames[0]) && !m_failure &&
+           !m_renderer.isAborted(renderData.m_renderId))
+      m_frameWritten.wait(&m_mutex, 500);
+
+    m_writerStats.m_renderStallTime += stallTimer.elapsed();
+  }
+
   // Output frames must be *cloned*, since the supplied rasters will be
   // overwritten by m_renderer
   TRasterP toBeSavedRasA = renderData.m_rasA->clone();
@@ -515,23 +603,35 @@ void MovieRenderer::Imp::doRenderRasterCompleted(const RenderData &renderData) {
     m_toBeAppliedGamma[*jt] = false;
   }
 
-  // Attempt flushing as many frames as possible to the level updater(s)
+  // Held frames reuse the cluster's raster instead of being rendered again
+  m_heldFrames += (int)renderData.m_frames.size() - 1;
+
+  m_firstCompletedRaster = false;
+
+  if (m_writer) {
+    ++m_queuedRenders;
+    m_writerStats.m_maxQueuedFrames =
+        std::max(m_writerStats.m_maxQueuedFrames, m_queuedRenders);
+
+    m_frameQueued.wakeOne();
+    return;
+  }
+
+  // Single images can be saved concurrently, by the render threads
   while (!m_toBeSaved.empty()) {
     std::map<double, std::pair<TRasterP, TRasterP>>::iterator ft =
         m_toBeSaved.begin();
 
-    // In the *movie type* case, frames must be saved sequentially.
-    // If the frame is not the next one in the sequence, wait until *that* frame
-    // is available.
-    if (m_movieType &&
-        (ft->first != m_framesToBeRendered[m_nextFrameIdxToSave].first))
-      break;
+    // Movie types without a writer could not open their output. Failures are
+    // still reported in sequence.
+    if (m_movieType && !isNextToSave(ft->first)) break;
 
     // This thread will be the one processing ft - remove it from the map to
     // prevent another
     // thread from interfering
     double frame = ft->first;
     std::pair<TRasterP, TRasterP> rasters = ft->second;
+    bool applyGamma                       = m_toBeAppliedGamma[frame];
 
     ++m_nextFrameIdxToSave;
     m_toBeSaved.erase(ft);
@@ -539,71 +639,127 @@ void MovieRenderer::Imp::doRenderRasterCompleted(const RenderData &renderData) {
     // Save current frame
     std::pair<bool, int> savedFrame;
     {
-      // Time the saving procedure
-      struct SaveTimer {
-        int &m_count;
-        SaveTimer(int &count) : m_count(count) {
-          if (m_count++ == 0) TStopWatch::global(0).start();
-        }
-        ~SaveTimer() {
-          if (--m_count == 0) TStopWatch::global(0).stop();
-        }
-      } saveTimer(m_savingThreadsCount);
-
-      // Unlock the mutex only in case this is NOT a movie type. Single images
-      // can be saved concurrently.
-      struct MutexUnlocker {
-        QMutexLocker *m_locker;
-        ~MutexUnlocker() {
-          if (m_locker) m_locker->relock();
-        }
-      } unlocker = {m_movieType ? (QMutexLocker *)0
-                                : (locker.unlock(), &locker)};
+      SaveTimer saveTimer(m_savingThreadsCount);
 
-      savedFrame = saveFrame(frame, rasters);
+      locker.unlock();
+      savedFrame = saveFrame(frame, rasters, applyGamma);
+      locker.relock();
     }
 
-    // Report status and deal with responses
-    bool okToContinue = true;
+    notifySavedFrame(savedFrame);
+  }
+}
 
-    std::set<MovieRenderer::Listener *>::iterator lt = m_listeners.begin();
+//---------------------------------------------------------
 
-    if (savedFrame.first) {
-      for (; lt != m_listeners.end(); ++lt)
-        okToContinue &= (*lt)->onFrameCompleted(savedFrame.second);
-    } else {
-      for (; lt != m_listeners.end(); ++lt) {
-        TException e;
-        okToContinue &= (*lt)->onFrameFailed(savedFrame.second, e);
-      }
+//! Returns whether the specified frame is the next one in the saving
+//! sequence of movie-type outputs.
+bool MovieRenderer::Imp::isNextToSave(double frame) const {
+  return m_nextFrameIdxToSave < (int)m_framesToBeRendered.size() &&
+         m_framesToBeRendered[m_nextFrameIdxToSave].first == frame;
+}
+
+//---------------------------------------------------------
+
+//! Reports the outcome of a frame save to the listeners. Must be invoked with
+//! m_mutex locked.
+void MovieRenderer::Imp::notifySavedFrame(
+    const std::pair<bool, int> &savedFrame) {
+  // Report status and deal with responses
+  bool okToContinue = true;
+
+  std::set<MovieRenderer::Listener *>::iterator lt = m_listeners.begin();
+
+  if (savedFrame.first) {
+    for (; lt != m_listeners.end(); ++lt)
+      okToContinue &= (*lt)->onFrameCompleted(savedFrame.second);
+  } else {
+    for (; lt != m_listeners.end(); ++lt) {
+      TException e;
+      okToContinue &= (*lt)->onFrameFailed(savedFrame.second, e);
     }
+  }
 
-    if (!okToContinue) {
-      // Some listener invoked termination of the render procedure. It seems
-      // it's their right
-      // to do so. I wonder what happens if two listeners would disagree on the
-      // matter...
-      // BTW stop the rendering, alright.
-
-      {
-        int from, to;
-        getRange(m_scene, false, from,
-                 to);  // It's ok since cancels can only happen from Toonz...
-
-        for (int i = from; i < to; i++)
-          TImageCache::instance()->remove(m_renderCacheId +
-                                          std::to_string(i + 1));
-      }
+  if (!okToContinue) {
+    // Some listener invoked termination of the render procedure. It seems
+    // it's their right
+    // to do so. I wonder what happens if two listeners would disagree on the
+    // matter...
+    // BTW stop the rendering, alright.
 
-      m_renderer.stopRendering();
+    {
+      int from, to;
+      getRange(m_scene, false, from,
+               to);  // It's ok since cancels can only happen from Toonz...
 
-      m_levelUpdaterA
-          .reset();  // No more saving. Further attempts to save images
-      m_levelUpdaterB.reset();  // will be rejected and treated as failures.
+      for (int i = from; i < to; i++)
+        TImageCache::instance()->remove(m_renderCacheId +
+                                        std::to_string(i + 1));
     }
+
+    m_renderer.stopRendering();
+
+    m_levelUpdaterA.reset();  // No more saving. Further attempts to save images
+    m_levelUpdaterB.reset();  // will be rejected and treated as failures.
   }
+}
 
-  m_firstCompletedRaster = false;
+//---------------------------------------------------------
+
+//! The writer thread's body. Saves the movie frames in sequence as they get
+//! available, until the render finishes - then has the output finalized in
+//! the main thread.
+void MovieRenderer::Imp::writeFrames() {
+  QMutexLocker locker(&m_mutex);
+
+  for (;;) {
+    std::map<double, std::pair<TRasterP, TRasterP>>::iterator ft =
+        m_toBeSaved.begin();
+
+    if (ft == m_toBeSaved.end() || !isNextToSave(ft->first)) {
+      if (m_renderFinished) break;
+
+      QElapsedTimer stallTimer;
+      stallTimer.start();
+
+      m_frameQueued.wait(&m_mutex);
+
+      m_writerStats.m_writerStallTime += stallTimer.elapsed();
+      continue;
+    }
+
+    double frame = ft->first;
+    std::pair<TRasterP, TRasterP> rasters = ft->second;
+    bool applyGamma                       = m_toBeAppliedGamma[frame];
+
+    ++m_nextFrameIdxToSave;
+    m_toBeSaved.erase(ft);
+
+    if (applyGamma) --m_queuedRenders;
+
+    m_frameWritten.wakeAll();
+
+    // Encoding happens outside the lock, so render threads never wait for it
+    std::pair<bool, int> savedFrame;
+    {
+      SaveTimer saveTimer(m_savingThreadsCount);
+
+      locker.unlock();
+      savedFrame = saveFrame(frame, rasters, applyGamma);
+      locker.relock();
+    }
+
+    notifySavedFrame(savedFrame);
+  }
+
+  // Frames left in the queue follow a failed one, and won't be saved
+  m_toBeSaved.clear();
+  m_queuedRenders = 0;
+  m_frameWritten.wakeAll();
+
+  locker.unlock();
+
+  MainThreadCall([this]() { finalize(); }).send();
 }
 
 //---------------------------------------------------------
@@ -631,7 +787,7 @@ void MovieRenderer::Imp::doPreviewRasterCompleted(
     if (renderData.m_info.m_mark != TRasterP())
       addMark(renderData.m_info.m_mark, img);
 
-    if (img->getRaster()->getPixelSize() == 8) {
+    if (img->getRaster()->getPixelSize() != 4) {
       TRaster32P aux(img->getRaster()->getLx(), img->getRaster()->getLy());
       TRop::convert(aux, img->getRaster());
       img->setRaster(aux);
@@ -725,11 +881,32 @@ void MovieRenderer::Imp::onRenderFailure(const RenderData &renderData,
     ++m_nextFrameIdxToSave;
     m_toBeSaved.erase(it++);
   }
+
+  // Render threads waiting for room in the writer's queue give up waiting
+  m_frameWritten.wakeAll();
+  m_frameQueued.wakeOne();
 }
 
 //---------------------------------------------------------
 
 void MovieRenderer::Imp::onRenderFinished(bool isCanceled) {
+  if (m_writer) {
+    // The writer finalizes the output once the queued frames are saved
+    QMutexLocker locker(&m_mutex);
+
+    m_renderFinished = true;
+    m_frameQueued.wakeOne();
+    return;
+  }
+
+  finalize();
+}
+
+//---------------------------------------------------------
+
+void MovieRenderer::Imp::finalize() {
+  if (m_writer) m_writer->wait();
+
   TFilePath levelName(
       m_levelUpdaterA.get()
           ? m_fp
@@ -843,6 +1020,16 @@ bool MovieRenderer::isPrecomputingEnabled() const {
 
 //---------------------------------------------------------
 
+void MovieRenderer::setMaxMemory(int MB) { m_imp->m_renderer.setMaxMemory(MB); }
+
+//---------------------------------------------------------
+
+void MovieRenderer::setMaxCacheMemory(int MB) {
+  m_imp->m_renderer.setMaxCacheMemory(MB);
+}
+
+//---------------------------------------------------------
+
 void MovieRenderer::start() {
   m_imp->prepareForStart();
 
@@ -871,6 +1058,35 @@ void MovieRenderer::onCanceled() { m_imp->m_renderer.stopRendering(true); }
 
 //---------------------------------------------------------
 
+MovieRenderer::WriterStatistics MovieRenderer::getWriterStatistics() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_writerStats;
+}
+
+//---------------------------------------------------------
+
+std::string MovieRenderer::getWriterStatisticsString() const {
+  if (!m_imp->m_movieType || m_imp->m_preview) return std::string();
+
+  WriterStatistics stats = getWriterStatistics();
+
+  return "Movie writer: " + std::to_string(stats.m_maxQueuedFrames) +
+         " frames queued at most, " +
+         std::to_string(stats.m_writerStallTime) +
+         " ms waiting for frames, " +
+         std::to_string(stats.m_renderStallTime) +
+         " ms of render threads waiting for the writer";
+}
+
+//---------------------------------------------------------
+
+int MovieRenderer::getHeldFrameCount() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_heldFrames;
+}
+
+//---------------------------------------------------------
+
 TRenderer *MovieRenderer::getTRenderer() {
   // Again, this is somewhat BAD. The pointed-to object dies together with the
   // MovieRenderer instance.
@@ -59,6 +59,8 @@ public:
   bool m_precomputingEnabled;
   bool m_canceled;
 
+  int m_maxMemory, m_maxCacheMemory;
+
   int m_currentFx;
   set<double>::iterator m_currentFrame;
   TRenderer *m_currentTRenderer;
@@ -106,6 +108,8 @@ MultimediaRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
     , m_listeners()
     , m_precomputingEnabled(true)
     , m_canceled(false)
+    , m_maxMemory(0)
+    , m_maxCacheMemory(0)
     , m_currentFx(0)
     , m_currentFrame()
     , m_multimediaMode(multimediaMode) {
@@ -368,6 +372,8 @@ void MultimediaRenderer::Imp::start() {
     movieRenderer.setRenderSettings(m_renderSettings);
     movieRenderer.setDpi(m_xDpi, m_yDpi);
     movieRenderer.enablePrecomputing(m_precomputingEnabled);
+    movieRenderer.setMaxMemory(m_maxMemory);
+    movieRenderer.setMaxCacheMemory(m_maxCacheMemory);
     movieRenderer.addListener(this);
 
     for (unsigned int j = 0; j < pairsToBeRendered.size(); ++j) {
@@ -530,6 +536,16 @@ bool MultimediaRenderer::isPrecomputingEnabled() const {
 
 //---------------------------------------------------------
 
+void MultimediaRenderer::setMaxMemory(int MB) { m_imp->m_maxMemory = MB; }
+
+//---------------------------------------------------------
+
+void MultimediaRenderer::setMaxCacheMemory(int MB) {
+  m_imp->m_maxCacheMemory = MB;
+}
+
+//---------------------------------------------------------
+
 void MultimediaRenderer::start() { m_imp->start(); }
 
 //---------------------------------------------------------
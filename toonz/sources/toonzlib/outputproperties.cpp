@@ -178,7 +178,8 @@ void TOutputProperties::getFileFormatPropertiesExtensions(
 
 void TOutputProperties::setRenderSettings(
     const TRenderSettings &renderSettings) {
-  assert(renderSettings.m_bpp == 32 || renderSettings.m_bpp == 64);
+  assert(renderSettings.m_bpp == 32 || renderSettings.m_bpp == 64 ||
+         renderSettings.m_bpp == 128);
   assert(renderSettings.m_gamma > 0);
   assert(renderSettings.m_quality == TRenderSettings::StandardResampleQuality ||
          renderSettings.m_quality == TRenderSettings::ImprovedResampleQuality ||
@@ -155,6 +155,24 @@ std::string PlasticDeformerFx::getAlias(double frame,
 
 //-----------------------------------------------------------------------------------
 
+TFxHash PlasticDeformerFx::buildAliasHash(double frame,
+                                          const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  addInputsAliasHash(hasher, frame, info);
+
+  TStageObject *meshColumnObj =
+      m_xsh->getStageObject(TStageObjectId::ColumnId(m_col));
+  const PlasticSkeletonDeformationP &sd =
+      meshColumnObj->getPlasticSkeletonDeformation();
+  if (sd) hasher.add(toString(sd, meshColumnObj->paramsTime(frame)));
+
+  return hasher.result();
+}
+
+//-----------------------------------------------------------------------------------
+
 bool PlasticDeformerFx::doGetBBox(double frame, TRectD &bbox,
                                   const TRenderSettings &info) {
   if (!m_port.isConnected()) return false;
@@ -0,0 +1,567 @@
+#include "toonz/rasterpyramid.h"
+
+// TnzCore includes
+#include "tsystem.h"
+#include "tfiletype.h"
+#include "tlevel_io.h"
+#include "tcodec.h"
+#include "trop.h"
+
+// Qt includes
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QDirIterator>
+
+// STD includes
+#include <algorithm>
+
+//***************************************************************************************
+//    Local namespace  stuff
+//***************************************************************************************
+
+namespace {
+
+const quint32 sidecarMagic  = 0x52595054;  // "TPYR"
+const qint32 sidecarVersion = 2;
+
+const int maxLevelShrink = 8;
+
+// Smaller images decode quickly enough
+const TINT64 minSourceArea = 4096 * 2048;
+
+// Eviction makes room for some more sidecars, not just for the last one
+const double evictionRatio = 0.9;
+
+const char *sidecarExtension = "pyr";
+
+//-----------------------------------------------------------------------------
+
+struct SidecarHeader {
+  qint64 m_sourceSize, m_sourceTime;
+  qint32 m_lx, m_ly;
+  double m_dpix, m_dpiy;
+
+  // Shrink factor and compressed size of each level, in file order
+  std::vector<std::pair<qint32, quint32>> m_levels;
+};
+
+QDataStream &operator<<(QDataStream &ds, const SidecarHeader &h) {
+  ds << sidecarMagic << sidecarVersion << h.m_sourceSize << h.m_sourceTime
+     << h.m_lx << h.m_ly << h.m_dpix << h.m_dpiy << (qint32)h.m_levels.size();
+
+  for (const auto &level : h.m_levels) ds << level.first << level.second;
+
+  return ds;
+}
+
+bool readHeader(QDataStream &ds, SidecarHeader &h) {
+  quint32 magic;
+  qint32 version, levelsCount;
+
+  ds >> magic >> version;
+  if (magic != sidecarMagic || version != sidecarVersion) return false;
+
+  ds >> h.m_sourceSize >> h.m_sourceTime >> h.m_lx >> h.m_ly >> h.m_dpix >>
+      h.m_dpiy >> levelsCount;
+  if (ds.status() != QDataStream::Ok || levelsCount < 0 || levelsCount > 8)
+    return false;
+
+  h.m_levels.resize(levelsCount);
+  for (auto &level : h.m_levels) ds >> level.first >> level.second;
+
+  return ds.status() == QDataStream::Ok;
+}
+
+//-----------------------------------------------------------------------------
+
+//! Box-filters \b src into \b dst, which is half its size rounded up
+template <typename PIXEL>
+void halve(const TRasterPT<PIXEL> &src, const TRasterPT<PIXEL> &dst) {
+  typedef typename PIXEL::Channel Channel;
+
+  int lx = src->getLx(), ly = src->getLy();
+
+  for (int y = 0; y < dst->getLy(); ++y) {
+    const PIXEL *row0 = src->pixels(2 * y);
+    const PIXEL *row1 = src->pixels(std::min(2 * y + 1, ly - 1));
+    PIXEL *pix        = dst->pixels(y);
+
+    for (int x = 0; x < dst->getLx(); ++x, ++pix) {
+      int x0 = 2 * x, x1 = std::min(x0 + 1, lx - 1);
+
+      const PIXEL &a = row0[x0], &b = row0[x1], &c = row1[x0], &d = row1[x1];
+
+      pix->r = (Channel)((a.r + b.r + c.r + d.r + 2) >> 2);
+      pix->g = (Channel)((a.g + b.g + c.g + d.g + 2) >> 2);
+      pix->b = (Channel)((a.b + b.b + c.b + d.b + 2) >> 2);
+      pix->m = (Channel)((a.m + b.m + c.m + d.m + 2) >> 2);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+TRasterP halve(const TRasterP &ras) {
+  TDimension size((ras->getLx() + 1) / 2, (ras->getLy() + 1) / 2);
+
+  TRasterP result = ras->create(size.lx, size.ly);
+
+  ras->lock(), result->lock();
+
+  if (TRaster32P ras32 = ras)
+    halve<TPixel32>(ras32, result);
+  else if (TRaster64P ras64 = ras)
+    halve<TPixel64>(ras64, result);
+
+  result->unlock(), ras->unlock();
+
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+
+//! Takes one pixel every \b shrink, as TImageReader does
+TRasterP subsample(const TRasterP &ras, int shrink) {
+  TRasterP result = ras->create((ras->getLx() - 1) / shrink + 1,
+                                (ras->getLy() - 1) / shrink + 1);
+
+  int pixelSize = ras->getPixelSize();
+
+  ras->lock(), result->lock();
+
+  for (int y = 0; y < result->getLy(); ++y) {
+    const UCHAR *src = ras->getRawData(0, y * shrink);
+    UCHAR *dst       = result->getRawData(0, y);
+
+    for (int x = 0; x < result->getLx(); ++x) {
+      memcpy(dst, src, pixelSize);
+      src += shrink * pixelSize, dst += pixelSize;
+    }
+  }
+
+  result->unlock(), ras->unlock();
+
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+
+//! Returns the file actually holding the specified frame
+TFilePath getFramePath(const TFilePath &levelPath, const TFrameId &fid) {
+  return levelPath.isLevelName() ? levelPath.withFrame(fid) : levelPath;
+}
+
+}  // namespace
+
+//***************************************************************************************
+//    RasterPyramidCache  implementation
+//***************************************************************************************
+
+RasterPyramidCache::RasterPyramidCache() : m_maxSize(0), m_size(0) {}
+
+//-----------------------------------------------------------------------------
+
+RasterPyramidCache *RasterPyramidCache::instance() {
+  static RasterPyramidCache theInstance;
+  return &theInstance;
+}
+
+//-----------------------------------------------------------------------------
+
+void RasterPyramidCache::setRootDir(const TFilePath &rootDir) {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_rootDir = rootDir;
+  }
+
+  updateSize();
+}
+
+//-----------------------------------------------------------------------------
+
+TFilePath RasterPyramidCache::getRootDir() const {
+  QMutexLocker locker(&m_mutex);
+  return m_rootDir;
+}
+
+//-----------------------------------------------------------------------------
+
+void RasterPyramidCache::setMaximumSize(int MB) {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_maxSize = std::max(MB, 0) * (TINT64)(1 << 20);
+  }
+
+  updateSize();
+}
+
+//-----------------------------------------------------------------------------
+
+int RasterPyramidCache::getMaximumSize() const {
+  QMutexLocker locker(&m_mutex);
+  return (int)(m_maxSize >> 20);
+}
+
+//-----------------------------------------------------------------------------
+
+bool RasterPyramidCache::isEnabled() const {
+  QMutexLocker locker(&m_mutex);
+  return !m_rootDir.isEmpty() && m_maxSize > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+int RasterPyramidCache::levelShrink(int shrink) {
+  int level = 1;
+  while (level < maxLevelShrink && shrink % (2 * level) == 0) level *= 2;
+
+  return level;
+}
+
+//-----------------------------------------------------------------------------
+
+bool RasterPyramidCache::isSuitable(const TFilePath &levelPath,
+                                    const TImageInfo &info) {
+  // Movies and layered files address frames in their own way
+  std::string type = levelPath.getType();
+  if (TFileType::getInfoFromExtension(type) != TFileType::RASTER_IMAGE ||
+      type == "psd")
+    return false;
+
+  return (TINT64)info.m_lx * info.m_ly >= minSourceArea;
+}
+
+//-----------------------------------------------------------------------------
+
+TFilePath RasterPyramidCache::getSidecarPath(const TFilePath &framePath,
+                                             bool is64bit) const {
+  QByteArray hash = QCryptographicHash::hash(framePath.getQString().toUtf8(),
+                                             QCryptographicHash::Md5)
+                        .toHex();
+
+  std::string name = hash.toStdString();
+  if (is64bit) name += "_64";
+
+  return getRootDir() + TFilePath(name + "." + sidecarExtension);
+}
+
+//-----------------------------------------------------------------------------
+
+void RasterPyramidCache::updateSize() {
+  TFilePath rootDir = getRootDir();
+
+  TINT64 size = 0;
+
+  if (!rootDir.isEmpty()) {
+    QDirIterator it(rootDir.getQString(),
+                    QStringList() << QString("*.") + sidecarExtension,
+                    QDir::Files);
+    while (it.hasNext()) {
+      it.next();
+      size += it.fileInfo().size();
+    }
+  }
+
+  bool overflow;
+  {
+    QMutexLocker locker(&m_mutex);
+
+    m_size   = size;
+    overflow = (m_maxSize > 0 && m_size > m_maxSize);
+  }
+
+  if (overflow) evict();
+}
+
+//-----------------------------------------------------------------------------
+
+//! Removes the least recently built sidecars, until the folder is back below
+//! its maximum size
+void RasterPyramidCache::evict() {
+  TFilePath rootDir;
+  TINT64 maxSize;
+  {
+    QMutexLocker locker(&m_mutex);
+    rootDir = m_rootDir;
+    maxSize = m_maxSize;
+  }
+
+  if (rootDir.isEmpty()) return;
+
+  struct Sidecar {
+    qint64 m_time, m_size;
+    QString m_path;
+
+    bool operator<(const Sidecar &other) const {
+      return m_time < other.m_time;
+    }
+  };
+
+  // Rescan the folder - other processes may be writing in it too
+  std::vector<Sidecar> sidecars;
+  TINT64 size = 0;
+
+  QDirIterator it(rootDir.getQString(),
+                  QStringList() << QString("*.") + sidecarExtension,
+                  QDir::Files);
+  while (it.hasNext()) {
+    Sidecar sidecar;
+    sidecar.m_path = it.next();
+    sidecar.m_size = it.fileInfo().size();
+    sidecar.m_time = it.fileInfo().lastModified().toMSecsSinceEpoch();
+
+    size += sidecar.m_size;
+    sidecars.push_back(sidecar);
+  }
+
+  std::sort(sidecars.begin(), sidecars.end());
+
+  TINT64 targetSize = (TINT64)(maxSize * evictionRatio);
+
+  for (const Sidecar &sidecar : sidecars) {
+    if (size <= targetSize) break;
+
+    // Another process may have removed it already
+    QFile::remove(sidecar.m_path);
+    size -= sidecar.m_size;
+  }
+
+  QMutexLocker locker(&m_mutex);
+  m_size = size;
+}
+
+//-----------------------------------------------------------------------------
+
+bool RasterPyramidCache::hasLevel(const TFilePath &levelPath,
+                                  const TFrameId &fid, int shrink,
+                                  bool is64bit) const {
+  int level = levelShrink(shrink);
+  if (level == 1 || !isEnabled()) return false;
+
+  TFilePath framePath = getFramePath(levelPath, fid);
+
+  QFileInfo sourceInfo(framePath.getQString());
+  if (!sourceInfo.exists()) return false;
+
+  QFile file(getSidecarPath(framePath, is64bit).getQString());
+  if (!file.open(QIODevice::ReadOnly)) return false;
+
+  QDataStream ds(&file);
+
+  SidecarHeader header;
+  if (!readHeader(ds, header) || header.m_sourceSize != sourceInfo.size() ||
+      header.m_sourceTime != sourceInfo.lastModified().toMSecsSinceEpoch())
+    return false;
+
+  for (const auto &entry : header.m_levels)
+    if (entry.first == level) return true;
+
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+
+TRasterP RasterPyramidCache::shrink(const TRasterP &ras, int level) {
+  TRasterP result = ras;
+
+  if (!TRaster32P(result) && !TRaster64P(result)) {
+    TRaster32P ras32(ras->getSize());
+    TRop::convert(ras32, ras);
+    result = ras32;
+  }
+
+  for (int f = 2; f <= level; f *= 2) result = halve(result);
+
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+
+TRasterImageP RasterPyramidCache::load(const TFilePath &levelPath,
+                                       const TFrameId &fid, int shrink,
+                                       bool is64bit) {
+  int level = levelShrink(shrink);
+  if (level == 1 || !isEnabled()) return TRasterImageP();
+
+  TFilePath framePath = getFramePath(levelPath, fid);
+
+  QFileInfo sourceInfo(framePath.getQString());
+  if (!sourceInfo.exists()) return TRasterImageP();
+
+  qint64 sourceSize = sourceInfo.size(),
+         sourceTime = sourceInfo.lastModified().toMSecsSinceEpoch();
+
+  TFilePath sidecarPath = getSidecarPath(framePath, is64bit);
+
+  // Reads the requested level from the sidecar, if up to date
+  auto readLevel = [&]() -> TRasterImageP {
+    QFile file(sidecarPath.getQString());
+    if (!file.open(QIODevice::ReadOnly)) return TRasterImageP();
+
+    QDataStream ds(&file);
+
+    SidecarHeader header;
+    if (!readHeader(ds, header) || header.m_sourceSize != sourceSize ||
+        header.m_sourceTime != sourceTime)
+      return TRasterImageP();
+
+    for (const auto &entry : header.m_levels) {
+      if (entry.first != level) {
+        if (ds.skipRawData(entry.second) != (int)entry.second) break;
+        continue;
+      }
+
+      QByteArray data(entry.second, Qt::Uninitialized);
+      if (ds.readRawData(data.data(), data.size()) != data.size()) break;
+
+      TRasterP ras;
+      TRasterCodecLz4 codec("LZ4", false);
+      try {
+        if (!codec.decompress((const UCHAR *)data.constData(), data.size(),
+                              ras, true))
+          break;
+      } catch (...) {
+        break;
+      }
+
+      if (!TRaster32P(ras) && !(is64bit && TRaster64P(ras))) break;
+
+      if (shrink > level) ras = subsample(ras, shrink / level);
+
+      TRasterImageP ri(ras);
+      ri->setDpi(header.m_dpix, header.m_dpiy);
+
+      return ri;
+    }
+
+    return TRasterImageP();
+  };
+
+  TRasterImageP ri = readLevel();
+  if (ri) return ri;
+
+  // Build the sidecar. Concurrent requests for the same one wait here, and
+  // find it ready - while different sidecars are built in parallel.
+  QString sidecarKey = sidecarPath.getQString();
+  {
+    QMutexLocker locker(&m_mutex);
+
+    while (m_building.count(sidecarKey)) m_buildDone.wait(&m_mutex);
+    m_building.insert(sidecarKey);
+  }
+
+  struct BuildLocker {
+    RasterPyramidCache *m_cache;
+    QString m_key;
+
+    ~BuildLocker() {
+      QMutexLocker locker(&m_cache->m_mutex);
+
+      m_cache->m_building.erase(m_key);
+      m_cache->m_buildDone.wakeAll();
+    }
+  } buildLocker = {this, sidecarKey};
+
+  ri = readLevel();
+  if (ri) return ri;
+
+  qint64 sidecarSize = 0, replacedSize = QFileInfo(sidecarKey).size();
+
+  try {
+    TLevelReaderP lr(levelPath);
+    if (!lr) return TRasterImageP();
+
+    TImageReaderP ir = lr->getFrameReader(fid);
+    if (!ir) return TRasterImageP();
+
+    const TImageInfo *info = ir->getImageInfo();
+    if (!info || !isSuitable(levelPath, *info)) return TRasterImageP();
+
+    ir->enable16BitRead(is64bit);
+
+    TRasterImageP source = ir->load();
+    if (!source) return TRasterImageP();
+
+    SidecarHeader header;
+    header.m_sourceSize = sourceSize;
+    header.m_sourceTime = sourceTime;
+    source->getDpi(header.m_dpix, header.m_dpiy);
+
+    TRasterP ras = source->getRaster();
+    source       = TRasterImageP();
+
+    // Pyramids keep 64-bit pixels only when the caller accepts them
+    if (!TRaster32P(ras) && !(is64bit && TRaster64P(ras))) {
+      TRaster32P ras32(ras->getSize());
+      TRop::convert(ras32, ras);
+      ras = ras32;
+    }
+
+    header.m_lx = ras->getLx();
+    header.m_ly = ras->getLy();
+
+    std::vector<TRasterP> compressed;
+    TRasterCodecLz4 codec("LZ4", false);
+
+    TRasterP levelRas = ras;
+    for (int f = 2; f <= maxLevelShrink; f *= 2) {
+      levelRas = halve(levelRas);
+
+      TINT32 dataSize;
+      TRasterP data = codec.compress(levelRas, 1, dataSize);
+      if (!data) return TRasterImageP();
+
+      compressed.push_back(data);
+      header.m_levels.push_back(std::make_pair((qint32)f, (quint32)dataSize));
+
+      if (f == level) {
+        ri = TRasterImageP(shrink > level ? subsample(levelRas, shrink / level)
+                                          : levelRas);
+        ri->setDpi(header.m_dpix, header.m_dpiy);
+      }
+    }
+
+    // Write to a temporary file first, so readers never see partial sidecars
+    TSystem::touchParentDir(sidecarPath);
+
+    QSaveFile file(sidecarPath.getQString());
+    if (file.open(QIODevice::WriteOnly)) {
+      QDataStream ds(&file);
+      ds << header;
+
+      for (size_t i = 0; i != compressed.size(); ++i) {
+        compressed[i]->lock();
+        ds.writeRawData((const char *)compressed[i]->getRawData(),
+                        header.m_levels[i].second);
+        compressed[i]->unlock();
+      }
+
+      if (ds.status() != QDataStream::Ok)
+        file.cancelWriting();
+      else {
+        qint64 size = file.size();
+        if (file.commit()) sidecarSize = size;
+      }
+    }
+  } catch (...) {
+    return TRasterImageP();
+  }
+
+  if (sidecarSize > 0) {
+    bool overflow;
+    {
+      QMutexLocker locker(&m_mutex);
+
+      m_size += sidecarSize - replacedSize;
+      overflow = (m_size > m_maxSize);
+    }
+
+    if (overflow) evict();
+  }
+
+  return ri;
+}
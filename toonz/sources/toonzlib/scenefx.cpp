@@ -96,6 +96,8 @@ public:
   bool canHandle(const TRenderSettings &info, double frame) override {
     return true;
   }
+  bool canComputeInFloat() const override { return true; }
+  bool handlesSparseTiles() const override { return true; }
 
   std::string getPluginId() const override { return std::string(); }
 
@@ -122,6 +124,11 @@ public:
     return TRasterFx::getAlias(m_frame, info);
   }
 
+  TFxHash buildAliasHash(double frame,
+                         const TRenderSettings &info) const override {
+    return TRasterFx::buildAliasHash(m_frame, info);
+  }
+
   void doDryCompute(TRectD &rect, double frame,
                     const TRenderSettings &info) override {
     if (m_port.isConnected())
@@ -202,6 +202,8 @@ void TSceneProperties::saveData(TOStream &os) const {
     os.child("multimedia") << out.getMultimediaRendering();
     os.child("threadsIndex") << out.getThreadIndex();
     os.child("maxTileSizeIndex") << out.getMaxTileSizeIndex();
+    os.child("subTileSize") << rs.m_subTileSize;
+    os.child("cpuVectorRasterizer") << (rs.m_cpuVectorRasterizer ? 1 : 0);
     os.child("subcameraPrev") << (out.isSubcameraPreview() ? 1 : 0);
     os.child("stereoscopic") << (rs.m_stereoscopic ? 1 : 0)
                              << rs.m_stereoscopicShift;
@@ -488,7 +490,7 @@ void TSceneProperties::loadData(TIStream &is, bool isLoadingProject) {
             } else if (tagName == "bpp") {
               int j;
               is >> j;
-              if (j == 32 || j == 64) renderSettings.m_bpp = j;
+              if (j == 32 || j == 64 || j == 128) renderSettings.m_bpp = j;
             } else if (tagName == "multimedia") {
               int j;
               is >> j;
@@ -501,6 +503,14 @@ void TSceneProperties::loadData(TIStream &is, bool isLoadingProject) {
               int j;
               is >> j;
               out.setMaxTileSizeIndex(j);
+            } else if (tagName == "subTileSize") {
+              int j;
+              is >> j;
+              if (j >= 0) renderSettings.m_subTileSize = j;
+            } else if (tagName == "cpuVectorRasterizer") {
+              int j;
+              is >> j;
+              renderSettings.m_cpuVectorRasterizer = (j != 0);
             } else if (tagName == "subcameraPrev") {
               int j;
               is >> j;
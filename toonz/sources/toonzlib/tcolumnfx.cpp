@@ -15,6 +15,8 @@
 #include "tropcm.h"
 #include "tofflinegl.h"
 #include "tvectorrenderdata.h"
+#include "tvectorrasterizer.h"
+#include "tsparseraster.h"
 
 // TnzBase includes
 #include "ttzpimagefx.h"
@@ -48,6 +50,7 @@
 #include "toonz/tvectorimageutils.h"
 #include "toonz/preferences.h"
 #include "toonz/dpiscale.h"
+#include "toonz/rasterpyramid.h"
 #include "imagebuilders.h"
 
 // 4.6 compatibility - sandor fxs
@@ -58,6 +61,10 @@ extern "C" {
 #include "sandor_fxs/patternmap.h"
 }
 
+// Qt includes
+#include <QFileInfo>
+#include <QDateTime>
+
 #include "toonz/tcolumnfx.h"
 
 //****************************************************************************************
@@ -176,6 +183,40 @@ std::string getAlias(TXsheet *xsh, double frame, const TRenderSettings &info) {
   return alias;
 }
 
+//-------------------------------------------------------------------
+
+TFxHash getAliasHash(TXsheet *xsh, double frame, const TRenderSettings &info) {
+  TFxSet *fxs = xsh->getFxDag()->getTerminalFxs();
+  TFxHasher hasher;
+
+  // Add the hash for each
+  for (int i = 0; i < fxs->getFxCount(); ++i) {
+    TRasterFx *fx = dynamic_cast<TRasterFx *>(fxs->getFx(i));
+    assert(fx);
+    if (!fx) continue;
+
+    hasher.add(fx->getAliasHash(frame, info));
+  }
+
+  return hasher.result();
+}
+
+//-------------------------------------------------------------------
+
+//! Adds the modification time and size of the specified file. Alias hashes
+//! may key caches which outlive the session, and must change when a new
+//! version of an input file is saved. Missing files make the hash volatile.
+void addFileStamp(TFxHasher &hasher, const TFilePath &fp) {
+  QFileInfo fileInfo(fp.getQString());
+  if (!fileInfo.exists()) {
+    hasher.setVolatile();
+    return;
+  }
+
+  hasher.add((TUINT64)fileInfo.lastModified().toMSecsSinceEpoch())
+      .add((TUINT64)fileInfo.size());
+}
+
 }  // namespace
 
 //****************************************************************************************
@@ -794,6 +835,114 @@ public:
   }
 };
 
+//****************************************************************************************
+//    Region loading
+//****************************************************************************************
+
+namespace {
+
+// Plates below this area are always loaded whole
+const TINT64 regionLoadMinArea = 4096 * 4096;
+
+//! Loads only the part of a large fullcolor plate that lies under the
+//! specified tile, so that rendering a small window of a huge scan does not
+//! decode all of it. Returns a null image when the whole frame has to be
+//! loaded instead; otherwise \b region receives the loaded image rect.
+TRasterImageP loadTileRegion(TXshSimpleLevel *sl, const TFrameId &fid,
+                             const TImageInfo &imageInfo, const TTile &tile,
+                             const TRenderSettings &info, TRect &region) {
+  if (sl->getType() != OVL_XSHLEVEL || !info.m_affine.isTranslation())
+    return TRasterImageP();
+
+  // Formats whose readers implement Tiio::Reader::readRegion()
+  std::string type = sl->getPath().getType();
+  if (type != "tif" && type != "tiff" && type != "png" && type != "jpg" &&
+      type != "jpeg")
+    return TRasterImageP();
+
+  // These need the whole image
+  if (TXshSimpleLevel::m_fillFullColorRaster ||
+      sl->getProperties()->antialiasSoftness() > 0)
+    return TRasterImageP();
+
+  int lx = imageInfo.m_lx, ly = imageInfo.m_ly;
+  if ((TINT64)lx * ly < regionLoadMinArea) return TRasterImageP();
+
+  // Edited images live in memory only
+  if (ImageManager::instance()->isModified(sl->getImageId(fid)))
+    return TRasterImageP();
+
+  // Place the tile in the image's reference, with some margin for the
+  // resampling done downstream
+  TRect tileBounds(tile.getRaster()->getBounds());
+  TRectD tileRectD = TRectD(tileBounds.x0, tileBounds.y0, tileBounds.x1 + 1,
+                            tileBounds.y1 + 1) +
+                     tile.m_pos +
+                     TPointD(lx / 2.0 - info.m_affine.a13,
+                             ly / 2.0 - info.m_affine.a23);
+
+  region = TRect(tfloor(tileRectD.x0) - 2, tfloor(tileRectD.y0) - 2,
+                 tceil(tileRectD.x1) + 1, tceil(tileRectD.y1) + 1) *
+           TRect(0, 0, lx - 1, ly - 1);
+
+  if (region.getLx() < 2 || region.getLy() < 2 ||
+      4 * (TINT64)region.getLx() * region.getLy() > (TINT64)lx * ly)
+    return TRasterImageP();
+
+  try {
+    TLevelReaderP lr(sl->getScene()->decodeFilePath(sl->getPath()));
+    TImageReaderP ir = lr->getFrameReader(fid);
+    if (!ir) return TRasterImageP();
+
+    ir->enable16BitRead(info.m_bpp == 64);
+    ir->setRegion(region);
+
+    TRasterImageP ri = ir->load();
+    if (ri && ri->getRaster()->getSize() == region.getSize()) return ri;
+  } catch (...) {
+  }
+
+  return TRasterImageP();
+}
+
+//-------------------------------------------------------------------
+
+//! Returns the pyramid level (see RasterPyramidCache) which can stand in for
+//! the specified frame under the given affine, or 1 if the frame has to be
+//! rendered at full resolution. Only levels already stored are returned -
+//! the others are left to the filtered resampling of the full image.
+int getPyramidLevel(TXshSimpleLevel *sl, const TFrameId &fid,
+                    const TImageInfo &imageInfo, const TAffine &aff,
+                    bool is64bit) {
+  RasterPyramidCache *pyramids = RasterPyramidCache::instance();
+
+  if (!pyramids->isEnabled() || sl->getType() != OVL_XSHLEVEL ||
+      !RasterPyramidCache::isSuitable(sl->getPath(), imageInfo))
+    return 1;
+
+  // These need the whole image
+  if (TXshSimpleLevel::m_fillFullColorRaster ||
+      sl->getProperties()->antialiasSoftness() > 0)
+    return 1;
+
+  // Edited images live in memory only
+  if (ImageManager::instance()->isModified(sl->getImageId(fid))) return 1;
+
+  // Take the largest level which is not smaller than the output
+  double scale = sqrt(fabs(aff.det()));
+
+  int level = 1;
+  while (2 * level * scale <= 1.0 + TConsts::epsilon) level *= 2;
+
+  level = RasterPyramidCache::levelShrink(level);
+  if (level == 1) return 1;
+
+  TFilePath path(sl->getScene()->decodeFilePath(sl->getPath()));
+  return pyramids->hasLevel(path, fid, level, is64bit) ? level : 1;
+}
+
+}  // namespace
+
 //****************************************************************************************
 //    TLevelColumnFx  implementation
 //****************************************************************************************
@@ -852,8 +1001,19 @@ TAffine TLevelColumnFx::handledAffine(const TRenderSettings &info,
   TPointD pixelsOrigin(-0.5 * imageInfo.m_lx, -0.5 * imageInfo.m_ly);
 
   const TAffine &aff = info.m_affine;
-  if (aff.a11 != 1.0 || aff.a22 != 1.0 || aff.a12 != 0.0 || aff.a21 != 0.0)
+  if (aff.a11 != 1.0 || aff.a22 != 1.0 || aff.a12 != 0.0 || aff.a21 != 0.0) {
+    // Reductions are rendered from the frame's pyramid, when available
+    TXshCell frameCell = m_levelColumn->getCell((int)frame);
+    int level          = frameCell.getSimpleLevel() == sl
+                    ? getPyramidLevel(sl, frameCell.m_frameId, imageInfo,
+                                      aff, info.m_bpp == 64)
+                    : 1;
+    if (level > 1)
+      return TTranslation(-pixelsOrigin * (1.0 / level)) *
+             TScale(1.0 / level);
+
     return TTranslation(-pixelsOrigin);
+  }
 
   // This is a translation, ok. Just ensure it is consistent.
   TAffine consistentAff(aff);
@@ -930,6 +1090,9 @@ void TLevelColumnFx::doDryCompute(TRectD &rect, double frame,
   // correct resolution. Caching is disabled in such case, at the moment.
   if (sl->getType() == PLI_XSHLEVEL) return;
 
+  // Pyramid levels are loaded directly, see doCompute()
+  if (!info.m_affine.isTranslation()) return;
+
   int renderStatus =
       TRenderer::instance().getRenderStatus(TRenderer::renderId());
 
@@ -981,19 +1144,65 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
   TImageP img;
   TImageInfo imageInfo;
 
+  // The loaded image rect, when only a region of the image was loaded
+  TRect region;
+
+  // The shrink factor of the loaded image, when taken from its pyramid
+  int pyramidLevel = 1;
+
   // Now, fetch the image
   if (sl->getType() != PLI_XSHLEVEL) {
     // Raster case
-    LevelFxBuilder builder(getAlias(frame, TRenderSettings()) + "_image", frame,
-                           info, sl, fid);
-
     getImageInfo(imageInfo, sl, fid);
-    TRectD imgRect(0, 0, imageInfo.m_lx, imageInfo.m_ly);
 
-    builder.setRasBounds(TRect(0, 0, imageInfo.m_lx - 1, imageInfo.m_ly - 1));
-    builder.build(imgRect);
+    if (!info.m_affine.isTranslation()) {
+      // The handled affine is a reduction, served by the image's pyramid
+      // (see handledAffine())
+      pyramidLevel = tround(1.0 / info.m_affine.a11);
+      img          = RasterPyramidCache::instance()->load(
+          sl->getScene()->decodeFilePath(sl->getPath()), fid, pyramidLevel,
+          info.m_bpp == 64);
+
+      if (!img) {
+        // The sidecar was removed in the meantime - shrink the full image
+        // the same way
+        LevelFxBuilder builder(getAlias(frame, TRenderSettings()) + "_image",
+                               frame, info, sl, fid);
+
+        TRectD imgRect(0, 0, imageInfo.m_lx, imageInfo.m_ly);
+
+        builder.setRasBounds(
+            TRect(0, 0, imageInfo.m_lx - 1, imageInfo.m_ly - 1));
+        builder.build(imgRect);
+
+        if (TRasterImageP ri = builder.getImage()) {
+          double dpix, dpiy;
+          ri->getDpi(dpix, dpiy);
+
+          TRasterImageP shrunk(
+              RasterPyramidCache::shrink(ri->getRaster(), pyramidLevel));
+          shrunk->setDpi(dpix, dpiy);
+          img = shrunk;
+        }
+      }
+    } else {
+      img = loadTileRegion(sl, fid, imageInfo, tile, info, region);
+
+      if (!img) {
+        region = TRect();
 
-    img = builder.getImage();
+        LevelFxBuilder builder(getAlias(frame, TRenderSettings()) + "_image",
+                               frame, info, sl, fid);
+
+        TRectD imgRect(0, 0, imageInfo.m_lx, imageInfo.m_ly);
+
+        builder.setRasBounds(
+            TRect(0, 0, imageInfo.m_lx - 1, imageInfo.m_ly - 1));
+        builder.build(imgRect);
+
+        img = builder.getImage();
+      }
+    }
   } else {
     // Vector case (loading is immediate)
     if (!img) {
@@ -1022,7 +1231,6 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
       // Deal separately
       applyTzpFxsOnVector(vectorImage, tile, frame, info);
     } else {
-      QMutexLocker m(&m_mutex);
       bBox = info.m_affine * vectorImage->getBBox();
       TDimension size(tile.getRaster()->getSize());
 
@@ -1033,12 +1241,49 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
       applyCmappedFx(vectorImage, info.m_data, (int)frame);
       TPalette *vpalette = vectorImage->getPalette();
       assert(vpalette);
-      m_isCachable = !vpalette->isAnimated();
-      int oldFrame = vpalette->getFrame();
+      bool isAnimated = vpalette->isAnimated();
+      {
+        QMutexLocker m(&m_mutex);
+        m_isCachable = !isAnimated;
+      }
 
       TVectorRenderData rd(TVectorRenderData::ProductionSettings(), aff,
                            TRect(size), vpalette);
 
+      if (info.m_cpuVectorRasterizer) {
+        // The rasterizer reads the style colors at construction. The palette
+        // frame is switched and restored within the palette lock, against
+        // concurrent TPalette::setFrame.
+        vpalette->mutex()->lock();
+
+        int oldFrame = vpalette->getFrame();
+        vpalette->setFrame((int)frame);
+        TVectorRasterizer rasterizer(vectorImage.getPointer(), rd);
+        vpalette->setFrame(oldFrame);
+
+        vpalette->mutex()->unlock();
+
+        if (rasterizer.isSupported()) {
+          // Render on the CPU, concurrently with the other render threads
+          tile.getRaster()->clear();
+          rasterizer.rasterize(tile.getRaster());
+
+          // The tiles no shape touches stay empty
+          std::vector<TRect> bboxes;
+          rasterizer.getBBoxes(bboxes);
+
+          TSparseRaster sparseRas(tile.getRaster(), true);
+          for (const TRect &bbox : bboxes)
+            sparseRas.setFilled(bbox.enlarge(1));
+          tile.setEmptyTiles(sparseRas);
+          return;
+        }
+      }
+
+      // OpenGL rendering, by default and for the styles the rasterizer does
+      // not support
+      QMutexLocker m(&m_mutex);
+
       if (!m_offlineContext || m_offlineContext->getLx() < size.lx ||
           m_offlineContext->getLy() < size.ly) {
         if (m_offlineContext) delete m_offlineContext;
@@ -1048,16 +1293,16 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
       m_offlineContext->makeCurrent();
       m_offlineContext->clear(TPixel32(0, 0, 0, 0));
 
-      // If level has animated palette, it is necessary to lock palette's color
-      // against
-      // concurrents TPalette::setFrame.
-      if (!m_isCachable) vpalette->mutex()->lock();
+      // The palette's colors are locked against concurrent TPalette::setFrame
+      // - other columns may share it
+      vpalette->mutex()->lock();
 
+      int oldFrame = vpalette->getFrame();
       vpalette->setFrame((int)frame);
       m_offlineContext->draw(vectorImage, rd, true);
       vpalette->setFrame(oldFrame);
 
-      if (!m_isCachable) vpalette->mutex()->unlock();
+      vpalette->mutex()->unlock();
 
       m_offlineContext->getRaster(tile.getRaster());
 
@@ -1173,13 +1418,23 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
     }
 
     if (ras) {
-      double lx_2 = ras->getLx() / 2.0;
-      double ly_2 = ras->getLy() / 2.0;
+      // Region and pyramid rasters are still centered on the whole image
+      double lx_2 = (region.isEmpty() && pyramidLevel == 1)
+                        ? ras->getLx() / 2.0
+                        : imageInfo.m_lx / (2.0 * pyramidLevel);
+      double ly_2 = (region.isEmpty() && pyramidLevel == 1)
+                        ? ras->getLy() / 2.0
+                        : imageInfo.m_ly / (2.0 * pyramidLevel);
 
       TRenderSettings infoAux(info);
-      assert(info.m_affine.isTranslation());
       infoAux.m_data.clear();
 
+      // The pyramid level already applies the affine's scale
+      if (pyramidLevel > 1)
+        infoAux.m_affine =
+            TTranslation(info.m_affine.a13, info.m_affine.a23);
+      assert(infoAux.m_affine.isTranslation());
+
       // Place the output rect in the image's reference
       tileRectD += TPointD(lx_2 - info.m_affine.a13, ly_2 - info.m_affine.a23);
 
@@ -1191,6 +1446,7 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
             TRectD(saveBox.x0, saveBox.y0, saveBox.x1 + 1, saveBox.y1 + 1);
       } else {
         TRect rasBounds(ras->getBounds());
+        if (!region.isEmpty()) rasBounds += region.getP00();
         inTileRectD = TRectD(rasBounds.x0, rasBounds.y0, rasBounds.x1 + 1,
                              rasBounds.y1 + 1);
       }
@@ -1205,6 +1461,7 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
       // Output that intersection in the requested tile
       TRect inTileRect(tround(inTileRectD.x0), tround(inTileRectD.y0),
                        tround(inTileRectD.x1) - 1, tround(inTileRectD.y1) - 1);
+      if (!region.isEmpty()) inTileRect -= region.getP00();
       TTile inTile(ras->extract(inTileRect),
                    inTileRectD.getP00() + TPointD(-lx_2, -ly_2));
 
@@ -1231,6 +1488,19 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
       }
 
       TRasterFx::applyAffine(tile, inTile, infoAux);
+
+      // The tiles coming from empty areas of the image are empty, too
+      TSparseRaster inSparseRas(TSparseRaster::fromDense(inTile.getRaster()));
+      if (inSparseRas.hasEmptyTiles()) {
+        TPointD inPos(inTile.m_pos - tile.m_pos +
+                      TPointD(infoAux.m_affine.a13, infoAux.m_affine.a23));
+
+        // Fractional placements resample the image, spreading its pixels
+        TSparseRaster sparseRas(tile.getRaster());
+        sparseRas.copyEmptyTiles(inSparseRas,
+                                 TPoint(tfloor(inPos.x), tfloor(inPos.y)), 4);
+        tile.setEmptyTiles(sparseRas);
+      }
     }
   }
 }
@@ -1533,6 +1803,53 @@ std::string TLevelColumnFx::getAlias(double frame,
 
 //-------------------------------------------------------------------
 
+TFxHash TLevelColumnFx::buildAliasHash(double frame,
+                                       const TRenderSettings &info) const {
+  TFxHasher hasher;
+
+  if (m_levelColumn && !m_levelColumn->getCell((int)frame).isEmpty()) {
+    const TXshCell &cell = m_levelColumn->getCell((int)frame);
+
+    if (TXshSimpleLevel *sl = cell.getSimpleLevel()) {
+      // Tell the saved versions of the level apart, and never trust unsaved
+      // edits
+      TPalette *palette = cell.getPalette();
+      if (sl->getDirtyFlag() || (palette && palette->getDirtyFlag()))
+        hasher.setVolatile();
+      else {
+        TFilePath path = sl->getScene()->decodeFilePath(sl->getPath());
+        ::addFileStamp(hasher, path.isLevelName()
+                                   ? path.withFrame(cell.m_frameId)
+                                   : path);
+
+        // Toonz raster levels keep their palette aside
+        if (sl->getType() == TZP_XSHLEVEL)
+          ::addFileStamp(hasher, path.withNoFrame().withType("tpl"));
+      }
+
+      // Level settings applied while computing, and the dpi - which may
+      // differ among scenes using the same file
+      LevelProperties *levelProp = sl->getProperties();
+      hasher.add(levelProp->doPremultiply())
+          .add(levelProp->whiteTransp())
+          .add(levelProp->antialiasSoftness());
+
+      const TAffine &dpiAff = ::getDpiAffine(sl, cell.m_frameId, true);
+      hasher.addReal(dpiAff.a11, 5)
+          .addReal(dpiAff.a12, 5)
+          .addReal(dpiAff.a21, 5)
+          .addReal(dpiAff.a22, 5);
+    } else if (TXshChildLevel *childLevel = cell.m_level->getChildLevel())
+      // Sub-xsheets are hashed structurally, like any fxs tree
+      return ::getAliasHash(childLevel->getXsheet(), frame, info);
+  }
+
+  // Level aliases are short, and can be hashed directly
+  return hasher.add(getAlias(frame, info)).result();
+}
+
+//-------------------------------------------------------------------
+
 int TLevelColumnFx::getColumnIndex() const {
   return m_levelColumn ? m_levelColumn->getIndex() : -1;
 }
@@ -1685,6 +2002,21 @@ std::string TPaletteColumnFx::getAlias(double frame,
 
 //-------------------------------------------------------------------
 
+TFxHash TPaletteColumnFx::buildAliasHash(double frame,
+                                         const TRenderSettings &info) const {
+  TFxHasher hasher;
+
+  TPalette *palette = getPalette(frame);
+  if (palette && palette->getDirtyFlag())
+    hasher.setVolatile();
+  else if (palette)
+    ::addFileStamp(hasher, getPalettePath(frame));
+
+  return hasher.add(getAlias(frame, info)).result();
+}
+
+//-------------------------------------------------------------------
+
 int TPaletteColumnFx::getColumnIndex() const {
   return m_paletteColumn ? m_paletteColumn->getIndex() : -1;
 }
@@ -1798,6 +2130,16 @@ std::string TZeraryColumnFx::getAlias(double frame,
 
 //-------------------------------------------------------------------
 
+TFxHash TZeraryColumnFx::buildAliasHash(double frame,
+                                        const TRenderSettings &info) const {
+  return TFxHasher()
+      .add(std::string("TZeraryColumnFx"))
+      .add(m_fx->getAliasHash(frame, info))
+      .result();
+}
+
+//-------------------------------------------------------------------
+
 void TZeraryColumnFx::loadData(TIStream &is) {
   if (m_fx) m_fx->release();
 
@@ -1882,6 +2224,23 @@ std::string TXsheetFx::getAlias(double frame,
 
 //-------------------------------------------------------------------
 
+TFxHash TXsheetFx::buildAliasHash(double frame,
+                                  const TRenderSettings &info) const {
+  TFxHasher hasher;
+  hasher.add(getFxType());
+
+  // Add each terminal fx's hash
+  TFxSet *terminalFxs = m_fxDag->getTerminalFxs();
+  int i, fxsCount = terminalFxs->getFxCount();
+  for (i = 0; i < fxsCount; ++i)
+    hasher.add(static_cast<TRasterFx *>(terminalFxs->getFx(i))
+                   ->getAliasHash(frame, info));
+
+  return hasher.result();
+}
+
+//-------------------------------------------------------------------
+
 void TXsheetFx::setFxDag(FxDag *fxDag) { m_fxDag = fxDag; }
 
 //****************************************************************************************
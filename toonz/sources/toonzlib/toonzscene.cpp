@@ -49,6 +49,10 @@
 TOfflineGL *currentOfflineGL = 0;
 
 #include <QProgressDialog>
+#include <QMessageBox>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
 
 #ifdef MACOSX
 #include <QSurfaceFormat>
@@ -246,6 +250,97 @@ void fixBiancoProblem(ToonzScene *scene, TXsheet *xsh) {
   }
 }
 
+//-----------------------------------------------------------------------------
+
+//! Returns whether the level's readers can run alongside other levels'.
+bool canLoadConcurrently(const ToonzScene *scene, TXshSimpleLevel *sl) {
+  // Subsequence loads share the global loading range
+  TFrameId fromFid, toFid;
+  getLoadingLevelRange(fromFid, toFid);
+  if (fromFid <= toFid) return false;
+
+  // Old psd levels rename themselves while loading. Movies go through
+  // platform services which are not reentrant.
+  std::string type = scene->decodeFilePath(sl->getPath()).getType();
+  return type != "psd" && type != "mov" && type != "3gp" && type != "avi";
+}
+
+//-----------------------------------------------------------------------------
+
+/*!
+  Loads a group of simple levels on worker threads. The loads are I/O bound
+  and independent from each other, so more threads than cores are used.
+*/
+class ConcurrentLevelLoader {
+  class Worker final : public QThread {
+    ConcurrentLevelLoader *m_loader;
+
+  public:
+    Worker(ConcurrentLevelLoader *loader) : m_loader(loader) {}
+    void run() override { m_loader->work(); }
+  };
+
+  std::vector<TXshSimpleLevel *> m_levels;
+  std::vector<QString> m_errors;  //!< Messages to be shown by the caller
+
+  QMutex m_mutex;
+  QWaitCondition m_levelLoaded;
+  int m_next, m_loadedCount;
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+
+public:
+  ConcurrentLevelLoader(const std::vector<TXshSimpleLevel *> &levels)
+      : m_levels(levels), m_next(0), m_loadedCount(0) {
+    int threadsCount = std::min((int)m_levels.size(),
+                                std::max(4, 2 * QThread::idealThreadCount()));
+
+    for (int t = 0; t < threadsCount; ++t) {
+      m_workers.emplace_back(new Worker(this));
+      m_workers.back()->start();
+    }
+  }
+
+  ~ConcurrentLevelLoader() {
+    for (auto &worker : m_workers) worker->wait();
+  }
+
+  //! Waits until either all levels are loaded or \b msecs have passed, and
+  //! returns the number of loaded levels
+  int wait(unsigned long msecs) {
+    QMutexLocker locker(&m_mutex);
+    if (m_loadedCount < (int)m_levels.size())
+      m_levelLoaded.wait(&m_mutex, msecs);
+
+    return m_loadedCount;
+  }
+
+  const std::vector<QString> &errors() const { return m_errors; }
+
+private:
+  void work() {
+    for (;;) {
+      TXshSimpleLevel *sl;
+      {
+        QMutexLocker locker(&m_mutex);
+        if (m_next == (int)m_levels.size()) return;
+        sl = m_levels[m_next++];
+      }
+
+      QString errorMessage;
+      try {
+        sl->load(errorMessage);
+      } catch (...) {
+      }
+
+      QMutexLocker locker(&m_mutex);
+      if (!errorMessage.isEmpty()) m_errors.push_back(errorMessage);
+      ++m_loadedCount;
+      m_levelLoaded.wakeAll();
+    }
+  }
+};
+
 //-----------------------------------------------------------------------------
 }  // namespace
 //-----------------------------------------------------------------------------
@@ -417,11 +512,43 @@ void ToonzScene::loadResources(bool withProgressDialog) {
     progressDialog->show();
   }
 
+  // Simple levels are loaded concurrently. The other levels, and the ones
+  // whose loading is not reentrant, follow on this thread.
+  std::vector<TXshSimpleLevel *> concurrentLevels;
+  std::vector<TXshLevel *> levels;
+  bool hasFullcolorLevels = false;
+
   int i;
   for (i = 0; i < m_levelSet->getLevelCount(); i++) {
-    if (progressDialog) progressDialog->setValue(i + 1);
+    TXshLevel *level    = m_levelSet->getLevel(i);
+    TXshSimpleLevel *sl = level->getSimpleLevel();
+
+    if (sl && canLoadConcurrently(this, sl)) {
+      concurrentLevels.push_back(sl);
+      hasFullcolorLevels |= (sl->getType() & FULLCOLOR_TYPE) != 0;
+    } else
+      levels.push_back(level);
+  }
+
+  int loadedCount = 0;
+
+  if (!concurrentLevels.empty()) {
+    // The fullcolor palette is shared, and created on first request
+    if (hasFullcolorLevels) FullColorPalette::instance()->getPalette(this);
+
+    ConcurrentLevelLoader loader(concurrentLevels);
+    while (loadedCount < (int)concurrentLevels.size()) {
+      loadedCount = loader.wait(100);
+      if (progressDialog) progressDialog->setValue(loadedCount);
+    }
+
+    for (const QString &errorMessage : loader.errors())
+      QMessageBox::warning(0, "Image format not supported", errorMessage);
+  }
+
+  for (TXshLevel *level : levels) {
+    if (progressDialog) progressDialog->setValue(++loadedCount);
 
-    TXshLevel *level = m_levelSet->getLevel(i);
     try {
       level->load();
     } catch (...) {
@@ -1004,6 +1004,10 @@ public:
 
 } loadingLevelRange;
 
+// Serializes the updates of the studio palettes' links from concurrent level
+// loads
+QMutex studioPaletteMutex;
+
 //-----------------------------------------------------------------------------
 }  // namespace
 //-----------------------------------------------------------------------------
@@ -1066,11 +1070,19 @@ static TFilePath getLevelPathAndSetNameWithPsdLevelName(
 // Nota: load() NON fa clearFrames(). si limita ad aggiungere le informazioni
 // relative ai frames su disco
 void TXshSimpleLevel::load() {
+  QString errorMessage;
+  if (!load(errorMessage))
+    QMessageBox::warning(0, "Image format not supported", errorMessage);
+}
+
+//-----------------------------------------------------------------------------
+
+bool TXshSimpleLevel::load(QString &errorMessage) {
   getProperties()->setCreator("");
   QString creator;
 
   assert(getScene());
-  if (!getScene()) return;
+  if (!getScene()) return true;
 
   m_isSubsequence = loadingLevelRange.isEnabled();
 
@@ -1141,12 +1153,12 @@ void TXshSimpleLevel::load() {
       const TImageInfo *info = lr->getImageInfo(level->begin()->first);
 
       if (info && info->m_samplePerPixel >= 5) {
-        QString msg = QString(
-                          "Failed to open %1.\nSamples per pixel is more than "
-                          "4. It may contain more than one alpha channel.")
-                          .arg(QString::fromStdWString(m_path.getWideString()));
-        QMessageBox::warning(0, "Image format not supported", msg);
-        return;
+        errorMessage =
+            QString(
+                "Failed to open %1.\nSamples per pixel is more than "
+                "4. It may contain more than one alpha channel.")
+                .arg(QString::fromStdWString(m_path.getWideString()));
+        return false;
       }
 
       if (info) set16BitChannelLevel(info->m_bitsPerSample == 16);
@@ -1172,7 +1184,8 @@ void TXshSimpleLevel::load() {
   }
   getProperties()->setCreator(creator.toStdString());
 
-  loadingLevelRange.reset();
+  // Not written when disabled, as levels may be loading concurrently
+  if (loadingLevelRange.isEnabled()) loadingLevelRange.reset();
   if (getType() != PLI_XSHLEVEL) {
     if (m_properties->getImageDpi() == TPointD() && !m_frames.empty()) {
       TDimension imageRes(0, 0);
@@ -1197,8 +1210,10 @@ void TXshSimpleLevel::load() {
     setRenumberTable();
   }
 
-  if (getPalette() && StudioPalette::isEnabled())
+  if (getPalette() && StudioPalette::isEnabled()) {
+    QMutexLocker locker(&studioPaletteMutex);
     StudioPalette::instance()->updateLinkedColors(getPalette());
+  }
 
   TFilePath refImgName;
   if (m_palette) {
@@ -1264,6 +1279,8 @@ void TXshSimpleLevel::load() {
     }
   }
   updateReadOnly();
+
+  return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -1987,7 +2004,9 @@ TPointD TXshSimpleLevel::getImageDpi(const TFrameId &fid, int frameStatus) {
 
 int TXshSimpleLevel::getImageSubsampling(const TFrameId &fid) const {
   if (isEmpty() || getType() == PLI_XSHLEVEL) return 1;
-  TImageP img = TImageCache::instance()->get(getImageId(fid), false);
+  // Cached images may have been released in the meantime - the image manager
+  // rebuilds them at the subsampling they were loaded with
+  TImageP img = getFrame(fid, ImageManager::none, 0);
   if (!img) return 1;
   if (TRasterImageP ri = img) return ri->getSubsampling();
   if (TToonzImageP ti = img) return ti->getSubsampling();